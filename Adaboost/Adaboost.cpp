@@ -3,16 +3,60 @@
 #include <iomanip>
 #include <string>
 #include <algorithm>
+#include <cmath>
+#include <omp.h>
 #include "opencv2/highgui/highgui.hpp"
 #include "Adaboost.hpp"
 
 using namespace std;
 using namespace cv;
 
+/*  H = H + alpha*h, wts = exp( sign*H )*scale, returns the sum of wts */
+static double updateScoresAndWeights( Mat &H,				/* in&out : scores, double n x 1 */
+									  const Mat &h,			/* in : output of the new tree */
+									  double alpha,			/* in : weight of the new tree */
+									  double sign,			/* in : 1 for neg samples, -1 for pos samples */
+									  double scale,			/* in : 1/(2*n) */
+									  Mat &wts,				/* out: weights, allocated by the caller */
+									  int nthreads )		/* in : number of threads */
+{
+	double *pH = (double*)H.data;
+	const double *ph = (const double*)h.data;
+	double *pw = (double*)wts.data;
+	const int n = H.rows;
+	double loss = 0;
+	#pragma omp parallel for num_threads( std::max( 1, std::min( nthreads, omp_get_max_threads()))) reduction(+:loss)
+	for( int c=0;c<n;c++)
+	{
+		pH[c] += alpha*ph[c];
+		pw[c] = std::exp( sign*pH[c] )*scale;
+		loss += pw[c];
+	}
+	return loss;
+}
+
+/*  same as applyAndGetError, using the scores of all the trees trained so far */
+static void getErrorFromScores( const Mat &H0,		/* in : scores of the neg samples */
+								const Mat &H1,		/* in : scores of the pos samples */
+								double &fn,			/* out: false negative */
+								double &fp )		/* out: false positive */
+{
+	fp = 0;
+	fn = 0;
+	for(int c=0;c<H0.rows;c++)
+		fp += (H0.at<double>(c,0) > 0?1:0);
+	fp /= H0.rows;
+
+	for(int c=0;c<H1.rows;c++)
+		fn += (H1.at<double>(c,0) > 0?0:1);
+	fn /= H1.rows;
+}
+
 bool Adaboost::Train(	const Mat &neg_data,				/* in : neg data format-> featuredim x number0*/
 						const Mat &pos_data,				/* in : pos data format-> featuredim x number1*/
 						const int &nWeaks,					/* in : how many weak classifiers( decision tree) are used  */
-						const tree_para &treepara)			/* in : parameter for the decision tree */
+						const tree_para &treepara,			/* in : parameter for the decision tree */
+						quantizeCache *pos_cache )			/* in&out : range of the pos data, can be 0 */
 {
 	if( neg_data.rows != pos_data.rows || neg_data.type() != pos_data.type())
 	{
@@ -29,11 +73,31 @@ bool Adaboost::Train(	const Mat &neg_data,				/* in : neg data format-> featured
 	data_pack train_pack;
 	train_pack.neg_data = neg_data;
 	train_pack.pos_data = pos_data;
+	train_pack.pos_cache = pos_cache;
+	return trainBoost( train_pack, neg_data.cols, pos_data.cols, neg_data.rows, nWeaks, treepara );
+}
 
-	/*  infos about the data  */
-	int number_neg_samples = neg_data.cols;
-	int number_pos_samples = pos_data.cols;
-	int feature_dim		   = neg_data.rows;
+bool Adaboost::Train(	const Ptr<quantizedStore> &store,	/* in : quantized data on disk, see quantizedStore */
+						const int &nWeaks,					/* in : how many weak classifiers( decision tree) are used  */
+						const tree_para &treepara)			/* in : parameter for the decision tree */
+{
+	if( store.empty() || store->rows() == 0 )
+	{
+		cout<<"In function Adaboost:Train : store is not opened "<<endl;
+		return false;
+	}
+	data_pack train_pack;
+	train_pack.store = store;
+	return trainBoost( train_pack, store->numberOfNeg(), store->numberOfPos(), store->featureDim(), nWeaks, treepara );
+}
+
+bool Adaboost::trainBoost(	data_pack &train_pack,				/* in : training data, Mats or store */
+							int number_neg_samples,				/* in : number of neg samples */
+							int number_pos_samples,				/* in : number of pos samples */
+							int feature_dim,					/* in : feature dim */
+							const int &nWeaks,					/* in : how many weak classifiers( decision tree) are used  */
+							const tree_para &treepara)			/* in : parameter for the decision tree */
+{
 
 	/* save the featuredim */
 	m_feature_dim = feature_dim;
@@ -67,10 +131,10 @@ bool Adaboost::Train(	const Mat &neg_data,				/* in : neg data format-> featured
 		if(m_debug)
 			cout<<"time single train on binaryTree is "<<time_single_shot/(double)getTickFrequency()<<endl;
 
-		/*  apply the training data on the model */
+		/*  predicted labels of the training data, taken from the leaves the samples reached while training */
 		Mat h0, h1;										/*  predicted labels */
-		bt.Apply( neg_data, h0);
-		bt.Apply( pos_data, h1);
+		bt.applyLeaves( train_pack.leaf0, h0);
+		bt.applyLeaves( train_pack.leaf1, h1);
 
 		double alpha = 1; 
 		double error = bt.getTrainError();
@@ -96,19 +160,19 @@ bool Adaboost::Train(	const Mat &neg_data,				/* in : neg data format-> featured
 			bt.showTreeInfo();
 		}
 
-		/* update cumulative scores H and weights */
-		H0 = H0 + alpha*h0;							/* output of the clf, since F_t(x) = F_t-1(x) + alpha_t*h_t(x) */
-		H1 = H1 + alpha*h1;
-
-		/*  divide by 2--> since we operate neg and pos samples separatly( sum of each weight is 1 potentially) */
-		cv::exp( H0, train_pack.wts0 );       train_pack.wts0 = train_pack.wts0/(2*number_neg_samples);
-		cv::exp( -1.0*H1, train_pack.wts1 );  train_pack.wts1 = train_pack.wts1/(2*number_pos_samples);
-		
-		double loss = (cv::sum( train_pack.wts0))[0] + (cv::sum(train_pack.wts1))[0];
+		/* update cumulative scores H and weights, in one pass over the samples
+		 * output of the clf, since F_t(x) = F_t-1(x) + alpha_t*h_t(x)
+		 * divide by 2--> since we operate neg and pos samples separatly( sum of each weight is 1 potentially) */
+		train_pack.wts0.create( number_neg_samples, 1, CV_64F );
+		train_pack.wts1.create( number_pos_samples, 1, CV_64F );
+		double loss = updateScoresAndWeights( H0, h0, alpha, 1.0, 1.0/(2*number_neg_samples), train_pack.wts0, treepara.nThreads ) +
+					  updateScoresAndWeights( H1, h1, alpha, -1.0, 1.0/(2*number_pos_samples), train_pack.wts1, treepara.nThreads );
 		/*  stop training if loss too small .... no need to continue */
 		if( loss < 1e-40)
 		{
 			cout<<"stopping early, loss = "<<loss<<", less than 1e-40"<<endl;
+			H0 = H0 - alpha*h0;			/* the tree is not kept, nor its scores */
+			H1 = H1 - alpha*h1;
 			break;
 		}
 		
@@ -123,13 +187,16 @@ bool Adaboost::Train(	const Mat &neg_data,				/* in : neg data format-> featured
 		if((c+1)%verbose == 0)
 		{
 			double fn,fp;
-			applyAndGetError(neg_data, pos_data, fn, fp );
+			getErrorFromScores( H0, H1, fn, fp );
 			cout<<"Training FP is "<<setprecision(6)<<setw(12)<<fp<<", FN is "<<
 				setprecision(6)<<setw(12)<<fn<<". size(learner) "<<setw(5)<<m_trees.size();
 			cout<<"\terr="<<setprecision(6)<<setw(10)<<errs.at<double>(c,0)<<"\t loss="<<losses.at<double>(c,0)<<endl;
 		}
 	}
 
+	m_train_scores0 = H0;
+	m_train_scores1 = H1;
+
 	/*  records the number of nodes of each tree */
 	m_nodes = Mat( m_trees.size(), 1, CV_32S);			/*  number of node of the tree */
 	for( unsigned int c=0;c<m_trees.size();c++)
@@ -168,6 +235,13 @@ bool Adaboost::Train(	const Mat &neg_data,				/* in : neg data format-> featured
 }
 
 
+void Adaboost::getTrainScores( Mat &neg_scores,			/* out: number0 x 1, double */
+							   Mat &pos_scores ) const	/* out: number1 x 1, double */
+{
+	neg_scores = m_train_scores0;
+	pos_scores = m_train_scores1;
+}
+
 void Adaboost::SetDebug( bool d )
 {
 	m_debug = d;
@@ -15,12 +15,26 @@ class Adaboost
 		/* 
 		 * ===  FUNCTION  ======================================================================
 		 *         Name:  Train
-		 *  Description:  ~ train ~
+		 *  Description:  ~ train ~, pos_cache keeps the range of pos_data for the next call with
+		 *                the same positives ( see quantizeCache )
 		 *          out:  no error -> true
 		 * =====================================================================================
 		 */
 		bool Train(  const Mat &neg_data,				/* in : neg data  format-> featuredim x number0 */
 					 const Mat &pos_data,				/* in : pos data  format-> featuredim x number0 */
+					 const int &nWeaks,					/* in : how many weak classifiers( decision tree) are used  */
+					 const tree_para &treepara,			/* in : parameter for the decision tree */
+					 quantizeCache *pos_cache = 0 );	/* in&out : range of the pos data, can be 0 */
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  Train
+		 *  Description:  train from the quantized data on disk ( quantizedStore::write ), the data
+		 *                does not have to fit into memory
+		 *          out:  no error -> true
+		 * =====================================================================================
+		 */
+		bool Train(  const Ptr<quantizedStore> &store,	/* in : opened store */
 					 const int &nWeaks,					/* in : how many weak classifiers( decision tree) are used  */
 					 const tree_para &treepara);		/* in : parameter for the decision tree */
 
@@ -122,11 +136,37 @@ class Adaboost
 		 */
 		const Mat& getNodes();
 
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  getTrainScores
+		 *  Description:  scores of the training samples at the end of Train, same as Apply on the
+		 *                training data without going through the trees again
+		 * =====================================================================================
+		 */
+		void getTrainScores( Mat &neg_scores,			/* out: number0 x 1, double */
+							 Mat &pos_scores ) const;	/* out: number1 x 1, double */
+
 	private:
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  trainBoost
+		 *  Description:  boosting loop shared by the Train functions
+		 * =====================================================================================
+		 */
+		bool trainBoost( data_pack &train_pack,			/* in : training data, Mats or store */
+						 int number_neg_samples,		/* in : number of neg samples */
+						 int number_pos_samples,		/* in : number of pos samples */
+						 int feature_dim,				/* in : feature dim */
+						 const int &nWeaks,				/* in : how many weak classifiers( decision tree) are used  */
+						 const tree_para &treepara);	/* in : parameter for the decision tree */
+
 		vector<binaryTree> m_trees;
 		bool m_debug;
 		int  m_feature_dim;
 		Mat  m_nodes;						/* number_of_trees x1 : number of nodes for each tree */
+		Mat  m_train_scores0;				/* scores of the neg training samples, H0 of the last Train */
+		Mat  m_train_scores1;				/* scores of the pos training samples, H1 of the last Train */
 };
 #endif
 
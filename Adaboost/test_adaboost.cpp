@@ -1,4 +1,6 @@
 #include <iostream>
+#include <cstdlib>
+#include <omp.h>
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/ml/ml.hpp"
 #include "opencv2/contrib/contrib.hpp"
@@ -45,13 +47,35 @@ int main( int argc, char** argv)
 	Adaboost ab; ab.SetDebug( false );
 	int number_n_weak = 2048;
 
-	double t = getTickCount();
-
 	tree_para train_paras;
 	train_paras.nBins = 256;
 	train_paras.maxDepth = 2;
     train_paras.fracFtrs = 0.0625;
 
+    /*  scaling test : ada_test number_of_weak max_threads, trains with 1, 2, 4 .. max_threads threads */
+    if( argc > 1)
+        number_n_weak = atoi( argv[1] );
+    if( argc > 2)
+    {
+        int max_threads = atoi( argv[2] );
+        double single_thread_time = 0;
+        for( int n=1;n<=max_threads;n*=2)
+        {
+            Adaboost ab_scaling;
+            train_paras.nThreads = n;
+            omp_set_num_threads( n );
+            double ts = getTickCount();
+            ab_scaling.Train( train_neg, train_pos, number_n_weak, train_paras);
+            ts = ((double)getTickCount() - ts)/(double)getTickFrequency();
+            if( n == 1)
+                single_thread_time = ts;
+            cout<<"threads "<<n<<" : "<<ts<<" s, speed up "<<single_thread_time/ts<<endl;
+        }
+        return 0;
+    }
+
+	double t = getTickCount();
+
 	/*  Train function will change the data  */
 	ab.Train( train_neg, train_pos, number_n_weak, train_paras);
 	t = (double)getTickCount() - t;
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include "opencv2/highgui/highgui.hpp"
+#include "trainingData.hpp"
+
+using namespace std;
+using namespace cv;
+
+/* the scatter add of the former computeCDF, one sample at a time on the featuredim x N Mats */
+static void scatterHist( const Mat &data, int fid, const Mat &weights, int nBins, double *hist )
+{
+	for( int b=0;b<nBins;b++)
+		hist[b] = 0;
+	const uchar *p = data.ptr<uchar>( fid );
+	const double *w = (const double*)weights.data;
+	for( int c=0;c<data.cols;c++)
+		hist[ p[c] ] += w[c];
+}
+
+/* histograms of all the features, featuredim x number of samples like the detector training,
+ * usage : bench_hist [featuredim] [number neg] [number pos] [nBins] */
+int main( int argc, char** argv)
+{
+	int feature_dim = 5120;
+	int n0 = 10000;
+	int n1 = 2000;
+	int nBins = 256;
+	if( argc > 1) feature_dim = atoi( argv[1] );
+	if( argc > 2) n0 = atoi( argv[2] );
+	if( argc > 3) n1 = atoi( argv[3] );
+	if( argc > 4) nBins = atoi( argv[4] );
+
+	/*  skewed data, most of the values fall into a few bins like the real channel features */
+	Mat neg_data( feature_dim, n0, CV_8U ), pos_data( feature_dim, n1, CV_8U );
+	RNG rng( 1234 );
+	for( int r=0;r<feature_dim;r++)
+	{
+		for( int c=0;c<n0;c++)
+			neg_data.at<uchar>(r,c) = std::min( nBins-1, (int)std::abs( rng.gaussian( nBins/16.0 )));
+		for( int c=0;c<n1;c++)
+			pos_data.at<uchar>(r,c) = std::min( nBins-1, (int)std::abs( rng.gaussian( nBins/8.0 )));
+	}
+	Mat wts0( n0, 1, CV_64F ), wts1( n1, 1, CV_64F );
+	rng.fill( wts0, RNG::UNIFORM, 0.5, 1.5 ); wts0 = wts0/( 2*cv::sum(wts0)[0] );
+	rng.fill( wts1, RNG::UNIFORM, 0.5, 1.5 ); wts1 = wts1/( 2*cv::sum(wts1)[0] );
+
+	vector<double> ref( feature_dim*2*nBins );
+	double t = getTickCount();
+	for( int f=0;f<feature_dim;f++)
+	{
+		scatterHist( neg_data, f, wts0, nBins, &ref[f*2*nBins] );
+		scatterHist( pos_data, f, wts1, nBins, &ref[f*2*nBins+nBins] );
+	}
+	double ref_time = ((double)getTickCount() - t)/getTickFrequency();
+	cout<<"scatter add ( computeCDF )     : "<<ref_time<<" s"<<endl;
+
+	trainingData train_set;
+	train_set.create( neg_data, pos_data );
+	vector<int> index( n0 + n1 );
+	for( int c=0;c<n0+n1;c++)
+		index[c] = c;
+
+	for( int d=0;d<2;d++)
+	{
+		train_set.setWeights( wts0, wts1, d == 1 );
+		vector<double> hist( feature_dim*2*nBins );
+		t = getTickCount();
+		for( int f=0;f<feature_dim;f++)
+			train_set.accumulate( f, index, nBins, &hist[f*2*nBins] );
+		double time_used = ((double)getTickCount() - t)/getTickFrequency();
+
+		double max_diff = 0;
+		for( unsigned int c=0;c<hist.size();c++)
+			max_diff = std::max( max_diff, std::abs( hist[c] - ref[c] ));
+		cout<<"trainingData ( "<<( d == 1 ? "double" : "float ")<<" weights ) : "<<time_used<<" s, speed up "<<ref_time/time_used
+			<<", max difference "<<max_diff<<endl;
+	}
+	return 0;
+}
@@ -7,6 +7,7 @@
 #include <algorithm>    // std::min
 #include "opencv2/highgui/highgui.hpp"
 #include "binarytree.hpp"
+#include "quantizer.hpp"
 
 using namespace cv;
 using namespace std;
@@ -59,86 +60,102 @@ void binaryTree::convertHsToDouble()
 	}
 }
 
-bool binaryTree::computeCDF(	const Mat & sampleData,				// in samples	1 x numberOfSamples, same feature for all the samples, one row
-								const Mat & weights,				// in weights	numberOfSamples x 1
-								int nBins,							// in number of bins
-								vector<double> &cdf					// out cdf
-								) const
+bool binaryTree::computeHistograms( const trainingData &train_set,	// in quantized data and weights
+									vector<nodeSplit> &jobs,		// in&out nodes, all with the same number of selected features
+									int nBins,						// in number of bins
+									int nthreads					// in numbers of the threads use in training
+									) const
 {
-	/*  initialize the cdf */
-	for ( unsigned int c=0;c<cdf.size() ;c++ )
-		cdf[c] = 0.0;
-	if( sampleData.type() != CV_8U || weights.type() != CV_64F || (unsigned int)nBins != cdf.size() || sampleData.rows != 1 || sampleData.cols != weights.rows)
+	if( jobs.empty())
+		return true;
+	int number_of_selected_feature = jobs[0].fids.rows;
+	if( nthreads < 0 || nBins < 0 || nBins > 256 )
 	{
-		cout<<"in function computeCDF : Wrong Data Formar in function computeCDF, return "<<endl;
+		cout<<"in function computeHistograms : wrong input ..."<<endl;
 		return false;
 	}
 
-	int number_of_samples = sampleData.cols;
-
-	uchar *p = sampleData.data;										/* just one row ~, same as uchar *p = sampleData.ptr(0) */
-	double *w = (double*)(weights.data);							/* just one col, also continus */
-
-	/* for each sample, computing its bin*/
-	for ( int c=0;c<number_of_samples ;c++ ) 
+	/*  only the jobs without histograms */
+	vector<int> todo;
+	for( unsigned int j=0;j<jobs.size();j++)
 	{
-		cdf[ p[c] ] += w[c];
+		if( jobs[j].fids.type() != CV_32S || jobs[j].fids.rows != number_of_selected_feature )
+		{
+			cout<<"in function computeHistograms : all the nodes should have the same number of features ..."<<endl;
+			return false;
+		}
+		if( jobs[j].hists->empty())
+		{
+			jobs[j].hists->resize( number_of_selected_feature*2*nBins );
+			todo.push_back( j );
+		}
 	}
 
-	/* culmulating ...*/
-	for( unsigned int c=1;c<cdf.size();c++)
+	int Nthreads = std::min( nthreads, omp_get_max_threads());
+	int number_of_pairs = todo.size()*number_of_selected_feature;
+
+	/*  only the samples reaching the node are visited, each ( node, feature ) pair owns its histogram.
+	 *  node sizes differ a lot, dynamic schedule */
+	#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 4)
+	for ( int p=0;p<number_of_pairs ;p++ ) 
 	{
-		cdf[c] += cdf[c-1];	
+		const nodeSplit &job = jobs[ todo[p/number_of_selected_feature] ];
+		int i = p%number_of_selected_feature;
+		train_set.accumulate( job.fids.at<int>(i,0), *job.index, nBins, &(*job.hists)[i*2*nBins] );
 	}
-    return true;
+	return true;
 }
 
 bool binaryTree::binaryTreeTrain(   
-						const Mat &neg_data,			// in column feature                    uint8   featuredim X number neg
-						const Mat &pos_data,			// in same as neg_data			        uint8	featuredim X number pos
-						const Mat &norm_neg_weight,		// in sample weight                    double   number neg X 1 
-						const Mat &norm_pos_weight,		// in same as above					   double	number pos X 1
+						vector<nodeSplit> &jobs,		// in&out nodes to split, with histograms
 						int nBins,						// in number of bins
-						double prior,					// in prior of the error rate
-						const Mat &fids_st,				// in index of the selected feature				featuredim X 1
-						int nthreads,					// in numbers of the threads use in training
-						Mat &errors_st,					// out
-						Mat &thresholds)				// out
+						int nthreads) const				// in numbers of the threads use in training
 {
-	if( neg_data.type()!= CV_8U || pos_data.type() != CV_8U ||
-			norm_neg_weight.type()!= CV_64F || norm_pos_weight.type()!= CV_64F ||
-			fids_st.type() != CV_32S || nthreads < 0 || nBins < 0 || prior < 0)
+	if( jobs.empty())
+		return true;
+	int number_of_selected_feature = jobs[0].fids.rows;
+	for( unsigned int j=0;j<jobs.size();j++)
+	{
+		if( (int)jobs[j].hists->size() != number_of_selected_feature*2*nBins || jobs[j].fids.rows != number_of_selected_feature ||
+				jobs[j].prior < 0 || jobs[j].weight <= 0 )
+		{
+			cout<<"in functin binaryTreeTrain : wrong input ..."<<endl;
+			return false;
+		}
+		jobs[j].errors = Mat::zeros( number_of_selected_feature, 1, CV_64F );
+		jobs[j].thresholds = Mat::zeros( number_of_selected_feature, 1, CV_8U);
+	}
+	if( nthreads < 0 || nBins < 0 )
 	{
 		cout<<"in functin binaryTreeTrain : wrong input ..."<<endl;
 		return false;
 	}
 
-	int number_of_selected_feature = fids_st.rows;
-	errors_st = Mat::zeros( number_of_selected_feature, 1, CV_64F );
-	thresholds = Mat::zeros( number_of_selected_feature, 1, CV_8U);
-
 	int Nthreads = std::min( nthreads, omp_get_max_threads());
+	int number_of_pairs = jobs.size()*number_of_selected_feature;
 
-	/* debug information:  */
-	//cout<<"number of selected feature is "<<fids_st.rows<<"\n: "<<fids_st<<endl;
-
-
-	/*  choose the best feature with the best threshold, so iteration is between number_of_selected_feature*nBins  */
+	/*  choose the best feature with the best threshold, so iteration is between number_of_selected_feature*nBins for each node */
 	#pragma omp parallel for num_threads(Nthreads)
-	for ( int i=0;i<number_of_selected_feature ;i++ ) 
+	for ( int p=0;p<number_of_pairs ;p++ ) 
 	{
-		vector<double> cdf0(nBins, 0);
-		vector<double> cdf1(nBins, 0);
+		nodeSplit &job = jobs[ p/number_of_selected_feature ];
+		int i = p%number_of_selected_feature;
+		const double *hist0 = &(*job.hists)[i*2*nBins];
+		const double *hist1 = hist0 + nBins;
+		double inv_weight = 1.0/job.weight;
+		double prior = job.prior;
+		double cdf0 = 0;	/* culmulating the histograms on the fly */
+		double cdf1 = 0;
 
 		double e0 = 1;		/* e0 and e1 --> e0+e1 = 1, getting a very small e0 and very big e0 are both good*/
 		double e1 = 0;
 		double e;
-		int thr;			/*  threshold, now is between [1, nBins-1] integer*/
-		computeCDF( neg_data.row(fids_st.at<int>(i,0)), norm_neg_weight, nBins, cdf0 );
-		computeCDF( pos_data.row(fids_st.at<int>(i,0)), norm_pos_weight, nBins, cdf1 );
+		int thr = 0;		/*  threshold, now is between [1, nBins-1] integer*/
 		for ( int c=0;c<nBins ; c++) 
 		{
-			 e = prior -cdf1[c] + cdf0[c];
+			 cdf0 += hist0[c];
+			 cdf1 += hist1[c];
+			 e = prior -cdf1*inv_weight + cdf0*inv_weight;
 			 if(e<e0)
 			 {
 				 e0 = e;e1 = 1-e;thr=c;
@@ -149,8 +166,8 @@ bool binaryTree::binaryTreeTrain(
 			 }
 
 		}
-		errors_st.at<double>(i,0) = e0;
-		thresholds.at<uchar>(i,0) = thr;
+		job.errors.at<double>(i,0) = e0;
+		job.thresholds.at<uchar>(i,0) = thr;
 	}
 	return true;
 }
@@ -178,18 +195,11 @@ void binaryTree::SetDebug( bool isDebug )		/* in: wanna debug information */
 	m_debug = isDebug;
 }
 
-bool binaryTree::Train( data_pack & train_data,			/* input&output : training data and weights info */
-						const tree_para &paras)			/* input tree paras */
+bool binaryTree::prepareTrainingData( data_pack &train_data,		/* in&out : training data, quantized and packed into train_data.train_set */
+									  const tree_para &paras,		/* in : tree paras */
+									  Mat &Xmin,					/* out: minimum value of each dimension */
+									  Mat &Xstep ) const			/* out: quantization step */
 {
-	if(m_debug)
-	{
-		cout<<"remember the input data will be revised, make a copy before Train function !"<<endl;
-		cout<<"training parameters are: \n";
-		cout<<"nbins(shoule be less than 256:) :\t\t"<<paras.nBins<<endl;
-		cout<<"maxDepth:\t\t"<<paras.maxDepth<<endl;
-		cout<<"fracFtrs:\t\t"<<paras.fracFtrs<<endl;
-		cout<<"nThreads:\t\t"<<paras.nThreads<<endl;
-	}
 	/*  extract data from paclage .. */
 	Mat neg_data = train_data.neg_data;
 	Mat pos_data = train_data.pos_data;
@@ -224,135 +234,160 @@ bool binaryTree::Train( data_pack & train_data,			/* input&output : training dat
 	
 	/*  data is not quantized at the first time, since quantization is very expensive, keep
 	 *  the information */
-	Mat Xmin;	
 	Mat Xmax;	
-	Mat Xstep;	
-	if( train_data.Xmax.empty() || train_data.Xmin.empty() || train_data.Xstep.empty())
+	bool has_range = !( train_data.Xmax.empty() || train_data.Xmin.empty() || train_data.Xstep.empty());
+	if( has_range )
 	{
 		if(m_debug)
-			cout<<"quantization info is empty, generate new quantization infos "<<endl;
-		Xmin	= Mat::zeros( feature_dim , 1, CV_64F );
-		Xmax	= Mat::zeros( feature_dim , 1, CV_64F );
-		Xstep	= Mat::zeros( feature_dim , 1, CV_64F );
+			cout<<"extracting quantization info from the train_data directly "<<endl;
+		Xmin  = train_data.Xmin;
+	 	Xmax  = train_data.Xmax;
+		Xstep = train_data.Xstep; 
+	}
+	else if(m_debug)
+		cout<<"quantization info is empty, generate new quantization infos "<<endl;
+
+	Mat quan_neg_data, quan_pos_data;
+	if( neg_data.type() == CV_8U)
+	{
+		if( !has_range )
+		{
+			Xmin	= Mat::zeros( feature_dim , 1, CV_64F );
+			Xmax	= Mat::zeros( feature_dim , 1, CV_64F );
+			computeXMinMax( neg_data, pos_data, Xmin, Xmax);
+			Xstep = ( Xmax - Xmin )/( paras.nBins - 1);
+		}
+		quan_neg_data = neg_data;
+		quan_pos_data = pos_data;
+	} 
+	else
+	{
+		/*  range [0 paras.nbins], feature rows are shared by the threads, the range of a row is computed in the
+		 *  same pass as its quantization */
+		if( !has_range )
+		{
+			Xmin.release();
+			Xstep.release();
+		}
+		if( !quantizeData( neg_data, pos_data, paras.nBins, Xmin, Xstep, quan_neg_data, quan_pos_data, paras.nThreads, train_data.pos_cache ))
+			return false;
+		if( !has_range )
+			Xmax = Xmin + Xstep*( paras.nBins - 1 );
 
-		/*  compute min and max value , used for value quantization*/
-		computeXMinMax( neg_data, pos_data, Xmin, Xmax);
-		Xstep = ( Xmax - Xmin )/( paras.nBins - 1);
+		/* ------- save the quantized data to train_data pack------  
+		 * !!!! this will change the original data !!!! */
+		train_data.neg_data = quan_neg_data;
+		train_data.pos_data = quan_pos_data;
+        if(m_debug)
+            cout<<"quantization done "<<endl;
+	}
 
-		/*  keep quantization information, quantization info is read only, no need to copy*/
+	/*  keep quantization information, quantization info is read only, no need to copy*/
+	if( !has_range )
+	{
 		train_data.Xmax  = Xmax;
 		train_data.Xmin  = Xmin;
 		train_data.Xstep = Xstep;
 	}
-	else
-	{	
-		if(m_debug)
-			cout<<"extracting quantization info from the train_data directly "<<endl;
-		Xmin  = train_data.Xmin;
-	 	Xmax  = train_data.Xmax;
-		Xstep = train_data.Xstep; 
+	
+	/*  copy the quantized data into the training layout, only once for all the trees of the boosting */
+	if( train_data.train_set.empty() || !train_data.train_set->isBuiltFrom( quan_neg_data, quan_pos_data ))
+	{
+		train_data.train_set = new trainingData();
+		if( !train_data.train_set->create( quan_neg_data, quan_pos_data ))
+			return false;
 	}
+	return true;
+}
+
+bool binaryTree::Train( data_pack & train_data,			/* input&output : training data and weights info */
+						const tree_para &paras)			/* input tree paras */
+{
+	if(m_debug)
+	{
+		cout<<"remember the input data will be revised, make a copy before Train function !"<<endl;
+		cout<<"training parameters are: \n";
+		cout<<"nbins(shoule be less than 256:) :\t\t"<<paras.nBins<<endl;
+		cout<<"maxDepth:\t\t"<<paras.maxDepth<<endl;
+		cout<<"fracFtrs:\t\t"<<paras.fracFtrs<<endl;
+		cout<<"nThreads:\t\t"<<paras.nThreads<<endl;
+	}
+	/*  quantized data and quantization infos, from the store on disk or from the Mats */
+	Mat Xmin;
+	Mat Xstep;
+	if( !train_data.store.empty())
+	{
+		if( !checkTreeParas(paras) || train_data.store->nBins() != paras.nBins )
+		{
+			cout<<"in function binaryTree::Train : wrong paras, or the store is quantized with another nBins "<<endl;
+			return false;
+		}
+		Xmin  = train_data.store->Xmin();
+		Xstep = train_data.store->Xstep();
+		if( train_data.train_set.empty() || !train_data.train_set->isAttachedTo( train_data.store ))
+		{
+			train_data.train_set = new trainingData();
+			if( !train_data.train_set->attach( train_data.store ))
+				return false;
+		}
+	}
+	else if( !prepareTrainingData( train_data, paras, Xmin, Xstep ))
+		return false;
+	trainingData &train_set = *train_data.train_set;
+	int feature_dim = train_set.featureDim();
+	int num_neg_samples = train_set.numberOfNeg();
+	int num_pos_samples = train_set.numberOfPos();
 
 	/* extract weights informatin */
-	Mat *wts0,*wts1;
+	Mat wts0, wts1;
 	if( train_data.wts0.empty())
 	{
 		if(m_debug)
 			cout<<"empty weight, generate new uniform wright "<<endl;
-		wts0 = new Mat(Mat::ones( num_neg_samples, 1, CV_64F)); *wts0 /=(num_neg_samples);
+		wts0 = Mat::ones( num_neg_samples, 1, CV_64F)/num_neg_samples;
 
-		/*  save the weight, clone the Mat since wts0 wts1 will be delete in the loop */
-		train_data.wts0 = (*wts0).clone();
+		/*  save the weight */
+		train_data.wts0 = wts0.clone();
 	}
 	else
 	{
 		if(m_debug)
 			cout<<"extracting weights0  info from the train_data directly "<<endl;
-		wts0 = new Mat(train_data.wts0);
+		wts0 = train_data.wts0;
 	}
 
 	if( train_data.wts1.empty())
 	{
 		if(m_debug)
 			cout<<"empty weight, generate new uniform wright "<<endl;
-		wts1 = new Mat(Mat::ones( num_pos_samples, 1, CV_64F)); *wts1 /=(num_pos_samples);
-		/*  save the weight, clone the Mat since wts0 wts1 will be delete in the loop */
-		train_data.wts1 = (*wts1).clone();
+		wts1 = Mat::ones( num_pos_samples, 1, CV_64F)/num_pos_samples;
+		/*  save the weight */
+		train_data.wts1 = wts1.clone();
 	}
 	else
 	{
 		if(m_debug)
 			cout<<"extracting weights1 info from the train_data directly "<<endl;
-		wts1 = new Mat(train_data.wts1);
+		wts1 = train_data.wts1;
 	}
 
 	/*  normalize the weights if necessary*/
-	double w = cv::sum(*wts0)[0] + cv::sum(*wts1)[0];
+	double w = cv::sum(wts0)[0] + cv::sum(wts1)[0];
 	if( m_debug)
 	{
-		cout<<"w0 is now \t"<<cv::sum(*wts0)[0]<<endl;
-		cout<<"w1 is now \t"<<cv::sum(*wts1)[0]<<endl;
+		cout<<"w0 is now \t"<<cv::sum(wts0)[0]<<endl;
+		cout<<"w1 is now \t"<<cv::sum(wts1)[0]<<endl;
 		cout<<"w is now \t"<<w<<endl;
 	}
 	if( std::abs( w - 1.0) > 1e-3)
 	{
-		*wts0 = *wts0/w;
-		*wts1 = *wts1/w;
+		wts0 = wts0/w;
+		wts1 = wts1/w;
 	}
 	
-	Mat quan_neg_data( neg_data.size(), CV_64F );
-	Mat quan_pos_data( pos_data.size(), CV_64F );
-
-
-	if( neg_data.type() == CV_8U)
-	{
-		quan_neg_data = neg_data;
-		quan_pos_data = pos_data;
-	} 
-	else
-	{
-		// data quantization, range [0 paras.nbins]
-		for ( int i=0;i<neg_data.cols ;i++ ) 
-		{
-            if(neg_data.type() == Xmin.type())
-            {
-                Mat tmp = (neg_data.col(i) - Xmin)/Xstep;
-                tmp.copyTo( quan_neg_data.col(i));
-            }
-            else
-            {
-                Mat tmp = neg_data.col(i);tmp.convertTo( tmp, Xmin.type());
-                tmp=(tmp-Xmin)/Xstep;
-                tmp.copyTo( quan_neg_data.col(i));
-            }
-		}
-		
-		for ( int i=0;i<pos_data.cols ;i++ ) 
-		{
-            if(neg_data.type() == Xmin.type())
-            {
-                Mat tmp = (pos_data.col(i) - Xmin)/Xstep;
-                tmp.copyTo( quan_pos_data.col(i));
-            }
-            else
-            {
-                Mat tmp = pos_data.col(i);tmp.convertTo(tmp,Xmin.type());
-                tmp = (tmp -Xmin)/Xstep;
-                tmp.copyTo( quan_pos_data.col(i));
-            }
-		}
-		/*  convert to uint8  */
-		quan_pos_data.convertTo( quan_pos_data, CV_8U);
-		quan_neg_data.convertTo( quan_neg_data, CV_8U);
+	if( !train_set.setWeights( wts0, wts1, paras.doubleWeights ))
+		return false;
 
-		/* ------- save the quantized data to train_data pack------  
-		 * !!!! this will change the original data !!!! */
-		train_data.neg_data = quan_neg_data;
-		train_data.pos_data = quan_pos_data;
-        if(m_debug)
-            cout<<"quantization done "<<endl;
-	}
-	
 	/*  K--> max number of split */
 	int K = 2*( num_neg_samples + num_pos_samples);
 	m_tree.thrs    = Mat::zeros( 1,K,CV_64F);
@@ -363,11 +398,19 @@ bool binaryTree::Train( data_pack & train_data,			/* input&output : training dat
 	m_tree.depth   = Mat::zeros( 1,K,CV_32S);
 	Mat errs       = Mat( 1,K,CV_64F);
 
-	/* store the weight of all nodes, initialize weight in the root node( index 0 )
-	 * delete corresponding item after the node split 
+	/* store the samples reaching each node, initialize the root node( index 0 ) with all the samples
+	 * release corresponding item after the node split 
 	 * the tree splits in a breath-first manner */
-    vector<Mat*> wtsAll0(K,NULL);wtsAll0[0] = wts0;
-    vector<Mat*> wtsAll1(K,NULL);wtsAll1[0] = wts1;
+	vector< vector<int> > indexAll(K);
+	indexAll[0].resize( train_set.numberOfSamples() );
+	for( int c=0;c<train_set.numberOfSamples();c++)
+		indexAll[0][c] = c;
+
+	/* leaf of each sample, set when the samples reach a node which is not split */
+	vector<int> sample_leaf( train_set.numberOfSamples(), 0 );
+
+	/* histograms of the nodes computed from their parent, only used with paras.histSubtract */
+	vector< vector<double> > histAll(K);
 	
 	int k=0;    /* k is the index now processing ... */
 	K=1;		/* increasing in the training process */
@@ -379,110 +422,157 @@ bool binaryTree::Train( data_pack & train_data,			/* input&output : training dat
 
 	cv::RNG rng(getTickCount());
 
+	/*  histogram subtraction needs the same features in parent and children, sample them once for the tree */
+	if( paras.histSubtract )
+		cv::randShuffle( fidsSt, 1, &rng);
+	Mat fids_selected = fidsSt.rowRange(0,int(fidsSt.rows*paras.fracFtrs));
+
+	/* the nodes of one depth are split together, k..level_end-1 */
 	while( k < K)
 	{
-        if(m_debug)
-            cout<<"spliting the tree in node "<<k<<endl;
-		/* get node wrights and prior */
-		Mat *weight0 = wtsAll0[k]; 
-		Scalar tmp_sum=cv::sum(*weight0); double w0=tmp_sum.val[0]; /* delete weight0 later */
-		Mat *weight1 = wtsAll1[k];
-		tmp_sum = cv::sum(*weight1); double w1 = tmp_sum.val[0];
-		
-		double w = w0+w1; double prior = w1/w; 
-		m_tree.weights.at<double>(0,k) = w; errs.at<double>(0,k)=std::min( prior, 1-prior);
-		m_tree.hs.at<double>(0,k)=std::max( -4.0, std::min(4.0, 0.5*std::log(prior/(1-prior))));
-
-		
-		/*  if nearly pure node ot insufficient data --> don't train split */
-		if( prior < 1e-3 || prior > 1-1e-3 || m_tree.depth.at<int>(0,k) >= paras.maxDepth || w < paras.minWeight)
+		int level_end = K;
+		vector<nodeSplit> jobs;
+		for( ;k<level_end;k++)
 		{
 			if(m_debug)
-				cout<<"------- node number "<<k<<" stop spliting -------"<<endl;
-			k++;continue;	/*  not break, since there maybe other node needs to split */
+				cout<<"spliting the tree in node "<<k<<endl;
+			/* get node wrights and prior */
+			const vector<int> &index = indexAll[k];
+			double w0, w1;
+			train_set.sumWeights( index, w0, w1 );
+			
+			double w = w0+w1; double prior = w1/w; 
+			m_tree.weights.at<double>(0,k) = w; errs.at<double>(0,k)=std::min( prior, 1-prior);
+			m_tree.hs.at<double>(0,k)=std::max( -4.0, std::min(4.0, 0.5*std::log(prior/(1-prior))));
+
+			
+			/*  if nearly pure node ot insufficient data --> don't train split */
+			if( prior < 1e-3 || prior > 1-1e-3 || m_tree.depth.at<int>(0,k) >= paras.maxDepth || w < paras.minWeight)
+			{
+				if(m_debug)
+					cout<<"------- node number "<<k<<" stop spliting -------"<<endl;
+				for( unsigned int c=0;c<index.size();c++)
+					sample_leaf[index[c]] = k;
+				vector<int>().swap( indexAll[k] ); vector<double>().swap( histAll[k] );
+				continue;	/*  not break, since there maybe other node needs to split */
+			}
+
+			nodeSplit job;
+			job.node   = k;
+			job.weight = w;
+			job.prior  = prior;
+			job.index  = &indexAll[k];
+			job.hists  = &histAll[k];
+
+			/*  randomly select feature index  */
+			if( !paras.histSubtract )
+			{
+				cv::randShuffle( fidsSt, 1, &rng);
+				job.fids = fids_selected.clone();
+			}
+			else
+				job.fids = fids_selected;
+			jobs.push_back( job );
 		}
 
-		/*  randomly select feature index  */
-		cv::randShuffle( fidsSt, 1, &rng);
-		
 		/*  ---------------------- train ----------------------- */
-		Mat errors_st, threshold_st;
-		binaryTreeTrain( quan_neg_data, quan_pos_data, *(weight0)/w, *(weight1)/w,  paras.nBins, prior, 
-				 fidsSt.rowRange(0,int(fidsSt.rows*paras.fracFtrs)), paras.nThreads, errors_st, threshold_st);
-		
-		/* find the minimum error, and corresponding feature index */
-		Point minLocation; double minError; double maxError;
-		cv::minMaxLoc( errors_st, &minError, &maxError, &minLocation);
-		int minErrorIndex = (int)minLocation.y;
-
-		int selectedFeature = fidsSt.at<int>(minErrorIndex, 0);
-
-		double threshold_ready_to_apply = threshold_st.at<uchar>(minErrorIndex,0) + 0.5;
-
-		/* split the data and continue if necessary */
-		Mat left0 = quan_neg_data.row(selectedFeature) < threshold_ready_to_apply; left0 /=255; /* normalize to 0,1 otherwize is 0,255 */
-		Mat left1 = quan_pos_data.row(selectedFeature) < threshold_ready_to_apply; left1 /=255;
-		
-
-		/* any(left0) --> there neg samples left in the left leaf, so the condition means they will split, 
-		 *  !any(left0) && !any(left1) --> means all the sample in right node ..*/
-		if( (any(left0) || any(left1)) && ( any(1-left0) || any(1-left1)))
+		computeHistograms( train_set, jobs, paras.nBins, paras.nThreads );
+		binaryTreeTrain( jobs, paras.nBins, paras.nThreads );
+
+		/*  histograms of the smaller children, the larger ones are parent - smaller child */
+		vector<nodeSplit> child_jobs;
+		vector<int> large_children;
+		vector<int> parents;
+
+		for( unsigned int j=0;j<jobs.size();j++)
 		{
-			if(m_debug)
-				cout<<"--------> split <----------"<<endl;
-			double actual_threshold = Xmin.at<double>( selectedFeature, 0) + Xstep.at<double>( selectedFeature, 0) * threshold_ready_to_apply;
-			m_tree.child.at<int>(0,k) = K; m_tree.fids.at<int>(0,k) = selectedFeature;m_tree.thrs.at<double>(0,k) = actual_threshold;
-			if(m_debug)
-				cout<<"---> split node "<<k<<"'s child is "<<m_tree.child.at<int>(0,k)<<", with feature "<<
-				m_tree.fids.at<int>(0,k)<<" and threshold "<<m_tree.thrs.at<double>(0,k)<<" with depth "<<(int)m_tree.depth.at<int>(0,k)<<endl;
-
-			/* -------------------------------- weights rearrange -------------------------------------*/
-			Mat left0_double; left0.convertTo( left0_double, CV_64F);
-			Mat *newWeight0 = new Mat((*weight0).mul(left0_double.t()));
-			Mat *newWeight0plus = new Mat((*weight0).mul( 1-left0_double.t())); /* "1-left0_double" is same as "~left0_double" */
-
-			wtsAll0[K]   = newWeight0;				/* left node */
-			wtsAll0[K+1] = newWeight0plus;			/* right node, index+1*/
-			delete wtsAll0[k]; wtsAll0[k] = NULL;	/* works on node k is done, release the memory */
-			Mat left1_double; left1.convertTo( left1_double, CV_64F);
-			Mat *newWeight1 = new Mat( (*weight1).mul(left1_double.t()) );
-			Mat *newWeight1plus = new Mat( (*weight1).mul(1-left1_double.t()) );
-
-			wtsAll1[K] = newWeight1;
-			wtsAll1[K+1] = newWeight1plus; 
-			delete wtsAll1[k]; wtsAll1[k] = NULL;
-			
-			/* -------------------------------- depth increasing-------------------------------------*/
-			m_tree.depth.at<int>(0,K) = m_tree.depth.at<int>(0,k)+1;
-			m_tree.depth.at<int>(0,K+1) = m_tree.depth.at<int>(0,k)+1;
-			K=K+2;														/* adding two more nodes, left&right */
+			int n = jobs[j].node;
+			const vector<int> &index = indexAll[n];
+
+			/* find the minimum error, and corresponding feature index */
+			Point minLocation; double minError; double maxError;
+			cv::minMaxLoc( jobs[j].errors, &minError, &maxError, &minLocation);
+			int minErrorIndex = (int)minLocation.y;
+
+			int selectedFeature = jobs[j].fids.at<int>(minErrorIndex, 0);
+
+			double threshold_ready_to_apply = jobs[j].thresholds.at<uchar>(minErrorIndex,0) + 0.5;
+
+			/* split the samples of the node */
+			vector<int> left, right;
+			const uchar *p = train_set.featureRow( selectedFeature );
+			for( unsigned int c=0;c<index.size();c++)
+				( p[index[c]] < threshold_ready_to_apply ? left : right ).push_back( index[c] );
+
+			/* split only if both children get samples */
+			if( !left.empty() && !right.empty())
+			{
+				if(m_debug)
+					cout<<"--------> split <----------"<<endl;
+				double actual_threshold = Xmin.at<double>( selectedFeature, 0) + Xstep.at<double>( selectedFeature, 0) * threshold_ready_to_apply;
+				m_tree.child.at<int>(0,n) = K; m_tree.fids.at<int>(0,n) = selectedFeature;m_tree.thrs.at<double>(0,n) = actual_threshold;
+				if(m_debug)
+					cout<<"---> split node "<<n<<"'s child is "<<m_tree.child.at<int>(0,n)<<", with feature "<<
+					m_tree.fids.at<int>(0,n)<<" and threshold "<<m_tree.thrs.at<double>(0,n)<<" with depth "<<(int)m_tree.depth.at<int>(0,n)<<endl;
+
+				/* -------------------------------- histograms of the children ---------------------------*/
+				if( paras.histSubtract && m_tree.depth.at<int>(0,n)+1 < paras.maxDepth )
+				{
+					int small_child = ( left.size() <= right.size() ) ? K : K+1;
+					nodeSplit child_job;
+					child_job.node  = small_child;
+					child_job.fids  = fids_selected;
+					child_job.index = &indexAll[small_child];
+					child_job.hists = &histAll[small_child];
+					child_jobs.push_back( child_job );
+					large_children.push_back( 2*K+1 - small_child );
+					parents.push_back( n );
+				}
+
+				/* -------------------------------- samples rearrange -------------------------------------*/
+				indexAll[K].swap( left );				/* left node */
+				indexAll[K+1].swap( right );			/* right node, index+1*/
+				
+				/* -------------------------------- depth increasing-------------------------------------*/
+				m_tree.depth.at<int>(0,K) = m_tree.depth.at<int>(0,n)+1;
+				m_tree.depth.at<int>(0,K+1) = m_tree.depth.at<int>(0,n)+1;
+				K=K+2;														/* adding two more nodes, left&right */
+			}
+			else
+			{
+				if(m_debug)
+					cout<<"--------> no spliting <-----------"<<endl;
+				for( unsigned int c=0;c<index.size();c++)
+					sample_leaf[index[c]] = n;
+			}
+
+			/* works on node n is done, release the memory */
+			vector<int>().swap( indexAll[n] );
 		}
-		else
+
+		computeHistograms( train_set, child_jobs, paras.nBins, paras.nThreads );
+		for( unsigned int j=0;j<child_jobs.size();j++)
 		{
-			if(m_debug)
-				cout<<"--------> no spliting <-----------"<<endl;
+			const vector<double> &parent_hists = histAll[ parents[j] ];
+			const vector<double> &small_hists = *child_jobs[j].hists;
+			vector<double> &large_hists = histAll[ large_children[j] ];
+			large_hists.resize( parent_hists.size() );
+			for( unsigned int c=0;c<parent_hists.size();c++)
+				large_hists[c] = std::max( 0.0, parent_hists[c] - small_hists[c] );
 		}
-
-		k++;
+		for( unsigned int j=0;j<jobs.size();j++)
+			vector<double>().swap( histAll[ jobs[j].node ] );
 	}
 
-    /* clear the momory*/
-    for( unsigned int c=0;c<wtsAll0.size();c++)
-    {
-        if( wtsAll0[c])
-        {
-            delete wtsAll0[c];wtsAll0[c]=NULL;
-        }
-    }
-    for( unsigned int c=0;c<wtsAll1.size();c++)
-    {
-        if( wtsAll1[c])
-        {
-            delete wtsAll1[c];wtsAll1[c]=NULL;
-        }
-    }
-
 	/* ############################# training result ############################# */
+	/*  leaves of the training samples, neg samples first in train_set */
+	train_data.leaf0 = Mat( num_neg_samples, 1, CV_32S );
+	train_data.leaf1 = Mat( num_pos_samples, 1, CV_32S );
+	for( int c=0;c<num_neg_samples;c++)
+		train_data.leaf0.at<int>(c,0) = sample_leaf[c];
+	for( int c=0;c<num_pos_samples;c++)
+		train_data.leaf1.at<int>(c,0) = sample_leaf[num_neg_samples+c];
+
 	/*  crop the infos , only need top K elements */
 	m_tree.child    = m_tree.child.colRange(0,K);
 	m_tree.depth    = m_tree.depth.colRange(0,K);
@@ -614,6 +704,28 @@ bool binaryTree::Apply( const Mat &inputData, Mat &predictedLabel )	 const	/* in
 	return true;
 }
 
+bool binaryTree::applyLeaves( const Mat &leaves,			/* in : leaf index of each sample, 32S number_of_sample x 1 */
+							  Mat &predictedLabel ) const	/* out: predicted label number_of_sample x 1, column vector */
+{
+	if( leaves.type() != CV_32S || leaves.cols != 1 || m_tree.hs.empty())
+	{
+		cout<<"in function applyLeaves : leaves should be 32S column vector, and the tree should be ready "<<endl;
+		return false;
+	}
+	predictedLabel = Mat::zeros( leaves.rows, 1, CV_64F);
+	for( int c=0;c<leaves.rows;c++)
+	{
+		int leaf = leaves.at<int>(c,0);
+		if( leaf < 0 || leaf >= m_tree.hs.cols )
+		{
+			cout<<"in function applyLeaves : leaf "<<leaf<<" is not in the tree "<<endl;
+			return false;
+		}
+		predictedLabel.at<double>(c,0) = m_tree.hs.at<double>(0,leaf);
+	}
+	return true;
+}
+
 void binaryTree::scaleHs( double factor )
 {
 	m_tree.hs = m_tree.hs*factor;
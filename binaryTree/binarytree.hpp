@@ -6,9 +6,12 @@
 
 #ifndef BINARYTREE_HPP
 #define BINARYTREE_HPP
+#include <vector>
 #include "opencv2/highgui/highgui.hpp"
+#include "trainingData.hpp"
 
 using namespace cv;
+using namespace std;
 
 /*  parameters for one tree */
 struct tree_para
@@ -18,6 +21,9 @@ struct tree_para
 	double	minWeight;	/* minimum sample weight allow split*/
 	double	fracFtrs;	/* fraction of features to sample for each node split */
 	int		nThreads;	/* max number of computational threads to use */
+	bool	histSubtract;	/* [false] sample the features once per tree instead of once per node, then the histograms of
+							   the larger child are computed as parent - smaller child */
+	bool	doubleWeights;	/* [false] accumulate the histograms with double weights instead of float */
 
 	tree_para()
 	{
@@ -26,6 +32,8 @@ struct tree_para
 		minWeight = 0.01;
 		fracFtrs = 0.0625;
 		nThreads = 8;
+		histSubtract = false;
+		doubleWeights = false;
 	}
 };
 
@@ -52,6 +60,33 @@ struct data_pack
 	Mat Xmin;				/* minimun value of each dimension		featuredim x 1*/
 	Mat Xmax;				/* maximun value of each dimension		featuredim x 1*/
 	Mat Xstep;				/* quantization step					featuredim x 1 */
+	Mat leaf0;				/* leaf of each negative sample in the last trained tree		numbers0 x 1, 32S */
+	Mat leaf1;				/* leaf of each positive sample in the last trained tree		numbers1 x 1, 32S */
+	Ptr<quantizedStore> store;		/* quantized data on disk, used instead of neg_data, pos_data and
+									   the quantization infos if not empty */
+	Ptr<trainingData> train_set;	/* quantized data in the training layout, made by binaryTree::Train and
+									   reused as long as neg_data and pos_data are not changed */
+	quantizeCache *pos_cache;		/* range of pos_data kept by the caller from one training to the
+									   next, can be 0 */
+
+	data_pack()
+	{
+		pos_cache = 0;
+	}
+};
+
+
+/*  one node to split, all the nodes of the same depth are split together in binaryTree::Train */
+struct nodeSplit
+{
+	int node;					/* node index in the tree */
+	double weight;				/* sum of the sample weights in the node */
+	double prior;				/* prior of the error rate */
+	Mat fids;					/* selected features, 32S number_of_selected_feature x 1 */
+	const vector<int> *index;	/* samples in the node */
+	vector<double> *hists;		/* histograms of the selected features, computed if empty */
+	Mat errors;					/* out : error of each selected feature */
+	Mat thresholds;				/* out : best threshold ( bin ) of each selected feature */
 };
 
 
@@ -74,6 +109,7 @@ class binaryTree
 		 *			out:  true->no error
 		 *	    warning:  this will change the original data in train_data ( quantization is expensive
          *	              save the quantized data back will save the computation)!!
+		 *	              if train_data.store is set, the quantized data is read from the store
 		 * =====================================================================================
 		 */
 		bool Train( 
@@ -92,6 +128,17 @@ class binaryTree
 		bool Apply( const Mat &inputData,			/* inp  featuredim x number_of_sample, column vector*/
 					  Mat &predictResult) const;	/* out  predicted label number_of_sample x 1, column vector*/		
 
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  applyLeaves
+		 *  Description:  predict the training samples from their leaves ( data_pack::leaf0, leaf1 ),
+		 *                no need to go through the tree again
+		 *		    out:  true->no error
+		 * =====================================================================================
+		 */
+		bool applyLeaves( const Mat &leaves,			/* in : leaf index of each sample, 32S number_of_sample x 1 */
+						  Mat &predictResult) const;	/* out: predicted label number_of_sample x 1, column vector */
+
 		/* 
 		 * ===  FUNCTION  ======================================================================
 		 *         Name:  showTreeInfo
@@ -145,6 +192,19 @@ class binaryTree
 		 */
 		bool checkTreeParas( const tree_para & p ) const;	/* input parameter */
 
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  prepareTrainingData
+		 *  Description:  check and quantize neg_data/pos_data if needed, and pack them into
+		 *                train_data.train_set
+		 *			out:  true->no error
+		 * =====================================================================================
+		 */
+		bool prepareTrainingData( data_pack &train_data,		/* in&out : training data */
+								  const tree_para &paras,		/* in : tree paras */
+								  Mat &Xmin,					/* out: minimum value of each dimension */
+								  Mat &Xstep ) const;			/* out: quantization step */
+
 		/* 
 		 * ===  FUNCTION  ======================================================================
 		 *         Name:  computeXMinMax
@@ -163,34 +223,33 @@ class binaryTree
 		/* 
 		 * ===  FUNCTION  ======================================================================
 		 *         Name:  binaryTreeTrain
-		 *  Description:  train the tree
-		 *			out:  errors_st			error when using the selected feature  number_of_feature_selected x 1
-		 *				  featureSelected	selected feature					   number_of_feature_selected x 1
+		 *  Description:  search the best threshold of each selected feature of each node, given the
+		 *                histograms. ( node, feature ) pairs are shared by the threads
+		 *			out:  jobs[].errors		error when using the selected feature  number_of_feature_selected x 1
+		 *				  jobs[].thresholds	best threshold ( bin ) of the feature   number_of_feature_selected x 1
 		 * =====================================================================================
 		 */
-		bool binaryTreeTrain(   const Mat &neg_data,			// in column feature featuredim x number
-								const Mat &pos_data,			// in same as neg_data
-								const Mat &norm_neg_weight,		// in sample weight, normalized( sum(neg) + sum(pos) = 1)
-								const Mat &norm_pos_weight,		// in 
+		bool binaryTreeTrain(   vector<nodeSplit> &jobs,		// in&out nodes to split, with histograms
 								int nBins,						// in number of bins
-								double prior,					// in prior of the error rate
-								const Mat &fids_st,				// in index of the selected feature
-								int nthreads,					// in numbers of the threads use in training
-								Mat &errors_st,					// out
-								Mat &thresholds);				// out
+								int nthreads) const;			// in numbers of the threads use in training
 
 
 		/* 
 		 * ===  FUNCTION  ======================================================================
-		 *         Name:  computeCDF
-		 *  Description:  compute the cdf, give the data and weights
+		 *         Name:  computeHistograms
+		 *  Description:  weighted histograms of the selected features, for the jobs whose hists are
+		 *                empty. Only the samples in the node are visited, ( node, feature ) pairs
+		 *                are shared by the threads
+		 *          out:  *jobs[].hists, for feature i : [ i*2*nBins, i*2*nBins + nBins ) neg
+		 *                histogram, followed by nBins pos histogram
 		 * =====================================================================================
 		 */
-		bool computeCDF(	const Mat & sampleData,				// in samples	featuredim x numberOfSamples
-							const Mat & weights,				// in weights	numberOfSamples x 1
-							int nBins,							// in number of bins
-							vector<double> &cdf					// out cdf
-						) const;
+		bool computeHistograms( const trainingData &train_set,	// in quantized data and weights
+								vector<nodeSplit> &jobs,		// in&out nodes, all with the same number of selected features
+								int nBins,						// in number of bins
+								int nthreads					// in numbers of the threads use in training
+								) const;
+
 
 		/* 
 		 * ===  FUNCTION  ======================================================================
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <omp.h>
+#include "quantizedStore.hpp"
+#include "quantizer.hpp"
+
+using namespace std;
+using namespace cv;
+
+#define QUANTIZED_STORE_VERSION 1
+#define QUANTIZED_STORE_ALIGN   64
+#define QUANTIZED_STORE_BLOCK   64		/* rows quantized in parallel before being written */
+static const char quantized_store_magic[8] = { 'Q','S','T','O','R','E','\0','\0' };
+
+struct quantizedStoreHeader
+{
+	char magic[8];						/* "QSTORE" */
+	unsigned int bom;					/* 0x01020304 */
+	unsigned int version;				/* QUANTIZED_STORE_VERSION */
+	int feature_dim;					/* number of rows */
+	int n_neg;							/* number of neg samples */
+	int n_pos;							/* number of pos samples */
+	int nbins;							/* number of bins */
+	unsigned long long row_step;		/* bytes between two rows */
+	unsigned long long info_offset;		/* offset of Xmin, Xstep follows */
+	unsigned long long rows_offset;		/* offset of the first row, multiple of QUANTIZED_STORE_ALIGN */
+	char reserved[8];
+};
+typedef char quantized_store_header_check[ sizeof(quantizedStoreHeader) == 64 ? 1 : -1 ];
+
+quantizedStore::quantizedStore()
+{
+	m_rows = 0;
+	m_row_step = 0;
+	m_dim = 0;
+	m_n0 = 0;
+	m_n1 = 0;
+	m_nbins = 0;
+}
+
+bool quantizedStore::write( const string &path,			/* in : file to write */
+							const Mat &neg_data,		/* in : neg data, CV_32F or CV_64F featuredim x number neg */
+							const Mat &pos_data,		/* in : pos data, same type and rows as neg_data */
+							int nBins,					/* in : number of quantization bins, <= 256 */
+							quantizeCache *cache )		/* in&out : pos range of the previous call, can be 0 */
+{
+	if( neg_data.empty() || pos_data.empty() || neg_data.type() != pos_data.type() || neg_data.rows != pos_data.rows ||
+			( neg_data.type() != CV_32F && neg_data.type() != CV_64F ) || nBins < 2 || nBins > 256 )
+	{
+		cout<<"<quantizedStore::write><error> data should be CV_32F or CV_64F, having the same rows, 2 <= nBins <= 256 "<<endl;
+		return false;
+	}
+	int feature_dim = neg_data.rows;
+	int n0 = neg_data.cols;
+	int n1 = pos_data.cols;
+
+	quantizedStoreHeader header;
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.magic, quantized_store_magic, sizeof(header.magic) );
+	header.bom         = 0x01020304;
+	header.version     = QUANTIZED_STORE_VERSION;
+	header.feature_dim = feature_dim;
+	header.n_neg       = n0;
+	header.n_pos       = n1;
+	header.nbins       = nBins;
+	header.row_step    = ( (unsigned long long)( n0 + n1 ) + QUANTIZED_STORE_ALIGN - 1 )/QUANTIZED_STORE_ALIGN*QUANTIZED_STORE_ALIGN;
+	header.info_offset = sizeof(header);
+	header.rows_offset = ( header.info_offset + 2*feature_dim*sizeof(double) + QUANTIZED_STORE_ALIGN - 1 )/QUANTIZED_STORE_ALIGN*QUANTIZED_STORE_ALIGN;
+
+	ofstream out( path.c_str(), ios::out | ios::binary | ios::trunc );
+	if( !out.is_open())
+	{
+		cout<<"<quantizedStore::write><error> can not open file "<<path<<endl;
+		return false;
+	}
+	out.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+	/*  Xmin and Xstep are known once all rows are quantized, they are written at the end */
+	vector<char> padding( header.rows_offset - header.info_offset, 0 );
+	out.write( &padding[0], padding.size() );
+
+	/*  range and quantization in the same pass, QUANTIZED_STORE_BLOCK rows in parallel, then written in order */
+	Mat xmin( feature_dim, 1, CV_64F ), xstep( feature_dim, 1, CV_64F );
+	if( cache )
+		prepareQuantizeCache( *cache, pos_data );
+	vector<uchar> block( header.row_step*QUANTIZED_STORE_BLOCK, 0 );
+	for( int r0=0;r0<feature_dim;r0+=QUANTIZED_STORE_BLOCK)
+	{
+		int n_rows = std::min( QUANTIZED_STORE_BLOCK, feature_dim - r0 );
+		#pragma omp parallel for
+		for( int r=r0;r<r0+n_rows;r++)
+		{
+			uchar *row = &block[ ( r - r0 )*header.row_step ];
+			quantizeRowPair( neg_data, pos_data, r, nBins, xmin.at<double>(r,0), xstep.at<double>(r,0), row, row + n0, cache );
+		}
+		out.write( reinterpret_cast<const char*>( &block[0] ), n_rows*header.row_step );
+	}
+
+	out.seekp( header.info_offset );
+	out.write( reinterpret_cast<const char*>( xmin.ptr<double>(0) ), feature_dim*sizeof(double) );
+	out.write( reinterpret_cast<const char*>( xstep.ptr<double>(0) ), feature_dim*sizeof(double) );
+	if( !out.good())
+	{
+		cout<<"<quantizedStore::write><error> failed to write "<<path<<endl;
+		return false;
+	}
+	return true;
+}
+
+bool quantizedStore::open( const string &path )			/* in : path of the store */
+{
+	m_rows = 0;
+	if( !m_file.open( path ))
+		return false;
+
+	quantizedStoreHeader header;
+	if( m_file.size() < sizeof(header) )
+	{
+		cout<<"<quantizedStore::open><error> file is too small "<<path<<endl;
+		return false;
+	}
+	memcpy( &header, m_file.data(), sizeof(header) );
+	if( memcmp( header.magic, quantized_store_magic, sizeof(header.magic) ) != 0 || header.bom != 0x01020304 ||
+			header.version != QUANTIZED_STORE_VERSION )
+	{
+		cout<<"<quantizedStore::open><error> "<<path<<" is not a quantized store, or has another version/byte order "<<endl;
+		return false;
+	}
+	if( header.feature_dim <= 0 || header.n_neg <= 0 || header.n_pos <= 0 || header.row_step < (unsigned long long)( header.n_neg + header.n_pos ) ||
+			header.rows_offset%QUANTIZED_STORE_ALIGN != 0 || header.info_offset + 2*header.feature_dim*sizeof(double) > header.rows_offset ||
+			header.rows_offset + header.row_step*header.feature_dim > m_file.size() )
+	{
+		cout<<"<quantizedStore::open><error> "<<path<<" is truncated or broken "<<endl;
+		return false;
+	}
+
+	m_dim      = header.feature_dim;
+	m_n0       = header.n_neg;
+	m_n1       = header.n_pos;
+	m_nbins    = header.nbins;
+	m_row_step = header.row_step;
+	m_rows     = m_file.data() + header.rows_offset;
+
+	/*  the infos are small, copy them */
+	m_xmin.create( m_dim, 1, CV_64F );
+	m_xstep.create( m_dim, 1, CV_64F );
+	memcpy( m_xmin.ptr<double>(0), m_file.data() + header.info_offset, m_dim*sizeof(double) );
+	memcpy( m_xstep.ptr<double>(0), m_file.data() + header.info_offset + m_dim*sizeof(double), m_dim*sizeof(double) );
+	return true;
+}
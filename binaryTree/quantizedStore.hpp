@@ -0,0 +1,75 @@
+#ifndef QUANTIZEDSTORE_HPP
+#define QUANTIZEDSTORE_HPP
+#include <string>
+#include "opencv2/core/core.hpp"
+#include "../misc/mappedFile.h"
+#include "quantizer.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*  quantized training data on disk, mapped read only for the training
+ *
+ *  file layout ( little endian ) :
+ *      header  64 bytes, see quantizedStore.cpp
+ *      Xmin    featuredim doubles
+ *      Xstep   featuredim doubles
+ *      rows    featuredim rows of uint8, neg samples then pos samples, each row starts on a 64 bytes
+ *              boundary, same layout as trainingData so the rows are used in place
+ *
+ *  the training only touches the rows of the sampled features, the os pages them in when needed,
+ *  the data does not have to fit into memory */
+class quantizedStore
+{
+	public:
+		quantizedStore();
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  write
+		 *  Description:  quantize the data like binaryTree::Train and write the store, blocks of
+		 *                rows are quantized in parallel, without making a quantized copy in memory.
+		 *                After that the float data can be released, and the store opened
+		 *                with a cache, the pos range is taken from the previous call if the
+		 *                generation of the cache did not change
+		 *          out:  true->no error
+		 * =====================================================================================
+		 */
+		static bool write( const string &path,			/* in : file to write */
+						   const Mat &neg_data,			/* in : neg data, CV_32F or CV_64F featuredim x number neg */
+						   const Mat &pos_data,			/* in : pos data, same type and rows as neg_data */
+						   int nBins,					/* in : number of quantization bins, <= 256 */
+						   quantizeCache *cache = 0 );	/* in&out : pos range of the previous call, can be 0 */
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  open
+		 *  Description:  map a store made by write
+		 * =====================================================================================
+		 */
+		bool open( const string &path );				/* in : path of the store */
+
+		const uchar* rows() const						/* first feature row, 64 bytes aligned */
+		{
+			return m_rows;
+		}
+		size_t rowStep() const { return m_row_step; }	/* bytes between two rows */
+		int featureDim() const { return m_dim; }
+		int numberOfNeg() const { return m_n0; }
+		int numberOfPos() const { return m_n1; }
+		int nBins() const { return m_nbins; }
+		const Mat& Xmin() const { return m_xmin; }		/* featuredim x 1, 64F */
+		const Mat& Xstep() const { return m_xstep; }	/* featuredim x 1, 64F */
+
+	private:
+		mappedFile m_file;				/* the mapping */
+		const uchar *m_rows;			/* rows inside the mapping */
+		size_t m_row_step;				/* bytes between two rows */
+		int m_dim;						/* feature dim */
+		int m_n0;						/* number of neg samples */
+		int m_n1;						/* number of pos samples */
+		int m_nbins;					/* number of bins used for the quantization */
+		Mat m_xmin;						/* minimum of each dimension */
+		Mat m_xstep;					/* quantization step of each dimension */
+};
+#endif
@@ -0,0 +1,235 @@
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <emmintrin.h>
+#include <omp.h>
+#include "quantizer.hpp"
+
+using namespace std;
+using namespace cv;
+
+static void _minMaxFloat( const float *p, int n, double &mi, double &ma )
+{
+	int c = 0;
+	if( n >= 4 )
+	{
+		__m128 vmin = _mm_loadu_ps( p );
+		__m128 vmax = vmin;
+		for( c=4;c+4<=n;c+=4)
+		{
+			__m128 v = _mm_loadu_ps( p + c );
+			vmin = _mm_min_ps( vmin, v );
+			vmax = _mm_max_ps( vmax, v );
+		}
+		float t_min[4], t_max[4];
+		_mm_storeu_ps( t_min, vmin );
+		_mm_storeu_ps( t_max, vmax );
+		for( int i=0;i<4;i++)
+		{
+			mi = std::min( mi, (double)t_min[i] );
+			ma = std::max( ma, (double)t_max[i] );
+		}
+	}
+	for( ;c<n;c++)
+	{
+		mi = std::min( mi, (double)p[c] );
+		ma = std::max( ma, (double)p[c] );
+	}
+}
+
+static void _minMaxDouble( const double *p, int n, double &mi, double &ma )
+{
+	int c = 0;
+	if( n >= 2 )
+	{
+		__m128d vmin = _mm_loadu_pd( p );
+		__m128d vmax = vmin;
+		for( c=2;c+2<=n;c+=2)
+		{
+			__m128d v = _mm_loadu_pd( p + c );
+			vmin = _mm_min_pd( vmin, v );
+			vmax = _mm_max_pd( vmax, v );
+		}
+		double t_min[2], t_max[2];
+		_mm_storeu_pd( t_min, vmin );
+		_mm_storeu_pd( t_max, vmax );
+		mi = std::min( mi, std::min( t_min[0], t_min[1] ));
+		ma = std::max( ma, std::max( t_max[0], t_max[1] ));
+	}
+	for( ;c<n;c++)
+	{
+		mi = std::min( mi, p[c] );
+		ma = std::max( ma, p[c] );
+	}
+}
+
+void rowMinMax( const Mat &data,		/* in : data */
+				int r,					/* in : row */
+				double &mi,				/* in&out : minimum */
+				double &ma )			/* in&out : maximum */
+{
+	if( data.type() == CV_32F )
+		_minMaxFloat( data.ptr<float>(r), data.cols, mi, ma );
+	else
+		_minMaxDouble( data.ptr<double>(r), data.cols, mi, ma );
+}
+
+/*  2 doubles -> 2 int32 in the low half, clamped to [0 255] first so that the conversion can not overflow,
+ *  rounded to nearest even like cvRound */
+static inline __m128i _quantize2( const __m128d &v, const __m128d &xmin, const __m128d &xstep )
+{
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d top  = _mm_set1_pd( 255.0 );
+	__m128d q = _mm_div_pd( _mm_sub_pd( v, xmin ), xstep );
+	q = _mm_min_pd( _mm_max_pd( q, zero ), top );
+	return _mm_cvtpd_epi32( q );
+}
+
+/*  4 int32 from two _quantize2 */
+static inline __m128i _combine( const __m128i &a, const __m128i &b )
+{
+	return _mm_unpacklo_epi64( a, b );
+}
+
+void quantizeRow( const Mat &data,		/* in : data, CV_32F or CV_64F */
+				  int r,				/* in : row */
+				  double xmin,			/* in : minimum of the row */
+				  double xstep,			/* in : quantization step */
+				  uchar *out )			/* out: data.cols values */
+{
+	const int n = data.cols;
+	const __m128d v_xmin = _mm_set1_pd( xmin );
+	const __m128d v_xstep = _mm_set1_pd( xstep );
+	int c = 0;
+	if( data.type() == CV_32F )
+	{
+		const float *p = data.ptr<float>(r);
+		for( ;c+8<=n;c+=8)
+		{
+			__m128 v0 = _mm_loadu_ps( p + c );
+			__m128 v1 = _mm_loadu_ps( p + c + 4 );
+			__m128i i0 = _combine( _quantize2( _mm_cvtps_pd( v0 ), v_xmin, v_xstep ),
+								   _quantize2( _mm_cvtps_pd( _mm_movehl_ps( v0, v0 )), v_xmin, v_xstep ));
+			__m128i i1 = _combine( _quantize2( _mm_cvtps_pd( v1 ), v_xmin, v_xstep ),
+								   _quantize2( _mm_cvtps_pd( _mm_movehl_ps( v1, v1 )), v_xmin, v_xstep ));
+			__m128i s = _mm_packs_epi32( i0, i1 );
+			_mm_storel_epi64( (__m128i*)( out + c ), _mm_packus_epi16( s, s ));
+		}
+		for( ;c<n;c++)
+			out[c] = saturate_cast<uchar>( ( (double)p[c] - xmin )/xstep );
+	}
+	else
+	{
+		const double *p = data.ptr<double>(r);
+		for( ;c+8<=n;c+=8)
+		{
+			__m128i i0 = _combine( _quantize2( _mm_loadu_pd( p + c ), v_xmin, v_xstep ),
+								   _quantize2( _mm_loadu_pd( p + c + 2 ), v_xmin, v_xstep ));
+			__m128i i1 = _combine( _quantize2( _mm_loadu_pd( p + c + 4 ), v_xmin, v_xstep ),
+								   _quantize2( _mm_loadu_pd( p + c + 6 ), v_xmin, v_xstep ));
+			__m128i s = _mm_packs_epi32( i0, i1 );
+			_mm_storel_epi64( (__m128i*)( out + c ), _mm_packus_epi16( s, s ));
+		}
+		for( ;c<n;c++)
+			out[c] = saturate_cast<uchar>( ( p[c] - xmin )/xstep );
+	}
+}
+
+void prepareQuantizeCache( quantizeCache &cache,	/* in&out : cache */
+						   const Mat &pos_data )	/* in : pos data */
+{
+	if( cache.cached_generation == cache.generation && cache.rows == pos_data.rows && cache.cols == pos_data.cols )
+		return;
+	cache.cached_generation = cache.generation;
+	cache.rows = pos_data.rows;
+	cache.cols = pos_data.cols;
+	/*  NaN range -> computed by the first call */
+	cache.pos_min = Mat( pos_data.rows, 1, CV_64F, Scalar::all( std::numeric_limits<double>::quiet_NaN() ));
+	cache.pos_max = Mat( pos_data.rows, 1, CV_64F, Scalar::all( std::numeric_limits<double>::quiet_NaN() ));
+}
+
+void quantizeRowPair( const Mat &neg_data,		/* in : neg data */
+					  const Mat &pos_data,		/* in : pos data */
+					  int r,					/* in : row */
+					  int nBins,				/* in : number of bins */
+					  double &xmin,				/* out: Xmin of the row */
+					  double &xstep,			/* out: Xstep of the row */
+					  uchar *quan_neg,			/* out: neg_data.cols values */
+					  uchar *quan_pos,			/* out: pos_data.cols values */
+					  quantizeCache *cache )	/* in&out : reused pos range, can be 0 */
+{
+	double mi = std::numeric_limits<double>::max();
+	double ma = -std::numeric_limits<double>::max();
+	if( cache && cache->pos_min.at<double>(r,0) == cache->pos_min.at<double>(r,0) )	/* not NaN */
+	{
+		mi = cache->pos_min.at<double>(r,0);
+		ma = cache->pos_max.at<double>(r,0);
+	}
+	else
+	{
+		rowMinMax( pos_data, r, mi, ma );
+		if( cache )
+		{
+			cache->pos_min.at<double>(r,0) = mi;
+			cache->pos_max.at<double>(r,0) = ma;
+		}
+	}
+	rowMinMax( neg_data, r, mi, ma );
+
+	xmin  = mi - 0.01;
+	xstep = ( ( ma + 0.01 ) - ( mi - 0.01 ) )/( nBins - 1 );
+
+	quantizeRow( neg_data, r, xmin, xstep, quan_neg );
+	quantizeRow( pos_data, r, xmin, xstep, quan_pos );
+}
+
+bool quantizeData( const Mat &neg_data,			/* in : neg data, CV_32F or CV_64F featuredim x number neg */
+				   const Mat &pos_data,			/* in : pos data, same type and rows */
+				   int nBins,					/* in : number of bins */
+				   Mat &Xmin,					/* in&out : featuredim x 1, 64F */
+				   Mat &Xstep,					/* in&out : featuredim x 1, 64F */
+				   Mat &quan_neg,				/* out: featuredim x number neg, 8U */
+				   Mat &quan_pos,				/* out: featuredim x number pos, 8U */
+				   int nthreads,				/* in : number of threads */
+				   quantizeCache *cache )		/* in&out : cache of the pos data */
+{
+	if( neg_data.empty() || pos_data.empty() || neg_data.type() != pos_data.type() || neg_data.rows != pos_data.rows ||
+			( neg_data.type() != CV_32F && neg_data.type() != CV_64F ) || nBins < 2 || nBins > 256 )
+	{
+		cout<<"<quantizeData><error> data should be CV_32F or CV_64F, having the same rows, 2 <= nBins <= 256 "<<endl;
+		return false;
+	}
+	const int feature_dim = neg_data.rows;
+	bool has_range = !Xmin.empty() && !Xstep.empty();
+	if( has_range && ( Xmin.rows != feature_dim || Xstep.rows != feature_dim || Xmin.type() != CV_64F || Xstep.type() != CV_64F ))
+	{
+		cout<<"<quantizeData><error> Xmin and Xstep should be featuredim x 1, CV_64F "<<endl;
+		return false;
+	}
+	if( !has_range )
+	{
+		Xmin.create( feature_dim, 1, CV_64F );
+		Xstep.create( feature_dim, 1, CV_64F );
+	}
+	quan_neg.create( feature_dim, neg_data.cols, CV_8U );
+	quan_pos.create( feature_dim, pos_data.cols, CV_8U );
+	if( cache && !has_range )
+		prepareQuantizeCache( *cache, pos_data );
+
+	int Nthreads = std::max( 1, std::min( nthreads, omp_get_max_threads()));
+	#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 16)
+	for( int r=0;r<feature_dim;r++)
+	{
+		if( has_range )
+		{
+			quantizeRow( neg_data, r, Xmin.at<double>(r,0), Xstep.at<double>(r,0), quan_neg.ptr<uchar>(r) );
+			quantizeRow( pos_data, r, Xmin.at<double>(r,0), Xstep.at<double>(r,0), quan_pos.ptr<uchar>(r) );
+		}
+		else
+		{
+			quantizeRowPair( neg_data, pos_data, r, nBins, Xmin.at<double>(r,0), Xstep.at<double>(r,0),
+					quan_neg.ptr<uchar>(r), quan_pos.ptr<uchar>(r), cache );
+		}
+	}
+	return true;
+}
@@ -0,0 +1,103 @@
+#ifndef QUANTIZER_HPP
+#define QUANTIZER_HPP
+#include "opencv2/core/core.hpp"
+
+using namespace cv;
+
+/*  quantization of the training data, feature-major ( featuredim x number ), one row at a time
+ *  the result is the same as ( x - Xmin )/Xstep followed by convertTo( CV_8U ) */
+
+/*  range of the positive data of a previous call, the positives usually stay the same across the
+ *  stages of the cascade training while the negatives change. Only the min/max of each row is kept,
+ *  the quantization depends on the negatives too. The caller changes generation when the pos data
+ *  changes, the cache is reset when generation or the size of the pos data is not the cached one */
+struct quantizeCache
+{
+	int generation;			/* set by the caller, id of the pos data */
+	int cached_generation;	/* generation of pos_min and pos_max, -1 -> nothing cached */
+	int rows;				/* size of the cached pos data */
+	int cols;
+	Mat pos_min;			/* featuredim x 1, 64F minimum of each row of the pos data */
+	Mat pos_max;			/* featuredim x 1, 64F maximum of each row of the pos data */
+
+	quantizeCache()
+	{
+		generation = 0;
+		cached_generation = -1;
+		rows = 0;
+		cols = 0;
+	}
+};
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  rowMinMax
+ *  Description:  update mi, ma with the values of row r, data is CV_32F or CV_64F
+ * =====================================================================================
+ */
+void rowMinMax( const Mat &data,		/* in : data */
+				int r,					/* in : row */
+				double &mi,				/* in&out : minimum */
+				double &ma );			/* in&out : maximum */
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  quantizeRow
+ *  Description:  out[c] = saturate_cast<uchar>( ( data(r,c) - xmin )/xstep ), sse2 for 8 values
+ *                at a time, computed in double like the Mat expression
+ * =====================================================================================
+ */
+void quantizeRow( const Mat &data,		/* in : data, CV_32F or CV_64F */
+				  int r,				/* in : row */
+				  double xmin,			/* in : minimum of the row */
+				  double xstep,			/* in : quantization step */
+				  uchar *out );			/* out: data.cols values */
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  prepareQuantizeCache
+ *  Description:  reset the cache if it was made for another generation or size of the pos
+ *                data, call it before quantizeRowPair
+ * =====================================================================================
+ */
+void prepareQuantizeCache( quantizeCache &cache,	/* in&out : cache */
+						   const Mat &pos_data );	/* in : pos data */
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  quantizeRowPair
+ *  Description:  range and quantization of row r of the neg and pos data in the same pass,
+ *                the row is still in cache when it is quantized. Rows are independent, call
+ *                it from a parallel loop
+ *                Xmin = min - 0.01, Xstep = ( max - min + 0.02 )/( nBins - 1 ) like
+ *                binaryTree::computeXMinMax
+ * =====================================================================================
+ */
+void quantizeRowPair( const Mat &neg_data,		/* in : neg data */
+					  const Mat &pos_data,		/* in : pos data */
+					  int r,					/* in : row */
+					  int nBins,				/* in : number of bins */
+					  double &xmin,				/* out: Xmin of the row */
+					  double &xstep,			/* out: Xstep of the row */
+					  uchar *quan_neg,			/* out: neg_data.cols values */
+					  uchar *quan_pos,			/* out: pos_data.cols values */
+					  quantizeCache *cache );	/* in&out : reused pos range, can be 0 */
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  quantizeData
+ *  Description:  quantize neg and pos data, rows are shared by the threads. If Xmin and Xstep
+ *                are given they are used, otherwise they are computed in the same pass
+ *          out:  true->no error
+ * =====================================================================================
+ */
+bool quantizeData( const Mat &neg_data,			/* in : neg data, CV_32F or CV_64F featuredim x number neg */
+				   const Mat &pos_data,			/* in : pos data, same type and rows */
+				   int nBins,					/* in : number of bins */
+				   Mat &Xmin,					/* in&out : featuredim x 1, 64F */
+				   Mat &Xstep,					/* in&out : featuredim x 1, 64F */
+				   Mat &quan_neg,				/* out: featuredim x number neg, 8U */
+				   Mat &quan_pos,				/* out: featuredim x number pos, 8U */
+				   int nthreads,				/* in : number of threads */
+				   quantizeCache *cache = 0 );	/* in&out : cache of the pos data */
+#endif
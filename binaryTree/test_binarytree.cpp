@@ -56,6 +56,14 @@ int main( int argc, char** argv)
 	t = getTickCount();
 	bt.Train( train_pack, tree_para());
 	cout<<"training time : "<<((double)getTickCount() - t)/double(getTickFrequency())<<endl;
+
+	/*  same with histogram subtraction, features are sampled once for the tree */
+	tree_para sub_paras;
+	sub_paras.histSubtract = true;
+	t = getTickCount();
+	bt.Train( train_pack, sub_paras);
+	cout<<"training time ( histogram subtraction ) : "<<((double)getTickCount() - t)/double(getTickFrequency())<<endl;
+	bt.showTreeInfo();
 	
 	return 0;
 }
@@ -0,0 +1,184 @@
+#include <iostream>
+#include <cstring>
+#include "trainingData.hpp"
+
+using namespace std;
+using namespace cv;
+
+#define TRAINING_DATA_ALIGN 64
+#define NUMBER_OF_SUB_HIST  4
+
+trainingData::trainingData()
+{
+	m_rows = 0;
+	m_row_step = 0;
+	m_double_weights = false;
+	m_n0 = 0;
+	m_n1 = 0;
+	m_dim = 0;
+	m_src_neg = 0;
+	m_src_pos = 0;
+}
+
+bool trainingData::create( const Mat &neg_data,			/* in : quantized neg data, uint8 featuredim x number neg */
+						   const Mat &pos_data )			/* in : quantized pos data, uint8 featuredim x number pos */
+{
+	if( neg_data.type() != CV_8U || pos_data.type() != CV_8U || neg_data.rows != pos_data.rows || neg_data.empty() || pos_data.empty())
+	{
+		cout<<"<trainingData::create><error> data should be uint8 and having the same rows "<<endl;
+		return false;
+	}
+	m_n0 = neg_data.cols;
+	m_n1 = pos_data.cols;
+	m_dim = neg_data.rows;
+	m_row_step = ( (size_t)( m_n0 + m_n1 ) + TRAINING_DATA_ALIGN - 1 )/TRAINING_DATA_ALIGN*TRAINING_DATA_ALIGN;
+
+	m_store.release();
+	m_buffer.assign( m_row_step*m_dim + TRAINING_DATA_ALIGN, 0 );
+	size_t misalign = (size_t)( &m_buffer[0] ) % TRAINING_DATA_ALIGN;
+	uchar *rows = &m_buffer[0] + ( misalign ? TRAINING_DATA_ALIGN - misalign : 0 );
+	m_rows = rows;
+
+	#pragma omp parallel for
+	for( int f=0;f<m_dim;f++)
+	{
+		uchar *row = rows + (size_t)f*m_row_step;
+		memcpy( row, neg_data.ptr<uchar>(f), m_n0 );
+		memcpy( row + m_n0, pos_data.ptr<uchar>(f), m_n1 );
+	}
+
+	m_labels.assign( m_n0 + m_n1, 0 );
+	for( int c=m_n0;c<m_n0+m_n1;c++)
+		m_labels[c] = 1;
+
+	m_src_neg = neg_data.data;
+	m_src_pos = pos_data.data;
+	return true;
+}
+
+bool trainingData::attach( const Ptr<quantizedStore> &store )	/* in : opened store */
+{
+	if( store.empty() || store->rows() == 0 )
+	{
+		cout<<"<trainingData::attach><error> store is not opened "<<endl;
+		return false;
+	}
+	vector<uchar>().swap( m_buffer );
+	m_store = store;
+	m_rows = store->rows();
+	m_row_step = store->rowStep();
+	m_n0 = store->numberOfNeg();
+	m_n1 = store->numberOfPos();
+	m_dim = store->featureDim();
+	m_src_neg = 0;
+	m_src_pos = 0;
+
+	m_labels.assign( m_n0 + m_n1, 0 );
+	for( int c=m_n0;c<m_n0+m_n1;c++)
+		m_labels[c] = 1;
+	return true;
+}
+
+bool trainingData::isAttachedTo( const Ptr<quantizedStore> &store ) const	/* in : store */
+{
+	return !m_store.empty() && m_store == store;
+}
+
+bool trainingData::isBuiltFrom( const Mat &neg_data,		/* in : neg data */
+								const Mat &pos_data ) const	/* in : pos data */
+{
+	return m_rows && m_store.empty() && neg_data.data == m_src_neg && pos_data.data == m_src_pos &&
+		neg_data.cols == m_n0 && pos_data.cols == m_n1 && neg_data.rows == m_dim && pos_data.rows == m_dim;
+}
+
+bool trainingData::setWeights( const Mat &wts0,			/* in : neg weights, double number neg x 1 */
+							   const Mat &wts1,			/* in : pos weights, double number pos x 1 */
+							   bool double_weights )	/* in : keep the weights in double instead of float */
+{
+	if( wts0.type() != CV_64F || wts1.type() != CV_64F || (int)wts0.total() != m_n0 || (int)wts1.total() != m_n1 )
+	{
+		cout<<"<trainingData::setWeights><error> weights should be double, one for each sample "<<endl;
+		return false;
+	}
+	m_double_weights = double_weights;
+	if( m_double_weights )
+	{
+		m_weights_d.resize( m_n0 + m_n1 );
+		vector<float>().swap( m_weights_f );
+	}
+	else
+	{
+		m_weights_f.resize( m_n0 + m_n1 );
+		vector<double>().swap( m_weights_d );
+	}
+	for( int c=0;c<m_n0+m_n1;c++)
+	{
+		double w = c < m_n0 ? wts0.at<double>( c, 0 ) : wts1.at<double>( c - m_n0, 0 );
+		if( m_double_weights )
+			m_weights_d[c] = w;
+		else
+			m_weights_f[c] = (float)w;
+	}
+	return true;
+}
+
+template<typename T> static void _sumWeights( const T *weights, const uchar *labels, const vector<int> &index, double &w0, double &w1 )
+{
+	w0 = 0; w1 = 0;
+	for( unsigned int c=0;c<index.size();c++)
+	{
+		if( labels[index[c]] )
+			w1 += weights[index[c]];
+		else
+			w0 += weights[index[c]];
+	}
+}
+
+void trainingData::sumWeights( const vector<int> &index,	/* in : samples */
+							   double &w0,					/* out: sum of neg weights */
+							   double &w1 ) const			/* out: sum of pos weights */
+{
+	if( m_double_weights )
+		_sumWeights( &m_weights_d[0], &m_labels[0], index, w0, w1 );
+	else
+		_sumWeights( &m_weights_f[0], &m_labels[0], index, w0, w1 );
+}
+
+template<typename T> static void _accumulate( const uchar *row,		/* in : feature row */
+											  const uchar *labels,	/* in : labels */
+											  const T *weights,		/* in : weights */
+											  const int *index,		/* in : samples */
+											  int n,				/* in : number of samples */
+											  int nBins,			/* in : number of bins */
+											  double *hist )		/* out: 2*nBins histogram */
+{
+	/* neg bins then pos bins, label*nBins selects the half */
+	T sub_hist[NUMBER_OF_SUB_HIST][2*256];
+	memset( sub_hist, 0, sizeof(sub_hist) );
+	int c = 0;
+	for( ;c+NUMBER_OF_SUB_HIST<=n;c+=NUMBER_OF_SUB_HIST)
+	{
+		int s0 = index[c], s1 = index[c+1], s2 = index[c+2], s3 = index[c+3];
+		sub_hist[0][ labels[s0]*nBins + row[s0] ] += weights[s0];
+		sub_hist[1][ labels[s1]*nBins + row[s1] ] += weights[s1];
+		sub_hist[2][ labels[s2]*nBins + row[s2] ] += weights[s2];
+		sub_hist[3][ labels[s3]*nBins + row[s3] ] += weights[s3];
+	}
+	for( ;c<n;c++)
+		sub_hist[0][ labels[index[c]]*nBins + row[index[c]] ] += weights[index[c]];
+
+	for( int b=0;b<2*nBins;b++)
+		hist[b] = (double)sub_hist[0][b] + sub_hist[1][b] + sub_hist[2][b] + sub_hist[3][b];
+}
+
+void trainingData::accumulate( int fid,						/* in : feature index */
+							   const vector<int> &index,	/* in : samples */
+							   int nBins,					/* in : number of bins, <= 256 */
+							   double *hist ) const			/* out: 2*nBins histogram, overwritten */
+{
+	const int *p_index = index.empty() ? 0 : &index[0];
+	if( m_double_weights )
+		_accumulate( featureRow( fid ), &m_labels[0], &m_weights_d[0], p_index, index.size(), nBins, hist );
+	else
+		_accumulate( featureRow( fid ), &m_labels[0], &m_weights_f[0], p_index, index.size(), nBins, hist );
+}
@@ -0,0 +1,120 @@
+#ifndef TRAININGDATA_HPP
+#define TRAININGDATA_HPP
+#include <vector>
+#include "opencv2/core/core.hpp"
+#include "quantizedStore.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*  quantized training samples in the layout used by binaryTree::Train
+ *
+ *  neg and pos samples share one sample axis ( neg 0..n0-1, then pos n0..n0+n1-1 ) and carry a
+ *  label byte, so one pass over the samples of a node fills both histograms. Feature f is one
+ *  row of n0+n1 bytes, each row starts on a 64 bytes boundary. Weights are kept in float, or in
+ *  double if asked by setWeights */
+class trainingData
+{
+	public:
+		trainingData();
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  create
+		 *  Description:  copy the quantized data into the aligned layout
+		 *          out:  false if the data is not uint8 or the feature dims do not match
+		 * =====================================================================================
+		 */
+		bool create( const Mat &neg_data,			/* in : quantized neg data, uint8 featuredim x number neg */
+					 const Mat &pos_data );			/* in : quantized pos data, uint8 featuredim x number pos */
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  attach
+		 *  Description:  use the rows of an opened store in place, nothing is copied
+		 * =====================================================================================
+		 */
+		bool attach( const Ptr<quantizedStore> &store );	/* in : opened store */
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  isAttachedTo
+		 *  Description:  true if attach was called with this store
+		 * =====================================================================================
+		 */
+		bool isAttachedTo( const Ptr<quantizedStore> &store ) const;	/* in : store */
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  isBuiltFrom
+		 *  Description:  true if create was called with these Mats ( same memory and size )
+		 * =====================================================================================
+		 */
+		bool isBuiltFrom( const Mat &neg_data,		/* in : neg data */
+						  const Mat &pos_data ) const;	/* in : pos data */
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  setWeights
+		 *  Description:  copy the sample weights, called before each tree
+		 * =====================================================================================
+		 */
+		bool setWeights( const Mat &wts0,			/* in : neg weights, double number neg x 1 */
+						 const Mat &wts1,			/* in : pos weights, double number pos x 1 */
+						 bool double_weights );		/* in : keep the weights in double instead of float */
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  sumWeights
+		 *  Description:  sum of the neg and pos weights of the samples in index
+		 * =====================================================================================
+		 */
+		void sumWeights( const vector<int> &index,	/* in : samples */
+						 double &w0,				/* out: sum of neg weights */
+						 double &w1 ) const;		/* out: sum of pos weights */
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  accumulate
+		 *  Description:  weighted histograms of feature fid over the samples in index, hist[0..nBins)
+		 *                for neg samples, hist[nBins..2*nBins) for pos samples. 4 sub-histograms are
+		 *                filled in turn, so that adjacent samples falling into the same bin do not
+		 *                wait for each other's store
+		 * =====================================================================================
+		 */
+		void accumulate( int fid,					/* in : feature index */
+						 const vector<int> &index,	/* in : samples */
+						 int nBins,					/* in : number of bins, <= 256 */
+						 double *hist ) const;		/* out: 2*nBins histogram, overwritten */
+
+		const uchar* featureRow( int fid ) const	/* quantized values of feature fid, 64 bytes aligned */
+		{
+			return m_rows + (size_t)fid*m_row_step;
+		}
+
+		const uchar* labels() const					/* label of each sample, 0 neg, 1 pos */
+		{
+			return &m_labels[0];
+		}
+
+		int numberOfNeg() const { return m_n0; }
+		int numberOfPos() const { return m_n1; }
+		int numberOfSamples() const { return m_n0 + m_n1; }
+		int featureDim() const { return m_dim; }
+
+	private:
+		vector<uchar> m_buffer;					/* storage of the rows, with room for the alignment */
+		Ptr<quantizedStore> m_store;			/* or the store holding the rows */
+		const uchar *m_rows;					/* first row, 64 bytes aligned */
+		size_t m_row_step;						/* bytes between two rows, multiple of 64 */
+		vector<uchar> m_labels;					/* label of each sample */
+		vector<float> m_weights_f;				/* weights, used if !m_double_weights */
+		vector<double> m_weights_d;				/* weights, used if m_double_weights */
+		bool m_double_weights;					/* which weight vector is used */
+		int m_n0;								/* number of neg samples */
+		int m_n1;								/* number of pos samples */
+		int m_dim;								/* feature dim */
+		const uchar *m_src_neg;					/* data given to create, used by isBuiltFrom */
+		const uchar *m_src_pos;
+};
+#endif
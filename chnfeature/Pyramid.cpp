@@ -1,18 +1,52 @@
 #include <iostream>
 #include <fstream> 
 #include <cmath>
+#include <cstring>
+#include <algorithm>
 #include <vector>
 #include <typeinfo>
+#include <omp.h>
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/contrib/contrib.hpp"
 #include "../misc/misc.hpp"
 #include "sseFun.h"
+#include "scratchArena.h"
 #include "Pyramid.h"
 
 using namespace std;
 using namespace cv;
 
+/* rows x cols floats taken from a scratch arena, valid until the arena is released */
+static Mat scratchMat( scratchArena &arena, int rows, int cols, bool zero=false )
+{
+	const size_t size=(size_t)rows*cols*sizeof(float);
+	return Mat(rows,cols,CV_32F,zero ? arena.allocZero(size) : arena.alloc(size));
+}
+
+/* number of threads computing the layers of a pyramid */
+static int pyramidThreads( const channels_opt &opt )
+{
+	return opt.nThreads > 0 ? opt.nThreads : omp_get_max_threads();
+}
+
+/* one allocation for all the layers, layer c is level_rows[c] x level_cols[c] floats, continuous and
+ * 16 bytes aligned, the headers share the reference count of the arena */
+static void allocateLevels( const vector<int> &level_rows,     //in:  rows of each layer
+							const vector<int> &level_cols,     //in:  cols of each layer
+							Mat &arena,                        //out: memory of all the layers
+							vector<Mat> &level_memory )        //out: memory of each layer, headers on arena
+{
+	const int n_levels=level_rows.size();
+	vector<int> offsets(n_levels+1,0);
+	for (int c=0;c<n_levels;c++)
+		offsets[c+1]=offsets[c]+(level_rows[c]*level_cols[c]+3)/4*4;
+	arena.create(1,std::max(offsets[n_levels],1),CV_32F);
+	level_memory.resize(n_levels);
+	for (int c=0;c<n_levels;c++)
+		level_memory[c]=arena.colRange(offsets[c],offsets[c]+level_rows[c]*level_cols[c]).reshape(1,level_rows[c]);
+}
+
 bool feature_Pyramids::chnsPyramid_sse( const Mat &img,                                    //in:  image
 										vector<vector<Mat> > &approxPyramid,			   //out: feature channels pyramid
 										vector<double> &scales,							   //out: all scales
@@ -41,79 +75,188 @@ bool feature_Pyramids::chnsPyramid_sse( const Mat &img,
 	scalesh.clear();
 	scalesw.clear();
 
-	/*get scales*/
-	vector<Size> ap_size;
-	vector<int> real_scal;
-	getscales(img,ap_size,real_scal,scales,scalesh,scalesw);
-	Mat img_tmp;	
+	/*real scales and lambdas, then the approximated layers as a second parallel wave, all written
+	  into one allocation. Layers go from the largest to the smallest, the dynamic schedule hands
+	  out the largest ones first*/
+	pyramidState state;
+	if(!prepareApproxPyramid(img,state))
+		return false;
+	const int n_levels=state.scales.size();
+	Mat arena;
+	vector<Mat> level_memory;
+	allocateApproxLevels(state,arena,level_memory);
+	approxPyramid.resize(n_levels);
+	#pragma omp parallel for schedule(dynamic) num_threads(pyramidThreads(m_opt))
+	for (int ap_id=0;ap_id<n_levels;ap_id++)
+		computeApproxLevel(state,ap_id,level_memory[ap_id],approxPyramid[ap_id]);
+	scales.swap(state.scales);
+	scalesh.swap(state.scalesh);
+	scalesw.swap(state.scalesw);
 	
-	vector<vector<Mat> > chns_Pyramid;
-	int chns_num;
-	for (int s_r=0;s_r<(int)real_scal.size();s_r++)
-	{
-		vector<Mat> chns;
-		resize(img,img_tmp,ap_size[real_scal[s_r]]*shrink,0.0,0.0,INTER_AREA);
-		computeChannels_sse(img_tmp,chns);
-		chns_num=chns.size();
-		chns_Pyramid.push_back(chns);
-	}
+	return true;
+}
 
-	//compute lambdas
-	vector<double> lambdas;
-	if (nApprox!=0)
-	{
-		get_lambdas(chns_Pyramid,lambdas,real_scal,scales);
+bool feature_Pyramids::prepareApproxPyramid( const Mat &img,              //in:  image
+											 pyramidState &state) const   //out: scales, real scale channels and lambdas
+{
+	planApproxPyramid(img.size(),state);
+	return computeRealLevels(img,state);
+}
+
+void feature_Pyramids::planApproxPyramid( const Size &img_size,           //in:  size of the image
+										  pyramidState &state) const      //out: scales and layer IDs
+{
+	int nApprox=m_opt.nApprox;
+
+	/*get scales, getscales only needs the size of the image*/
+	state.ap_size.clear();
+	state.real_scal.clear();
+	state.scales.clear();
+	state.scalesh.clear();
+	state.scalesw.clear();
+	Mat img_header(img_size,CV_8UC1,(void*)0);
+	getscales(img_header,state.ap_size,state.real_scal,state.scales,state.scalesh,state.scalesw);
 
-	}
 	//compute based-scales
-	vector<int> approx_scal;
-	for (unsigned int s_r=0;s_r<scales.size();s_r++)
+	state.approx_scal.clear();
+	for (unsigned int s_r=0;s_r<state.scales.size();s_r++)
 	{
 		int tmp=s_r/(nApprox+1);
-		if (s_r-real_scal[tmp]>((nApprox+1)/2))
+		if (s_r-state.real_scal[tmp]>((nApprox+1)/2))
 		{
-			approx_scal.push_back(real_scal[tmp+1]);
+			state.approx_scal.push_back(state.real_scal[tmp+1]);
 		}else{
-			approx_scal.push_back(real_scal[tmp]);
+			state.approx_scal.push_back(state.real_scal[tmp]);
 		}	
 	}
-	//compute approxPyramid
+}
+
+bool feature_Pyramids::computeRealLevels( const Mat &img,                 //in:  image, same size as the one given to planApproxPyramid
+										  pyramidState &state) const      //in&out: real scale channels and lambdas
+{
+	int shrink =m_opt.shrink;     //down_samples
+	int nApprox=m_opt.nApprox;
+
+	/*resized images are kept in state, reused if the image size does not change. Each real layer
+	  is a task, largest first*/
+	const int n_real=state.real_scal.size();
+	state.real_images.resize(n_real);
+	state.real_memory.resize(n_real);
+	state.chns_Pyramid.resize(n_real);
+	int n_failed=0;
+	#pragma omp parallel for schedule(dynamic) num_threads(pyramidThreads(m_opt)) reduction(+:n_failed)
+	for (int s_r=0;s_r<n_real;s_r++)
+	{
+		state.chns_Pyramid[s_r].clear();
+		resize(img,state.real_images[s_r],state.ap_size[state.real_scal[s_r]]*shrink,0.0,0.0,INTER_AREA);
+		if(!computeChannels_sse(state.real_images[s_r],state.real_memory[s_r],state.chns_Pyramid[s_r]))
+			n_failed++;
+	}
+	if (n_failed>0)
+		return false;
+
+	//compute lambdas
+	state.lambdas.clear();
+	if (nApprox!=0)
+	{
+		get_lambdas(state.chns_Pyramid,state.lambdas,state.real_scal,state.scales);
+
+	}
+	return true;
+}
+
+void feature_Pyramids::computeApproxLevel( const pyramidState &state,       //in:  output of prepareApproxPyramid
+										   int ap_id,                       //in:  index of the layer
+										   vector<Mat> &approx_chns) const  //out: channels of the layer, padded, continuous in memory
+{
+	Mat approx;
+	computeApproxLevel(state,ap_id,approx,approx_chns);
+}
+
+void feature_Pyramids::computeApproxLevel( const pyramidState &state,       //in:  output of prepareApproxPyramid
+										   int ap_id,                       //in:  index of the layer
+										   Mat &approx,                     //in&out: memory of the layer, reused if the size matches
+										   vector<Mat> &approx_chns) const  //out: channels of the layer, padded, continuous in memory
+{
+	int shrink =m_opt.shrink;
+	int nApprox=m_opt.nApprox;
+	Size pad =m_opt.pad;
+	int chns_num=state.chns_Pyramid[0].size();
 	double ratio;
-	for (int ap_id=0;ap_id<(int)approx_scal.size();ap_id++)
+
+	/*memory is consistent*/
+	int approx_rows=state.ap_size[ap_id].height;
+	int approx_cols=state.ap_size[ap_id].width;
+	/*the size of pad*/
+	int pad_T=pad.height/shrink;
+	int pad_R=pad.width/shrink;
+	/*every element is written by copyMakeBorder below, no need to set it to zero*/
+	approx.create(chns_num*(approx_rows+2*pad_T),approx_cols+2*pad_R,CV_32FC1);
+	approx_chns.resize(chns_num);
+	/*intermediate results of each channel are taken from the thread's scratch arena*/
+	scratchScope scratch;
+	Mat py_tmp=scratchMat(scratch.arena(),approx_rows,approx_cols);
+	Mat py_smooth=scratchMat(scratch.arena(),approx_rows,approx_cols);
+	for(int n_chans=0;n_chans<chns_num;n_chans++)
 	{
-		vector<Mat> approx_chns;
-		approx_chns.clear();
-		/*memory is consistent*/
-		int approx_rows=ap_size[ap_id].height;
-		int approx_cols=ap_size[ap_id].width;
-		/*the size of pad*/
-		int pad_T=pad.height/shrink;
-		int pad_R=pad.width/shrink;
-		Mat approx=Mat::zeros(10*(approx_rows+2*pad_T),approx_cols+2*pad_R,CV_32FC1);//Ϊchns_Pyramind32F
-		for(int n_chans=0;n_chans<chns_num;n_chans++)
+		Mat py=approx.rowRange(n_chans*(approx_rows+2*pad_T),(n_chans+1)*(approx_rows+2*pad_T));
+		int ma=state.approx_scal[ap_id]/(nApprox+1);
+		resize(state.chns_Pyramid[ma][n_chans],py_tmp,py_tmp.size(),0.0,0.0,INTER_LINEAR);
+		if (nApprox!=0)
 		{
-			Mat py_tmp=Mat::zeros(approx_rows,approx_cols,CV_32FC1);
-			Mat py=approx.rowRange(n_chans*(approx_rows+2*pad_T),(n_chans+1)*(approx_rows+2*pad_T));//pad Ժͼ
-			int ma=approx_scal[ap_id]/(nApprox+1);
-			resize(chns_Pyramid[ma][n_chans],py_tmp,py_tmp.size(),0.0,0.0,INTER_LINEAR);
-			if (nApprox!=0)
-			{
-				ratio=(double)pow(scales[ap_id]/scales[approx_scal[ap_id]],-lambdas[n_chans]);
-				py_tmp=py_tmp*ratio;
-			}
-			//smooth channels, optionally pad and concatenate channels
-			convTri(py_tmp,py_tmp,1,1);
-			copyMakeBorder(py_tmp,py,pad_T,pad_T,pad_R,pad_R,IPL_BORDER_CONSTANT);
-			approx_chns.push_back(py);
-		}		
-		approxPyramid.push_back(approx_chns);
-	}	
-	vector<int>().swap(approx_scal);
-	vector<double>().swap(lambdas);
-	vector<vector<Mat> >().swap(chns_Pyramid);
-	vector<int>().swap(real_scal);
-	vector<Size>().swap(ap_size) ;
-	
+			ratio=(double)pow(state.scales[ap_id]/state.scales[state.approx_scal[ap_id]],-state.lambdas[n_chans]);
+			py_tmp*=ratio;
+		}
+		//smooth channels, optionally pad and concatenate channels
+		convTri(py_tmp,py_smooth,1,1);
+		copyMakeBorder(py_smooth,py,pad_T,pad_T,pad_R,pad_R,IPL_BORDER_CONSTANT);
+		approx_chns[n_chans]=py;
+	}		
+}
+
+void feature_Pyramids::allocateApproxLevels( const pyramidState &state,       //in:  planned state, see planApproxPyramid
+											 Mat &arena,                      //out: memory of all the layers
+											 vector<Mat> &level_memory) const //out: memory of each layer, headers on arena
+{
+	/*same size as computeApproxLevel*/
+	const int chns_num=m_opt.nbins+4;
+	const int pad_T=m_opt.pad.height/m_opt.shrink;
+	const int pad_R=m_opt.pad.width/m_opt.shrink;
+	vector<int> level_rows,level_cols;
+	for (unsigned int c=0;c<state.ap_size.size();c++)
+	{
+		level_rows.push_back(chns_num*(state.ap_size[c].height+2*pad_T));
+		level_cols.push_back(state.ap_size[c].width+2*pad_R);
+	}
+	allocateLevels(level_rows,level_cols,arena,level_memory);
+}
+
+bool feature_Pyramids::quantizeLevel( const vector<Mat> &chns,          //in:  channels of a layer, output of computeApproxLevel
+									  const vector<float> &scales,      //in:  scale of each channel
+									  int depth,                        //in:  CV_8U or CV_16U
+									  Mat &memory,                      //in&out: memory of the quantized layer
+									  vector<Mat> &quantized_chns) const//out: quantized channels, headers on memory
+{
+	if (chns.empty()||scales.size()!=chns.size())
+	{
+		cout<<"<feature_Pyramids::quantizeLevel><error> one scale is needed for each channel "<<endl;
+		return false;
+	}
+	if (depth!=CV_8U&&depth!=CV_16U)
+	{
+		cout<<"<feature_Pyramids::quantizeLevel><error> depth must be CV_8U or CV_16U "<<endl;
+		return false;
+	}
+	/*channels stay continuous in memory, one after another, as the float layer*/
+	const int rows=chns[0].rows;
+	const int cols=chns[0].cols;
+	memory.create(chns.size()*rows,cols,depth);
+	quantized_chns.resize(chns.size());
+	for (unsigned int c=0;c<chns.size();c++)
+	{
+		quantized_chns[c]=memory.rowRange(c*rows,(c+1)*rows);
+		chns[c].convertTo(quantized_chns[c],depth,scales[c]);
+	}
 	return true;
 }
 
@@ -277,18 +420,26 @@ bool feature_Pyramids::convt_2_luv( const Mat input_image,
 {
 	if( input_image.channels() != 3 || input_image.empty())
 		return false;
-	/* L U V channel is continunous in memory ~ */
-	Mat luv_big = Mat::zeros( input_image.rows*3, input_image.cols, CV_32F);
-	L_channel = luv_big.rowRange( 0, input_image.rows);
-	U_channel = luv_big.rowRange( input_image.rows, input_image.rows*2);
-	V_channel = luv_big.rowRange( input_image.rows*2, input_image.rows*3);
+	/* L U V channel is continunous in memory ~, reused if they are already */
 	int number_of_element = input_image.cols * input_image.rows;
+	const size_t plane_size = number_of_element*sizeof(float);
+	bool pre_allocated = L_channel.size() == input_image.size() && L_channel.type() == CV_32F && L_channel.isContinuous() &&
+		U_channel.size() == input_image.size() && U_channel.type() == CV_32F && U_channel.data == L_channel.data + plane_size &&
+		V_channel.size() == input_image.size() && V_channel.type() == CV_32F && V_channel.data == L_channel.data + 2*plane_size;
+	if( !pre_allocated )
+	{
+		Mat luv_big = Mat::zeros( input_image.rows*3, input_image.cols, CV_32F);
+		L_channel = luv_big.rowRange( 0, input_image.rows);
+		U_channel = luv_big.rowRange( input_image.rows, input_image.rows*2);
+		V_channel = luv_big.rowRange( input_image.rows*2, input_image.rows*3);
+	}
+	float *luv = (float*)L_channel.data;
 	if( input_image.depth() == CV_8U)
-		rgb2luv_sse( (const uchar*)(input_image.data), (float*)(luv_big.data), number_of_element, 1.0f/255);
+		rgb2luv_sse( (const uchar*)(input_image.data), luv, number_of_element, 1.0f/255);
 	else if( input_image.depth() == CV_32F)
-		rgb2luv_sse( (const float*)(input_image.data), (float*)(luv_big.data), number_of_element, 1.0f);
+		rgb2luv_sse( (const float*)(input_image.data), luv, number_of_element, 1.0f);
 	else if( input_image.depth() == CV_64F)
-		rgb2luv_sse( (const double*)(input_image.data), (float*)(luv_big.data), number_of_element, 1.0);
+		rgb2luv_sse( (const double*)(input_image.data), luv, number_of_element, 1.0);
 	else
 		return false;
 	return true;
@@ -322,8 +473,10 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
         }
     }
 
-    mag = Mat::zeros( input_image.size(), CV_32F);
-    ori = Mat::zeros( input_image.size(), CV_32F);
+    if( mag.size() != input_image.size() || mag.type() != CV_32F || !mag.isContinuous())
+        mag = Mat::zeros( input_image.size(), CV_32F);
+    if( ori.size() != input_image.size() || ori.type() != CV_32F || !ori.isContinuous())
+        ori = Mat::zeros( input_image.size(), CV_32F);
     
     float* in_data = (float*)(input_image.data);
     if( channel!=0)
@@ -336,7 +489,8 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
     gradMag( (const float*)(input_image.data), (float *)(mag.data), (float *)(ori.data), input_image.rows, 
                 input_image.cols, dim, full );
 
-    Mat smooth_mag;
+    scratchScope scratch;
+    Mat smooth_mag = scratchMat( scratch.arena(), mag.rows, mag.cols );
     int norm_pad = 5;
     convTri( mag, smooth_mag, norm_pad, 1);
     float norm_const = 0.005;
@@ -348,6 +502,14 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
 
  bool feature_Pyramids::computeChannels_sse( const Mat &image,                  // in : input image, BGR 
                                                 vector<Mat>& channels) const    //out : 10 channle features, continuous in memory
+{
+    Mat memory;
+    return computeChannels_sse( image, memory, channels );
+}
+
+bool feature_Pyramids::computeChannels_sse( const Mat &image,                   // in : input image, BGR
+                                            Mat &memory,                        // in&out : memory of the channels
+                                            vector<Mat>& channels) const        //out : 10 channle features, headers on memory
 {
     const int limited_size = 8;
     if( image.channels() != 3 || image.empty() || image.cols <limited_size || image.rows < limited_size)
@@ -355,6 +517,8 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
         cout<<" only works with color imagem which size is larger than 8"<<endl;
         return false;
     }
+    if( m_opt.tiled && canTileChannels( image ))
+        return computeChannels_tiled( image, memory, channels );
 
     /*set para*/
 	int nbins=m_opt.nbins;
@@ -364,7 +528,8 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
 
 	int channels_addr_rows=(image.rows)/shrink;
 	int channels_addr_cols=(image.cols)/shrink;
-	Mat channels_addr=Mat::zeros((nbins+4)*channels_addr_rows,channels_addr_cols,CV_32FC1);
+	memory.create((nbins+4)*channels_addr_rows,channels_addr_cols,CV_32FC1);
+	Mat channels_addr=memory;
 
     /*  convert to LUV with normalization to [0,1] */
     /*  first crop it to the proper size, use crop instead of resize to keep the nature radio of image */
@@ -377,8 +542,12 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
     }
     Mat crop_input = image.rowRange( 0, h_cropped_size).colRange(0, w_cropped_size );
     
-    /* 1--> convert it to LUV with normalization */
-    Mat L,U,V;
+    /* 1--> convert it to LUV with normalization, the intermediate results are taken from the thread's scratch arena */
+    scratchScope scratch;
+    Mat luv = scratchMat( scratch.arena(), 3*crop_input.rows, crop_input.cols );
+    Mat L = luv.rowRange( 0, crop_input.rows );
+    Mat U = luv.rowRange( crop_input.rows, 2*crop_input.rows );
+    Mat V = luv.rowRange( 2*crop_input.rows, 3*crop_input.rows );
     if(!convt_2_luv( crop_input, L, U, V))
     {
         cout<<"error in convt_2_luv function "<<endl;
@@ -386,7 +555,7 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
     }
 
     /*  smooth all the three channel */
-    Mat smooth_LUV;                      //LUV togather, 3 times bigger than L
+    Mat smooth_LUV = scratchMat( scratch.arena(), 3*crop_input.rows, crop_input.cols );  //LUV togather, 3 times bigger than L
     convTri( L,smooth_LUV, smoothSize, 3);  //L U V is all been smoothed, giving just L ( since they have the same size and continuous in memory)
     
     /*  resize and add to channels */
@@ -398,7 +567,8 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
     }
     
     /* 2--> compute the magnitude and oritentation */
-    Mat Mag,Ori;
+    Mat Mag = scratchMat( scratch.arena(), crop_input.rows, crop_input.cols );
+    Mat Ori = scratchMat( scratch.arena(), crop_input.rows, crop_input.cols );
     computeGradMag(L, U, V, Mag, Ori, false);
     Mat mag_resized = channels_addr.rowRange( 3*channels_addr_rows, 4*channels_addr_rows);
     cv::resize( Mag, mag_resized, mag_resized.size(), 0.0, 0.0, INTER_AREA);
@@ -407,6 +577,7 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
     /*  3--> compute Gradient hist */ 
     /* size will be nbins*channels_addr_rows x channels_addr_cols */
     Mat gghist = channels_addr.rowRange( 4*channels_addr_rows, (4+nbins)*channels_addr_rows);   
+    gghist.setTo( 0 );
     if(!computeGradHist( Mag, Ori, gghist, binsize, nbins, false))
     {
         cout<<"computeGradHist wrong "<<endl;
@@ -436,6 +607,206 @@ bool feature_Pyramids::computeGradMag(  const Mat &input_image,
     return true;
 }
 
+/*  rows [first, last) of some planes of an image, cap rows are kept for each plane, rows that are
+ *  not needed any more are dropped from the top. Used by computeChannels_tiled */
+struct rowWindow
+{
+    Mat buf;
+    int planes, cap, width;
+    int first, last;
+
+    void create( int n_planes, int n_cap, int n_width, scratchArena &arena )
+    {
+        planes = n_planes; cap = n_cap; width = n_width;
+        first = last = 0;
+        buf = scratchMat( arena, planes*cap, width, true );
+    }
+    float* row( int plane, int r )
+    {
+        return buf.ptr<float>( plane*cap + r - first );
+    }
+    void keepFrom( int r )
+    {
+        if( r <= first )
+            return;
+        int n_keep = last > r ? last - r : 0;
+        for( int p=0;p<planes;p++)
+            memmove( buf.ptr<float>( p*cap ), buf.ptr<float>( p*cap + r - first ), n_keep*width*sizeof(float) );
+        first = r;
+        if( last < first )
+            last = first;
+    }
+};
+
+bool feature_Pyramids::canTileChannels( const Mat &image ) const
+{
+    int shrink = m_opt.shrink;
+    int h_cropped_size = image.rows - image.rows%shrink;
+    int border = std::max( m_opt.smooth, 5 ) + 2;
+    return image.isContinuous() && image.channels() == 3 && image.cols%shrink == 0 && image.cols%4 == 0 &&
+        m_opt.binsize == shrink && h_cropped_size > 2*border &&
+        ( image.depth() == CV_8U || image.depth() == CV_32F || image.depth() == CV_64F );
+}
+
+/*  rgb2luv_sse of the rows [r0, r1) of a continuous image, planes of the output are ( r1 - r0 )*cols apart */
+static void stripToLuv( const Mat &image, int r0, int r1, float *luv )
+{
+    int n = ( r1 - r0 )*image.cols;
+    if( image.depth() == CV_8U)
+        rgb2luv_sse( image.ptr<uchar>(r0), luv, n, 1.0f/255);
+    else if( image.depth() == CV_32F)
+        rgb2luv_sse( image.ptr<float>(r0), luv, n, 1.0f);
+    else
+        rgb2luv_sse( image.ptr<double>(r0), luv, n, 1.0);
+}
+
+bool feature_Pyramids::computeChannels_tiled( const Mat &image,             // in : input image, BGR
+                                              vector<Mat>& channels) const  //out : 10 channle features, continuous in memory
+{
+    Mat memory;
+    return computeChannels_tiled( image, memory, channels );
+}
+
+bool feature_Pyramids::computeChannels_tiled( const Mat &image,             // in : input image, BGR
+                                              Mat &memory,                  // in&out : memory of the channels
+                                              vector<Mat>& channels) const  //out : 10 channle features, headers on memory
+{
+    if( !canTileChannels( image ))
+    {
+        cout<<"<computeChannels_tiled><error> image can not be tiled, use computeChannels_sse "<<endl;
+        return false;
+    }
+
+    /*set para*/
+    int nbins=m_opt.nbins;
+    int binsize=m_opt.binsize;
+    int shrink =m_opt.shrink;
+    int smoothSize=m_opt.smooth;
+
+    int channels_addr_rows=(image.rows)/shrink;
+    int channels_addr_cols=(image.cols)/shrink;
+    memory.create((nbins+4)*channels_addr_rows,channels_addr_cols,CV_32FC1);
+    Mat channels_addr=memory;
+
+    /*  same crop as computeChannels_sse, width is already a multiple of shrink */
+    const int w = image.cols;
+    const int h = image.rows - image.rows%shrink;
+
+    /*  strips of about 32 rows, a multiple of shrink ( resize stays inside the strip ) and of 4 ( rgb2luv_sse
+     *  keeps its alignment ) */
+    const int strip_unit = 4*shrink;
+    const int strip_rows = ( 32 + strip_unit - 1 )/strip_unit*strip_unit;
+    const int mag_radius = 5;                   /* smoothing of the magnitude in computeGradMag */
+    const float norm_const = 0.005;
+    const bool luv_conv_sse = smoothSize > 1;   /* same choice as convTri */
+    const int luv_margin = std::max( smoothSize, mag_radius + 1 );
+
+    /*  LUV rows for the smoothing and the gradient, magnitude and orientation rows for their smoothing */
+    /*  all of them are taken from the thread's scratch arena */
+    scratchScope scratch;
+    rowWindow luv_win, mag_win;
+    luv_win.create( 3, strip_rows + 2*luv_margin + 8, w, scratch.arena() );
+    mag_win.create( 2, strip_rows + 2*mag_radius + 8, w, scratch.arena() );
+    const int luv_plane = luv_win.cap*w;
+
+    Mat luv_strip = scratchMat( scratch.arena(), 3*luv_win.cap, w, true );         /* output of rgb2luv_sse */
+    Mat smooth_luv = scratchMat( scratch.arena(), 3*strip_rows, w, true );
+    Mat smooth_mag = scratchMat( scratch.arena(), strip_rows, w, true );
+    Mat norm_mag = scratchMat( scratch.arena(), strip_rows, w, true );
+    Mat row_buf = scratchMat( scratch.arena(), 4, 3*GRADMAG_ROW_STRIDE( w ), true );    /* M2, Gx, Gy for gradMagRow, T for convTri1Row */
+
+    convTriState luv_state[3], mag_state;
+    if( luv_conv_sse )
+        for( int c=0;c<3;c++)
+            convTriStart( luv_state[c], w, h, smoothSize );
+    convTriStart( mag_state, w, h, mag_radius );
+
+    Mat gghist = channels_addr.rowRange( 4*channels_addr_rows, (4+nbins)*channels_addr_rows);
+    gghist.setTo( 0 );
+    bool no_error = true;
+    for( int y0=0;y0<h && no_error;y0+=strip_rows)
+    {
+        const int y1 = std::min( h, y0 + strip_rows );
+        const int n_rows = y1 - y0;
+
+        /* 1--> LUV rows needed by the smoothing of [y0 y1) and by the gradient of the magnitude rows
+         *      needed by the smoothing of the magnitude */
+        const int mag_need = std::min( h, y1 + mag_radius );
+        int luv_need = std::max( y1 + ( luv_conv_sse ? smoothSize : 1 ), mag_need + 1 );
+        luv_need = std::min( h, ( luv_need + 3 )/4*4 );
+        luv_win.keepFrom( std::max( 0, std::min( y0 - ( luv_conv_sse ? smoothSize + 2 : 1 ), mag_win.last - 1 )));
+        if( luv_need - luv_win.first > luv_win.cap )
+        {
+            cout<<"<computeChannels_tiled><error> strip does not fit into the window "<<endl;
+            no_error = false;
+            break;
+        }
+        if( luv_need > luv_win.last )
+        {
+            const int r0 = luv_win.last;
+            const int n_new = luv_need - r0;
+            stripToLuv( image, r0, luv_need, luv_strip.ptr<float>(0) );
+            for( int c=0;c<3;c++)
+                memcpy( luv_win.row( c, r0 ), luv_strip.ptr<float>(0) + c*n_new*w, n_new*w*sizeof(float) );
+            luv_win.last = luv_need;
+        }
+
+        /* 2--> smooth LUV, resize and add to channels */
+        for( int c=0;c<3;c++)
+        {
+            float *out = smooth_luv.ptr<float>( c*strip_rows );
+            if( luv_conv_sse )
+            {
+                if( convTriRows( luv_state[c], luv_win.row( c, luv_win.first ), luv_win.first, luv_win.last, y1, out ) != n_rows )
+                    no_error = false;
+            }
+            else
+            {
+                for( int i=y0;i<y1;i++)
+                    convTri1Row( luv_win.row( c, i > 0 ? i-1 : i ), luv_win.row( c, i ), luv_win.row( c, i < h-1 ? i+1 : i ),
+                                 row_buf.ptr<float>(3), out + ( i - y0 )*w, w, 2.0f );
+            }
+            Mat c_resized = channels_addr.rowRange( c*channels_addr_rows + y0/shrink, c*channels_addr_rows + y1/shrink );
+            cv::resize( smooth_luv.rowRange( c*strip_rows, c*strip_rows + n_rows ), c_resized, c_resized.size(), 0.0, 0.0, 1);
+        }
+
+        /* 3--> magnitude and orientation rows, the smoothing of [y0 y1) reads the rows down to y0-1-(mag_radius+1) */
+        mag_win.keepFrom( std::max( 0, y0 - mag_radius - 2 ));
+        for( int x=mag_win.last;x<mag_need;x++)
+        {
+            gradMagRow( luv_win.row( 0, x ), luv_plane, mag_win.row( 0, x ), mag_win.row( 1, x ), h, w, 3, x, false,
+                        row_buf.ptr<float>(0), row_buf.ptr<float>(1), row_buf.ptr<float>(2) );
+            mag_win.last = x + 1;
+        }
+
+        /* 4--> normalize the magnitude, resize and add to channels */
+        if( convTriRows( mag_state, mag_win.row( 0, mag_win.first ), mag_win.first, mag_win.last, y1, smooth_mag.ptr<float>(0) ) != n_rows )
+            no_error = false;
+        memcpy( norm_mag.ptr<float>(0), mag_win.row( 0, y0 ), n_rows*w*sizeof(float) );
+        gradMagNorm( norm_mag.ptr<float>(0), smooth_mag.ptr<float>(0), n_rows, w, norm_const );
+        Mat mag_resized = channels_addr.rowRange( 3*channels_addr_rows + y0/shrink, 3*channels_addr_rows + y1/shrink );
+        cv::resize( norm_mag.rowRange( 0, n_rows ), mag_resized, mag_resized.size(), 0.0, 0.0, INTER_AREA);
+
+        /* 5--> gradient hist of the strip */
+        gradHistRows( norm_mag.ptr<float>(0), mag_win.row( 1, y0 ), gghist.ptr<float>(0), h, w, y0, y1, binsize, nbins, false );
+    }
+
+    if( luv_conv_sse )
+        for( int c=0;c<3;c++)
+            convTriEnd( luv_state[c] );
+    convTriEnd( mag_state );
+    if( !no_error )
+    {
+        cout<<"<computeChannels_tiled><error> rows are missing in a strip "<<endl;
+        return false;
+    }
+
+    /* push them into channels, same layout as computeChannels_sse */
+    for( int c=0;c<4+nbins;c++)
+        channels.push_back( channels_addr.rowRange( c*channels_addr_rows, (c+1)*channels_addr_rows ));
+    return true;
+}
+
 bool feature_Pyramids::chnsPyramid_sse(const Mat &img,                      //in : input image
                                      vector<vector<Mat> > &chns_Pyramid,    //out: output features
                                      vector<double> &scales) const          //out: scale of each pyramid
@@ -460,23 +831,51 @@ bool feature_Pyramids::chnsPyramid_sse(const Mat &img,                      //in
 
 	getscales(img,ap_size,real_scal,scales,scalesh,scalesw);
 
-	Mat img_tmp;
-	Mat img_half;
-	//compute real 
-	for (int s_r=0;s_r<(int)scales.size();s_r++)
+	/*smoothed channels of all the scales go into one allocation*/
+	const int n_scales=scales.size();
+	const int chns_num=m_opt.nbins+4;
+	vector<int> level_rows,level_cols;
+	for (int s_r=0;s_r<n_scales;s_r++)
+	{
+		level_rows.push_back(chns_num*ap_size[s_r].height);
+		level_cols.push_back(ap_size[s_r].width);
+	}
+	Mat arena;
+	vector<Mat> level_memory;
+	allocateLevels(level_rows,level_cols,arena,level_memory);
+
+	//compute real, each scale is a task, largest first
+	chns_Pyramid.resize(n_scales);
+	int n_failed=0;
+	#pragma omp parallel for schedule(dynamic) num_threads(pyramidThreads(m_opt)) reduction(+:n_failed)
+	for (int s_r=0;s_r<n_scales;s_r++)
 	{
+		/*resized image and channels before smoothing are taken from the thread's scratch arena*/
+		scratchScope scratch;
+		const Size img_size=ap_size[s_r]*shrink;
+		Mat img_tmp(img_size,img.type(),scratch.arena().alloc(img_size.area()*img.elemSize()));
+		Mat chns_memory=scratchMat(scratch.arena(),chns_num*ap_size[s_r].height,ap_size[s_r].width);
 		vector<Mat> chns;
-		cv::resize(img,img_tmp,ap_size[s_r]*shrink,0.0,0.0,1);
-		if(!computeChannels_sse(img_tmp,chns))
-        {
-            cout<<"error computing computeChannels_sse "<<endl;
-            return false;
-        }
-		for (int c = 0; c < chns.size(); c++)
+		cv::resize(img,img_tmp,img_size,0.0,0.0,1);
+		if(!computeChannels_sse(img_tmp,chns_memory,chns))
 		{
-			convTri(chns[c],chns[c],1,1);
+			n_failed++;
+			continue;
+		}
+		chns_Pyramid[s_r].resize(chns.size());
+		for (int c = 0; c < (int)chns.size(); c++)
+		{
+			/*convTri writes into the arena when the size matches, allocates otherwise*/
+			if (c<chns_num)
+				chns_Pyramid[s_r][c]=level_memory[s_r].rowRange(c*ap_size[s_r].height,(c+1)*ap_size[s_r].height);
+			convTri(chns[c],chns_Pyramid[s_r][c],1,1);
 		}
-		chns_Pyramid.push_back(chns);
+	}
+	if (n_failed>0)
+	{
+		cout<<"error computing computeChannels_sse "<<endl;
+		chns_Pyramid.clear();
+		return false;
 	}
     return true;
 }
@@ -634,6 +1033,69 @@ void feature_Pyramids::getscales( const Mat &img,                         //in:
 								  vector<double> &scalesw                 //out: the width of per layer
 								  )const
 {
+	/*the result only depends on the image size and the options, look it up first*/
+	scalesKey key;
+	key.cols=img.cols;
+	key.rows=img.rows;
+	key.nPerOct=m_opt.nPerOct;
+	key.nOctUp=m_opt.nOctUp;
+	key.shrink=m_opt.shrink;
+	key.nApprox=m_opt.nApprox;
+	key.minW=m_opt.minDS.width;
+	key.minH=m_opt.minDS.height;
+
+	bool found=false;
+	scalesEntry entry;
+	#pragma omp critical(getscales_cache)
+	{
+		map<scalesKey,scalesEntry>::const_iterator it=m_scales_cache.find(key);
+		if (it!=m_scales_cache.end())
+		{
+			entry=it->second;
+			found=true;
+			m_scales_hits++;
+		}else{
+			m_scales_misses++;
+		}
+	}
+
+	if (!found)
+	{
+		computeScales(img,entry.ap_size,entry.real_scal,entry.scales,entry.scalesh,entry.scalesw);
+		#pragma omp critical(getscales_cache)
+		{
+			/*image sizes seen by a detector are few, the cache is simply emptied when it grows too large*/
+			if (m_scales_cache.size()>=64)
+				m_scales_cache.clear();
+			m_scales_cache[key]=entry;
+		}
+	}
+
+	ap_size.insert(ap_size.end(),entry.ap_size.begin(),entry.ap_size.end());
+	real_scal.insert(real_scal.end(),entry.real_scal.begin(),entry.real_scal.end());
+	scales.insert(scales.end(),entry.scales.begin(),entry.scales.end());
+	scalesh.insert(scalesh.end(),entry.scalesh.begin(),entry.scalesh.end());
+	scalesw.insert(scalesw.end(),entry.scalesw.begin(),entry.scalesw.end());
+}
+
+void feature_Pyramids::getScalesCacheStats( long &hits,                   //out: number of getscales calls found in the cache
+											long &misses) const           //out: number of getscales calls computed
+{
+	#pragma omp critical(getscales_cache)
+	{
+		hits=m_scales_hits;
+		misses=m_scales_misses;
+	}
+}
+
+void feature_Pyramids::computeScales( const Mat &img,                     //in:  image
+								  vector<Size> &ap_size,                  //out: the size of per layer
+								  vector<int> &real_scal,                 //out: the ID of layer we really compute
+								  vector<double> &scales,                 //out: all scales
+								  vector<double> &scalesh,                //out: the height of per layer
+								  vector<double> &scalesw                 //out: the width of per layer
+								  )const
+{
 	
 	int nPerOct =m_opt.nPerOct;
 	int nOctUp =m_opt.nOctUp;
@@ -1269,6 +1731,8 @@ const channels_opt& feature_Pyramids::getParas() const
 }
 feature_Pyramids::feature_Pyramids()
 {
+    m_scales_hits = 0;
+    m_scales_misses = 0;
     int norm_pad_size = 5;
 	m_normPad = get_Km(norm_pad_size);
 	m_opt = channels_opt();
@@ -5,6 +5,7 @@
 #include <fstream> 
 #include <cmath>
 #include <vector>
+#include <map>
 #include <typeinfo>
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
@@ -24,6 +25,8 @@ struct channels_opt
 	int nApprox;// number of approx
 	Size minDS ; //minimum image size for channel computation
 	Size pad;
+	bool tiled; //computeChannels_sse in strips of rows, same result, intermediates stay in cache
+	int nThreads; //threads computing the layers of a pyramid, 0 -> omp_get_max_threads()
 	channels_opt ()
 	{
 		nPerOct=8 ;
@@ -35,8 +38,55 @@ struct channels_opt
 		nbins=6;
         binsize= shrink;
 		nApprox=7;
+		tiled=false;
+		nThreads=0;
 	}
 };
+/* intermediate result of the approximated pyramid, real scales are computed, approximated layers
+ * can be computed one by one ( and in parallel ) with computeApproxLevel */
+struct pyramidState
+{
+	vector<Size> ap_size;					//size of each layer
+	vector<int> real_scal;					//ID of the layers really computed
+	vector<int> approx_scal;				//ID of the real layer each layer is approximated from
+	vector<double> scales;					//all scales
+	vector<double> scalesh;					//the height scales
+	vector<double> scalesw;					//the width scales
+	vector<double> lambdas;					//lambdas of each channel, empty if nApprox == 0
+	vector<vector<Mat> > chns_Pyramid;		//channels of the real layers, no padding
+	vector<Mat> real_images;				//resized images of the real layers, reused by computeRealLevels
+	vector<Mat> real_memory;				//memory of chns_Pyramid, reused by computeRealLevels
+};
+
+/* key of the getscales cache, the scales depend only on the image size and these options */
+struct scalesKey
+{
+	int cols, rows;
+	int nPerOct, nOctUp, shrink, nApprox;
+	int minW, minH;
+	bool operator<( const scalesKey &b ) const
+	{
+		const int a_v[8] = { cols, rows, nPerOct, nOctUp, shrink, nApprox, minW, minH };
+		const int b_v[8] = { b.cols, b.rows, b.nPerOct, b.nOctUp, b.shrink, b.nApprox, b.minW, b.minH };
+		for( int c=0;c<8;c++)
+		{
+			if( a_v[c] != b_v[c] )
+				return a_v[c] < b_v[c];
+		}
+		return false;
+	}
+};
+
+/* value of the getscales cache, same as the output of getscales */
+struct scalesEntry
+{
+	vector<Size> ap_size;
+	vector<int> real_scal;
+	vector<double> scales;
+	vector<double> scalesh;
+	vector<double> scalesw;
+};
+
 class feature_Pyramids
 {
 public:
@@ -84,6 +134,14 @@ public:
 				  vector<double> &scalesw								  //out: the width of per layer
 				  ) const;
 	/* ===  FUNCTION  ======================================================================
+	*         Name:  getScalesCacheStats
+	*  Description:  hits and misses of the getscales cache, getscales results are cached by the
+	*                image size and the options, thread safe
+	* =====================================================================================
+	*/
+	void getScalesCacheStats( long &hits,                                //out: number of calls found in the cache
+							  long &misses) const;                       //out: number of calls computed
+	/* ===  FUNCTION  ======================================================================
 	*         Name:  get_lambdas
 	*  Description:  get lambdas---use the parameter to estimate approximated pyramid layer
 	* =====================================================================================
@@ -146,6 +204,36 @@ public:
      */
     bool computeChannels_sse( const Mat &image,             // in : input image, BGR 
                               vector<Mat>& channels) const; //out : 10 channle features, continuous in memory
+
+    /* same as above, the channels are written into memory, which is reused if the size matches. The
+     * intermediate results are taken from threadScratch() */
+    bool computeChannels_sse( const Mat &image,             // in : input image, BGR
+                              Mat &memory,                  // in&out : memory of the channels
+                              vector<Mat>& channels) const; //out : 10 channle features, headers on memory
+
+    /* 
+     * ===  FUNCTION  ======================================================================
+     *         Name:  computeChannels_tiled
+     *  Description:  computeChannels_sse in one pass over strips of rows: LUV, smoothing,
+     *                gradient, normalization and histogram of a strip are done before the
+     *                next strip, the intermediates stay in cache. The running sums of the
+     *                smoothing are carried from strip to strip, the result is the same as
+     *                computeChannels_sse bit by bit
+     *                used by computeChannels_sse when channels_opt::tiled is set, returns
+     *                false if the image can not be tiled ( see canTileChannels )
+     * =====================================================================================
+     */
+    bool computeChannels_tiled( const Mat &image,             // in : input image, BGR
+                                vector<Mat>& channels) const; //out : 10 channle features, continuous in memory
+
+    /* same as above, the channels are written into memory, which is reused if the size matches */
+    bool computeChannels_tiled( const Mat &image,             // in : input image, BGR
+                                Mat &memory,                  // in&out : memory of the channels
+                                vector<Mat>& channels) const; //out : 10 channle features, headers on memory
+
+    /* true if computeChannels_tiled can be used for this image : continuous, width multiple of
+     * shrink and 4, binsize == shrink */
+    bool canTileChannels( const Mat &image ) const;
     /* 
      * ===  FUNCTION  ======================================================================
      *         Name:  convTri
@@ -163,6 +251,7 @@ public:
      * ===  FUNCTION  ======================================================================
      *         Name:  convt_2_luv
      *  Description:  convert the image from BGR to LUV, LUV channel is contiunous in memory
+     *                the channels are reused if they are pre allocated that way
      * =====================================================================================
      */
 
@@ -182,8 +271,8 @@ public:
      bool computeGradMag( const Mat &input_image,      //in  : input image (first channel for color image ) 
                           const Mat &input_image2,     //in  : input image channel 2, set empty for gray image
                           const Mat &input_image3,     //in  : input image channel 3, set empty for gray image
-                          Mat &mag,                    //out : output mag
-                          Mat &ori,                    //out : output ori
+                          Mat &mag,                    //out : output mag, reused if it is pre allocated with the right size
+                          Mat &ori,                    //out : output ori, same
                           bool full,                   //in  : ture -> 0-2pi, otherwise 0-pi
                           int channel = 0              //in  : choose specific channel to compute the mag and ori
                        ) const;
@@ -207,7 +296,8 @@ public:
       /* 
        * ===  FUNCTION  ======================================================================
        *         Name:  chnsPyramid_sse
-       *  Description:  compute channels pyramid without approximation, slower but accurate
+       *  Description:  compute channels pyramid without approximation, slower but accurate,
+       *                scales are computed in parallel into one allocation
        * =====================================================================================
        */
     bool chnsPyramid_sse(const Mat &img,                        //in : input image
@@ -218,7 +308,8 @@ public:
 /* 
      * ===  FUNCTION  ======================================================================
      *         Name:  chnsPyramid_sse
-     *  Description:  compute channels pyramid with approximation, fast
+     *  Description:  compute channels pyramid with approximation, fast. Real scales in
+     *                parallel, then the approximated layers in parallel into one allocation
      * =====================================================================================
      */
 	bool chnsPyramid_sse(const Mat &img,                                    //in:  image
@@ -227,6 +318,78 @@ public:
 						vector<double> &scalesh,						    //out: the height scales
 						vector<double> &scalesw) const;					    //out: the width scales
 
+    /* 
+     * ===  FUNCTION  ======================================================================
+     *         Name:  prepareApproxPyramid
+     *  Description:  first half of chnsPyramid_sse( approximated ): scales, real layers and lambdas
+     * =====================================================================================
+     */
+    bool prepareApproxPyramid( const Mat &img,                      //in:  image
+                               pyramidState &state) const;          //out: scales, real scale channels and lambdas
+
+    /* 
+     * ===  FUNCTION  ======================================================================
+     *         Name:  planApproxPyramid
+     *  Description:  scales and layer IDs only, depend on the image size and the options only,
+     *                can be done once for a fixed image size
+     * =====================================================================================
+     */
+    void planApproxPyramid( const Size &img_size,                   //in:  size of the image
+                            pyramidState &state) const;             //out: scales and layer IDs
+
+    /* 
+     * ===  FUNCTION  ======================================================================
+     *         Name:  computeRealLevels
+     *  Description:  real layers and lambdas for an image, state has to be planned for the
+     *                same image size. The real layers are computed in parallel
+     * =====================================================================================
+     */
+    bool computeRealLevels( const Mat &img,                         //in:  image
+                            pyramidState &state) const;             //in&out: real scale channels and lambdas
+
+    /* 
+     * ===  FUNCTION  ======================================================================
+     *         Name:  computeApproxLevel
+     *  Description:  second half of chnsPyramid_sse( approximated ): compute one layer, the
+     *                same as approxPyramid[ap_id], thread safe
+     * =====================================================================================
+     */
+    void computeApproxLevel( const pyramidState &state,             //in:  output of prepareApproxPyramid
+                             int ap_id,                             //in:  index of the layer
+                             vector<Mat> &approx_chns) const;       //out: channels of the layer, padded, continuous in memory
+
+    /* same as above, the layer is written into approx, which is reused if the size matches */
+    void computeApproxLevel( const pyramidState &state,             //in:  output of prepareApproxPyramid
+                             int ap_id,                             //in:  index of the layer
+                             Mat &approx,                           //in&out: memory of the layer
+                             vector<Mat> &approx_chns) const;       //out: channels of the layer, headers on approx
+
+    /* 
+     * ===  FUNCTION  ======================================================================
+     *         Name:  allocateApproxLevels
+     *  Description:  memory of all the layers of a planned state in one allocation, layer c
+     *                is written into level_memory[c] by computeApproxLevel without allocating
+     * =====================================================================================
+     */
+    void allocateApproxLevels( const pyramidState &state,           //in:  planned state, see planApproxPyramid
+                               Mat &arena,                          //out: memory of all the layers
+                               vector<Mat> &level_memory) const;    //out: memory of each layer, headers on arena, 16 bytes aligned
+
+    /* 
+     * ===  FUNCTION  ======================================================================
+     *         Name:  quantizeLevel
+     *  Description:  quantized layer for the detector: channel c is multiplied by scales[c],
+     *                rounded and saturated to uint8 or uint16. Same layout as the float layer,
+     *                4 ( or 2 ) times less memory to read during the scan. The scales are given
+     *                by the detector, see softcascade::getChannelScales
+     * =====================================================================================
+     */
+    bool quantizeLevel( const vector<Mat> &chns,                    //in:  channels of a layer, output of computeApproxLevel
+                        const vector<float> &scales,                //in:  scale of each channel
+                        int depth,                                  //in:  CV_8U or CV_16U
+                        Mat &memory,                                //in&out: memory of the quantized layer, reused if the size matches
+                        vector<Mat> &quantized_chns) const;         //out: quantized channels, headers on memory
+
     
     /* 
      * ===  FUNCTION  ======================================================================
@@ -257,11 +420,27 @@ public:
                       double range=0.5);
 
   private:
+	/* ===  FUNCTION  ======================================================================
+	*         Name:  computeScales
+	*  Description:  the search done by getscales, without the cache
+	* =====================================================================================
+	*/
+	void computeScales(const Mat &img,
+					   vector<Size> &ap_size,
+					   vector<int> &real_scal,
+					   vector<double> &scales,
+					   vector<double> &scalesh,
+					   vector<double> &scalesw) const;
+
 	  channels_opt  m_opt;
 	  vector<double>lam;
       Mat m_normPad;        //pad_size = normPad(5)
       Mat m_km;             //pad_size = smooth(1);
 
+      mutable map<scalesKey, scalesEntry> m_scales_cache;     //getscales results, guarded by omp critical(getscales_cache)
+      mutable long m_scales_hits;                             //number of getscales calls found in the cache
+      mutable long m_scales_misses;                           //number of getscales calls computed
+
 };
 Mat get_Km(int smooth);
 #endif
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/contrib/contrib.hpp"
+#include "Pyramid.h"
+#include "scratchArena.h"
+
+using namespace std;
+using namespace cv;
+
+/* computeChannels_sse with and without tiling, on the image ( or a random one ) at several sizes,
+ * the channels have to be the same bit by bit. Then the intermediate buffers of a second pyramid of
+ * the same image have to come from the scratch arena without any system allocation
+ * usage : bench_channels [image] [repeat] */
+int main( int argc, char** argv)
+{
+    Mat input_image;
+    int repeat = 20;
+    if( argc > 1)
+        input_image = imread( argv[1] );
+    if( argc > 2)
+        repeat = atoi( argv[2] );
+    if( input_image.empty())
+    {
+        cout<<"no image given, using a random one "<<endl;
+        input_image.create( 480, 640, CV_8UC3 );
+        randu( input_image, Scalar::all(0), Scalar::all(255) );
+    }
+
+    const double scales[4] = { 0.5, 1.0, 2.0, 3.0 };
+    feature_Pyramids ff;
+    channels_opt opts = ff.getParas();
+    for( int s=0;s<4;s++)
+    {
+        Mat img;
+        resize( input_image, img, Size(), scales[s], scales[s] );
+        img = img.colRange( 0, img.cols - img.cols%4 ).clone();
+
+        double time_used[2] = { 0, 0 };
+        vector<Mat> chns[2];
+        for( int t=0;t<2;t++)
+        {
+            opts.tiled = ( t == 1 );
+            ff.setParas( opts );
+            TickMeter tk;
+            for( int r=0;r<repeat;r++)
+            {
+                chns[t].clear();
+                tk.start();
+                ff.computeChannels_sse( img, chns[t] );
+                tk.stop();
+            }
+            time_used[t] = tk.getTimeMilli()/repeat;
+        }
+
+        bool same = chns[0].size() == chns[1].size();
+        for( unsigned int c=0;same && c<chns[0].size();c++)
+            same = chns[0][c].size() == chns[1][c].size() &&
+                memcmp( chns[0][c].data, chns[1][c].data, chns[0][c].rows*chns[0][c].cols*sizeof(float) ) == 0;
+        cout<<img.size()<<" : full image "<<time_used[0]<<" ms, tiled "<<time_used[1]<<" ms, speed up "
+            <<time_used[0]/time_used[1]<<", "<<( same ? "same channels" : "!! channels differ !!")<<endl;
+        if( !same )
+            return -1;
+    }
+
+    /*  one thread, so that the same thread arena sees the same work in both frames */
+    opts.tiled = false;
+    opts.nThreads = 1;
+    ff.setParas( opts );
+    vector<vector<Mat> > pyramid;
+    vector<double> pyramid_scales, scalesh, scalesw;
+    ff.chnsPyramid_sse( input_image, pyramid, pyramid_scales, scalesh, scalesw );
+    const unsigned long first_frame = scratchSystemAllocations();
+    ff.chnsPyramid_sse( input_image, pyramid, pyramid_scales, scalesh, scalesw );
+    const unsigned long second_frame = scratchSystemAllocations() - first_frame;
+    cout<<"scratch arena : "<<first_frame<<" system allocations in the first pyramid, "<<second_frame<<" in the second, capacity "
+        <<threadScratch().capacity()/1024<<" KB"<<endl;
+    if( second_frame != 0 )
+        return -1;
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/contrib/contrib.hpp"
+#include "sseFun.h"
+#include "../misc/misc.hpp"
+
+using namespace std;
+using namespace cv;
+
+#define NUMBER_OF_KERNELS 6
+static const char *kernel_names[NUMBER_OF_KERNELS] = { "rgb2luv_sse", "gradMag    ", "gradMagNorm", "gradHist   ", "convTri1   ", "convTri_sse" };
+
+/* run each kernel repeat times on the image with the kernels selected by setSseSimdLevel, the output
+ * of the last run is kept for the comparison between the widths */
+static void runKernels( const Mat &img,                 /* in : 8UC3 image, continuous */
+                        int repeat,                     /* in : number of runs */
+                        double *time_used,              /* out: ms per run of each kernel */
+                        vector<Mat> &outputs )          /* out: output of each kernel */
+{
+    const int h = img.rows, w = img.cols, n = h*w;
+    Mat luv( 3*h, w, CV_32F ), mag( h, w, CV_32F ), ori( h, w, CV_32F ), norm( h, w, CV_32F ), smooth( h, w, CV_32F );
+    Mat hist( h/4*6, w/4, CV_32F ), tri1( 3*h, w, CV_32F ), tri( 3*h, w, CV_32F );
+
+    TickMeter tk[NUMBER_OF_KERNELS];
+    for( int r=0;r<repeat;r++)
+    {
+        tk[0].start();
+        rgb2luv_sse( img.data, (float*)luv.data, n, 1.0f/255 );
+        tk[0].stop();
+
+        tk[1].start();
+        gradMag( (float*)luv.data, (float*)mag.data, (float*)ori.data, h, w, 3, false );
+        tk[1].stop();
+
+        convTri_sse( (float*)mag.data, (float*)smooth.data, w, h, 5, 1, 1 );
+        mag.copyTo( norm );
+        tk[2].start();
+        gradMagNorm( (float*)norm.data, (float*)smooth.data, h, w, 0.005f );
+        tk[2].stop();
+
+        hist.setTo( 0 );
+        tk[3].start();
+        gradHist( (float*)norm.data, (float*)ori.data, (float*)hist.data, h, w, 4, 6, 0, false );
+        tk[3].stop();
+
+        tk[4].start();
+        convTri1( (float*)luv.data, (float*)tri1.data, 3*h, w, 1, 2.0f, 1 );
+        tk[4].stop();
+
+        tk[5].start();
+        convTri_sse( (float*)luv.data, (float*)tri.data, w, h, 5, 3, 1 );
+        tk[5].stop();
+    }
+    for( int k=0;k<NUMBER_OF_KERNELS;k++)
+        time_used[k] = tk[k].getTimeMilli()/repeat;
+
+    outputs.clear();
+    outputs.push_back( luv );
+    outputs.push_back( mag );
+    outputs.push_back( norm );
+    outputs.push_back( hist );
+    outputs.push_back( tri1 );
+    outputs.push_back( tri );
+}
+
+/* time of each sseFun kernel with the sse2, avx2 and avx512 builds, and the largest difference to sse2
+ * ( sse2 and avx2 have to be the same bit by bit )
+ * usage : bench_kernels [image] [repeat] */
+int main( int argc, char** argv)
+{
+    Mat img;
+    int repeat = 50;
+    if( argc > 1)
+        img = imread( argv[1] );
+    if( argc > 2)
+        repeat = atoi( argv[2] );
+    if( img.empty())
+    {
+        cout<<"no image given, using a random one "<<endl;
+        img.create( 480, 640, CV_8UC3 );
+        randu( img, Scalar::all(0), Scalar::all(255) );
+    }
+    img = img.colRange( 0, img.cols - img.cols%4 ).clone();
+    cout<<"image "<<img.size()<<", cpu simd level : "<<getCpuSimdLevel()<<endl;
+
+    const int simd_levels[3] = { SIMD_SSE2, SIMD_AVX2, SIMD_AVX512 };
+    double time_used[3][NUMBER_OF_KERNELS];
+    vector<Mat> outputs[3];
+    int number_of_levels = 0;
+    for( ;number_of_levels<3 && simd_levels[number_of_levels]<=getCpuSimdLevel();number_of_levels++)
+    {
+        setSseSimdLevel( simd_levels[number_of_levels] );
+        runKernels( img, repeat, time_used[number_of_levels], outputs[number_of_levels] );
+    }
+    setSseSimdLevel( SIMD_AVX2 );     /* back to the default, bit exact kernels */
+
+    cout<<"kernel     ";
+    for( int l=0;l<number_of_levels;l++)
+        cout<<" | "<<setw(16)<<sseKernelsFor( simd_levels[l] ).name;
+    cout<<endl;
+
+    bool exact = true;
+    for( int k=0;k<NUMBER_OF_KERNELS;k++)
+    {
+        cout<<kernel_names[k];
+        for( int l=0;l<number_of_levels;l++)
+        {
+            double max_diff = 0;
+            const Mat &a = outputs[0][k], &b = outputs[l][k];
+            for( int i=0;i<a.rows*a.cols;i++)
+                max_diff = std::max( max_diff, (double)std::fabs( a.ptr<float>(0)[i] - b.ptr<float>(0)[i] ));
+            if( simd_levels[l] == SIMD_AVX2 && max_diff > 0 )
+                exact = false;
+            cout<<" | "<<setw(7)<<setprecision(3)<<time_used[l][k]<<" ms x"<<setw(4)<<setprecision(2)<<time_used[0][k]/time_used[l][k];
+            if( l > 0 )
+                cout<<" diff "<<max_diff;
+        }
+        cout<<endl;
+    }
+    if( !exact )
+    {
+        cout<<"!! avx2 differs from sse2 !!"<<endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include "scratchArena.h"
+
+/* first block of an arena, enough for the buffers of a vga frame */
+#define SCRATCH_MIN_BLOCK ( 1 << 20 )
+
+static unsigned long s_system_allocations = 0;
+
+scratchArena::scratchArena()
+{
+    m_current = 0;
+    m_used = 0;
+}
+
+scratchArena::~scratchArena()
+{
+    for( unsigned int c=0;c<m_blocks.size();c++)
+        free( m_blocks[c].data );
+}
+
+void scratchArena::addBlock( size_t size )
+{
+    block b;
+    b.data = (char*)malloc( size );
+    if( !b.data )                   /* same as new and cv::Mat, the arena never gives back null */
+        throw std::bad_alloc();
+    b.size = size;
+    b.base = m_blocks.empty() ? 0 : m_blocks.back().base + m_blocks.back().size;
+    m_blocks.push_back( b );
+    #pragma omp atomic
+    s_system_allocations++;
+}
+
+void* scratchArena::alloc( size_t size, size_t alignment )
+{
+    for( ;m_current<m_blocks.size();m_current++, m_used=0)
+    {
+        const block &b = m_blocks[m_current];
+        size_t start = ( (size_t)( b.data + m_used ) + alignment - 1 )/alignment*alignment - (size_t)b.data;
+        if( start + size <= b.size )
+        {
+            m_used = start + size;
+            return b.data + start;
+        }
+        if( m_current + 1 == m_blocks.size())
+            break;
+    }
+
+    /*  no room left, the new block is at least as large as all the others together */
+    addBlock( std::max( size + alignment, std::max( capacity(), (size_t)SCRATCH_MIN_BLOCK )));
+    m_current = m_blocks.size() - 1;
+    m_used = 0;
+    return alloc( size, alignment );
+}
+
+void* scratchArena::allocZero( size_t size, size_t alignment )
+{
+    void *p = alloc( size, alignment );
+    memset( p, 0, size );
+    return p;
+}
+
+size_t scratchArena::mark() const
+{
+    if( m_blocks.empty())
+        return 0;
+    return m_blocks[m_current].base + m_used;
+}
+
+void scratchArena::release( size_t mark )
+{
+    if( mark >= this->mark())
+        return;
+    while( m_current > 0 && m_blocks[m_current].base > mark )
+        m_current--;
+    m_used = mark - m_blocks[m_current].base;
+
+    /*  empty, merge the blocks so that the same work fits into one block next time */
+    if( mark == 0 && m_blocks.size() > 1 )
+    {
+        const size_t total = capacity();
+        for( unsigned int c=0;c<m_blocks.size();c++)
+            free( m_blocks[c].data );
+        m_blocks.clear();
+        addBlock( total );
+        m_current = 0;
+        m_used = 0;
+    }
+}
+
+void scratchArena::reset()
+{
+    release( 0 );
+}
+
+size_t scratchArena::capacity() const
+{
+    if( m_blocks.empty())
+        return 0;
+    return m_blocks.back().base + m_blocks.back().size;
+}
+
+scratchArena& threadScratch()
+{
+    static __thread scratchArena *arena = 0;
+    if( arena == 0 )
+        arena = new scratchArena;
+    return *arena;
+}
+
+unsigned long scratchSystemAllocations()
+{
+    unsigned long n;
+    #pragma omp atomic read
+    n = s_system_allocations;
+    return n;
+}
@@ -0,0 +1,76 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+/* bump allocator for the temporary buffers of the channel features. Memory is taken by moving an
+ * offset and given back in LIFO order with mark/release ( or scratchScope ). When the arena gets
+ * empty again the blocks it had to add are merged into one, so once the first frame has been
+ * processed the following frames do not call malloc any more.
+ * Not thread safe, each thread uses its own arena, see threadScratch */
+class scratchArena
+{
+    public:
+        scratchArena();
+        ~scratchArena();
+
+        /*  size bytes aligned to alignment ( a power of 2 ), not initialized, throws std::bad_alloc if the system has no memory left */
+        void* alloc( size_t size, size_t alignment = 16 );
+
+        /*  same as alloc, set to 0 */
+        void* allocZero( size_t size, size_t alignment = 16 );
+
+        /*  position of the arena, give it to release */
+        size_t mark() const;
+
+        /*  give back everything allocated after the mark, ignored if it has been released already */
+        void release( size_t mark );
+
+        /*  give back everything */
+        void reset();
+
+        /*  bytes owned by the arena */
+        size_t capacity() const;
+
+    private:
+        struct block
+        {
+            char *data;
+            size_t size;
+            size_t base;                /* position of the first byte, sum of the size of the blocks before */
+        };
+
+        void addBlock( size_t size );
+
+        std::vector<block> m_blocks;
+        size_t m_current;               /* block in use */
+        size_t m_used;                  /* bytes used in the current block */
+
+        scratchArena( const scratchArena & );
+        scratchArena& operator=( const scratchArena & );
+};
+
+/*  arena of the calling thread, created on first use and kept until the program ends */
+scratchArena& threadScratch();
+
+/*  memory of threadScratch() taken in the lifetime of the scope is given back when it ends */
+class scratchScope
+{
+    public:
+        scratchScope() : m_arena( threadScratch()), m_mark( m_arena.mark()) {}
+        ~scratchScope() { m_arena.release( m_mark ); }
+        scratchArena& arena() { return m_arena; }
+
+    private:
+        scratchArena &m_arena;
+        size_t m_mark;
+
+        scratchScope( const scratchScope & );
+        scratchScope& operator=( const scratchScope & );
+};
+
+/*  number of blocks all the scratch arenas got from the system since the program started */
+unsigned long scratchSystemAllocations();
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef SIMD_VEC_HPP
+#define SIMD_VEC_HPP
+
+/* width agnostic float/int vectors for sseKernels_impl.hpp, the width is the one of the translation
+ * unit : avx512 with -mavx512f, avx2 with -mavx2, sse2 otherwise.
+ * Everything is inside SIMD_KERNEL_NS ( one namespace for each width ), nothing is shared with the
+ * translation units built with other flags */
+
+#include <immintrin.h>
+
+#ifndef SIMD_KERNEL_NS
+#error "define SIMD_KERNEL_NS before including simdVec.hpp"
+#endif
+
+namespace SIMD_KERNEL_NS {
+
+#if defined(__AVX512F__)
+
+struct V
+{
+    typedef __m512  f;
+    typedef __m512i i;
+    enum { W = 16 };
+    static f set( float x ) { return _mm512_set1_ps(x); }
+    static i seti( int x ) { return _mm512_set1_epi32(x); }
+    static f zero() { return _mm512_setzero_ps(); }
+    static f load( const float *p ) { return _mm512_loadu_ps(p); }
+    static void store( float *p, f x ) { _mm512_storeu_ps(p,x); }
+    static void storei( int *p, i x ) { _mm512_storeu_si512( (void*)p, x ); }
+    static f add( f x, f y ) { return _mm512_add_ps(x,y); }
+    static f sub( f x, f y ) { return _mm512_sub_ps(x,y); }
+    static f mul( f x, f y ) { return _mm512_mul_ps(x,y); }
+    static f min( f x, f y ) { return _mm512_min_ps(x,y); }
+    static f rcp( f x ) { return _mm512_rcp14_ps(x); }
+    static f rsqrt( f x ) { return _mm512_rsqrt14_ps(x); }
+    static f and_( f x, f y ) { return _mm512_castsi512_ps( _mm512_and_si512( _mm512_castps_si512(x), _mm512_castps_si512(y) )); }
+    static f or_( f x, f y ) { return _mm512_castsi512_ps( _mm512_or_si512( _mm512_castps_si512(x), _mm512_castps_si512(y) )); }
+    static f andnot( f x, f y ) { return _mm512_castsi512_ps( _mm512_andnot_si512( _mm512_castps_si512(x), _mm512_castps_si512(y) )); }
+    static f xor_( f x, f y ) { return _mm512_castsi512_ps( _mm512_xor_si512( _mm512_castps_si512(x), _mm512_castps_si512(y) )); }
+    static f cmpgt( f x, f y ) { return _mm512_castsi512_ps( _mm512_maskz_set1_epi32( _mm512_cmp_ps_mask( x, y, _CMP_GT_OQ ), -1 )); }
+    static f cmplt( f x, f y ) { return _mm512_castsi512_ps( _mm512_maskz_set1_epi32( _mm512_cmp_ps_mask( x, y, _CMP_LT_OQ ), -1 )); }
+    static i addi( i x, i y ) { return _mm512_add_epi32(x,y); }
+    static i andi( i x, i y ) { return _mm512_and_si512(x,y); }
+    static i cmpgti( i x, i y ) { return _mm512_maskz_set1_epi32( _mm512_cmpgt_epi32_mask( x, y ), -1 ); }
+    static i cvtt( f x ) { return _mm512_cvttps_epi32(x); }
+    static f cvt( i x ) { return _mm512_cvtepi32_ps(x); }
+    /* same approximation as rcp, for the elements left after the vectors */
+    static float rcp1( float x ) { return _mm_cvtss_f32( _mm_rcp14_ss( _mm_setzero_ps(), _mm_set_ss(x) )); }
+};
+
+#elif defined(__AVX2__)
+
+struct V
+{
+    typedef __m256  f;
+    typedef __m256i i;
+    enum { W = 8 };
+    static f set( float x ) { return _mm256_set1_ps(x); }
+    static i seti( int x ) { return _mm256_set1_epi32(x); }
+    static f zero() { return _mm256_setzero_ps(); }
+    static f load( const float *p ) { return _mm256_loadu_ps(p); }
+    static void store( float *p, f x ) { _mm256_storeu_ps(p,x); }
+    static void storei( int *p, i x ) { _mm256_storeu_si256( (__m256i*)p, x ); }
+    static f add( f x, f y ) { return _mm256_add_ps(x,y); }
+    static f sub( f x, f y ) { return _mm256_sub_ps(x,y); }
+    static f mul( f x, f y ) { return _mm256_mul_ps(x,y); }
+    static f min( f x, f y ) { return _mm256_min_ps(x,y); }
+    static f rcp( f x ) { return _mm256_rcp_ps(x); }
+    static f rsqrt( f x ) { return _mm256_rsqrt_ps(x); }
+    static f and_( f x, f y ) { return _mm256_and_ps(x,y); }
+    static f or_( f x, f y ) { return _mm256_or_ps(x,y); }
+    static f andnot( f x, f y ) { return _mm256_andnot_ps(x,y); }
+    static f xor_( f x, f y ) { return _mm256_xor_ps(x,y); }
+    static f cmpgt( f x, f y ) { return _mm256_cmp_ps( x, y, _CMP_GT_OQ ); }
+    static f cmplt( f x, f y ) { return _mm256_cmp_ps( x, y, _CMP_LT_OQ ); }
+    static i addi( i x, i y ) { return _mm256_add_epi32(x,y); }
+    static i andi( i x, i y ) { return _mm256_and_si256(x,y); }
+    static i cmpgti( i x, i y ) { return _mm256_cmpgt_epi32(x,y); }
+    static i cvtt( f x ) { return _mm256_cvttps_epi32(x); }
+    static f cvt( i x ) { return _mm256_cvtepi32_ps(x); }
+    /* same approximation as rcp, for the elements left after the vectors */
+    static float rcp1( float x ) { return _mm_cvtss_f32( _mm_rcp_ss( _mm_set_ss(x) )); }
+};
+
+#else
+
+struct V
+{
+    typedef __m128  f;
+    typedef __m128i i;
+    enum { W = 4 };
+    static f set( float x ) { return _mm_set1_ps(x); }
+    static i seti( int x ) { return _mm_set1_epi32(x); }
+    static f zero() { return _mm_setzero_ps(); }
+    static f load( const float *p ) { return _mm_loadu_ps(p); }
+    static void store( float *p, f x ) { _mm_storeu_ps(p,x); }
+    static void storei( int *p, i x ) { _mm_storeu_si128( (__m128i*)p, x ); }
+    static f add( f x, f y ) { return _mm_add_ps(x,y); }
+    static f sub( f x, f y ) { return _mm_sub_ps(x,y); }
+    static f mul( f x, f y ) { return _mm_mul_ps(x,y); }
+    static f min( f x, f y ) { return _mm_min_ps(x,y); }
+    static f rcp( f x ) { return _mm_rcp_ps(x); }
+    static f rsqrt( f x ) { return _mm_rsqrt_ps(x); }
+    static f and_( f x, f y ) { return _mm_and_ps(x,y); }
+    static f or_( f x, f y ) { return _mm_or_ps(x,y); }
+    static f andnot( f x, f y ) { return _mm_andnot_ps(x,y); }
+    static f xor_( f x, f y ) { return _mm_xor_ps(x,y); }
+    static f cmpgt( f x, f y ) { return _mm_cmpgt_ps(x,y); }
+    static f cmplt( f x, f y ) { return _mm_cmplt_ps(x,y); }
+    static i addi( i x, i y ) { return _mm_add_epi32(x,y); }
+    static i andi( i x, i y ) { return _mm_and_si128(x,y); }
+    static i cmpgti( i x, i y ) { return _mm_cmpgt_epi32(x,y); }
+    static i cvtt( f x ) { return _mm_cvttps_epi32(x); }
+    static f cvt( i x ) { return _mm_cvtepi32_ps(x); }
+    /* same approximation as rcp, for the elements left after the vectors */
+    static float rcp1( float x ) { return _mm_cvtss_f32( _mm_rcp_ss( _mm_set_ss(x) )); }
+};
+
+#endif
+
+} // namespace SIMD_KERNEL_NS
+
+#endif
@@ -3,7 +3,7 @@
 #include <string.h>
 
 #include "sseFun.h"
-#include "wrappers.hpp"
+#include "scratchArena.h"
 #define PI 3.14159265358979323846264338
 
 
@@ -46,7 +46,7 @@ void hogChannels( float *feature,               // out: output feature
   #undef GETT
 }
 
-// HOG helper: compute 2x2 block normalization values (padded by 1 pixel)
+// HOG helper: compute 2x2 block normalization values (padded by 1 pixel), taken from threadScratch()
 float* hogNormMatrix( float *gradientHist,  //in : gradientHist
                       int nOrients,         //in : number of orientation
                       int hb,               //in : number of block in y direction
@@ -55,7 +55,7 @@ float* hogNormMatrix( float *gradientHist,  //in : gradientHist
 {
   float *N, *N1, *n; int o, x, y, dx, dy, hb1=hb+1, wb1=wb+1;
   float eps = 1e-4f/4/binSize/binSize/binSize/binSize; // precise backward equality
-  N = (float*) wrCalloc(hb1*wb1,sizeof(float)); N1=N+wb1+1;
+  N = (float*) threadScratch().allocZero(hb1*wb1*sizeof(float)); N1=N+wb1+1;
 
   for( o=0; o<nOrients; o++ )for( y=0; y<hb; y++ )for( x=0; x<wb; x++ )
     N1[y*wb1+x] += gradientHist[o*wb*hb+y*wb+x]*gradientHist[o*wb*hb+y*wb+x];
@@ -89,14 +89,14 @@ void ssehog(const float *Mag,   //in : magnitude
 
 {
   float *NormalizedValue, *gradientHist; const int hb=height/binSize, wb=width/binSize;
+  scratchScope scratch;
   // compute unnormalized gradient histograms
-  gradientHist = (float*) wrCalloc(wb*hb*nOrients,sizeof(float));
+  gradientHist = (float*) scratch.arena().allocZero(wb*hb*nOrients*sizeof(float));
   gradHist( Mag, Ori, gradientHist, height, width, binSize, nOrients, 1, full );
   // compute block normalization values
   NormalizedValue = hogNormMatrix( gradientHist, nOrients, hb, wb, binSize );
   // perform four normalizations per spatial block
   hogChannels( feature, gradientHist, NormalizedValue, hb, wb, nOrients, clip, 0 );
-  wrFree(NormalizedValue); wrFree(gradientHist);
 }
 
 
@@ -112,12 +112,13 @@ void ssefhog( const float *Mag,     // in : magnitude
 {
   const int hb=height/binSize, wb=width/binSize, nb=hb*wb, nbo=nb*nOrients;
   float *N, *R1, *R2; int o, x;
+  scratchScope scratch;
   // compute unnormalized constrast sensitive histograms
   // add binSize as the buffer for sse
-  R1 = (float*) wrCalloc(wb*hb*nOrients*2+binSize,sizeof(float));
+  R1 = (float*) scratch.arena().allocZero((wb*hb*nOrients*2+binSize)*sizeof(float));
   gradHist( Mag, Ori, R1, height, width, binSize, nOrients*2, -1, true );
   // compute unnormalized contrast insensitive histograms
-  R2 = (float*) wrCalloc(wb*hb*nOrients + binSize,sizeof(float));
+  R2 = (float*) scratch.arena().allocZero((wb*hb*nOrients + binSize)*sizeof(float));
   for( o=0; o<nOrients; o++ ) for( x=0; x<nb; x++ )
     R2[o*nb+x] = R1[o*nb+x]+R1[(o+nOrients)*nb+x];
   // compute block normalization values
@@ -126,8 +127,6 @@ void ssefhog( const float *Mag,     // in : magnitude
   hogChannels( feature+nbo*0, R1, N, hb, wb, nOrients*2, clip, 1 );
   hogChannels( feature+nbo*2, R2, N, hb, wb, nOrients*1, clip, 1 );
   hogChannels( feature+nbo*3, R1, N, hb, wb, nOrients*2, clip, 2 );
-
-  wrFree(N); wrFree(R1); wrFree(R2);
 }
 
 
@@ -162,8 +161,9 @@ void gradHist( const float *Magnitude,  // in : magnitude, size width x height
     float *gHist0, *gHist1, *Magnitude0, *Magnitude1;
     int row_index, col_index; int *Orientation0, *Orientation1; float yb, init;
 
-    Orientation0=(int*)alMalloc(width*sizeof(int),16); Magnitude0=(float*) alMalloc(width*sizeof(float),16);
-    Orientation1=(int*)alMalloc(width*sizeof(int),16); Magnitude1=(float*) alMalloc(width*sizeof(float),16);
+    scratchScope scratch;
+    Orientation0=(int*)scratch.arena().alloc(width*sizeof(int)); Magnitude0=(float*) scratch.arena().alloc(width*sizeof(float));
+    Orientation1=(int*)scratch.arena().alloc(width*sizeof(int)); Magnitude1=(float*) scratch.arena().alloc(width*sizeof(float));
 
     // main loop
     for( row_index=0; row_index<h0; row_index++ )
@@ -236,7 +236,6 @@ void gradHist( const float *Magnitude,  // in : magnitude, size width x height
          #undef GH
 	    }
     }
-    alFree(Orientation0); alFree(Orientation1); alFree(Magnitude0); alFree(Magnitude1);
     // normalize boundary bins which only get 7/8 of weight of interior bins
     if( softBin%2!=0 ) for( int o=0; o<nOrients; o++ ) {
         row_index=0; for( col_index=0; col_index<height_block; col_index++ ) gHist[o*nb+row_index+col_index*width_block]*=8.f/7.f;
@@ -247,44 +246,45 @@ void gradHist( const float *Magnitude,  // in : magnitude, size width x height
 }
 
 
+// gradHist of the rows [row_begin, row_end) for the channel features ( softBin=0 ), Mag and Ori point to row row_begin
+void gradHistRows( const float *Magnitude, const float *Orientation, float *gHist, int height, int width,
+                   int row_begin, int row_end, int binSize, int nOrients, bool full )
+{
+    const int height_block=height/binSize, width_block=width/binSize, h0=height_block*binSize, w0=width_block*binSize, nb=width_block*height_block;
+    const float s=(float)binSize, sInv2=1/s/s;
+    float *gHist1, *Magnitude0, *Magnitude1;
+    int row_index, col_index; int *Orientation0, *Orientation1;
+
+    scratchScope scratch;
+    Orientation0=(int*)scratch.arena().alloc(width*sizeof(int)); Magnitude0=(float*) scratch.arena().alloc(width*sizeof(float));
+    Orientation1=(int*)scratch.arena().alloc(width*sizeof(int)); Magnitude1=(float*) scratch.arena().alloc(width*sizeof(float));
+
+    if( row_end>h0 ) row_end=h0;
+    for( row_index=row_begin; row_index<row_end; row_index++ )
+    {
+        const int row=row_index-row_begin;
+        gradQuantize(Orientation+row*width,Magnitude+row*width,Orientation0,Orientation1,Magnitude0,Magnitude1,nb,w0,sInv2,nOrients,full,true);
+        // interpolate w.r.t. orientation only, not spatial bin, same as gradHist
+        gHist1=gHist+(row_index/binSize)*width_block;
+#define GH gHist1[Orientation0[col_index]]+=Magnitude0[col_index]; gHist1[Orientation1[col_index]]+=Magnitude1[col_index]; col_index++;
+        if( binSize==1 )      for(col_index=0; col_index<w0;) { GH; gHist1++; }
+        else if( binSize==2 ) for(col_index=0; col_index<w0;) { GH; GH; gHist1++; }
+        else if( binSize==3 ) for(col_index=0; col_index<w0;) { GH; GH; GH; gHist1++; }
+        else if( binSize==4 ) for(col_index=0; col_index<w0;) { GH; GH; GH; GH; gHist1++; }
+        else for( col_index=0; col_index<w0;) { for( int y1=0; y1<binSize; y1++ ) { GH; } gHist1++; }
+#undef GH
+    }
+}
+
+
 // helper for gradHist, quantize O and M into O0, O1 and M0, M1 (uses sse)
 void gradQuantize( const float *O, const float *M, int *O0, int *O1, float *M0, float *M1,
                    int nb, int n, float norm, int nOrients, bool full, bool interpolate )
 {
-    // assumes all *OUTPUT* matrices are 4-byte aligned
-    int i, o0, o1; float o, od, m;
-    __m128i _o0, _o1, *_O0, *_O1; __m128 _o, _od, _m, *_M0, *_M1;
-    // define useful constants
-    const float oMult=(float)nOrients/(full?2*(float)PI:(float)PI); const int oMax=nOrients*nb;
-    const __m128 _norm=SET(norm), _oMult=SET(oMult), _nbf=SET((float)nb);
-    const __m128i _oMax=SET(oMax), _nb=SET(nb);
-    // perform the majority of the work with sse
-    _O0=(__m128i*) O0; _O1=(__m128i*) O1; _M0=(__m128*) M0; _M1=(__m128*) M1;
-    if( interpolate ) for( i=0; i<=n-4; i+=4 ) {
-        _o=MUL(LDu(O[i]),_oMult); _o0=CVT(_o); _od=SUB(_o,CVT(_o0));
-        _o0=CVT(MUL(CVT(_o0),_nbf)); _o0=AND(CMPGT(_oMax,_o0),_o0); *_O0++=_o0;
-        _o1=ADD(_o0,_nb); _o1=AND(CMPGT(_oMax,_o1),_o1); *_O1++=_o1;
-        _m=MUL(LDu(M[i]),_norm); *_M1=MUL(_od,_m); *_M0++=SUB(_m,*_M1); _M1++;
-    } else for( i=0; i<=n-4; i+=4 ) {
-        _o=MUL(LDu(O[i]),_oMult); _o0=CVT(ADD(_o,SET(.5f)));
-        _o0=CVT(MUL(CVT(_o0),_nbf)); _o0=AND(CMPGT(_oMax,_o0),_o0); *_O0++=_o0;
-        *_M0++=MUL(LDu(M[i]),_norm); *_M1++=SET(0.f); *_O1++=SET(0);
-    }
-    // compute trailing locations without sse
-    if( interpolate ) for(; i<n; i++ ) {
-        o=O[i]*oMult; o0=(int) o; od=o-o0;
-        o0*=nb; if(o0>=oMax) o0=0; O0[i]=o0;
-        o1=o0+nb; if(o1==oMax) o1=0; O1[i]=o1;
-        m=M[i]*norm; M1[i]=od*m; M0[i]=m-M1[i];
-    } else for(; i<n; i++ ) {
-        o=O[i]*oMult; o0=(int) (o+.5f);
-        o0*=nb; if(o0>=oMax) o0=0; O0[i]=o0;
-        M0[i]=M[i]*norm; M1[i]=0; O1[i]=0;
-    }
+    sseKernels().gradQuantize( O, M, O0, O1, M0, M1, nb, n, norm, nOrients, full, interpolate );
 }
 
 
-
 // convolve one row of I by a [1 p 1] filter (uses SSE)
 void convTri1Y( const float *I, float *O, int w, float p, int s ) {
 #define C4(m,o) ADD(ADD(LDu(I[m*j-1+o]),MUL(p,LDu(I[m*j+o]))),LDu(I[m*j+1+o]))
@@ -307,21 +307,23 @@ void convTri1Y( const float *I, float *O, int w, float p, int s ) {
 #undef C4
 }
 
+// convolve one row by a [1 p 1] filter, given the row above and below (uses SSE)
+void convTri1Row( const float *Il, const float *Im, const float *Ir, float *T, float *O, int w, float p, int s ) {
+    sseKernels().convTri1Row( Il, Im, Ir, T, O, w, p, s );
+}
+
 // convolve I by a [1 p 1] filter (uses SSE)
 void convTri1( const float *I, float *O, int h, int w, int d, float p, int s) {
-    const float nrm = 1.0f/((p+2)*(p+2)); int i, j, w0=w-(w%4);
+    int i;
     const float *Il, *Im, *Ir;
-    float *T=(float*) alMalloc(w*sizeof(float),16);
+    scratchScope scratch;
+    float *T=(float*) scratch.arena().alloc(w*sizeof(float));
     for( int d0=0; d0<d; d0++ )
         for( i=s/2; i<h; i+=s )
         {
             Il=Im=Ir=I+i*w+d0*h*w; if(i>0) Il-=w; if(i<h-1) Ir+=w;
-            for( j=0; j<w0; j+=4 )
-                STR(T[j],MUL(nrm,ADD(ADD(LDu(Il[j]),MUL(p,LDu(Im[j]))),LDu(Ir[j]))));
-            for( j=w0; j<w; j++ ) T[j]=nrm*(Il[j]+p*Im[j]+Ir[j]);
-            convTri1Y(T,O,w,p,s); O+=w/s;
+            convTri1Row(Il,Im,Ir,T,O,w,p,s); O+=w/s;
         }
-    alFree(T);
 }
 
 
@@ -377,55 +379,28 @@ float* acosTable() {
     init=true; return a1;
 }
 
+// compute gradient magnitude and orientation of row x (uses sse)
+void gradMagRow( const float *I, int plane, float *M, float *O, int h, int w, int d, int x, bool full,
+                 float *M2, float *Gx, float *Gy )
+{
+    sseKernels().gradMagRow( I, plane, M, O, h, w, d, x, full, M2, Gx, Gy );
+}
+
 // compute gradient magnitude and orientation at each location (uses sse)
 void gradMag( const float *I, float *M, float *O, int h, int w, int d, bool full )
 {
-    int x, y, y1, c, w4, s; float *Gx, *Gy, *M2; __m128 *_Gx, *_Gy, *_M2, _m;
-    float *acost = acosTable(), acMult=10000.0f;
+    int x, s; float *Gx, *Gy, *M2;
 
-    // allocate memory for storing one row of output (padded so w4%4==0)
-    w4=(w%4==0) ? w : w-(w%4)+4; s=d*w4*sizeof(float);
-    M2=(float*) alMalloc(s,16); _M2=(__m128*) M2;
-    Gx=(float*) alMalloc(s,16); _Gx=(__m128*) Gx;
-    Gy=(float*) alMalloc(s,16); _Gy=(__m128*) Gy;
+    // allocate memory for storing one row of output (padded to GRADMAG_ROW_PAD)
+    s=d*GRADMAG_ROW_STRIDE(w)*sizeof(float);
+    scratchScope scratch;
+    M2=(float*) scratch.arena().alloc(s);
+    Gx=(float*) scratch.arena().alloc(s);
+    Gy=(float*) scratch.arena().alloc(s);
 
     // compute gradient magnitude and orientation for each row
     for( x=0; x<h; x++ )
-    {
-        // compute gradients (Gx, Gy) with maximum squared magnitude (M2)
-        for(c=0; c<d; c++)          // compute for each channel, take the max value
-        {
-            grad1( I+x*w+c*w*h, Gx+c*w4, Gy+c*w4, h, w, x );
-            for( y=0; y<w4/4; y++ )
-            {
-                y1=w4/4*c+y;
-                _M2[y1]=ADD(MUL(_Gx[y1],_Gx[y1]),MUL(_Gy[y1],_Gy[y1]));
-                if( c==0 ) continue; _m = CMPGT( _M2[y1], _M2[y] );
-                _M2[y] = OR( AND(_m,_M2[y1]), ANDNOT(_m,_M2[y]) );
-                _Gx[y] = OR( AND(_m,_Gx[y1]), ANDNOT(_m,_Gx[y]) );
-                _Gy[y] = OR( AND(_m,_Gy[y1]), ANDNOT(_m,_Gy[y]) );
-            }
-        }
-        // compute gradient mangitude (M) and normalize Gx // avoid the exception when arctan(Gy/Gx)
-        for( y=0; y<w4/4; y++ ) {
-            _m = SSEMIN( RCPSQRT(_M2[y]), SET(1e10f) );
-            _M2[y] = RCP(_m);
-            if(O) _Gx[y] = MUL( MUL(_Gx[y],_m), SET(acMult) );
-            if(O) _Gx[y] = XOR( _Gx[y], AND(_Gy[y], SET(-0.f)) );
-        };
-        memcpy( M+x*w, M2, w*sizeof(float) );
-        // compute and store gradient orientation (O) via table lookup
-        if( O!=0 ) for( y=0; y<w; y++ ) O[x*w+y] = acost[(int)Gx[y]];
-        if( O!=0 && full ) {
-            y1=((~size_t(O+x*w)+1)&15)/4; y=0;
-            for( ; y<y1; y++ ) O[y+x*w]+=(Gy[y]<0)*(float)PI;
-            for( ; y<w-4; y+=4 ) STRu( O[y+x*w],
-                    ADD( LDu(O[y+x*w]), AND(CMPLT(LDu(Gy[y]),SET(0.f)),SET((float)PI)) ) );
-            for( ; y<w; y++ ) O[y+x*w]+=(Gy[y]<0)*(float)PI;
-        }
-    }
-
-    alFree(Gx); alFree(Gy); alFree(M2);
+        gradMagRow( I+x*w, w*h, M+x*w, O ? O+x*w : 0, h, w, d, x, full, M2, Gx, Gy );
 }
 
 
@@ -434,15 +409,7 @@ void gradMagNorm( float *M,                     // output: M = M/(S + norm)
                   const float *S,               // input : Source Matrix
                   int h, int w, float norm )    // input : parameters
 {
-    __m128 *_M, *_S, _norm; int i=0, n=h*w, n4=n/4;
-    _S = (__m128*) S; _M = (__m128*) M; _norm = SET(norm);
-    bool sse = !(size_t(M)&15) && !(size_t(S)&15);
-    if(sse)
-        for(; i<n4; i++)
-        { *_M=MUL(*_M,RCP(ADD(*_S++,_norm))); _M++; }
-    if(sse)
-        i*=4;
-    for(; i<n; i++) M[i] /= (S[i] + norm);
+    sseKernels().gradMagNorm( M, S, h, w, norm );
 }
 
 // convolve one row of I by a 2rx1 triangle filter
@@ -464,47 +431,60 @@ void convTriY( float *I, float *O, int w, int r, int s )
     }
 }
 
-void convTri_sse( const float *I, float *O, int width, int height, int r,int d , int s) 
+void convTriStart( convTriState &st, int width, int height, int r, int s )
 {
-    r++; float nrm = 1.0f/(r*r*r*r); int i, j, k=(s-1)/2, h0, h1, w0;
-    if(width%4==0)
-        h0=h1=width;
-    else
-    { h0=width-(width%4); h1=h0+4; }
-    w0=(height/s)*s;
+    st.width=width; st.height=height; st.s=s;
+    r++; st.r=r; st.nrm = 1.0f/(r*r*r*r); st.k=(s-1)/2; st.next=0;
+    st.h1=(width%4==0) ? width : width-(width%4)+4;
+    st.arena_mark=threadScratch().mark();
+    st.T=(float*) threadScratch().alloc(2*st.h1*sizeof(float)); st.U=st.T+st.h1;
+}
 
-    float *T=(float*) alMalloc(2*h1*sizeof(float),16), *U=T+h1;
-    while( d-->0)
+void convTriEnd( convTriState &st )
+{
+    threadScratch().release(st.arena_mark); st.T=st.U=0;
+}
+
+int convTriRows( convTriState &st, const float *I, int first, int available, int end, float *O )
+{
+    const sseKernelTable &kernels=sseKernels();
+    const int width=st.width, height=st.height, r=st.r, s=st.s;
+    const float nrm=st.nrm; float *T=st.T, *U=st.U;
+    int i, n_out=0, w0=(height/s)*s;
+    if( end<w0 ) w0=end;
+#define ROW(x) (I+((x)-first)*width)
+    if( st.next==0 )
     {
+        if( end<=0 || ( available<r && available<height )) return 0;
         // initialize T and U
-        for(j=0; j<h0; j+=4) STR(U[j], STR(T[j], LDu(I[j])));
-        for(i=1; i<r; i++) for(j=0; j<h0; j+=4) INC(U[j],INC(T[j],LDu(I[j+i*width])));
-        for(j=0; j<h0; j+=4) STR(U[j],MUL(nrm,(SUB(MUL(2,LD(U[j])),LD(T[j])))));
-        for(j=0; j<h0; j+=4) STR(T[j],0);
-        for(j=h0; j<width; j++ ) U[j]=T[j]=I[j];
-        for(i=1; i<r; i++) for(j=h0; j<width; j++ ) U[j]+=T[j]+=I[j+i*width];
-        for(j=h0; j<width; j++ ) { U[j] = nrm * (2*U[j]-T[j]); T[j]=0; }
+        kernels.convTriInit( T, U, ROW(0), width );
+        for(i=1; i<r; i++) kernels.convTriAccumulate( T, U, ROW(i), width );
+        kernels.convTriFinishInit( T, U, nrm, width );
         // prepare and convolve each column in turn
-        k++; if(k==s) { k=0; convTriY(U,O,width,r-1,s); O+=width/s; }
-        for( i=1; i<w0; i++ )
-        {
-            const float *Il=I+(i-1-r)*width; if(i<=r) Il=I+(r-i)*width; const float *Im=I+(i-1)*width;
-            const float *Ir=I+(i-1+r)*width; if(i>height-r) Ir=I+(2*height-r-i)*width;
-            for( j=0; j<h0; j+=4 ) {
-                INC(T[j],ADD(LDu(Il[j]),LDu(Ir[j]),MUL(-2,LDu(Im[j]))));
-                INC(U[j],MUL(nrm,LD(T[j])));
-            }
-            for( j=h0; j<width; j++ ) U[j]+=nrm*(T[j]+=Il[j]+Ir[j]-2*Im[j]);
-            k++; if(k==s) { k=0; convTriY(U,O,width,r-1,s); O+=width/s; }
-        }
-        I+=width*height;
+        st.k++; if(st.k==s) { st.k=0; convTriY(U,O,width,r-1,s); O+=width/s; n_out++; }
+        st.next=1;
+    }
+    for( i=st.next; i<w0; i++ )
+    {
+        int il=(i<=r) ? r-i : i-1-r, ir=(i>height-r) ? 2*height-r-i : i-1+r;
+        if( ir>=available ) break;
+        kernels.convTriStep( T, U, ROW(il), ROW(i-1), ROW(ir), nrm, width );
+        st.k++; if(st.k==s) { st.k=0; convTriY(U,O,width,r-1,s); O+=width/s; n_out++; }
     }
-    alFree(T);
+#undef ROW
+    st.next=i;
+    return n_out;
 }
 
-
-
-
-
-
-
+void convTri_sse( const float *I, float *O, int width, int height, int r,int d , int s) 
+{
+    convTriState st;
+    convTriStart( st, width, height, r, s );
+    while( d-->0)
+    {
+        st.next=0;
+        O += convTriRows( st, I, 0, height, height, O )*(width/s);
+        I+=width*height;
+    }
+    convTriEnd( st );
+}
@@ -2,6 +2,7 @@
 #define SSEFUN_h
 #include <math.h>
 #include "sse.hpp"
+#include "sseKernels.h"
 
 #define PI 3.14159265358979323846264338
 
@@ -24,6 +25,25 @@ void gradHist( const float *Mag,	// in : magnitude, size width x height
 
 
 
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  gradHistRows
+ *  Description:  gradHist of rows [row_begin, row_end) for channel features ( softBin=0 ),
+ *                called strip by strip in row order it gives the same result as gradHist
+ * =====================================================================================
+ */
+void gradHistRows( const float *Mag,	// in : magnitude of row row_begin, rows are width apart
+				   const float *Ori,	// in : orientation of row row_begin, same layout as Mag
+				   float *gHist,		// in&out : gradHist of the whole image, see gradHist
+				   int height,			// in : height of the whole image
+				   int width,			// in : width
+				   int row_begin,		// in : first row
+				   int row_end,			// in : last row + 1
+				   int binSize,			// in : size of spatial bin
+				   int nOrients,		// in : number of orientation
+				   bool full=false);	// in : true -> 0-2pi, false -> 0-pi
+
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  conTri1Y
@@ -37,6 +57,23 @@ void convTri1Y( const float *InputData,		// in : input data
 				int s=1);					// in : resample factor, only 1 or 2 is supported
 
 
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  conTri1Row
+ *  Description:  convolve one row by a [1 p 1] filter, Il and Ir are the rows above and
+ *                below ( Im itself on the border ) (uses SSE)
+ * =====================================================================================
+ */
+void convTri1Row( const float *Il,			// in : row above
+				  const float *Im,			// in : row
+				  const float *Ir,			// in : row below
+				  float *T,					// in : buffer, width floats, 16 bytes aligned
+				  float *OutputData,		// out: output row
+				  int width,				// in : the width of the image
+				  float p,					// in :
+				  int s=1);					// in : resample factor, only 1 or 2 is supported
+
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  conTri1
@@ -83,6 +120,48 @@ void convTri_sse( const float *InputData,       // in : input image's header
 
 
 
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  convTriRows
+ *  Description:  convTri_sse for one channel, row by row. The vertical running sums are
+ *                kept in convTriState, so the input rows can be given strip by strip in
+ *                order; the result is the same as convTri_sse
+ *                convTriStart -> convTriRows ... convTriRows -> convTriEnd, the buffers are
+ *                taken from threadScratch(), on the thread calling convTriStart
+ * =====================================================================================
+ */
+struct convTriState
+{
+    float *T;                   // running sums
+    float *U;
+    float nrm;                  // 1/(r+1)^4
+    int width, height;          // size of the image
+    int r;                      // radius + 1
+    int s;                      // resample factor
+    int k;                      // resample counter
+    int h1;                     // padded width
+    int next;                   // next row of the loop, 0 -> not initialized
+    size_t arena_mark;          // threadScratch() mark before T and U were taken
+};
+
+void convTriStart( convTriState &st,            // out: state
+                   int width,                   // in : width of the image
+                   int height,                  // in : height of the image
+                   int r,                       // in : radius of the smooth kernel
+                   int s=1 );                   // in : resample factor, only 1 or 2 is supported
+
+int convTriRows( convTriState &st,              // in&out : state
+                 const float *InputData,        // in : input row "first", rows are width apart
+                 int first,                     // in : first input row available
+                 int available,                 // in : last input row available + 1
+                 int end,                       // in : stop before output row end
+                 float *OutputData );           // out: output rows
+                                                // return: number of output rows written, stops when an input row is missing
+
+void convTriEnd( convTriState &st );            // in : state to release, gives back everything taken from threadScratch()
+                                                //      since convTriStart, end the states in reverse order or together
+
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  grad1
@@ -120,6 +199,25 @@ void gradMag( const float *InputData,   // in : input image data,  width x heigh
                                         //      the Mag and Ori will be the biggest one among all channels
               bool full );              // in : true for 0-2pi, false for 0-pi
 
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  gradMagRow
+ *  Description:  gradMag of row x, rows x-1 and x+1 have to be width apart from the row
+ * =====================================================================================
+ */
+void gradMagRow( const float *InputData,    // in : row x of the first channel
+                 int plane,                 // in : distance between two channels, in elements
+                 float *Mag,                //out : magnitude of row x
+                 float *Ori,                //out : orientation of row x, can be 0
+                 int height,                // in : height of the image
+                 int width,                 // in : width of the image
+                 int dim,                   // in : dim of the image
+                 int x,                     // in : index of row
+                 bool full,                 // in : true for 0-2pi, false for 0-pi
+                 float *M2,                 // in : buffer, dim*GRADMAG_ROW_STRIDE(width) floats
+                 float *Gx,                 // in : buffer, same size
+                 float *Gy );               // in : buffer, same size
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  gradMaggradMagNorm
@@ -224,10 +322,16 @@ template<class iT, class oT> void rgb2luv( const iT *InputData,     //in : input
 }
 
 
+/* rgb2luv_sse kernel for each input type, see sseKernelTable */
+inline void rgb2luvKernel( const unsigned char *I, float *J, int n, const luvConstants &c ) { sseKernels().rgb2luv_u8( I, J, n, c ); }
+inline void rgb2luvKernel( const float *I, float *J, int n, const luvConstants &c ) { sseKernels().rgb2luv_f32( I, J, n, c ); }
+inline void rgb2luvKernel( const double *I, float *J, int n, const luvConstants &c ) { sseKernels().rgb2luv_f64( I, J, n, c ); }
+
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  rgb2luv_sse
- *  Description:  Convert from rgb to luv using sse
+ *  Description:  Convert from rgb to luv using sse, with the kernels of sseKernels()
  * =====================================================================================
  */
 template<class iT> void rgb2luv_sse( const iT *I,   // in : input_image's header
@@ -235,70 +339,13 @@ template<class iT> void rgb2luv_sse( const iT *I,   // in : input_image's header
                                      int n,         // in : number of the elements
                                      float nrm )    // in : normlized value( scale factor )
 {
-    const int k=256; float R[k], G[k], B[k];
-    if( (size_t(R)&15||size_t(G)&15||size_t(B)&15||size_t(I)&15||size_t(J)&15)
-            || n%4>0 )
+    if( (size_t(I)&15||size_t(J)&15) || n%4>0 )
     {
         rgb2luv(I,J,n,nrm); return;
     }                      // data not align
-    int i=0, i1, n1; float minu, minv, un, vn, mr[3], mg[3], mb[3];
-    float *lTable = rgb2luv_setup(nrm,mr,mg,mb,minu,minv,un,vn);
-    while( i<n )
-    {
-        n1 = i+k; if(n1>n) n1=n; float *J1=J+i; float *R1, *G1, *B1;
-        /* ------------ RGB is now RRRRRGGGGGBBBBB ----------*/
-        // convert to floats (and load input into cache)
-        R1=R; G1=G; B1=B;
-        const iT *Bi=I+i*3, *Gi=Bi+1, *Ri=Bi+2;
-        for( i1=0; i1<(n1-i); i1++ )
-        {
-            R1[i1] = (float) (*Ri);Ri = Ri+3;
-            G1[i1] = (float) (*Gi);Gi = Gi+3;
-            B1[i1] = (float) (*Bi);Bi = Bi+3;
-        }
-        /* ------------ RGB is now RRRRRGGGGGBBBBB ----------*/
-        // compute RGB -> XYZ
-        for( int j=0; j<3; j++ )
-        {
-            __m128 _mr, _mg, _mb, *_J=(__m128*) (J1+j*n);
-            __m128 *_R=(__m128*) R1, *_G=(__m128*) G1, *_B=(__m128*) B1;
-            _mr=SET(mr[j]); _mg=SET(mg[j]); _mb=SET(mb[j]);
-            for( i1=i; i1<n1; i1+=4 )
-            {
-                *(_J++) = ADD( ADD(MUL(*(_R++),_mr),MUL(*(_G++),_mg)),MUL(*(_B++),_mb));
-            }
-        }
-        /* ---------------XXXXXXXYYYYYYYZZZZZZZZ now --------------- */
-
-        { // compute XZY -> LUV (without doing L lookup/normalization)
-            __m128 _c15, _c3, _cEps, _c52, _c117, _c1024, _cun, _cvn;
-            _c15=SET(15.0f); _c3=SET(3.0f); _cEps=SET(1e-35f);
-            _c52=SET(52.0f); _c117=SET(117.0f), _c1024=SET(1024.0f);
-            _cun=SET(13*un); _cvn=SET(13*vn);
-            __m128 *_X, *_Y, *_Z, _x, _y, _z;
-            _X=(__m128*) J1; _Y=(__m128*) (J1+n); _Z=(__m128*) (J1+2*n);
-            for( i1=i; i1<n1; i1+=4 )
-            {
-                _x = *_X; _y=*_Y; _z=*_Z;
-                _z = RCP(ADD(_x,ADD(_cEps,ADD(MUL(_c15,_y),MUL(_c3,_z)))));
-                *(_X++) = MUL(_c1024,_y);
-                *(_Y++) = SUB(MUL(MUL(_c52,_x),_z),_cun);
-                *(_Z++) = SUB(MUL(MUL(_c117,_y),_z),_cvn);
-            }
-        }
-        { // perform lookup for L and finalize computation of U and V
-            for( i1=i; i1<n1; i1++ ) J[i1] = lTable[(int)J[i1]];
-            __m128 *_L, *_U, *_V, _l, _cminu, _cminv;
-            _L=(__m128*) J1; _U=(__m128*) (J1+n); _V=(__m128*) (J1+2*n);
-            _cminu=SET(minu); _cminv=SET(minv);
-            for( i1=i; i1<n1; i1+=4 ) {
-                _l = *(_L++);
-                *_U = SUB(MUL(_l,*_U),_cminu); _U++;
-                *_V = SUB(MUL(_l,*_V),_cminv); _V++;
-            }
-        }
-        i = n1;
-    }
+    luvConstants c;
+    c.lTable = rgb2luv_setup(nrm,c.mr,c.mg,c.mb,c.minu,c.minv,c.un,c.vn);
+    rgb2luvKernel( I, J, n, c );
 }
 
 
@@ -0,0 +1,34 @@
+#include <algorithm>
+#include "sseKernels.h"
+#include "../misc/misc.hpp"
+
+/* kernels chosen by setSseSimdLevel, 0 -> the default ones */
+static const sseKernelTable *s_kernels = 0;
+
+const sseKernelTable& sseKernelsFor( int simd_level )
+{
+    if( simd_level >= SIMD_AVX512 )
+        return sseKernels_avx512();
+    if( simd_level >= SIMD_AVX2 )
+        return sseKernels_avx2();
+    return sseKernels_sse2();
+}
+
+/* the widest bit exact kernels of the cpu, the local static is initialized once even if the first calls
+ * come from several threads ( guarded by the compiler ) */
+static const sseKernelTable& defaultKernels()
+{
+    static const sseKernelTable &kernels = sseKernelsFor( std::min( getCpuSimdLevel(), (int)SIMD_AVX2 ));
+    return kernels;
+}
+
+const sseKernelTable& sseKernels()
+{
+    const sseKernelTable *selected = s_kernels;
+    return selected ? *selected : defaultKernels();
+}
+
+void setSseSimdLevel( int simd_level )
+{
+    s_kernels = &sseKernelsFor( std::min( simd_level, getCpuSimdLevel() ));
+}
@@ -0,0 +1,74 @@
+#ifndef SSE_KERNELS_H
+#define SSE_KERNELS_H
+
+/* the hot loops of sseFun, compiled once for each simd width : sseKernels_sse2.cpp, sseKernels_avx2.cpp
+ * ( -mavx2 ) and sseKernels_avx512.cpp ( -mavx512f ). Kept free of inline functions ( sse.hpp, opencv,
+ * std templates ), an inline function shared with the other translation units could be taken from the
+ * avx build and run on a cpu without avx.
+ * sse2 and avx2 give the same results bit by bit, avx512 uses the more precise rcp14/rsqrt14, so the
+ * luv conversion, the gradient magnitude and its normalization differ in the last bits ( the orientation
+ * can move by one step of the acos table ) */
+
+/* rows of the gradMagRow buffers ( M2, Gx, Gy ) are padded to a multiple of this, enough for any width */
+#define GRADMAG_ROW_PAD 16
+
+/* constants of the rgb -> luv conversion, see rgb2luv_setup */
+struct luvConstants
+{
+    float mr[3], mg[3], mb[3];
+    float minu, minv, un, vn;
+    const float *lTable;
+};
+
+struct sseKernelTable
+{
+    int simd_level;                 /* SIMD_SSE2, SIMD_AVX2 or SIMD_AVX512 */
+    const char *name;
+    int width;                      /* floats in one register */
+
+    /* see gradMagRow in sseFun.h, buffers are dim*GRADMAG_ROW_STRIDE(w) floats */
+    void (*gradMagRow)( const float *I, int plane, float *M, float *O, int h, int w, int d, int x, bool full,
+                        float *M2, float *Gx, float *Gy );
+    /* see gradMagNorm */
+    void (*gradMagNorm)( float *M, const float *S, int h, int w, float norm );
+    /* see gradQuantize */
+    void (*gradQuantize)( const float *O, const float *M, int *O0, int *O1, float *M0, float *M1,
+                          int nb, int n, float norm, int nOrients, bool full, bool interpolate );
+    /* see convTri1Row */
+    void (*convTri1Row)( const float *Il, const float *Im, const float *Ir, float *T, float *O, int w, float p, int s );
+    /* vertical running sums of convTriRows : T = U = row0 | T += row, U += T | U = nrm*(2U - T), T = 0 |
+     * T += Il + Ir - 2Im, U += nrm*T */
+    void (*convTriInit)( float *T, float *U, const float *row, int width );
+    void (*convTriAccumulate)( float *T, float *U, const float *row, int width );
+    void (*convTriFinishInit)( float *T, float *U, float nrm, int width );
+    void (*convTriStep)( float *T, float *U, const float *Il, const float *Im, const float *Ir, float nrm, int width );
+    /* see rgb2luv_sse, n%4 == 0 and 16 bytes aligned I, J */
+    void (*rgb2luv_u8)( const unsigned char *I, float *J, int n, const luvConstants &c );
+    void (*rgb2luv_f32)( const float *I, float *J, int n, const luvConstants &c );
+    void (*rgb2luv_f64)( const double *I, float *J, int n, const luvConstants &c );
+};
+
+/* kernels of each width */
+const sseKernelTable& sseKernels_sse2();
+const sseKernelTable& sseKernels_avx2();
+const sseKernelTable& sseKernels_avx512();
+
+/* kernels for a simd level, SIMD_NONE and SIMD_SSE2 -> sse2, SIMD_AVX2 -> avx2, SIMD_AVX512 -> avx512 */
+const sseKernelTable& sseKernelsFor( int simd_level );
+
+/* kernels used by sseFun. Unless set, the widest bit exact ones supported by the cpu : avx2 at most,
+ * avx512 has to be asked for with setSseSimdLevel */
+const sseKernelTable& sseKernels();
+
+/* select the kernels used by sseFun, capped to the cpu. SIMD_AVX512 turns on the avx512 kernels,
+ * call it before the threads computing channels start */
+void setSseSimdLevel( int simd_level );
+
+/* floats per row of the gradMagRow buffers */
+#define GRADMAG_ROW_STRIDE(width) ( ( (width) + GRADMAG_ROW_PAD - 1 )/GRADMAG_ROW_PAD*GRADMAG_ROW_PAD )
+
+/* defined in sseFun.cpp, used by the kernels */
+float* acosTable();
+void convTri1Y( const float *InputData, float *OutputData, int width, float p, int s );
+
+#endif
@@ -0,0 +1,9 @@
+/* this file is compiled with -mavx2, only call it after checking the cpu ( getCpuSimdLevel ) */
+#define SIMD_KERNEL_NS kernels_avx2
+#include "sseKernels_impl.hpp"
+
+const sseKernelTable& sseKernels_avx2()
+{
+    static const sseKernelTable table = SSE_KERNEL_TABLE( 2 /* SIMD_AVX2 */, "avx2" );
+    return table;
+}
@@ -0,0 +1,10 @@
+/* this file is compiled with -mavx512f -ffp-contract=off ( no fused multiply add, same rounding as the other
+ * widths ), only call it after checking the cpu ( getCpuSimdLevel ) */
+#define SIMD_KERNEL_NS kernels_avx512
+#include "sseKernels_impl.hpp"
+
+const sseKernelTable& sseKernels_avx512()
+{
+    static const sseKernelTable table = SSE_KERNEL_TABLE( 3 /* SIMD_AVX512 */, "avx512" );
+    return table;
+}
@@ -0,0 +1,271 @@
+#ifndef SSE_KERNELS_IMPL_HPP
+#define SSE_KERNELS_IMPL_HPP
+
+/* kernels of sseKernelTable written once for the vectors of simdVec.hpp, included by sseKernels_sse2.cpp,
+ * sseKernels_avx2.cpp and sseKernels_avx512.cpp. The operations are done in the same order as the
+ * original sse code, the elements left after the vectors use the same operations one by one */
+
+#include <string.h>
+#include <stddef.h>
+#include "sseKernels.h"
+#include "simdVec.hpp"
+
+namespace SIMD_KERNEL_NS {
+
+static const float k_pi = 3.14159265358979323846f;
+
+// compute x and y gradients for just one row, the padding of the buffers is set to 0
+static void grad1( const float *I, float *Gx, float *Gy, int h, int w, int w_pad, int x )
+{
+    int y;
+    const float *Ip=I-w, *In=I+w; float r=.5f;
+    if(x==0) { r=1; Ip+=w; } else if(x==h-1) { r=1; In-=w; }      //on the border
+    const V::f _r=V::set(r), _half=V::set(.5f);
+    for( y=0; y+V::W<=w; y+=V::W ) V::store( Gy+y, V::mul( V::sub( V::load(In+y), V::load(Ip+y) ), _r ));
+    for( ; y<w; y++ ) Gy[y]=(In[y]-Ip[y])*r;
+
+    // Gx, one sided on the left and right border
+    Gx[0]=(I[1]-I[0])*1;
+    for( y=1; y+V::W<=w-1; y+=V::W ) V::store( Gx+y, V::mul( V::sub( V::load(I+y+1), V::load(I+y-1) ), _half ));
+    for( ; y<w-1; y++ ) Gx[y]=(I[y+1]-I[y-1])*.5f;
+    Gx[w-1]=(I[w-1]-I[w-2])*1;
+
+    for( y=w; y<w_pad; y++ ) Gx[y]=Gy[y]=0;
+}
+
+static void gradMagRow( const float *I, int plane, float *M, float *O, int h, int w, int d, int x, bool full,
+                        float *M2, float *Gx, float *Gy )
+{
+    const int ws=GRADMAG_ROW_STRIDE(w);
+    const float *acost=acosTable(), acMult=10000.0f;
+    int y, c;
+
+    // compute gradients (Gx, Gy) with maximum squared magnitude (M2)
+    for( c=0; c<d; c++ )          // compute for each channel, take the max value
+    {
+        grad1( I+c*plane, Gx+c*ws, Gy+c*ws, h, w, ws, x );
+        for( y=0; y<ws; y+=V::W )
+        {
+            const int y1=c*ws+y;
+            V::f _gx=V::load(Gx+y1), _gy=V::load(Gy+y1);
+            V::f _m2=V::add( V::mul(_gx,_gx), V::mul(_gy,_gy) );
+            if( c==0 ) { V::store( M2+y, _m2 ); continue; }
+            V::f _m=V::cmpgt( _m2, V::load(M2+y) );
+            V::store( M2+y, V::or_( V::and_(_m,_m2), V::andnot(_m,V::load(M2+y)) ));
+            V::store( Gx+y, V::or_( V::and_(_m,_gx), V::andnot(_m,V::load(Gx+y)) ));
+            V::store( Gy+y, V::or_( V::and_(_m,_gy), V::andnot(_m,V::load(Gy+y)) ));
+        }
+    }
+    // compute gradient mangitude (M) and normalize Gx // avoid the exception when arctan(Gy/Gx)
+    const V::f _big=V::set(1e10f), _acMult=V::set(acMult), _sign=V::set(-0.f);
+    for( y=0; y<ws; y+=V::W )
+    {
+        V::f _m=V::min( V::rsqrt( V::load(M2+y) ), _big );
+        V::store( M2+y, V::rcp(_m) );
+        if( O )
+        {
+            V::f _gx=V::mul( V::mul( V::load(Gx+y), _m ), _acMult );
+            V::store( Gx+y, V::xor_( _gx, V::and_( V::load(Gy+y), _sign )));
+        }
+    }
+    memcpy( M, M2, w*sizeof(float) );
+    // compute and store gradient orientation (O) via table lookup
+    if( O!=0 ) for( y=0; y<w; y++ ) O[y]=acost[(int)Gx[y]];
+    if( O!=0 && full )
+    {
+        const V::f _zero=V::zero(), _pi=V::set(k_pi);
+        for( y=0; y+V::W<=w; y+=V::W ) V::store( O+y, V::add( V::load(O+y), V::and_( V::cmplt( V::load(Gy+y), _zero ), _pi )));
+        for( ; y<w; y++ ) O[y]+=(Gy[y]<0)*k_pi;
+    }
+}
+
+// normalize gradient magnitude at each location
+static void gradMagNorm( float *M, const float *S, int h, int w, float norm )
+{
+    int i=0, n=h*w, n4=n/4*4;
+    bool sse=!(size_t(M)&15) && !(size_t(S)&15);
+    if( sse )
+    {
+        const V::f _norm=V::set(norm);
+        for( ; i+V::W<=n4; i+=V::W ) V::store( M+i, V::mul( V::load(M+i), V::rcp( V::add( V::load(S+i), _norm ))));
+        for( ; i<n4; i++ ) M[i]=M[i]*V::rcp1( S[i]+norm );
+    }
+    for( ; i<n; i++ ) M[i]/=(S[i]+norm);
+}
+
+// helper for gradHist, quantize O and M into O0, O1 and M0, M1
+static void gradQuantize( const float *O, const float *M, int *O0, int *O1, float *M0, float *M1,
+                          int nb, int n, float norm, int nOrients, bool full, bool interpolate )
+{
+    int i=0, o0, o1; float o, od, m;
+    const float oMult=(float)nOrients/(full?2*k_pi:k_pi); const int oMax=nOrients*nb;
+    const V::f _norm=V::set(norm), _oMult=V::set(oMult), _nbf=V::set((float)nb);
+    const V::i _oMax=V::seti(oMax), _nb=V::seti(nb);
+    if( interpolate ) for( ; i<=n-V::W; i+=V::W ) {
+        V::f _o=V::mul( V::load(O+i), _oMult ); V::i _o0=V::cvtt(_o); V::f _od=V::sub( _o, V::cvt(_o0) );
+        _o0=V::cvtt( V::mul( V::cvt(_o0), _nbf )); _o0=V::andi( V::cmpgti(_oMax,_o0), _o0 ); V::storei( O0+i, _o0 );
+        V::i _o1=V::addi( _o0, _nb ); _o1=V::andi( V::cmpgti(_oMax,_o1), _o1 ); V::storei( O1+i, _o1 );
+        V::f _m=V::mul( V::load(M+i), _norm ), _m1=V::mul( _od, _m ); V::store( M1+i, _m1 ); V::store( M0+i, V::sub( _m, _m1 ));
+    } else for( ; i<=n-V::W; i+=V::W ) {
+        V::f _o=V::mul( V::load(O+i), _oMult ); V::i _o0=V::cvtt( V::add( _o, V::set(.5f) ));
+        _o0=V::cvtt( V::mul( V::cvt(_o0), _nbf )); _o0=V::andi( V::cmpgti(_oMax,_o0), _o0 ); V::storei( O0+i, _o0 );
+        V::store( M0+i, V::mul( V::load(M+i), _norm )); V::store( M1+i, V::zero() ); V::storei( O1+i, V::seti(0) );
+    }
+    // compute trailing locations without simd
+    if( interpolate ) for(; i<n; i++ ) {
+        o=O[i]*oMult; o0=(int) o; od=o-o0;
+        o0*=nb; if(o0>=oMax) o0=0; O0[i]=o0;
+        o1=o0+nb; if(o1==oMax) o1=0; O1[i]=o1;
+        m=M[i]*norm; M1[i]=od*m; M0[i]=m-M1[i];
+    } else for(; i<n; i++ ) {
+        o=O[i]*oMult; o0=(int) (o+.5f);
+        o0*=nb; if(o0>=oMax) o0=0; O0[i]=o0;
+        M0[i]=M[i]*norm; M1[i]=0; O1[i]=0;
+    }
+}
+
+// convolve one row of I by a [1 p 1] filter, no resampling
+static void convTri1Y( const float *I, float *O, int w, float p )
+{
+    int j=0;
+    const V::f _p=V::set(p);
+    O[j]=(1+p)*I[j]+I[j+1]; j++;
+    for( ; j+V::W<=w-1; j+=V::W ) V::store( O+j, V::add( V::add( V::load(I+j-1), V::mul( _p, V::load(I+j) )), V::load(I+j+1) ));
+    for( ; j<w-1; j++ ) O[j]=I[j-1]+p*I[j]+I[j+1];
+    O[j]=I[j-1]+(1+p)*I[j];
+}
+
+// convolve one row by a [1 p 1] filter, given the row above and below
+static void convTri1Row( const float *Il, const float *Im, const float *Ir, float *T, float *O, int w, float p, int s )
+{
+    const float nrm=1.0f/((p+2)*(p+2)); int j=0;
+    const V::f _nrm=V::set(nrm), _p=V::set(p);
+    for( ; j+V::W<=w; j+=V::W )
+        V::store( T+j, V::mul( _nrm, V::add( V::add( V::load(Il+j), V::mul( _p, V::load(Im+j) )), V::load(Ir+j) )));
+    for( ; j<w; j++ ) T[j]=nrm*(Il[j]+p*Im[j]+Ir[j]);
+    if( s==1 )
+        convTri1Y( T, O, w, p );
+    else
+        ::convTri1Y( T, O, w, p, s );
+}
+
+// vertical running sums of the triangle filter, see convTriRows
+static void convTriInit( float *T, float *U, const float *row, int width )
+{
+    int j=0;
+    for( ; j+V::W<=width; j+=V::W ) { V::f _r=V::load(row+j); V::store( T+j, _r ); V::store( U+j, _r ); }
+    for( ; j<width; j++ ) U[j]=T[j]=row[j];
+}
+
+static void convTriAccumulate( float *T, float *U, const float *row, int width )
+{
+    int j=0;
+    for( ; j+V::W<=width; j+=V::W )
+    {
+        V::f _t=V::add( V::load(T+j), V::load(row+j) );
+        V::store( T+j, _t ); V::store( U+j, V::add( V::load(U+j), _t ));
+    }
+    for( ; j<width; j++ ) U[j]+=T[j]+=row[j];
+}
+
+static void convTriFinishInit( float *T, float *U, float nrm, int width )
+{
+    int j=0;
+    const V::f _nrm=V::set(nrm), _two=V::set(2);
+    for( ; j+V::W<=width; j+=V::W )
+    {
+        V::store( U+j, V::mul( _nrm, V::sub( V::mul( _two, V::load(U+j) ), V::load(T+j) )));
+        V::store( T+j, V::zero() );
+    }
+    for( ; j<width; j++ ) { U[j]=nrm*(2*U[j]-T[j]); T[j]=0; }
+}
+
+static void convTriStep( float *T, float *U, const float *Il, const float *Im, const float *Ir, float nrm, int width )
+{
+    int j=0;
+    const V::f _nrm=V::set(nrm), _m2=V::set(-2);
+    for( ; j+V::W<=width; j+=V::W )
+    {
+        V::f _t=V::add( V::load(T+j), V::add( V::add( V::load(Il+j), V::load(Ir+j) ), V::mul( _m2, V::load(Im+j) )));
+        V::store( T+j, _t ); V::store( U+j, V::add( V::load(U+j), V::mul( _nrm, _t )));
+    }
+    for( ; j<width; j++ ) U[j]+=nrm*(T[j]+=Il[j]+Ir[j]-2*Im[j]);
+}
+
+// convert from rgb ( opencv order B,G,R ) to luv, planes of J are n apart
+template<class iT> static void rgb2luv( const iT *I, float *J, int n, const luvConstants &c )
+{
+    const int k=256; float R[k], G[k], B[k];
+    int i=0, i1, n1;
+    const V::f _c15=V::set(15.0f), _c3=V::set(3.0f), _cEps=V::set(1e-35f), _c52=V::set(52.0f), _c117=V::set(117.0f),
+               _c1024=V::set(1024.0f), _cun=V::set(13*c.un), _cvn=V::set(13*c.vn), _cminu=V::set(c.minu), _cminv=V::set(c.minv);
+    while( i<n )
+    {
+        n1=i+k; if(n1>n) n1=n; const int len=n1-i; float *J1=J+i;
+        /* ------------ RGB is now RRRRRGGGGGBBBBB ----------*/
+        const iT *Bi=I+i*3, *Gi=Bi+1, *Ri=Bi+2;
+        for( i1=0; i1<len; i1++ )
+        {
+            R[i1]=(float) (*Ri); Ri=Ri+3;
+            G[i1]=(float) (*Gi); Gi=Gi+3;
+            B[i1]=(float) (*Bi); Bi=Bi+3;
+        }
+        // compute RGB -> XYZ
+        for( int j=0; j<3; j++ )
+        {
+            float *Jj=J1+j*n;
+            const V::f _mr=V::set(c.mr[j]), _mg=V::set(c.mg[j]), _mb=V::set(c.mb[j]);
+            for( i1=0; i1+V::W<=len; i1+=V::W )
+                V::store( Jj+i1, V::add( V::add( V::mul( V::load(R+i1), _mr ), V::mul( V::load(G+i1), _mg )), V::mul( V::load(B+i1), _mb )));
+            for( ; i1<len; i1++ )
+                Jj[i1]=(R[i1]*c.mr[j]+G[i1]*c.mg[j])+B[i1]*c.mb[j];
+        }
+        /* ---------------XXXXXXXYYYYYYYZZZZZZZZ now --------------- */
+        { // compute XZY -> LUV (without doing L lookup/normalization)
+            float *X=J1, *Y=J1+n, *Z=J1+2*n;
+            for( i1=0; i1+V::W<=len; i1+=V::W )
+            {
+                V::f _x=V::load(X+i1), _y=V::load(Y+i1), _z=V::load(Z+i1);
+                _z=V::rcp( V::add( _x, V::add( _cEps, V::add( V::mul(_c15,_y), V::mul(_c3,_z) ))));
+                V::store( X+i1, V::mul(_c1024,_y) );
+                V::store( Y+i1, V::sub( V::mul( V::mul(_c52,_x), _z ), _cun ));
+                V::store( Z+i1, V::sub( V::mul( V::mul(_c117,_y), _z ), _cvn ));
+            }
+            for( ; i1<len; i1++ )
+            {
+                float x=X[i1], y=Y[i1], z=Z[i1];
+                z=V::rcp1( x+(1e-35f+(15.0f*y+3.0f*z)) );
+                X[i1]=1024.0f*y;
+                Y[i1]=(52.0f*x)*z-13*c.un;
+                Z[i1]=(117.0f*y)*z-13*c.vn;
+            }
+        }
+        { // perform lookup for L and finalize computation of U and V
+            for( i1=i; i1<n1; i1++ ) J[i1]=c.lTable[(int)J[i1]];
+            float *L=J1, *U=J1+n, *Vc=J1+2*n;
+            for( i1=0; i1+V::W<=len; i1+=V::W )
+            {
+                V::f _l=V::load(L+i1);
+                V::store( U+i1, V::sub( V::mul( _l, V::load(U+i1) ), _cminu ));
+                V::store( Vc+i1, V::sub( V::mul( _l, V::load(Vc+i1) ), _cminv ));
+            }
+            for( ; i1<len; i1++ ) { U[i1]=L[i1]*U[i1]-c.minu; Vc[i1]=L[i1]*Vc[i1]-c.minv; }
+        }
+        i=n1;
+    }
+}
+
+static void rgb2luv_u8( const unsigned char *I, float *J, int n, const luvConstants &c ) { rgb2luv( I, J, n, c ); }
+static void rgb2luv_f32( const float *I, float *J, int n, const luvConstants &c ) { rgb2luv( I, J, n, c ); }
+static void rgb2luv_f64( const double *I, float *J, int n, const luvConstants &c ) { rgb2luv( I, J, n, c ); }
+
+} // namespace SIMD_KERNEL_NS
+
+/* table of the kernels of this translation unit */
+#define SSE_KERNEL_TABLE( level, name ) { level, name, SIMD_KERNEL_NS::V::W,                         \
+    SIMD_KERNEL_NS::gradMagRow, SIMD_KERNEL_NS::gradMagNorm, SIMD_KERNEL_NS::gradQuantize,          \
+    SIMD_KERNEL_NS::convTri1Row, SIMD_KERNEL_NS::convTriInit, SIMD_KERNEL_NS::convTriAccumulate,    \
+    SIMD_KERNEL_NS::convTriFinishInit, SIMD_KERNEL_NS::convTriStep,                                 \
+    SIMD_KERNEL_NS::rgb2luv_u8, SIMD_KERNEL_NS::rgb2luv_f32, SIMD_KERNEL_NS::rgb2luv_f64 }
+
+#endif
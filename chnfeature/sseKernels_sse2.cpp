@@ -0,0 +1,8 @@
+#define SIMD_KERNEL_NS kernels_sse2
+#include "sseKernels_impl.hpp"
+
+const sseKernelTable& sseKernels_sse2()
+{
+    static const sseKernelTable table = SSE_KERNEL_TABLE( 1 /* SIMD_SSE2 */, "sse2" );
+    return table;
+}
@@ -41,6 +41,14 @@ void SortIdx(std::vector<T> &vals, std::vector<int> &idx)
 
 void NonMaxSupress(std::vector<cv::Rect> &boxes, std::vector<double> &scores,
                    double overlap_threshold , int type)
+{
+    std::vector<int> kept;
+    NonMaxSupress( boxes, scores, kept, overlap_threshold, type );
+}
+
+void NonMaxSupress(std::vector<cv::Rect> &boxes, std::vector<double> &scores,
+                   std::vector<int> &kept,
+                   double overlap_threshold , int type)
 {
     assert( boxes.size() == scores.size() );
     assert( overlap_threshold > 0.0 && overlap_threshold < 1.0 );
@@ -55,6 +63,7 @@ void NonMaxSupress(std::vector<cv::Rect> &boxes, std::vector<double> &scores,
     std::vector<double> areas;
     std::vector<bool> supress;  // supress[i] set to TRUE is boxes[i] is supressed
     cv::Rect rect1, rect2;
+    kept.clear();
 
     // sort with indice
     SortIdx(scores, idx);
@@ -79,6 +88,7 @@ void NonMaxSupress(std::vector<cv::Rect> &boxes, std::vector<double> &scores,
         {
             resBoxes.push_back( rect1 );
             resScores.push_back( scores[idx1]);
+            kept.push_back( idx1 );
         }
 
         for (int j = i-1; j>=0; j--)
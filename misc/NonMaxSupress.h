@@ -26,4 +26,12 @@
 void NonMaxSupress(std::vector<cv::Rect> &boxes, std::vector<double> &scores,
                    double overlap_threshold = 0.65, int type=NMS_MAXG|NMS_MIN);
 
+/*
+ * same as above, kept[i] is the index in the input boxes of the i-th output box,
+ * for the data that follows the boxes
+ */
+void NonMaxSupress(std::vector<cv::Rect> &boxes, std::vector<double> &scores,
+                   std::vector<int> &kept,
+                   double overlap_threshold = 0.65, int type=NMS_MAXG|NMS_MIN);
+
 #endif // NONMAXSUPRESS_H
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <algorithm>
+#include "opencv2/highgui/highgui.hpp"
+#include "asyncWriter.h"
+
+asyncWriter::asyncWriter( int max_queued )         /* in : images kept in memory at most */
+{
+    m_max_queued = std::max( 1, max_queued );
+    m_done = false;
+    m_finished = false;
+    m_failed = 0;
+    pthread_mutex_init( &m_mutex, 0 );
+    pthread_cond_init( &m_cond, 0 );
+    pthread_cond_init( &m_room, 0 );
+    m_running = ( pthread_create( &m_thread, 0, asyncWriter::run, this ) == 0 );
+    if( !m_running )
+        cout<<"<asyncWriter::asyncWriter><error> can not start the writer thread, images are written by the caller"<<endl;
+}
+
+asyncWriter::~asyncWriter()
+{
+    finish();
+    pthread_cond_destroy( &m_room );
+    pthread_cond_destroy( &m_cond );
+    pthread_mutex_destroy( &m_mutex );
+}
+
+void asyncWriter::write( const string &path,        /* in : path of the image */
+                         const Mat &image )         /* in : image */
+{
+    if( !m_running )
+    {
+        if( !imwrite( path, image ))
+        {
+            pthread_mutex_lock( &m_mutex );
+            m_failed++;
+            pthread_mutex_unlock( &m_mutex );
+        }
+        return;
+    }
+    pthread_mutex_lock( &m_mutex );
+    while( (int)m_queue.size() >= m_max_queued )
+        pthread_cond_wait( &m_room, &m_mutex );
+    m_queue.push_back( make_pair( path, image ));
+    pthread_cond_signal( &m_cond );
+    pthread_mutex_unlock( &m_mutex );
+}
+
+int asyncWriter::finish()
+{
+    if( m_finished )
+        return m_failed;
+    m_finished = true;
+    if( m_running )
+    {
+        pthread_mutex_lock( &m_mutex );
+        m_done = true;
+        pthread_cond_signal( &m_cond );
+        pthread_mutex_unlock( &m_mutex );
+        pthread_join( m_thread, 0 );
+        m_running = false;
+    }
+    if( m_failed > 0 )
+        cout<<"<asyncWriter::finish><error> "<<m_failed<<" images could not be written"<<endl;
+    return m_failed;
+}
+
+void* asyncWriter::run( void *self )
+{
+    asyncWriter *w = (asyncWriter*)self;
+    while( true )
+    {
+        pthread_mutex_lock( &w->m_mutex );
+        while( w->m_queue.empty() && !w->m_done )
+            pthread_cond_wait( &w->m_cond, &w->m_mutex );
+        if( w->m_queue.empty() )        /* done, and nothing left */
+        {
+            pthread_mutex_unlock( &w->m_mutex );
+            return 0;
+        }
+        pair<string, Mat> item = w->m_queue.front();
+        w->m_queue.pop_front();
+        pthread_cond_signal( &w->m_room );
+        pthread_mutex_unlock( &w->m_mutex );
+
+        if( !imwrite( item.first, item.second ))
+        {
+            pthread_mutex_lock( &w->m_mutex );
+            w->m_failed++;
+            pthread_mutex_unlock( &w->m_mutex );
+        }
+    }
+}
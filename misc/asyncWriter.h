@@ -0,0 +1,59 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <string>
+#include <deque>
+#include <pthread.h>
+#include "opencv2/core/core.hpp"
+
+using namespace std;
+using namespace cv;
+
+/* writes images to disk on its own thread, so that the threads which detect do not wait for the
+ * disk unless max_queued images are already waiting. The images are written in the order they are
+ * given. Not copyable */
+class asyncWriter
+{
+    public:
+        asyncWriter( int max_queued = 64 );     /* in : images kept in memory at most */
+        ~asyncWriter();                         /* waits for the images left, same as finish */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  write
+         *  Description:  queue the image to be saved with imwrite, can be called from any
+         *                thread, blocks while the queue is full. The Mat is shared with the
+         *                caller, do not change its pixels afterwards ( cropImage gives a new one )
+         * =====================================================================================
+         */
+        void write( const string &path,         /* in : path of the image */
+                    const Mat &image );         /* in : image */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  finish
+         *  Description:  wait until all the queued images are written, then stop the thread.
+         *                Return the number of images which could not be written, the next
+         *                calls ( and the destructor ) only return it
+         * =====================================================================================
+         */
+        int finish();
+
+    private:
+        asyncWriter( const asyncWriter & );
+        asyncWriter& operator=( const asyncWriter & );
+
+        static void* run( void *self );         /* writer thread */
+
+        deque< pair<string, Mat> > m_queue;     /* images waiting */
+        pthread_mutex_t m_mutex;
+        pthread_cond_t m_cond;                  /* signaled when an image is queued or finish is called */
+        pthread_cond_t m_room;                  /* signaled when an image is taken from the queue */
+        pthread_t m_thread;
+        int m_max_queued;                       /* size limit of m_queue */
+        bool m_running;                         /* thread started and not joined yet */
+        bool m_done;                            /* no more images will be queued */
+        bool m_finished;                        /* finish was called */
+        int m_failed;                           /* images imwrite could not write */
+};
+#endif
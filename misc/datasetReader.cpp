@@ -0,0 +1,161 @@
+#include <iostream>
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "datasetReader.h"
+
+datasetReader::datasetReader()
+{
+    m_imread_flags = 1;
+    m_queue_size = 16;
+    m_next_decode = 0;
+    m_next_out = 0;
+    m_stop = true;
+    m_open_tick = 0;
+    m_decode_seconds = 0;
+    m_wait_seconds = 0;
+    m_decoded = 0;
+    pthread_mutex_init( &m_mutex, 0 );
+    pthread_cond_init( &m_ready_cond, 0 );
+    pthread_cond_init( &m_room_cond, 0 );
+}
+
+datasetReader::~datasetReader()
+{
+    stop();
+    join();
+    pthread_cond_destroy( &m_room_cond );
+    pthread_cond_destroy( &m_ready_cond );
+    pthread_mutex_destroy( &m_mutex );
+}
+
+bool datasetReader::open( const vector<string> &paths,     /* in : images to read */
+                          int n_workers,                   /* in : number of decode threads */
+                          int queue_size,                  /* in : max number of decoded images waiting */
+                          int imread_flags,                /* in : flags of imread */
+                          const Size &resize_to )          /* in : resize after decoding if not empty */
+{
+    stop();
+    join();
+    if( n_workers < 1 || queue_size < 1 )
+    {
+        cout<<"<datasetReader::open><error> n_workers and queue_size should be positive"<<endl;
+        return false;
+    }
+
+    m_paths = paths;
+    m_imread_flags = imread_flags;
+    m_resize_to = resize_to;
+    m_queue_size = queue_size;
+    m_ready.clear();
+    m_next_decode = 0;
+    m_next_out = 0;
+    m_stop = false;
+    m_open_tick = getTickCount();
+    m_decode_seconds = 0;
+    m_wait_seconds = 0;
+    m_decoded = 0;
+
+    for( int c=0;c<n_workers;c++)
+    {
+        pthread_t t;
+        if( pthread_create( &t, 0, datasetReader::run, this ) != 0 )
+        {
+            cout<<"<datasetReader::open><error> can not start the decode thread "<<c<<endl;
+            break;
+        }
+        m_workers.push_back( t );
+    }
+    if( m_workers.empty() )
+    {
+        m_stop = true;
+        return false;
+    }
+    return true;
+}
+
+bool datasetReader::next( int &index,       /* out: index of the image in paths */
+                          Mat &image )      /* out: decoded image */
+{
+    const int64 t0 = getTickCount();
+    pthread_mutex_lock( &m_mutex );
+    map<int, Mat>::iterator it;
+    while( !m_stop && m_next_out < (int)m_paths.size() && ( it = m_ready.find( m_next_out )) == m_ready.end() )
+        pthread_cond_wait( &m_ready_cond, &m_mutex );
+    bool got = false;
+    if( !m_stop && m_next_out < (int)m_paths.size() )
+    {
+        index = m_next_out++;
+        image = it->second;
+        m_ready.erase( it );
+        pthread_cond_broadcast( &m_room_cond );
+        got = true;
+    }
+    m_wait_seconds += ( getTickCount() - t0 )/getTickFrequency();
+    pthread_mutex_unlock( &m_mutex );
+    return got;
+}
+
+void datasetReader::stop()
+{
+    pthread_mutex_lock( &m_mutex );
+    m_stop = true;
+    m_ready.clear();
+    pthread_cond_broadcast( &m_ready_cond );
+    pthread_cond_broadcast( &m_room_cond );
+    pthread_mutex_unlock( &m_mutex );
+}
+
+void datasetReader::join()
+{
+    for( unsigned int c=0;c<m_workers.size();c++)
+        pthread_join( m_workers[c], 0 );
+    m_workers.clear();
+}
+
+void datasetReader::reportThroughput( const string &name,     /* in : name of the loop */
+                                      int n_consumers )       /* in : number of threads which called next */
+{
+    pthread_mutex_lock( &m_mutex );
+    const double wall = ( getTickCount() - m_open_tick )/getTickFrequency();
+    const int n_workers = std::max( 1, (int)m_workers.size() );
+    const double decode_busy = m_decode_seconds/n_workers;
+    const double compute_busy = std::max( 0.0, wall - m_wait_seconds/std::max( 1, n_consumers ));
+    cout<<name<<" : "<<m_next_out<<" images in "<<wall<<" s, decode "
+        <<( decode_busy > 0 ? m_decoded/decode_busy : 0 )<<" images/s ( "<<n_workers<<" threads ), compute "
+        <<( compute_busy > 0 ? m_next_out/compute_busy : 0 )<<" images/s ( "<<n_consumers<<" threads, "
+        <<m_wait_seconds/std::max( 1, n_consumers )<<" s waiting for images )"<<endl;
+    pthread_mutex_unlock( &m_mutex );
+}
+
+void* datasetReader::run( void *self )
+{
+    datasetReader *r = (datasetReader*)self;
+    pthread_mutex_lock( &r->m_mutex );
+    while( true )
+    {
+        /* room for one more decoded image */
+        while( !r->m_stop && r->m_next_decode < (int)r->m_paths.size() && r->m_next_decode >= r->m_next_out + r->m_queue_size )
+            pthread_cond_wait( &r->m_room_cond, &r->m_mutex );
+        if( r->m_stop || r->m_next_decode >= (int)r->m_paths.size() )
+            break;
+        const int index = r->m_next_decode++;
+        pthread_mutex_unlock( &r->m_mutex );
+
+        const int64 t0 = getTickCount();
+        Mat img = imread( r->m_paths[index], r->m_imread_flags );
+        if( !img.empty() && r->m_resize_to.area() > 0 )
+            resize( img, img, r->m_resize_to, 0, 0, INTER_AREA );
+        const double seconds = ( getTickCount() - t0 )/getTickFrequency();
+
+        pthread_mutex_lock( &r->m_mutex );
+        r->m_decode_seconds += seconds;
+        r->m_decoded++;
+        if( !r->m_stop )
+        {
+            r->m_ready[index] = img;
+            pthread_cond_broadcast( &r->m_ready_cond );
+        }
+    }
+    pthread_mutex_unlock( &r->m_mutex );
+    return 0;
+}
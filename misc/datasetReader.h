@@ -0,0 +1,95 @@
+#ifndef DATASET_READER_H
+#define DATASET_READER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <pthread.h>
+#include "opencv2/core/core.hpp"
+
+using namespace std;
+using namespace cv;
+
+/* decodes a list of images ahead of the threads which use them : n_workers threads call imread,
+ * at most queue_size decoded images wait in memory, and next() hands them out in the order of
+ * the list, whatever the number of threads calling it. Not copyable */
+class datasetReader
+{
+    public:
+        datasetReader();
+        ~datasetReader();                           /* stops and joins the workers */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  open
+         *  Description:  start decoding paths, the previous list is stopped first
+         * =====================================================================================
+         */
+        bool open( const vector<string> &paths,     /* in : images to read */
+                   int n_workers = 2,               /* in : number of decode threads */
+                   int queue_size = 16,             /* in : max number of decoded images waiting */
+                   int imread_flags = 1,            /* in : flags of imread, 0 -> grayscale */
+                   const Size &resize_to = Size()); /* in : if not empty, the images are resized to it after decoding */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  next
+         *  Description:  next image of the list, waits for it if needed, thread safe. image is
+         *                empty if it could not be read. False once the list is done or stopped
+         * =====================================================================================
+         */
+        bool next( int &index,                      /* out: index of the image in paths */
+                   Mat &image );                    /* out: decoded image */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  stop
+         *  Description:  no more images are decoded, next() returns false from now on
+         * =====================================================================================
+         */
+        void stop();
+
+        int size() const                            /* number of images in the list */
+        {
+            return m_paths.size();
+        }
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  reportThroughput
+         *  Description:  print the images per second of the decode stage ( the workers ) and of
+         *                the compute stage ( the n_consumers threads calling next, minus the
+         *                time they waited for images ) since open
+         * =====================================================================================
+         */
+        void reportThroughput( const string &name,  /* in : name of the loop, printed */
+                               int n_consumers );   /* in : number of threads which called next */
+
+    private:
+        datasetReader( const datasetReader & );
+        datasetReader& operator=( const datasetReader & );
+
+        static void* run( void *self );             /* decode thread */
+        void join();
+
+        vector<string> m_paths;
+        int m_imread_flags;
+        Size m_resize_to;
+        int m_queue_size;
+
+        vector<pthread_t> m_workers;
+        pthread_mutex_t m_mutex;
+        pthread_cond_t m_ready_cond;                /* signaled when an image is decoded */
+        pthread_cond_t m_room_cond;                 /* signaled when an image is handed out */
+        map<int, Mat> m_ready;                      /* decoded images, by index */
+        int m_next_decode;                          /* next index to decode */
+        int m_next_out;                             /* next index to hand out */
+        bool m_stop;
+
+        /* throughput */
+        int64 m_open_tick;                          /* getTickCount at open */
+        double m_decode_seconds;                    /* time spent in imread and resize, summed over the workers */
+        double m_wait_seconds;                      /* time spent waiting in next, summed over the callers */
+        int m_decoded;                              /* number of images decoded */
+};
+#endif
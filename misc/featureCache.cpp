@@ -0,0 +1,235 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include "featureCache.h"
+
+using namespace std;
+using namespace cv;
+
+#define FEATURE_CACHE_VERSION 2
+static const char feature_cache_magic[8] = { 'F','C','A','C','H','E','\0','\0' };
+
+struct featureCacheHeader
+{
+    char magic[8];                      /* "FCACHE" */
+    unsigned int bom;                   /* 0x01020304 */
+    unsigned int version;               /* FEATURE_CACHE_VERSION */
+    int feature_dim;                    /* number of floats of each record */
+    char reserved[4];
+    unsigned long long options_hash;    /* options the vectors are computed with */
+};
+typedef char feature_cache_header_check[ sizeof(featureCacheHeader) == 32 ? 1 : -1 ];
+
+featureCache::featureCache()
+{
+    m_dim = 0;
+    m_options_hash = 0;
+    m_hits = 0;
+    m_misses = 0;
+}
+
+bool featureCache::open( const string &path,        /* in : file of the cache */
+                         int feature_dim,           /* in : length of the vectors */
+                         unsigned long long options_hash )  /* in : hash of the options of the features */
+{
+    m_path = path;
+    m_dim = feature_dim;
+    m_options_hash = options_hash;
+    m_index.clear();
+    m_pending.clear();
+    m_file.close();
+    m_hits = 0;
+    m_misses = 0;
+    if( feature_dim <= 0 )
+    {
+        cout<<"<featureCache::open><error> feature_dim should be positive"<<endl;
+        return false;
+    }
+
+    featureCacheHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, feature_cache_magic, sizeof(header.magic) );
+    header.bom = 0x01020304;
+    header.version = FEATURE_CACHE_VERSION;
+    header.feature_dim = feature_dim;
+    header.options_hash = options_hash;
+
+    /* a new cache if there is none, or if it can not be used */
+    bool usable = false;
+    {
+        ifstream in( path.c_str(), ios::in | ios::binary );
+        featureCacheHeader on_disk;
+        if( in.is_open() && in.read( reinterpret_cast<char*>( &on_disk ), sizeof(on_disk) ))
+            usable = memcmp( &on_disk, &header, sizeof(header) ) == 0;
+    }
+    if( !usable )
+    {
+        ofstream out( path.c_str(), ios::out | ios::binary | ios::trunc );
+        out.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+        if( !out.good())
+        {
+            cout<<"<featureCache::open><error> can not write "<<path<<endl;
+            return false;
+        }
+    }
+
+    if( !m_file.open( path ))
+        return false;
+    /* a record cut by an interrupted flush is removed, the next records are appended after the whole ones */
+    const size_t record_size = sizeof(unsigned long long) + m_dim*sizeof(float);
+    const size_t n_records = ( m_file.size() - sizeof(header) )/record_size;
+    if( sizeof(header) + n_records*record_size != m_file.size() )
+    {
+        m_file.close();
+        if( truncate( path.c_str(), sizeof(header) + n_records*record_size ) != 0 || !m_file.open( path ))
+        {
+            cout<<"<featureCache::open><error> can not remove the cut record of "<<path<<endl;
+            return false;
+        }
+    }
+    size_t offset = sizeof(header);
+    for( size_t c=0;c<n_records;c++, offset+=record_size )
+    {
+        unsigned long long key;
+        memcpy( &key, m_file.data() + offset, sizeof(key) );
+        m_index[key] = offset + sizeof(key);
+    }
+    return true;
+}
+
+bool featureCache::lookup( unsigned long long key,      /* in : key of the window */
+                           Mat &column ) const          /* out: feature vector */
+{
+    const unsigned char *found = 0;
+    map<unsigned long long, size_t>::const_iterator it = m_index.find( key );
+    if( it != m_index.end() && it->second + m_dim*sizeof(float) <= m_file.size() )
+        found = m_file.data() + it->second;
+
+    bool pending = false;
+    if( !found )
+    {
+        #pragma omp critical(feature_cache)
+        {
+            map<unsigned long long, Mat>::const_iterator jt = m_pending.find( key );
+            if( jt != m_pending.end() )
+            {
+                jt->second.copyTo( column );
+                pending = true;
+            }
+        }
+    }
+    else
+    {
+        /* the records are not aligned in the file */
+        column.create( m_dim, 1, CV_32F );
+        for( int r=0;r<m_dim;r++)
+            memcpy( column.ptr<float>(r), found + r*sizeof(float), sizeof(float) );
+    }
+
+    if( found || pending )
+    {
+        #pragma omp atomic
+        m_hits++;
+        return true;
+    }
+    #pragma omp atomic
+    m_misses++;
+    return false;
+}
+
+void featureCache::insert( unsigned long long key,      /* in : key of the window */
+                           const Mat &column )          /* in : featuredim x 1, CV_32F */
+{
+    if( column.type() != CV_32F || column.rows != m_dim || column.cols != 1 )
+    {
+        cout<<"<featureCache::insert><error> column should be "<<m_dim<<"x1 CV_32F"<<endl;
+        return;
+    }
+    Mat copy = column.clone();
+    #pragma omp critical(feature_cache)
+    {
+        m_pending[key] = copy;
+    }
+}
+
+bool featureCache::flush()
+{
+    if( m_pending.empty() )
+        return true;
+
+    /* append after the records already mapped, the mapping stays valid while the file grows */
+    const size_t old_size = m_file.size();
+    const size_t record_size = sizeof(unsigned long long) + m_dim*sizeof(float);
+    vector<unsigned long long> written;
+    bool ok = false;
+    {
+        ofstream out( m_path.c_str(), ios::out | ios::binary | ios::app );
+        if( out.is_open())
+        {
+            for( map<unsigned long long, Mat>::const_iterator it = m_pending.begin(); it != m_pending.end(); it++ )
+            {
+                if( m_index.count( it->first ))
+                    continue;
+                out.write( reinterpret_cast<const char*>( &it->first ), sizeof(it->first) );
+                out.write( reinterpret_cast<const char*>( it->second.data ), m_dim*sizeof(float) );
+                written.push_back( it->first );
+            }
+            out.close();
+            ok = out.good();
+        }
+    }
+    m_pending.clear();
+    if( !ok )
+    {
+        /* drop what may have been written, the old records and their mapping are kept */
+        if( truncate( m_path.c_str(), old_size ) != 0 )
+            cout<<"<featureCache::flush><warning> can not truncate "<<m_path<<endl;
+        cout<<"<featureCache::flush><error> failed to write "<<m_path<<endl;
+        return false;
+    }
+    if( written.empty() )
+        return true;
+
+    /* map the grown file, only the new records are added to the index */
+    if( !m_file.open( m_path ))
+    {
+        m_index.clear();
+        cout<<"<featureCache::flush><error> can not map "<<m_path<<" again, the cache is empty"<<endl;
+        return false;
+    }
+    size_t offset = old_size;
+    for( unsigned int c=0;c<written.size();c++, offset+=record_size )
+        m_index[ written[c] ] = offset + sizeof(unsigned long long);
+    return true;
+}
+
+unsigned long long featureCache::hashBytes( const void *data, size_t size, unsigned long long h )
+{
+    const unsigned char *p = (const unsigned char*)data;
+    for( size_t c=0;c<size;c++)
+    {
+        h ^= p[c];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+unsigned long long featureCache::hashImage( const Mat &image )
+{
+    const int info[3] = { image.rows, image.cols, image.type() };
+    unsigned long long h = hashBytes( info, sizeof(info) );
+    const size_t row_bytes = image.cols*image.elemSize();
+    for( int r=0;r<image.rows;r++)
+        h = hashBytes( image.ptr(r), row_bytes, h );
+    return h;
+}
+
+unsigned long long featureCache::makeKey( unsigned long long image_hash, const Rect &r, bool flipped, unsigned long long options_hash )
+{
+    const int window[5] = { r.x, r.y, r.width, r.height, flipped ? 1 : 0 };
+    unsigned long long h = hashBytes( &image_hash, sizeof(image_hash) );
+    h = hashBytes( window, sizeof(window), h );
+    return hashBytes( &options_hash, sizeof(options_hash), h );
+}
@@ -0,0 +1,104 @@
+#ifndef FEATURE_CACHE_H
+#define FEATURE_CACHE_H
+
+#include <string>
+#include <map>
+#include "opencv2/core/core.hpp"
+#include "mappedFile.h"
+
+using namespace std;
+using namespace cv;
+
+/*  feature vectors of training windows on disk, addressed by a 64 bits key made from the content of
+ *  the image, the window and the options of the features ( makeKey ), so that the next stages and
+ *  the next runs only compute the features of new windows
+ *
+ *  file layout ( little endian ) :
+ *      header  32 bytes, see featureCache.cpp
+ *      records one after the other, each one is the key ( 8 bytes ) and featuredim floats
+ *
+ *  the file is mapped for the lookups, new vectors stay in memory until flush appends them.
+ *  The header keeps the options hash, a file made with other options is started again, so it only
+ *  holds the windows of one set of options. Records are never removed, the file grows with the new
+ *  windows of each run ( featuredim*4+8 bytes each ), delete it to start from zero */
+class featureCache
+{
+    public:
+        featureCache();
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  open
+         *  Description:  use the cache at path, created if it does not exist. A cache made for
+         *                another feature dim or other options is started again
+         * =====================================================================================
+         */
+        bool open( const string &path,              /* in : file of the cache */
+                   int feature_dim,                 /* in : length of the vectors */
+                   unsigned long long options_hash );   /* in : hash of the options of the features */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  lookup
+         *  Description:  copy the vector of key to column ( featuredim x 1 CV_32F, continuous or
+         *                not ), thread safe. False if key is not in the cache
+         * =====================================================================================
+         */
+        bool lookup( unsigned long long key,        /* in : key of the window */
+                     Mat &column ) const;           /* out: feature vector */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  insert
+         *  Description:  keep the vector of key until the next flush, thread safe
+         * =====================================================================================
+         */
+        void insert( unsigned long long key,        /* in : key of the window */
+                     const Mat &column );           /* in : featuredim x 1, CV_32F */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  flush
+         *  Description:  append the new vectors to the file and map it again, not thread safe.
+         *                On failure the new vectors are dropped, the records already on disk
+         *                stay usable ( or the cache is emptied if it can not be mapped again )
+         * =====================================================================================
+         */
+        bool flush();
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  getStats
+         *  Description:  number of lookups found and not found since open
+         * =====================================================================================
+         */
+        void getStats( long &hits, long &misses ) const
+        {
+            hits = m_hits;
+            misses = m_misses;
+        }
+
+        /* fnv-1a of the bytes, h is the hash of the previous bytes */
+        static unsigned long long hashBytes( const void *data, size_t size, unsigned long long h = 14695981039346656037ULL );
+
+        /* hash of the size, type and pixels of the image */
+        static unsigned long long hashImage( const Mat &image );
+
+        /* key of the window r of the image, flipped or not, options_hash is the hash of the
+         * options the features depend on */
+        static unsigned long long makeKey( unsigned long long image_hash, const Rect &r, bool flipped, unsigned long long options_hash );
+
+    private:
+        featureCache( const featureCache & );
+        featureCache& operator=( const featureCache & );
+
+        string m_path;
+        int m_dim;                                              /* feature dim */
+        unsigned long long m_options_hash;                      /* options of the vectors in the file */
+        mappedFile m_file;                                      /* records already on disk */
+        map<unsigned long long, size_t> m_index;                /* key -> offset of the vector in the file */
+        map<unsigned long long, Mat> m_pending;                 /* vectors not written yet */
+        mutable long m_hits;
+        mutable long m_misses;
+};
+#endif
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mappedFile.h"
+
+using namespace std;
+
+mappedFile::mappedFile()
+{
+    m_data = 0;
+    m_size = 0;
+}
+
+mappedFile::~mappedFile()
+{
+    close();
+}
+
+bool mappedFile::open( const string &path )     /* in : path of the file */
+{
+    close();
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+    {
+        cout<<"<mappedFile::open><error> can not open file "<<path<<endl;
+        return false;
+    }
+    struct stat st;
+    if( fstat( fd, &st ) != 0 || st.st_size == 0 )
+    {
+        cout<<"<mappedFile::open><error> file "<<path<<" is empty "<<endl;
+        ::close( fd );
+        return false;
+    }
+    void *p = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close( fd );                  /* the mapping stays valid after the descriptor is closed */
+    if( p == MAP_FAILED )
+    {
+        cout<<"<mappedFile::open><error> can not map file "<<path<<endl;
+        return false;
+    }
+    m_data = (const unsigned char*)p;
+    m_size = st.st_size;
+    return true;
+}
+
+void mappedFile::close()
+{
+    if( m_data )
+        munmap( (void*)m_data, m_size );
+    m_data = 0;
+    m_size = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+using namespace std;
+
+/* read only memory mapping of a whole file, unmapped in the destructor. Not copyable, share it
+ * with cv::Ptr<mappedFile> */
+class mappedFile
+{
+    public:
+        mappedFile();
+        ~mappedFile();
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  open
+         *  Description:  map the file, the previous mapping is released
+         * =====================================================================================
+         */
+        bool open( const string &path );        /* in : path of the file */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  close
+         *  Description:  release the mapping
+         * =====================================================================================
+         */
+        void close();
+
+        const unsigned char* data() const       /* start of the file, page aligned */
+        {
+            return m_data;
+        }
+
+        size_t size() const                     /* size of the file in bytes */
+        {
+            return m_size;
+        }
+
+    private:
+        mappedFile( const mappedFile & );
+        mappedFile& operator=( const mappedFile & );
+
+        const unsigned char *m_data;            /* mapped memory */
+        size_t m_size;                          /* size of the mapping */
+};
+#endif
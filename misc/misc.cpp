@@ -155,3 +155,47 @@ bool colorEqu( const Mat &input_image,
 
     return true;
 }
+
+/* highest simd level supported by the cpu, checked with cpuid */
+int getCpuSimdLevel()
+{
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports("avx512f") )
+        return SIMD_AVX512;
+    if( __builtin_cpu_supports("avx2") )
+        return SIMD_AVX2;
+    if( __builtin_cpu_supports("sse2") )
+        return SIMD_SSE2;
+#endif
+    return SIMD_NONE;
+}
+
+/* extract the center part of the feature( crossponding to the target) , save it as 
+ * clomun in output_data(not continuous) */
+void makeTrainData( vector<Mat> &in_data, Mat &output_data, Size modelDs, int shrink)
+{
+    assert( output_data.type() == CV_32F);
+    assert( in_data[0].type() == CV_32F && in_data[0].isContinuous());
+
+	int w_in_data = in_data[0].cols;
+	int h_in_data = in_data[0].rows;
+
+	int w_f = modelDs.width/shrink;
+	int h_f = modelDs.height/shrink;
+    
+    assert( w_in_data > w_f && h_in_data > h_f );
+	for( int c=0;c < in_data.size(); c++)
+	{
+        float *ptr=(float*)in_data[c].ptr() + (h_in_data - h_f)/2*w_in_data + (w_in_data - w_f)/2;
+        for( int j=0;j<h_f;j++)
+        {
+            float *pp = ptr + j*w_in_data;
+            for( int i=0;i<w_f;i++)
+            {
+                output_data.at<float>( c*h_f*w_f + j*w_f+i ,0) = pp[i];    
+            }
+        }
+
+	}
+}
@@ -31,4 +31,14 @@ bool saveMatToFile( string path_name, const Mat & m);
 
 bool colorEqu( const Mat &input_image, 
                 Mat &output_image);
+
+/* extract the center part of the feature( crossponding to the target) , save it as 
+ * clomun in output_data(not continuous) */
+void makeTrainData( vector<Mat> &in_data, Mat &output_data, Size modelDs, int shrink);
+
+/* simd instruction sets, used to select kernels at runtime */
+enum { SIMD_NONE = 0, SIMD_SSE2 = 1, SIMD_AVX2 = 2, SIMD_AVX512 = 3 };
+
+/* highest simd level supported by the cpu, checked with cpuid */
+int getCpuSimdLevel();
 #endif
@@ -0,0 +1,69 @@
+#ifndef SEGMENTED_VECTOR_H
+#define SEGMENTED_VECTOR_H
+
+#include <vector>
+#include <cstddef>
+#include <assert.h>
+#include <omp.h>
+
+using namespace std;
+
+/* append only container for the results of an OpenMP parallel loop : each thread appends to its
+ * own segment without any lock, the segments are merged once after the loop, in thread order */
+template <typename T> class segmentedVector
+{
+    public:
+        segmentedVector( int n_threads = omp_get_max_threads() )      /* in : number of threads of the team */
+            : m_segments( n_threads )
+        {
+        }
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  push_back
+         *  Description:  append to the segment of the calling thread, only call it from a team
+         *                of at most n_threads threads
+         * =====================================================================================
+         */
+        void push_back( const T &value )
+        {
+            const int tid = omp_get_thread_num();
+            assert( tid < (int)m_segments.size() );
+            m_segments[tid].items.push_back( value );
+        }
+
+        size_t size() const                     /* number of elements in all the segments */
+        {
+            size_t n = 0;
+            for( unsigned int c=0;c<m_segments.size();c++)
+                n += m_segments[c].items.size();
+            return n;
+        }
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  merge
+         *  Description:  append all the segments to out and clear them, outside of the parallel
+         *                region
+         * =====================================================================================
+         */
+        void merge( vector<T> &out )            /* out: the elements are appended */
+        {
+            out.reserve( out.size() + size() );
+            for( unsigned int c=0;c<m_segments.size();c++)
+            {
+                out.insert( out.end(), m_segments[c].items.begin(), m_segments[c].items.end() );
+                vector<T>().swap( m_segments[c].items );
+            }
+        }
+
+    private:
+        /* one cache line each, the threads do not write to the same line when they append */
+        struct segment
+        {
+            vector<T> items;
+            char pad[64];
+        };
+        vector<segment> m_segments;
+};
+#endif
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include "opencv2/contrib/contrib.hpp"
+#include "opencv2/highgui/highgui.hpp"
+#include "softcascade.hpp"
+#include "../chnfeature/Pyramid.h"
+
+#include "boost/filesystem.hpp"
+
+using namespace std;
+using namespace cv;
+
+namespace bf = boost::filesystem;
+
+/* compare the packed node layout with the nxK Mats layout on the same pyramids
+ * usage : bench_layout model.xml /path/to/INRIA/Test/pos/ [repeat] */
+int main( int argc, char** argv)
+{
+    string model_path = "for_test_sc.xml";
+    string test_img_folder = "/home/yuanyang/Workspace/INRIA/Test/pos/";
+    int repeat = 3;
+    if( argc > 1)
+        model_path = argv[1];
+    if( argc > 2)
+        test_img_folder = argv[2];
+    if( argc > 3)
+        repeat = atoi( argv[3] );
+
+    softcascade sc;
+    if(!sc.Load( model_path ))
+    {
+        cout<<"Can not load the model "<<model_path<<endl;
+        return -1;
+    }
+    if( !bf::exists( test_img_folder ))
+    {
+        cout<<"Folder "<<test_img_folder<<" does not exist "<<endl;
+        return -1;
+    }
+
+    /* compute the pyramids once, only the scan is timed */
+    feature_Pyramids ff;
+    vector< vector< vector<Mat> > > pyramids;
+    int number_of_levels = 0;
+    bf::directory_iterator end_it;
+    for( bf::directory_iterator file_iter( test_img_folder ); file_iter!=end_it; file_iter++)
+    {
+        string pathname = file_iter->path().string();
+        string extname  = bf::extension( *file_iter);
+        if( extname!=".jpg" && extname!=".bmp" && extname!=".png" && extname!=".JPG" && extname!=".BMP" && extname!=".PNG")
+            continue;
+        Mat img = imread( pathname );
+        if( img.empty())
+            continue;
+        vector< vector<Mat> > approPyramid;
+        vector<double> appro_scales, scale_h, scale_w;
+        ff.chnsPyramid_sse( img, approPyramid, appro_scales, scale_h, scale_w );
+        number_of_levels += approPyramid.size();
+        pyramids.push_back( approPyramid );
+    }
+    cout<<"Images : "<<pyramids.size()<<", pyramid levels : "<<number_of_levels<<endl;
+
+    double time_used[2] = {0, 0};
+    vector< vector<double> > scores[2];
+    for( int layout=0;layout<2;layout++)
+    {
+        sc.setPackedEvaluation( layout == 0 );
+        for( int r=0;r<repeat;r++)
+        {
+            vector<double> all_conf;
+            TickMeter tk;tk.start();
+            for( unsigned int c=0;c<pyramids.size();c++)
+            {
+                for( unsigned int l=0;l<pyramids[c].size();l++)
+                {
+                    vector<Rect> t_tar;
+                    vector<double> t_conf;
+                    sc.Apply( pyramids[c][l], t_tar, t_conf );
+                    all_conf.insert( all_conf.end(), t_conf.begin(), t_conf.end());
+                }
+            }
+            tk.stop();
+            time_used[layout] += tk.getTimeMilli();
+            if( r == 0)
+                scores[layout].push_back( all_conf );
+        }
+    }
+
+    /* the packed layout keeps hs in float, the scores differ slightly */
+    double max_diff = 0;
+    bool same_windows = scores[0][0].size() == scores[1][0].size();
+    for( unsigned int c=0;same_windows && c<scores[0][0].size();c++)
+        max_diff = std::max( max_diff, std::abs( scores[0][0][c] - scores[1][0][c] ));
+
+    cout<<"packed layout : "<<time_used[0]/repeat<<" ms per pass, "<<scores[0][0].size()<<" windows"<<endl;
+    cout<<"mat layout    : "<<time_used[1]/repeat<<" ms per pass, "<<scores[1][0].size()<<" windows"<<endl;
+    cout<<"speed up      : "<<time_used[1]/time_used[0]<<endl;
+    if( same_windows )
+        cout<<"same windows accepted, max score difference "<<max_diff<<endl;
+    else
+        cout<<"accepted windows differ ( windows close to cascThr )"<<endl;
+	return 0;
+}
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "opencv2/contrib/contrib.hpp"
+#include "softcascade.hpp"
+
+using namespace std;
+using namespace cv;
+
+/* time to get a model ready for detection, xml ( FileStorage + packModel ) vs binary ( mmap )
+ * usage : bench_load model.xml model.bin [repeat] , model.bin is made by convert_model */
+int main( int argc, char** argv)
+{
+    if( argc < 3)
+    {
+        cout<<"usage : "<<argv[0]<<" model.xml model.bin [repeat]"<<endl;
+        return -1;
+    }
+    int repeat = 10;
+    if( argc > 3)
+        repeat = atoi( argv[3] );
+
+    double xml_time = 0, bin_time = 0;
+    for( int r=0;r<repeat;r++)
+    {
+        softcascade sc_xml, sc_bin;
+        TickMeter tk;
+        tk.start();
+        if(!sc_xml.Load( argv[1] ))
+            return -1;
+        tk.stop();
+        xml_time += tk.getTimeMilli();
+
+        tk.reset();tk.start();
+        if(!sc_bin.LoadBinary( argv[2] ))
+            return -1;
+        tk.stop();
+        bin_time += tk.getTimeMilli();
+    }
+    cout<<"xml    : "<<xml_time/repeat<<" ms"<<endl;
+    cout<<"binary : "<<bin_time/repeat<<" ms, speed up "<<xml_time/bin_time<<endl;
+	return 0;
+}
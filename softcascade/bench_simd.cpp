@@ -0,0 +1,188 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include "opencv2/contrib/contrib.hpp"
+#include "opencv2/highgui/highgui.hpp"
+#include "softcascade.hpp"
+#include "../chnfeature/Pyramid.h"
+#include "../misc/misc.hpp"
+
+#include "boost/filesystem.hpp"
+
+using namespace std;
+using namespace cv;
+
+namespace bf = boost::filesystem;
+
+/* scan all the levels of all the frames repeat times, return the time per frame in ms */
+static double scanPyramids( const softcascade &sc,
+                            const vector< vector< vector<Mat> > > &pyramids,
+                            int repeat,
+                            vector<Rect> &all_rects,
+                            vector<double> &all_conf )
+{
+    double time_used = 0;
+    for( int r=0;r<repeat;r++)
+    {
+        all_rects.clear();
+        all_conf.clear();
+        TickMeter tk;tk.start();
+        for( unsigned int c=0;c<pyramids.size();c++)
+            for( unsigned int l=0;l<pyramids[c].size();l++)
+                sc.Apply( pyramids[c][l], all_rects, all_conf );
+        tk.stop();
+        time_used += tk.getTimeMilli();
+    }
+    return time_used/(repeat*pyramids.size());
+}
+
+/* dense scan ( stride 4 ) on 640x480 frames with each row kernel, the results have to be the same bit by bit,
+ * then the same on uint8 and uint16 levels ( channelDepth ), compared with the scalar kernel on the same levels
+ * usage : bench_simd model.xml /path/to/INRIA/Test/pos/ [repeat] */
+int main( int argc, char** argv)
+{
+    string model_path = "for_test_sc.xml";
+    string test_img_folder = "/home/yuanyang/Workspace/INRIA/Test/pos/";
+    int repeat = 3;
+    if( argc > 1)
+        model_path = argv[1];
+    if( argc > 2)
+        test_img_folder = argv[2];
+    if( argc > 3)
+        repeat = atoi( argv[3] );
+
+    softcascade sc;
+    if(!sc.Load( model_path ))
+    {
+        cout<<"Can not load the model "<<model_path<<endl;
+        return -1;
+    }
+    cascadeParameter opts = sc.getParas();
+    opts.stride = 4;
+    sc.setParas( opts );
+
+    /* pyramids of the 640x480 frames */
+    feature_Pyramids ff;
+    vector< vector< vector<Mat> > > pyramids;
+    if( bf::exists( test_img_folder ))
+    {
+        bf::directory_iterator end_it;
+        for( bf::directory_iterator file_iter( test_img_folder ); file_iter!=end_it; file_iter++)
+        {
+            string pathname = file_iter->path().string();
+            string extname  = bf::extension( *file_iter);
+            if( extname!=".jpg" && extname!=".bmp" && extname!=".png" && extname!=".JPG" && extname!=".BMP" && extname!=".PNG")
+                continue;
+            Mat img = imread( pathname );
+            if( img.empty())
+                continue;
+            resize( img, img, Size(640, 480) );
+            vector< vector<Mat> > approPyramid;
+            vector<double> appro_scales, scale_h, scale_w;
+            ff.chnsPyramid_sse( img, approPyramid, appro_scales, scale_h, scale_w );
+            pyramids.push_back( approPyramid );
+        }
+    }
+    else
+    {
+        cout<<"Folder "<<test_img_folder<<" does not exist, using random frames "<<endl;
+        for( int c=0;c<10;c++)
+        {
+            Mat img( 480, 640, CV_8UC3 );
+            randu( img, Scalar::all(0), Scalar::all(255) );
+            vector< vector<Mat> > approPyramid;
+            vector<double> appro_scales, scale_h, scale_w;
+            ff.chnsPyramid_sse( img, approPyramid, appro_scales, scale_h, scale_w );
+            pyramids.push_back( approPyramid );
+        }
+    }
+    cout<<"Frames : "<<pyramids.size()<<", cpu simd level : "<<getCpuSimdLevel()<<endl;
+
+    const int simd_levels[3] = { SIMD_NONE, SIMD_SSE2, SIMD_AVX2 };
+    const char *simd_names[3] = { "scalar", "sse2  ", "avx2  " };
+    double scalar_time = 0;
+    vector<Rect> reference_rects;
+    vector<double> reference_conf;
+    for( int s=0;s<3;s++)
+    {
+        if( simd_levels[s] > getCpuSimdLevel() )
+        {
+            cout<<simd_names[s]<<" : not supported by this cpu "<<endl;
+            continue;
+        }
+        sc.setSimdLevel( simd_levels[s] );
+        vector<Rect> all_rects;
+        vector<double> all_conf;
+        double time_used = scanPyramids( sc, pyramids, repeat, all_rects, all_conf );
+
+        bool exact = true;
+        if( s == 0)
+        {
+            scalar_time = time_used;
+            reference_rects = all_rects;
+            reference_conf = all_conf;
+        }
+        else
+        {
+            exact = all_rects.size() == reference_rects.size();
+            for( unsigned int c=0;exact && c<all_rects.size();c++)
+                exact = ( all_rects[c] == reference_rects[c] && all_conf[c] == reference_conf[c] );
+        }
+        cout<<simd_names[s]<<" : "<<time_used<<" ms per frame, speed up "<<scalar_time/time_used<<", "<<all_rects.size()<<" windows, "
+            <<( exact ? "same as scalar" : "!! differs from scalar !!")<<endl;
+        if( !exact )
+            return -1;
+    }
+
+    /* quantized levels, the windows found may differ from the float ones near the thresholds */
+    const int depths[2] = { CV_8U, CV_16U };
+    const char *depth_names[2] = { "uint8 ", "uint16" };
+    const vector<Rect> float_rects = reference_rects;
+    for( int d=0;d<2;d++)
+    {
+        opts.channelDepth = depths[d];
+        sc.setParas( opts );
+        vector< vector< vector<Mat> > > q_pyramids( pyramids.size() );
+        for( unsigned int c=0;c<pyramids.size();c++)
+        {
+            q_pyramids[c].resize( pyramids[c].size() );
+            for( unsigned int l=0;l<pyramids[c].size();l++)
+            {
+                Mat memory;
+                ff.quantizeLevel( pyramids[c][l], sc.getChannelScales(), depths[d], memory, q_pyramids[c][l] );
+            }
+        }
+
+        double q_scalar_time = 0;
+        for( int s=0;s<3;s++)
+        {
+            if( simd_levels[s] > getCpuSimdLevel() )
+                continue;
+            sc.setSimdLevel( simd_levels[s] );
+            vector<Rect> all_rects;
+            vector<double> all_conf;
+            double time_used = scanPyramids( sc, q_pyramids, repeat, all_rects, all_conf );
+
+            bool exact = true;
+            if( s == 0)
+            {
+                q_scalar_time = time_used;
+                reference_rects = all_rects;
+                reference_conf = all_conf;
+            }
+            else
+            {
+                exact = all_rects.size() == reference_rects.size();
+                for( unsigned int c=0;exact && c<all_rects.size();c++)
+                    exact = ( all_rects[c] == reference_rects[c] && all_conf[c] == reference_conf[c] );
+            }
+            cout<<depth_names[d]<<" "<<simd_names[s]<<" : "<<time_used<<" ms per frame, speed up "<<scalar_time/time_used
+                <<" ( "<<q_scalar_time/time_used<<" against "<<depth_names[d]<<" scalar ), "<<all_rects.size()<<" windows ( "
+                <<float_rects.size()<<" on float ), "<<( exact ? "same as scalar" : "!! differs from scalar !!")<<endl;
+            if( !exact )
+                return -1;
+        }
+    }
+	return 0;
+}
@@ -0,0 +1,199 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <omp.h>
+#include "opencv2/highgui/highgui.hpp"
+#include "softcascade.hpp"
+#include "../chnfeature/Pyramid.h"
+#include "../misc/misc.hpp"
+
+#include "boost/filesystem.hpp"
+
+using namespace std;
+using namespace cv;
+
+namespace bf = boost::filesystem;
+
+/* crop the window around the target, same as the training ( sampleWins in main.cpp ), and put its
+ * features as a new column of data */
+static void appendWindow( const Mat &img,
+                          const Rect &target,
+                          const softcascade &sc,
+                          vector<Mat> &windows )
+{
+    const cascadeParameter opts = sc.getParas();
+    Rect r = resizeToFixedRatio( target, opts.modelDs.width*1.0/opts.modelDs.height, 1);
+    int modelDsBig_width = std::max( 8*opts.shrink, opts.modelDsPad.width)+std::max(2, 64/opts.shrink)*opts.shrink;
+    int modelDsBig_height = std::max( 8*opts.shrink,opts.modelDsPad.height)+std::max(2,64/opts.shrink)*opts.shrink;
+    r = resizeBbox( r, modelDsBig_height*1.0/opts.modelDs.height, modelDsBig_width*1.0/opts.modelDs.width );
+    Mat target_obj = cropImage( img, r );
+    cv::resize( target_obj, target_obj, cv::Size(modelDsBig_width, modelDsBig_height), 0, 0, INTER_AREA);
+    windows.push_back( target_obj );
+}
+
+/* features of the windows, one column per window */
+static Mat windowFeatures( const vector<Mat> &windows,
+                           const softcascade &sc )
+{
+    const cascadeParameter opts = sc.getParas();
+    const feature_Pyramids &ff = sc.getFeatureGen();
+    int feature_dim = opts.modelDsPad.width/opts.shrink*opts.modelDsPad.height/opts.shrink*opts.nchannels;
+    Mat data = Mat::zeros( feature_dim, windows.size(), CV_32F );
+    #pragma omp parallel for
+    for( int c=0;c<(int)windows.size();c++)
+    {
+        vector<Mat> feas;
+        ff.computeChannels_sse( windows[c], feas );
+        for( unsigned int i=0;i<feas.size();i++)
+            ff.convTri( feas[i], feas[i], 1, 1);
+        Mat tmp = data.col(c);
+        makeTrainData( feas, tmp, opts.modelDsPad, opts.shrink );
+    }
+    return data;
+}
+
+/* average number of trees evaluated before the rejection, and the fraction accepted */
+static double averageTrees( const Mat &traces,
+                            const vector<double> &reject_thrs,
+                            double &accepted )
+{
+    double total = 0;
+    int n_accepted = 0;
+    for( int r=0;r<traces.rows;r++)
+    {
+        const double *trace = traces.ptr<double>(r);
+        int t = 0;
+        while( t < traces.cols && trace[t] > reject_thrs[t] )
+            t++;
+        total += std::min( t+1, traces.cols );
+        if( t == traces.cols )
+            n_accepted++;
+    }
+    accepted = traces.rows > 0 ? 1.0*n_accepted/traces.rows : 0;
+    return traces.rows > 0 ? total/traces.rows : 0;
+}
+
+static bool isImage( const bf::path &p )
+{
+    string extname = bf::extension( p );
+    return extname==".jpg" || extname==".bmp" || extname==".png" || extname==".JPG" || extname==".BMP" || extname==".PNG";
+}
+
+/* per tree rejection thresholds of a trained model, from positives which are not in the training set
+ * usage : calibrate_cascade model.xml pos_img_dir pos_gt_dir [target_recall] [neg_img_dir] [calibrated.xml]
+ *         neg_img_dir is only used to report the number of trees evaluated on negative windows */
+int main( int argc, char** argv)
+{
+    if( argc < 4 )
+    {
+        cout<<"usage : "<<argv[0]<<" model.xml pos_img_dir pos_gt_dir [target_recall] [neg_img_dir] [calibrated.xml]"<<endl;
+        return -1;
+    }
+    string model_path = argv[1];
+    string pos_img_dir = argv[2];
+    string pos_gt_dir = argv[3];
+    double target_recall = argc > 4 ? atof( argv[4] ) : 0.995;
+    string neg_img_dir = argc > 5 ? argv[5] : "";
+    string out_path = argc > 6 ? argv[6] : "calibrated_sc.xml";
+
+    softcascade sc;
+    if(!sc.Load( model_path ))
+    {
+        cout<<"Can not load the model "<<model_path<<endl;
+        return -1;
+    }
+    /* the thresholds are calibrated for the constant cascThr */
+    cascadeParameter opts = sc.getParas();
+    opts.cascThrs.clear();
+    sc.setParas( opts );
+    const vector<double> constant_thrs = sc.getRejectThresholds();
+
+    /* positives, and their flipped version, same as the training */
+    vector<Mat> pos_windows;
+    if( !bf::exists( pos_img_dir ) || !bf::exists( pos_gt_dir ))
+    {
+        cout<<"Check "<<pos_img_dir<<" and "<<pos_gt_dir<<endl;
+        return -1;
+    }
+    bf::directory_iterator end_it;
+    for( bf::directory_iterator file_iter( pos_img_dir ); file_iter!=end_it; file_iter++)
+    {
+        if( !isImage( file_iter->path() ))
+            continue;
+        string gt_path = pos_gt_dir + bf::basename( file_iter->path() ) + ".xml";
+        if( !bf::exists( gt_path ))
+            continue;
+        Mat img = imread( file_iter->path().string() );
+        if( img.empty())
+            continue;
+        vector<Rect> target_rects;
+        FileStorage fst( gt_path, FileStorage::READ | FileStorage::FORMAT_XML);
+        fst["boxes"]>>target_rects;
+        fst.release();
+        Mat flipped_img;
+        cv::flip( img, flipped_img, 1 );
+        for( unsigned int c=0;c<target_rects.size();c++)
+        {
+            appendWindow( img, target_rects[c], sc, pos_windows );
+            Rect flipped_rect = target_rects[c];
+            flipped_rect.x = img.cols - target_rects[c].x - target_rects[c].width;
+            appendWindow( flipped_img, flipped_rect, sc, pos_windows );
+        }
+    }
+    if( pos_windows.empty())
+    {
+        cout<<"No positive found in "<<pos_img_dir<<endl;
+        return -1;
+    }
+    Mat pos_data = windowFeatures( pos_windows, sc );
+    vector<Mat>().swap( pos_windows );
+
+    /* random negative windows */
+    Mat neg_data;
+    if( !neg_img_dir.empty() && bf::exists( neg_img_dir ))
+    {
+        vector<Mat> neg_windows;
+        for( bf::directory_iterator file_iter( neg_img_dir ); file_iter!=end_it; file_iter++)
+        {
+            if( !isImage( file_iter->path() ))
+                continue;
+            Mat img = imread( file_iter->path().string() );
+            if( img.empty())
+                continue;
+            vector<Rect> neg_rects;
+            sampleRects( opts.nPerNeg, img.size(), opts.modelDs, neg_rects );
+            for( unsigned int c=0;c<neg_rects.size();c++)
+                appendWindow( img, neg_rects[c], sc, neg_windows );
+        }
+        if( !neg_windows.empty())
+            neg_data = windowFeatures( neg_windows, sc );
+    }
+
+    double recall = 0;
+    if( !sc.calibrateRejection( pos_data, target_recall, recall ))
+        return -1;
+
+    /* trees evaluated per window, constant cascThr against the calibrated thresholds */
+    Mat pos_traces, neg_traces;
+    double pos_acc_before = 0, pos_acc_after = 0;
+    sc.traceScores( pos_data, pos_traces );
+    double pos_trees_before = averageTrees( pos_traces, constant_thrs, pos_acc_before );
+    double pos_trees_after  = averageTrees( pos_traces, sc.getRejectThresholds(), pos_acc_after );
+    cout<<"positives : "<<pos_traces.rows<<", accepted "<<pos_acc_before<<" -> "<<pos_acc_after
+        <<", trees per window "<<pos_trees_before<<" -> "<<pos_trees_after<<endl;
+    if( !neg_data.empty() )
+    {
+        double neg_acc_before = 0, neg_acc_after = 0;
+        sc.traceScores( neg_data, neg_traces );
+        double neg_trees_before = averageTrees( neg_traces, constant_thrs, neg_acc_before );
+        double neg_trees_after  = averageTrees( neg_traces, sc.getRejectThresholds(), neg_acc_after );
+        cout<<"negatives : "<<neg_traces.rows<<", accepted "<<neg_acc_before<<" -> "<<neg_acc_after
+            <<", trees per window "<<neg_trees_before<<" -> "<<neg_trees_after<<endl;
+    }
+
+    if( !sc.Save( out_path ))
+        return -1;
+    cout<<"recall "<<recall<<" ( target "<<target_recall<<" ), model saved to "<<out_path<<endl;
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <emmintrin.h>
+#include <cstring>
+#include <algorithm>
+#include "cascadeKernels.h"
+#include "../misc/misc.hpp"
+
+
+/*  one window at a time, T is float, unsigned char or unsigned short */
+template <typename T> static void _scan_row_scalar( const T *row,                     /* in : feature of the first window in this row */
+                                                    int n_width,                      /* in : number of windows in this row */
+                                                    int step,                         /* in : distance between adjacent windows, in elements */
+                                                    const cascadeNode *nodes,         /* in : packed nodes, resolved for this pyramid level */
+                                                    int number_of_trees,              /* in : number of trees */
+                                                    int nodes_per_tree,               /* in : number of nodes reserved for each tree */
+                                                    const double *reject_thrs,        /* in : rejection threshold of each tree */
+                                                    double *scores )                  /* out: n_width scores */
+{
+    for( int w=0;w<n_width;w++)
+    {
+        const T *probe_feature_starter = row + w*step;
+        const cascadeNode *t_nodes = nodes;
+        double h = 0;
+        for( int t=0;t<number_of_trees;t++)
+        {
+            int position = 0;
+            while( t_nodes[position].child)
+            {
+                position = (( probe_feature_starter[t_nodes[position].fid] < t_nodes[position].thr) ? position*2+1 : position*2+2);
+            }
+            h += t_nodes[position].hs;
+            t_nodes += nodes_per_tree;
+            if( h <= reject_thrs[t] )   /* reject once the score is less than the threshold of this tree */
+            {
+                h = std::min( h, reject_thrs[number_of_trees-1] );
+                break;
+            }
+        }
+        scores[w] = h;
+    }
+}
+
+
+/*  select a where mask is set, b otherwise */
+static inline __m128 _select_ps( const __m128 &mask, const __m128 &a, const __m128 &b )
+{
+    return _mm_or_ps( _mm_and_ps( mask, a), _mm_andnot_ps( mask, b));
+}
+
+/*  load the feature fid of 4 adjacent windows */
+static inline __m128 _load_windows( const float *row, int fid, int step )
+{
+    if( step == 1)
+        return _mm_loadu_ps( row + fid );
+    return _mm_setr_ps( row[fid], row[fid+step], row[fid+2*step], row[fid+3*step] );
+}
+
+/*  same on uint8 features, converted to float ( exact ) */
+static inline __m128 _load_windows( const unsigned char *row, int fid, int step )
+{
+    if( step == 1)
+    {
+        int four_bytes;
+        memcpy( &four_bytes, row + fid, sizeof(four_bytes));
+        const __m128i zero = _mm_setzero_si128();
+        return _mm_cvtepi32_ps( _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( four_bytes ), zero), zero));
+    }
+    return _mm_setr_ps( row[fid], row[fid+step], row[fid+2*step], row[fid+3*step] );
+}
+
+/*  same on uint16 features */
+static inline __m128 _load_windows( const unsigned short *row, int fid, int step )
+{
+    if( step == 1)
+        return _mm_cvtepi32_ps( _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i*)( row + fid )), _mm_setzero_si128()));
+    return _mm_setr_ps( row[fid], row[fid+step], row[fid+2*step], row[fid+3*step] );
+}
+
+template <typename T> static void _scan_row_sse( const T *row,                        /* in : feature of the first window in this row */
+                                                 int n_width,                         /* in : number of windows in this row */
+                                                 int step,                            /* in : distance between adjacent windows, in elements */
+                                                 const cascadeNode *nodes,            /* in : packed nodes, resolved for this pyramid level */
+                                                 int number_of_trees,                 /* in : number of trees */
+                                                 int nodes_per_tree,                  /* in : number of nodes reserved for each tree */
+                                                 const double *reject_thrs,           /* in : rejection threshold of each tree */
+                                                 double *scores )                     /* out: n_width scores */
+{
+    const __m128d last_thr = _mm_set1_pd( reject_thrs[number_of_trees-1] );
+    int w = 0;
+    for( ;w+4<=n_width;w+=4)
+    {
+        const T *probe = row + w*step;
+        const cascadeNode *t_nodes = nodes;
+
+        /*  scores of window 0,1 and 2,3 are kept in double, same as the scalar version */
+        __m128d h_lo = _mm_setzero_pd();
+        __m128d h_hi = _mm_setzero_pd();
+        __m128d active_lo = _mm_castsi128_pd( _mm_set1_epi32(-1) );
+        __m128d active_hi = active_lo;
+        for( int t=0;t<number_of_trees;t++)
+        {
+            /*  all three splits are evaluated, the leaf is selected with the masks instead of branches */
+            __m128 m0 = _mm_cmplt_ps( _load_windows( probe, t_nodes[0].fid, step), _mm_set1_ps( t_nodes[0].thr ));
+            __m128 m1 = _mm_cmplt_ps( _load_windows( probe, t_nodes[1].fid, step), _mm_set1_ps( t_nodes[1].thr ));
+            __m128 m2 = _mm_cmplt_ps( _load_windows( probe, t_nodes[2].fid, step), _mm_set1_ps( t_nodes[2].thr ));
+            __m128 left  = _select_ps( m1, _mm_set1_ps( t_nodes[3].hs ), _mm_set1_ps( t_nodes[4].hs ));
+            __m128 right = _select_ps( m2, _mm_set1_ps( t_nodes[5].hs ), _mm_set1_ps( t_nodes[6].hs ));
+            __m128 hs    = _select_ps( m0, left, right );
+
+            /*  rejected windows add +0, their score does not change any more */
+            h_lo = _mm_add_pd( h_lo, _mm_and_pd( active_lo, _mm_cvtps_pd( hs )));
+            h_hi = _mm_add_pd( h_hi, _mm_and_pd( active_hi, _mm_cvtps_pd( _mm_movehl_ps( hs, hs ))));
+            const __m128d thr = _mm_set1_pd( reject_thrs[t] );
+            active_lo = _mm_and_pd( active_lo, _mm_cmpgt_pd( h_lo, thr ));
+            active_hi = _mm_and_pd( active_hi, _mm_cmpgt_pd( h_hi, thr ));
+            t_nodes += nodes_per_tree;
+
+            if( (_mm_movemask_pd( active_lo ) | _mm_movemask_pd( active_hi )) == 0 )
+                break;
+        }
+        /*  rejected windows are clamped to the last threshold, as in the scalar version */
+        h_lo = _mm_or_pd( _mm_and_pd( active_lo, h_lo ), _mm_andnot_pd( active_lo, _mm_min_pd( h_lo, last_thr )));
+        h_hi = _mm_or_pd( _mm_and_pd( active_hi, h_hi ), _mm_andnot_pd( active_hi, _mm_min_pd( h_hi, last_thr )));
+        _mm_storeu_pd( scores + w, h_lo );
+        _mm_storeu_pd( scores + w + 2, h_hi );
+    }
+
+    /*  left windows */
+    if( w < n_width )
+        _scan_row_scalar( row + w*step, n_width - w, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores + w );
+}
+
+
+void scanRowDepth2_scalar( const float *row, int n_width, int step, const cascadeNode *nodes,
+                           int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    _scan_row_scalar( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+void scanRowDepth2_sse( const float *row, int n_width, int step, const cascadeNode *nodes,
+                        int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    _scan_row_sse( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+void scanRowDepth2_scalar_u8( const unsigned char *row, int n_width, int step, const cascadeNode *nodes,
+                              int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    _scan_row_scalar( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+void scanRowDepth2_sse_u8( const unsigned char *row, int n_width, int step, const cascadeNode *nodes,
+                           int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    _scan_row_sse( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+void scanRowDepth2_scalar_u16( const unsigned short *row, int n_width, int step, const cascadeNode *nodes,
+                               int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    _scan_row_scalar( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+void scanRowDepth2_sse_u16( const unsigned short *row, int n_width, int step, const cascadeNode *nodes,
+                            int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    _scan_row_sse( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+
+scanRowFun getScanRowDepth2( int simd_level )
+{
+    if( simd_level >= SIMD_AVX2 )
+        return scanRowDepth2_avx2;
+    if( simd_level >= SIMD_SSE2 )
+        return scanRowDepth2_sse;
+    return scanRowDepth2_scalar;
+}
+
+scanRowFun_u8 getScanRowDepth2_u8( int simd_level )
+{
+    if( simd_level >= SIMD_AVX2 )
+        return scanRowDepth2_avx2_u8;
+    if( simd_level >= SIMD_SSE2 )
+        return scanRowDepth2_sse_u8;
+    return scanRowDepth2_scalar_u8;
+}
+
+scanRowFun_u16 getScanRowDepth2_u16( int simd_level )
+{
+    if( simd_level >= SIMD_AVX2 )
+        return scanRowDepth2_avx2_u16;
+    if( simd_level >= SIMD_SSE2 )
+        return scanRowDepth2_sse_u16;
+    return scanRowDepth2_scalar_u16;
+}
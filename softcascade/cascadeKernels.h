@@ -0,0 +1,83 @@
+#ifndef CASCADE_KERNELS_H
+#define CASCADE_KERNELS_H
+
+/* kept free of opencv headers, cascadeKernels_avx2.cpp is compiled with -mavx2 and must not
+ * instantiate any inline function shared with the other translation units */
+
+/* packed node of the combined cascade, nodes of one tree are stored contiguously, trees are
+ * stored one after another with a fixed number of nodes per tree -> 16 bytes, 4 nodes per cache line */
+struct cascadeNode
+{
+	int   fid;							/* feature index in the model window, replaced by the channel offset when resolved against a pyramid level */
+	float thr;							/* threshold, rounded up to float so that ( x < thr ) gives the same result as the double threshold for float data */
+	float hs;							/* log ratio (.5*log(p/(1-p)) of the node */
+	int   child;						/* child index in the tree, 0 for leaf */
+};
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  scanRowDepth2
+ *  Description:  evaluate a cascade of full depth-2 trees ( 7 nodes, children of p are
+ *                2p+1 and 2p+2 ) on n_width adjacent windows of one row, window w reads
+ *                its features from row + w*step + nodes[].fid
+ *                the score of a rejected window is min( score, reject_thrs[number_of_trees-1] ),
+ *                so only the windows which pass all the trees are above the last threshold
+ *                all versions give the same scores, bit by bit
+ * =====================================================================================
+ */
+typedef void (*scanRowFun)( const float *row,               /* in : feature of the first window in this row */
+                            int n_width,                    /* in : number of windows in this row */
+                            int step,                       /* in : distance between adjacent windows, in elements */
+                            const cascadeNode *nodes,       /* in : packed nodes, resolved for this pyramid level */
+                            int number_of_trees,            /* in : number of trees */
+                            int nodes_per_tree,             /* in : number of nodes reserved for each tree */
+                            const double *reject_thrs,      /* in : rejection threshold of each tree, window is rejected once the score <= reject_thrs[t] */
+                            double *scores );               /* out: n_width scores, > reject_thrs[number_of_trees-1] for accepted windows */
+
+/* one window at a time, reference version */
+void scanRowDepth2_scalar( const float *row, int n_width, int step, const cascadeNode *nodes,
+                           int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+
+/* 4 windows in each sse register */
+void scanRowDepth2_sse( const float *row, int n_width, int step, const cascadeNode *nodes,
+                        int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+
+/* 8 windows in each avx register, cpu must support avx2 */
+void scanRowDepth2_avx2( const float *row, int n_width, int step, const cascadeNode *nodes,
+                         int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+
+/* return the kernel for a simd level, SIMD_NONE -> scalar, SIMD_SSE2 -> sse, SIMD_AVX2 and above -> avx2 */
+scanRowFun getScanRowDepth2( int simd_level );
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  scanRowDepth2 on quantized channels
+ *  Description:  same kernels on uint8 or uint16 channels ( quantized pyramid ), the nodes
+ *                must hold the thresholds in the same integer domain, see
+ *                softcascade::quantizedNodes. Features are converted to float in the
+ *                registers, which is exact, so all versions still give the same scores
+ * =====================================================================================
+ */
+typedef void (*scanRowFun_u8)( const unsigned char *row, int n_width, int step, const cascadeNode *nodes,
+                               int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+typedef void (*scanRowFun_u16)( const unsigned short *row, int n_width, int step, const cascadeNode *nodes,
+                                int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+
+void scanRowDepth2_scalar_u8( const unsigned char *row, int n_width, int step, const cascadeNode *nodes,
+                              int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+void scanRowDepth2_sse_u8( const unsigned char *row, int n_width, int step, const cascadeNode *nodes,
+                           int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+void scanRowDepth2_avx2_u8( const unsigned char *row, int n_width, int step, const cascadeNode *nodes,
+                            int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+
+void scanRowDepth2_scalar_u16( const unsigned short *row, int n_width, int step, const cascadeNode *nodes,
+                               int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+void scanRowDepth2_sse_u16( const unsigned short *row, int n_width, int step, const cascadeNode *nodes,
+                            int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+void scanRowDepth2_avx2_u16( const unsigned short *row, int n_width, int step, const cascadeNode *nodes,
+                             int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores );
+
+scanRowFun_u8  getScanRowDepth2_u8( int simd_level );
+scanRowFun_u16 getScanRowDepth2_u16( int simd_level );
+
+#endif
@@ -0,0 +1,123 @@
+#include <immintrin.h>
+#include "cascadeKernels.h"
+
+/* this file is compiled with -mavx2, only call it after checking the cpu ( getCpuSimdLevel ) */
+
+/*  load the feature fid of 8 adjacent windows */
+static inline __m256 _load_windows( const float *row, int fid, int step, const __m256i &lane_offset )
+{
+    if( step == 1)
+        return _mm256_loadu_ps( row + fid );
+    return _mm256_i32gather_ps( row + fid, lane_offset, 4 );
+}
+
+/*  same on uint8 features, converted to float ( exact ) */
+static inline __m256 _load_windows( const unsigned char *row, int fid, int step, const __m256i & )
+{
+    if( step == 1)
+        return _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)( row + fid ))));
+    const unsigned char *p = row + fid;
+    return _mm256_setr_ps( p[0], p[step], p[2*step], p[3*step], p[4*step], p[5*step], p[6*step], p[7*step] );
+}
+
+/*  same on uint16 features */
+static inline __m256 _load_windows( const unsigned short *row, int fid, int step, const __m256i & )
+{
+    if( step == 1)
+        return _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)( row + fid ))));
+    const unsigned short *p = row + fid;
+    return _mm256_setr_ps( p[0], p[step], p[2*step], p[3*step], p[4*step], p[5*step], p[6*step], p[7*step] );
+}
+
+/*  the windows left after the last 8, with the scalar kernel of the same type */
+static inline void _scan_left( const float *row, int n_width, int step, const cascadeNode *nodes,
+                               int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    scanRowDepth2_scalar( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+static inline void _scan_left( const unsigned char *row, int n_width, int step, const cascadeNode *nodes,
+                               int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    scanRowDepth2_scalar_u8( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+static inline void _scan_left( const unsigned short *row, int n_width, int step, const cascadeNode *nodes,
+                               int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    scanRowDepth2_scalar_u16( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+template <typename T> static void _scan_row_avx2( const T *row,                       /* in : feature of the first window in this row */
+                                                  int n_width,                        /* in : number of windows in this row */
+                                                  int step,                           /* in : distance between adjacent windows, in elements */
+                                                  const cascadeNode *nodes,           /* in : packed nodes, resolved for this pyramid level */
+                                                  int number_of_trees,                /* in : number of trees */
+                                                  int nodes_per_tree,                 /* in : number of nodes reserved for each tree */
+                                                  const double *reject_thrs,          /* in : rejection threshold of each tree */
+                                                  double *scores )                    /* out: n_width scores */
+{
+    const __m256d last_thr = _mm256_set1_pd( reject_thrs[number_of_trees-1] );
+    const __m256i lane_offset = _mm256_mullo_epi32( _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32( step ));
+    int w = 0;
+    for( ;w+8<=n_width;w+=8)
+    {
+        const T *probe = row + w*step;
+        const cascadeNode *t_nodes = nodes;
+
+        /*  scores of window 0-3 and 4-7 are kept in double, same as the scalar version */
+        __m256d h_lo = _mm256_setzero_pd();
+        __m256d h_hi = _mm256_setzero_pd();
+        __m256d active_lo = _mm256_castsi256_pd( _mm256_set1_epi32(-1) );
+        __m256d active_hi = active_lo;
+        for( int t=0;t<number_of_trees;t++)
+        {
+            /*  all three splits are evaluated, the leaf is selected with the masks instead of branches */
+            __m256 m0 = _mm256_cmp_ps( _load_windows( probe, t_nodes[0].fid, step, lane_offset), _mm256_set1_ps( t_nodes[0].thr ), _CMP_LT_OQ );
+            __m256 m1 = _mm256_cmp_ps( _load_windows( probe, t_nodes[1].fid, step, lane_offset), _mm256_set1_ps( t_nodes[1].thr ), _CMP_LT_OQ );
+            __m256 m2 = _mm256_cmp_ps( _load_windows( probe, t_nodes[2].fid, step, lane_offset), _mm256_set1_ps( t_nodes[2].thr ), _CMP_LT_OQ );
+            __m256 left  = _mm256_blendv_ps( _mm256_set1_ps( t_nodes[4].hs ), _mm256_set1_ps( t_nodes[3].hs ), m1 );
+            __m256 right = _mm256_blendv_ps( _mm256_set1_ps( t_nodes[6].hs ), _mm256_set1_ps( t_nodes[5].hs ), m2 );
+            __m256 hs    = _mm256_blendv_ps( right, left, m0 );
+
+            /*  rejected windows add +0, their score does not change any more */
+            h_lo = _mm256_add_pd( h_lo, _mm256_and_pd( active_lo, _mm256_cvtps_pd( _mm256_castps256_ps128( hs ))));
+            h_hi = _mm256_add_pd( h_hi, _mm256_and_pd( active_hi, _mm256_cvtps_pd( _mm256_extractf128_ps( hs, 1 ))));
+            const __m256d thr = _mm256_set1_pd( reject_thrs[t] );
+            active_lo = _mm256_and_pd( active_lo, _mm256_cmp_pd( h_lo, thr, _CMP_GT_OQ ));
+            active_hi = _mm256_and_pd( active_hi, _mm256_cmp_pd( h_hi, thr, _CMP_GT_OQ ));
+            t_nodes += nodes_per_tree;
+
+            if( (_mm256_movemask_pd( active_lo ) | _mm256_movemask_pd( active_hi )) == 0 )
+                break;
+        }
+        /*  rejected windows are clamped to the last threshold, as in the scalar version */
+        h_lo = _mm256_blendv_pd( _mm256_min_pd( h_lo, last_thr ), h_lo, active_lo );
+        h_hi = _mm256_blendv_pd( _mm256_min_pd( h_hi, last_thr ), h_hi, active_hi );
+        _mm256_storeu_pd( scores + w, h_lo );
+        _mm256_storeu_pd( scores + w + 4, h_hi );
+    }
+
+    /*  left windows */
+    if( w < n_width )
+        _scan_left( row + w*step, n_width - w, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores + w );
+}
+
+
+void scanRowDepth2_avx2( const float *row, int n_width, int step, const cascadeNode *nodes,
+                         int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    _scan_row_avx2( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+void scanRowDepth2_avx2_u8( const unsigned char *row, int n_width, int step, const cascadeNode *nodes,
+                            int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    _scan_row_avx2( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
+
+void scanRowDepth2_avx2_u16( const unsigned short *row, int n_width, int step, const cascadeNode *nodes,
+                             int number_of_trees, int nodes_per_tree, const double *reject_thrs, double *scores )
+{
+    _scan_row_avx2( row, n_width, step, nodes, number_of_trees, nodes_per_tree, reject_thrs, scores );
+}
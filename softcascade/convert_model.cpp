@@ -0,0 +1,50 @@
+#include <iostream>
+#include <string>
+#include "softcascade.hpp"
+
+using namespace std;
+using namespace cv;
+
+/* convert a xml model saved by softcascade::Save into the binary format read by LoadBinary
+ * usage : convert_model model.xml model.bin */
+int main( int argc, char** argv)
+{
+    if( argc < 3)
+    {
+        cout<<"usage : "<<argv[0]<<" model.xml model.bin"<<endl;
+        return -1;
+    }
+
+    softcascade sc;
+    if(!sc.Load( argv[1] ))
+    {
+        cout<<"Can not load the model "<<argv[1]<<endl;
+        return -1;
+    }
+    if(!sc.SaveBinary( argv[2] ))
+    {
+        cout<<"Can not save the model to "<<argv[2]<<endl;
+        return -1;
+    }
+
+    /* read it back, the packed nodes have to be the same */
+    softcascade check;
+    if(!check.LoadBinary( argv[2] ))
+    {
+        cout<<"Can not read back "<<argv[2]<<endl;
+        return -1;
+    }
+    vector<cascadeNode> nodes_xml, nodes_bin;
+    Size level_size = sc.getParas().modelDsPad;
+    level_size.width /= sc.getParas().shrink;
+    level_size.height /= sc.getParas().shrink;
+    sc.resolveLevelNodes( level_size, nodes_xml );
+    check.resolveLevelNodes( level_size, nodes_bin );
+    bool same = nodes_xml.size() == nodes_bin.size();
+    for( unsigned int c=0;same && c<nodes_xml.size();c++)
+        same = nodes_xml[c].fid == nodes_bin[c].fid && nodes_xml[c].thr == nodes_bin[c].thr &&
+               nodes_xml[c].hs == nodes_bin[c].hs && nodes_xml[c].child == nodes_bin[c].child;
+    same = same && sc.getRejectThresholds() == check.getRejectThresholds();
+    cout<<argv[1]<<" -> "<<argv[2]<<" , "<<nodes_bin.size()<<" nodes, "<<( same ? "checked" : "!! differs !!")<<endl;
+    return same ? 0 : -1;
+}
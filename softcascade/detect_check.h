@@ -16,6 +16,9 @@
 #include "boost/filesystem.hpp"
 #include "boost/lambda/bind.hpp"
 
+#include "../misc/asyncWriter.h"
+#include "../misc/datasetReader.h"
+
 using namespace std;
 using namespace cv;
 
@@ -215,16 +218,24 @@ class detect_check
         long num_80_120 = 0;
         long num_above_120 = 0;
 
+        vector<string> missed_paths;
         bf::directory_iterator end_it;
         for( bf::directory_iterator file_iter( pos_fn ); file_iter!=end_it; file_iter++)
 	    {
             string pathname = file_iter->path().string();
-            string basename = bf::basename( *file_iter);
 	    	string extname  = bf::extension( *file_iter);
-            /*  both the images and groundtruth file should exist */
 	    	if( extname!=".jpg" && extname!=".bmp" && extname!=".png" && extname!=".JPG" && extname!=".BMP" && extname!=".PNG")
 	    		continue;
-            Mat img = imread( pathname );
+            missed_paths.push_back( pathname );
+        }
+
+        /* only the size is needed, decoded in gray */
+        datasetReader reader;
+        reader.open( missed_paths, 2, 16, 0 );
+        int index = 0;
+        Mat img;
+        while( reader.next( index, img ))
+        {
             if(img.empty())
                 continue;
 
@@ -238,6 +249,7 @@ class detect_check
             else
                 num_above_120++;
         }
+        reader.reportThroughput( "get_stat_on_missed", 1 );
         ofstream stat_f("stat.txt", ios::trunc);
         stat_f<<"missed face size :"<<endl;
         stat_f<<"0 - 40 \t"<<num_under_40<<endl;
@@ -290,86 +302,96 @@ class detect_check
         int number_of_target = 0;
         int number_of_fn = 0;
         int number_of_wrong = 0;
+        /* the missed targets and the false positives are saved by the writer thread */
+        asyncWriter writer;
         
-        #pragma omp parallel for num_threads(Nthreads) reduction( +: number_of_fn) reduction( +: number_of_wrong ) reduction(+:number_of_target)
-        for( int i=0;i<pos_image_path_vector.size(); i++)
-        { 
-            // reading groundtruth...
-            vector<Rect> target_rects;
-            FileStorage fst( gt_path_vector[i], FileStorage::READ | FileStorage::FORMAT_XML);
-            fst["boxes"]>>target_rects;
-            fst.release();
-            number_of_target += target_rects.size();
-
-            // reading image
-            Mat test_img = imread( pos_image_path_vector[i]);
-            vector<Rect> det_rects;
-            vector<double> det_confs;
-
-            detector.detectMultiScale( test_img, det_rects, det_confs, m_minSize, m_maxSize, m_scale_factor, m_stride, m_threshold);
-
-            /* debug show */
-            //for ( int c=0;c<det_rects.size() ; c++) {
-            //    rectangle( test_img, det_rects[c], Scalar(0,0,255), 3);
-            //    cout<<"conf is "<<det_confs[c]<<endl;
-            //}
-            //cout<<endl;
-            //imshow("test", test_img);
-            //waitKey(0);
-
-            int matched = 0;
-            vector<bool> isMatched_r( target_rects.size(), false);
-            vector<bool> isMatched_l( det_rects.size(), false);
-            for( int c=0;c<det_rects.size();c++)
+        /* the images are decoded ahead by the reader, each thread takes the next one */
+        datasetReader reader;
+        reader.open( pos_image_path_vector );
+        #pragma omp parallel num_threads(Nthreads) reduction( +: number_of_fn) reduction( +: number_of_wrong ) reduction(+:number_of_target)
+        {
+            int i = 0;
+            Mat test_img;
+            while( reader.next( i, test_img ))
             {
-                for( int k=0;k<target_rects.size();k++)	
+                // reading groundtruth...
+                vector<Rect> target_rects;
+                FileStorage fst( gt_path_vector[i], FileStorage::READ | FileStorage::FORMAT_XML);
+                fst["boxes"]>>target_rects;
+                fst.release();
+                number_of_target += target_rects.size();
+
+                vector<Rect> det_rects;
+                vector<double> det_confs;
+
+                detector.detectMultiScale( test_img, det_rects, det_confs, m_minSize, m_maxSize, m_scale_factor, m_stride, m_threshold);
+
+                /* debug show */
+                //for ( int c=0;c<det_rects.size() ; c++) {
+                //    rectangle( test_img, det_rects[c], Scalar(0,0,255), 3);
+                //    cout<<"conf is "<<det_confs[c]<<endl;
+                //}
+                //cout<<endl;
+                //imshow("test", test_img);
+                //waitKey(0);
+
+                int matched = 0;
+                vector<bool> isMatched_r( target_rects.size(), false);
+                vector<bool> isMatched_l( det_rects.size(), false);
+                for( int c=0;c<det_rects.size();c++)
                 {
-                    if( isSameTarget( det_rects[c], target_rects[k]) && !isMatched_r[k] && !isMatched_l[c])
+                    for( int k=0;k<target_rects.size();k++)	
                     {
-                        matched++;
-                        isMatched_r[k] = true;
-                        isMatched_l[c] = true;
-                        break;
+                        if( isSameTarget( det_rects[c], target_rects[k]) && !isMatched_r[k] && !isMatched_l[c])
+                        {
+                            matched++;
+                            isMatched_r[k] = true;
+                            isMatched_l[c] = true;
+                            break;
+                        }
                     }
                 }
-            }
 
-            bf::path t_path( pos_image_path_vector[i]);
-            string basename = bf::basename(t_path);
-            /*  no need for the critical section when using the reduction */
-            //#pragma omp critical
-            {
-                for(int c=0;c<isMatched_r.size();c++)
+                bf::path t_path( pos_image_path_vector[i]);
+                string basename = bf::basename(t_path);
+                /*  no need for the critical section when using the reduction */
+                //#pragma omp critical
                 {
-                    if( !isMatched_r[c] && in_the_range(target_rects[c]) )
+                    for(int c=0;c<isMatched_r.size();c++)
                     {
-                        number_of_fn++;
-                        if(m_save_images)
+                        if( !isMatched_r[c] && in_the_range(target_rects[c]) )
                         {
-                            stringstream ss;ss<<c;string index_string;ss>>index_string;
-                            string save_path = "./pos_fn/"+basename+"_"+index_string+".jpg";
-                            Mat save_img = cropImage( test_img, target_rects[c] );
-                            imwrite( save_path, save_img);
+                            number_of_fn++;
+                            if(m_save_images)
+                            {
+                                stringstream ss;ss<<c;string index_string;ss>>index_string;
+                                string save_path = "./pos_fn/"+basename+"_"+index_string+".jpg";
+                                Mat save_img = cropImage( test_img, target_rects[c] );
+                                writer.write( save_path, save_img);
+                            }
                         }
                     }
-                }
 
-                for(int c=0;c<isMatched_l.size();c++)
-                {
-                    if( !isMatched_l[c])
+                    for(int c=0;c<isMatched_l.size();c++)
                     {
-                        number_of_wrong++;
-                        if(m_save_images)
+                        if( !isMatched_l[c])
                         {
-                            stringstream ss;ss<<c;string index_string;ss>>index_string;
-                            string save_path = "./pos_fp/"+basename+"_"+index_string+".jpg";
-                            Mat save_img = cropImage( test_img, det_rects[c]);
-                            imwrite( save_path, save_img);
+                            number_of_wrong++;
+                            if(m_save_images)
+                            {
+                                stringstream ss;ss<<c;string index_string;ss>>index_string;
+                                string save_path = "./pos_fp/"+basename+"_"+index_string+".jpg";
+                                Mat save_img = cropImage( test_img, det_rects[c]);
+                                writer.write( save_path, save_img);
+                            }
                         }
                     }
                 }
             }
         }
+        reader.reportThroughput( "test_detector", Nthreads );
+
+        writer.finish();
 
         hit  = 1.0*(number_of_target - number_of_fn)/number_of_target;
         FPPI = 1.0*(number_of_wrong)/pos_image_path_vector.size();
@@ -378,6 +400,39 @@ class detect_check
         return true;
     }
 
+    /* 
+     * ===  FUNCTION  ======================================================================
+     *         Name:  compare_detectors
+     *  Description:  test_detector with two detectors on the same images, eg the float
+     *                detector and the same model on quantized channels, report the accuracy
+     *                and time delta of candidate against reference
+     * =====================================================================================
+     */
+    bool compare_detectors( detectType &reference,      /*  in : reference detector */
+                            detectType &candidate,      /*  in : detector to compare with the reference */
+                            double &delta_hit,          /*  out: hit of candidate - hit of reference */
+                            double &delta_FPPI)         /*  out: FPPI of candidate - FPPI of reference */
+    {
+        double ref_hit = 0, ref_FPPI = 0;
+        double can_hit = 0, can_FPPI = 0;
+        TickMeter ref_tk;ref_tk.start();
+        if( !test_detector( reference, ref_hit, ref_FPPI))
+            return false;
+        ref_tk.stop();
+        TickMeter can_tk;can_tk.start();
+        if( !test_detector( candidate, can_hit, can_FPPI))
+            return false;
+        can_tk.stop();
+
+        delta_hit  = can_hit - ref_hit;
+        delta_FPPI = can_FPPI - ref_FPPI;
+        cout<<"            hit \tFPPI \ttime(s)"<<endl;
+        cout<<"reference : "<<ref_hit<<" \t"<<ref_FPPI<<" \t"<<ref_tk.getTimeSec()<<endl;
+        cout<<"candidate : "<<can_hit<<" \t"<<can_FPPI<<" \t"<<can_tk.getTimeSec()<<endl;
+        cout<<"delta     : "<<delta_hit<<" \t"<<delta_FPPI<<" \tspeed up "<<ref_tk.getTimeSec()/can_tk.getTimeSec()<<endl;
+        return true;
+    }
+
     private:
 
     /* 
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <vector>
+#include <omp.h>
+#include "opencv2/highgui/highgui.hpp"
+#include "detectorSession.hpp"
+#include "../misc/NonMaxSupress.h"
+
+using namespace std;
+using namespace cv;
+
+
+DetectorSession::DetectorSession()
+{
+    m_detector = 0;
+    m_n_threads = 1;
+}
+
+
+bool DetectorSession::init( const softcascade &detector,        /* in : loaded detector */
+                            const Size &frame_size )            /* in : size of all the frames */
+{
+    if( !detector.checkModel())
+        return false;
+    if( frame_size.width < 8 || frame_size.height < 8)
+    {
+        cout<<"<DetectorSession::init><error> frame is too small "<<endl;
+        return false;
+    }
+    m_detector   = &detector;
+    m_frame_size = frame_size;
+
+    const cascadeParameter opts = detector.getParas();
+    const channels_opt &chn_opts = detector.getFeatureGen().getParas();
+    m_n_threads = opts.nThreads > 0 ? opts.nThreads : omp_get_max_threads();
+
+    /*  scales only depend on the frame size */
+    detector.getFeatureGen().planApproxPyramid( frame_size, m_state );
+    const int n_levels = m_state.scales.size();
+    const int pad_T = chn_opts.pad.height/chn_opts.shrink;
+    const int pad_R = chn_opts.pad.width/chn_opts.shrink;
+
+    m_level_nodes.resize( n_levels );
+    m_levels.resize( n_levels );
+    m_quantized_memory.resize( n_levels );
+    m_quantized_levels.resize( n_levels );
+    m_level_rects.resize( n_levels );
+    m_level_conf.resize( n_levels );
+    m_level_targets.resize( n_levels );
+    m_level_target_conf.resize( n_levels );
+    for( int c=0;c<n_levels;c++)
+    {
+        const Size level_size( m_state.ap_size[c].width + 2*pad_R, m_state.ap_size[c].height + 2*pad_T );
+        if( !detector.resolveLevelNodes( level_size, m_level_nodes[c] ))
+            return false;
+    }
+    /*  all the levels in one allocation */
+    detector.getFeatureGen().allocateApproxLevels( m_state, m_level_arena, m_level_memory );
+    return true;
+}
+
+
+bool DetectorSession::detect( const Mat &frame,                 /* in : frame, size must be the one given to init */
+                              vector<Rect> &targets,            /* out: target positions */
+                              vector<double> &confidence,       /* out: target confidence */
+                              double threshold )                /* in : detect threshold */
+{
+    if( m_detector == 0 )
+    {
+        cout<<"<DetectorSession::detect><error> session is not initialized "<<endl;
+        return false;
+    }
+    if( frame.size() != m_frame_size )
+    {
+        cout<<"<DetectorSession::detect><error> frame size "<<frame.cols<<"x"<<frame.rows<<" does not match the session "
+            <<m_frame_size.width<<"x"<<m_frame_size.height<<endl;
+        return false;
+    }
+
+    const feature_Pyramids &fea_gen = m_detector->getFeatureGen();
+    const int channel_depth = m_detector->getParas().channelDepth;
+    if( !fea_gen.computeRealLevels( frame, m_state ))
+        return false;
+
+    /*  same as the streaming detectMultiScale, with the memory kept in the session */
+    const int n_levels = m_state.scales.size();
+    int n_failed = 0;
+    #pragma omp parallel for schedule(dynamic) num_threads(m_n_threads) reduction(+:n_failed)
+    for( int c=0;c<n_levels;c++)
+    {
+        fea_gen.computeApproxLevel( m_state, c, m_level_memory[c], m_levels[c] );
+        const vector<Mat> *scanned = &m_levels[c];
+        if( channel_depth != CV_32F )
+        {
+            if( !fea_gen.quantizeLevel( m_levels[c], m_detector->getChannelScales(), channel_depth, m_quantized_memory[c], m_quantized_levels[c] ))
+            {
+                n_failed++;
+                continue;
+            }
+            scanned = &m_quantized_levels[c];
+        }
+
+        m_level_rects[c].clear();
+        m_level_conf[c].clear();
+        m_level_targets[c].clear();
+        m_level_target_conf[c].clear();
+        if( !m_detector->scanLevel( *scanned, m_level_nodes[c], m_level_rects[c], m_level_conf[c] ))
+            n_failed++;
+        softcascade::mapLevelResults( m_level_rects[c], m_level_conf[c], m_state.scales[c], m_state.scalesw[c], m_state.scalesh[c],
+                                      frame.size(), threshold, m_level_targets[c], m_level_target_conf[c] );
+    }
+    if( n_failed > 0 )
+        return false;
+
+    for( int c=0;c<n_levels;c++)
+    {
+        targets.insert( targets.end(), m_level_targets[c].begin(), m_level_targets[c].end() );
+        confidence.insert( confidence.end(), m_level_target_conf[c].begin(), m_level_target_conf[c].end() );
+    }
+
+    /*  non max supression */
+    NonMaxSupress( targets, confidence );
+    return true;
+}
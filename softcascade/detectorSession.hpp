@@ -0,0 +1,69 @@
+#ifndef DETECTOR_SESSION_HPP
+#define DETECTOR_SESSION_HPP
+
+#include <vector>
+#include "opencv2/highgui/highgui.hpp"
+#include "softcascade.hpp"
+#include "../chnfeature/Pyramid.h"
+
+using namespace std;
+using namespace cv;
+
+/* detection on a stream of frames with the same size, eg camera. Everything that depends only on
+ * the frame size is computed once in init: scales of the pyramid, the resolved nodes of each level,
+ * memory of each level and of the results of each level. detect() reuses them for every frame, only
+ * the non max supression and the targets given back still allocate for each frame */
+class DetectorSession
+{
+    public:
+        DetectorSession();
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  init
+         *  Description:  bind to a detector and a frame size, the detector has to stay alive and
+         *                unchanged as long as the session is used
+         * =====================================================================================
+         */
+        bool init( const softcascade &detector,         /* in : loaded detector */
+                   const Size &frame_size );            /* in : size of all the frames */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  detect
+         *  Description:  same as softcascade::detectMultiScale on a frame of the session size
+         * =====================================================================================
+         */
+        bool detect( const Mat &frame,                  /* in : frame, size must be the one given to init */
+                     vector<Rect> &targets,             /* out: target positions */
+                     vector<double> &confidence,        /* out: target confidence */
+                     double threshold = 0 );            /* in : detect threshold */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  getFrameSize
+         *  Description:  size given to init
+         * =====================================================================================
+         */
+        Size getFrameSize() const
+        {
+            return m_frame_size;
+        }
+
+    private:
+        const softcascade *m_detector;                  /* bound detector */
+        Size m_frame_size;                              /* size of the frames */
+        int m_n_threads;                                /* number of threads, from cascadeParameter::nThreads */
+        pyramidState m_state;                           /* scales, computed once; real layers, recomputed for each frame */
+        vector< vector<cascadeNode> > m_level_nodes;    /* resolved nodes of each level */
+        Mat m_level_arena;                              /* memory of all the levels */
+        vector<Mat> m_level_memory;                     /* memory of each level, headers on m_level_arena */
+        vector< vector<Mat> > m_levels;                 /* channel headers on m_level_memory */
+        vector<Mat> m_quantized_memory;                 /* memory of each quantized level ( channelDepth CV_8U or CV_16U ), allocated by the first frame */
+        vector< vector<Mat> > m_quantized_levels;       /* channel headers on m_quantized_memory */
+        vector< vector<Rect> > m_level_rects;           /* detections on each level, in level coordinates */
+        vector< vector<double> > m_level_conf;          /* confidence of m_level_rects */
+        vector< vector<Rect> > m_level_targets;         /* detections on each level, in image coordinates */
+        vector< vector<double> > m_level_target_conf;   /* confidence of m_level_targets */
+};
+#endif
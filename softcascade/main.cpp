@@ -2,6 +2,8 @@
 #include <vector>
 #include <algorithm>
 #include <sstream>
+#include <fstream>
+#include <cstring>
 #include <ctime>
 
 #include "opencv2/contrib/contrib.hpp"
@@ -15,7 +17,12 @@
 #include "../misc/misc.hpp"
 #include "softcascade.hpp"
 #include "../chnfeature/Pyramid.h"
+#include "../chnfeature/sseKernels.h"
 #include "../misc/NonMaxSupress.h"
+#include "../misc/segmentedVector.h"
+#include "../misc/datasetReader.h"
+#include "../misc/featureCache.h"
+#include "../misc/mappedFile.h"
 
 #include <omp.h>
 
@@ -42,35 +49,6 @@ bool isSameTarget( Rect r1, Rect r2)
 /*  random generator function */
 int myrandom (int i) { return std::rand()%i;}
 
-/* extract the center part of the feature( crossponding to the target) , save it as 
- * clomun in output_data(not continuous) */
-void makeTrainData( vector<Mat> &in_data, Mat &output_data, Size modelDs, int shrink)
-{
-    assert( output_data.type() == CV_32F);
-    assert( in_data[0].type() == CV_32F && in_data[0].isContinuous());
-
-	int w_in_data = in_data[0].cols;
-	int h_in_data = in_data[0].rows;
-
-	int w_f = modelDs.width/shrink;
-	int h_f = modelDs.height/shrink;
-    
-    assert( w_in_data > w_f && h_in_data > h_f );
-	for( int c=0;c < in_data.size(); c++)
-	{
-        float *ptr=(float*)in_data[c].ptr() + (h_in_data - h_f)/2*w_in_data + (w_in_data - w_f)/2;
-        for( int j=0;j<h_f;j++)
-        {
-            float *pp = ptr + j*w_in_data;
-            for( int i=0;i<w_f;i++)
-            {
-                output_data.at<float>( c*h_f*w_f + j*w_f+i ,0) = pp[i];    
-            }
-        }
-
-	}
-}
-
 size_t getNumberOfFilesInDir( string in_path )
 {
     bf::path c_path(in_path);   
@@ -88,75 +66,98 @@ size_t getNumberOfFilesInDir( string in_path )
 }
 
 
+/* convTri( conv_size, dim ) applied to each channel of a training window after computeChannels_sse */
+static const int train_smooth_size = 1;
+static const int train_smooth_dim = 1;
+
+/* hash of the options the feature vector of a training window depends on, part of the featureCache keys.
+ * sse2 and avx2 give the same bits, only the use of the avx512 kernels is in it */
+unsigned long long featureOptionsHash( const feature_Pyramids &ff,         /* in : feature generator */
+                                       const cascadeParameter &opts )      /* in : detector options */
+{
+    const channels_opt &c_opt = ff.getParas();
+    const int values[11] = { c_opt.shrink, c_opt.smooth, c_opt.nbins, c_opt.binsize,
+                             opts.modelDsPad.width, opts.modelDsPad.height, opts.shrink, opts.nchannels,
+                             train_smooth_size, train_smooth_dim, sseKernels().simd_level >= SIMD_AVX512 ? 1 : 0 };
+    return featureCache::hashBytes( values, sizeof(values) );
+}
+
+/* positive windows, negatives are mined by mineNegatives */
 bool sampleWins(    const softcascade &sc, 	    /*  in: detector */
                     int stage, 			        /*  in: stage */
-                    bool isPositive,            /*  in: true->sample positive, false -> sample negative */
                     bool hasGroundTruth,        /*  in: hasGroundTruth = false -> no need for xml, positive samples are cropped */
-                    vector<Mat> &samples,       /* out: target objects, flipped( only for positive)*/
-                    vector<Mat> &origsamples)   /* out: original target */
+                    unsigned long long options_hash,            /*  in: featureOptionsHash */
+                    vector<Mat> &samples,       /* out: target objects, flipped */
+                    vector<Mat> &origsamples,   /* out: original target */
+                    vector<unsigned long long> &sample_keys )   /* out: featureCache key of each of samples */
 {
     cout<<"Sampling ..."<<endl;
 	int Nthreads = omp_get_max_threads();
 
     origsamples.clear();
     samples.clear();
+    sample_keys.clear();
+    /* each thread keeps its crops and their keys, merged into origsamples after the loop */
+    segmentedVector<Mat> crops( Nthreads );
+    segmentedVector<unsigned long long> crop_keys( Nthreads );
 
     cascadeParameter opts = sc.getParas();
-    int number_to_sample = 0;
-    if(isPositive)
-        number_to_sample = opts.nPos;
-    else
-        number_to_sample = opts.nNeg;
+    int number_to_sample = opts.nPos;
     
-    if(isPositive)	//sample Positive samples or mining negative samples from positive..
+    if( hasGroundTruth)
     {
-        if( hasGroundTruth)
+        bf::path pos_img_path( opts.posImgDir );
+        bf::path pos_gt_path( opts.posGtDir );
+
+        if( !bf::exists( pos_img_path) || !bf::exists(pos_gt_path))
         {
-            bf::path pos_img_path( opts.posImgDir );
-            bf::path pos_gt_path( opts.posGtDir );
+            cout<<"pos img or gt path does not exist!"<<endl;
+            cout<<"check "<<pos_img_path<<"  and "<<pos_gt_path<<endl;
+            return false;
+        }
+        int number_pos_img = getNumberOfFilesInDir( opts.posGtDir );
 
-            if( !bf::exists( pos_img_path) || !bf::exists(pos_gt_path))
-            {
-                cout<<"pos img or gt path does not exist!"<<endl;
-                cout<<"check "<<pos_img_path<<"  and "<<pos_gt_path<<endl;
-                return false;
-            }
-            int number_pos_img = getNumberOfFilesInDir( opts.posGtDir );
+        /* iterate the folder*/
+        bf::directory_iterator end_it;
+        vector<string> image_path_vector;
+        vector<string> gt_path_vector;
 
-            /* iterate the folder*/
-            bf::directory_iterator end_it;
-            vector<string> image_path_vector;
-            vector<string> gt_path_vector;
+        for( bf::directory_iterator file_iter(pos_img_path); file_iter!=end_it; file_iter++)
+        {
+            bf::path s = *(file_iter);
+            string basename = bf::basename( s );
+            string pathname = file_iter->path().string();
+            string extname  = bf::extension( s );
+            
+            if( extname!=".jpg" && extname!=".bmp" && extname!=".png" &&
+                    extname!=".JPG" && extname!=".BMP" && extname!=".PNG")
+                continue;
 
-            for( bf::directory_iterator file_iter(pos_img_path); file_iter!=end_it; file_iter++)
+            /* check if both groundTruth and image exist */
+            bf::path gt_path( opts.posGtDir + basename + ".xml");
+            if(!bf::exists( gt_path))   // image already exists ..
             {
-                bf::path s = *(file_iter);
-                string basename = bf::basename( s );
-                string pathname = file_iter->path().string();
-                string extname  = bf::extension( s );
-                
-                if( extname!=".jpg" && extname!=".bmp" && extname!=".png" &&
-                        extname!=".JPG" && extname!=".BMP" && extname!=".PNG")
-                    continue;
-
-                /* check if both groundTruth and image exist */
-                bf::path gt_path( opts.posGtDir + basename + ".xml");
-                if(!bf::exists( gt_path))   // image already exists ..
-                {
-                    continue;
-                }
-
-                image_path_vector.push_back( pathname );
-                /* read the gt according to the image name */
-                gt_path_vector.push_back(opts.posGtDir + basename + ".xml");
+                continue;
             }
-            
 
-            #pragma omp parallel for num_threads(Nthreads) /* openmp -->but no error check in runtime ... */
-            for( int i=0;i<image_path_vector.size();i++)
-            {
-                Mat im = imread( image_path_vector[i]);
+            image_path_vector.push_back( pathname );
+            /* read the gt according to the image name */
+            gt_path_vector.push_back(opts.posGtDir + basename + ".xml");
+        }
+        
 
+        /* the images are decoded ahead by the reader, each thread takes the next one */
+        datasetReader reader;
+        reader.open( image_path_vector );
+        #pragma omp parallel num_threads(Nthreads)
+        {
+            int i = 0;
+            Mat im;
+            while( reader.next( i, im ))
+            {
+                if( im.empty())
+                    continue;
+                const unsigned long long image_hash = featureCache::hashImage( im );
                 vector<Rect> target_rects;
                 FileStorage fst( gt_path_vector[i], FileStorage::READ | FileStorage::FORMAT_XML);
                 fst["boxes"]>>target_rects;
@@ -172,50 +173,57 @@ bool sampleWins(    const softcascade &sc, 	    /*  in: detector */
                     double w_ratio = modelDsBig_width*1.0/opts.modelDs.width;
                     double h_ratio = modelDsBig_height*1.0/opts.modelDs.height;
                     target_rects[i] = resizeBbox( target_rects[i], h_ratio, w_ratio);
-                    
+                
                     /* finally crop the image */
                     Mat target_obj = cropImage( im, target_rects[i]);
                     cv::resize( target_obj, target_obj, cv::Size(modelDsBig_width, modelDsBig_height), 0, 0, INTER_AREA);
-                    #pragma omp critical
-                    {
-                        origsamples.push_back( target_obj );
-                    }
+                    crops.push_back( target_obj );
+                    crop_keys.push_back( featureCache::makeKey( image_hash, target_rects[i], false, options_hash ));
                 }
             }
         }
-        else
-        {
-            bf::path pos_img_path( opts.posImgDir );
+        reader.reportThroughput( "Sampling positives", Nthreads );
+    }
+    else
+    {
+        bf::path pos_img_path( opts.posImgDir );
 
-            if( !bf::exists( pos_img_path) )
-            {
-                cout<<"pos img or gt path does not exist!"<<endl;
-                return false;
-            }
-            int number_pos_img = getNumberOfFilesInDir( opts.posGtDir );
+        if( !bf::exists( pos_img_path) )
+        {
+            cout<<"pos img or gt path does not exist!"<<endl;
+            return false;
+        }
+        int number_pos_img = getNumberOfFilesInDir( opts.posGtDir );
 
-            /* iterate the folder*/
-            bf::directory_iterator end_it;
-            vector<string> image_path_vector;
-            for( bf::directory_iterator file_iter(pos_img_path); file_iter!=end_it; file_iter++)
-            {
-                bf::path s = *(file_iter);
-                string basename = bf::basename( s );
-                string pathname = file_iter->path().string();
-                string extname  = bf::extension( s );
-                
-                if( extname!=".jpg" && extname!=".bmp" && extname!=".png" &&
-                        extname!=".JPG" && extname!=".BMP" && extname!=".PNG")
-                    continue;
-                image_path_vector.push_back( pathname );
-            }
+        /* iterate the folder*/
+        bf::directory_iterator end_it;
+        vector<string> image_path_vector;
+        for( bf::directory_iterator file_iter(pos_img_path); file_iter!=end_it; file_iter++)
+        {
+            bf::path s = *(file_iter);
+            string basename = bf::basename( s );
+            string pathname = file_iter->path().string();
+            string extname  = bf::extension( s );
             
+            if( extname!=".jpg" && extname!=".bmp" && extname!=".png" &&
+                    extname!=".JPG" && extname!=".BMP" && extname!=".PNG")
+                continue;
+            image_path_vector.push_back( pathname );
+        }
+        
 
-            #pragma omp parallel for num_threads(Nthreads) /* openmp -->but no error check in runtime ... */
-            for( int i=0;i<image_path_vector.size();i++)
+        /* the images are decoded ahead by the reader, each thread takes the next one */
+        datasetReader reader;
+        reader.open( image_path_vector );
+        #pragma omp parallel num_threads(Nthreads)
+        {
+            int i = 0;
+            Mat im;
+            while( reader.next( i, im ))
             {
-                Mat im = imread( image_path_vector[i]);
-
+                if( im.empty())
+                    continue;
+                const unsigned long long image_hash = featureCache::hashImage( im );
                 /*  resize the rect to fixed widht / height ratio, for pedestrain det , is 41/100 for INRIA database */
                 Rect target_rects = resizeToFixedRatio( target_rects, opts.modelDs.width*1.0/opts.modelDs.height, 1); /* respect to height */
                 target_rects = Rect(0, 0, im.cols, im.rows);
@@ -225,121 +233,281 @@ bool sampleWins(    const softcascade &sc, 	    /*  in: detector */
                 double w_ratio = modelDsBig_width*1.0/opts.modelDs.width;
                 double h_ratio = modelDsBig_height*1.0/opts.modelDs.height;
                 target_rects = resizeBbox( target_rects, h_ratio, w_ratio);
-                
+            
                 /* finally crop the image */
                 Mat target_obj = cropImage( im, target_rects);
                 cv::resize( target_obj, target_obj, cv::Size(modelDsBig_width, modelDsBig_height), 0, 0, INTER_AREA);
-                #pragma omp critical
-                {
-                    origsamples.push_back( target_obj );
-                }
+                crops.push_back( target_obj );
+                crop_keys.push_back( featureCache::makeKey( image_hash, target_rects, false, options_hash ));
             }
         }
+        reader.reportThroughput( "Sampling positives", Nthreads );
+    }
 
-        /* sample target if n_target > number_to_sample */
-        if( origsamples.size() > number_to_sample)
-        {
-            std::random_shuffle( origsamples.begin(), origsamples.end(), myrandom);
-            origsamples.resize( number_to_sample);
-        }
-        
-        samples.resize( origsamples.size()*2); int copy_offset = origsamples.size();
-        for(int i = 0; i<origsamples.size(); i++ )
-        {
-            samples[i] = origsamples[i].clone();
-            Mat flipped_target; cv::flip( origsamples[i], flipped_target, 1 );
-            samples[i+copy_offset] = flipped_target;
-        }
+    vector<Mat> all_crops;
+    vector<unsigned long long> all_keys;
+    crops.merge( all_crops );
+    crop_keys.merge( all_keys );
+
+    /* sample target if n_target > number_to_sample */
+    vector<int> order( all_crops.size() );
+    for( unsigned int i=0;i<order.size();i++)
+        order[i] = i;
+    if( order.size() > number_to_sample)
+    {
+        std::random_shuffle( order.begin(), order.end(), myrandom);
+        order.resize( number_to_sample);
+    }
+    origsamples.resize( order.size() );
+    vector<unsigned long long> orig_keys( order.size() );
+    for( unsigned int i=0;i<order.size();i++)
+    {
+        origsamples[i] = all_crops[ order[i] ];
+        orig_keys[i] = all_keys[ order[i] ];
     }
-    else /* for negative samples */
+    
+    samples.resize( origsamples.size()*2); int copy_offset = origsamples.size();
+    sample_keys.resize( samples.size() );
+    for(int i = 0; i<origsamples.size(); i++ )
     {
-		bf::path neg_img_path(opts.negImgDir);
-		int number_target_per_image = opts.nPerNeg;
+        samples[i] = origsamples[i].clone();
+        Mat flipped_target; cv::flip( origsamples[i], flipped_target, 1 );
+        samples[i+copy_offset] = flipped_target;
+        sample_keys[i] = orig_keys[i];
+        sample_keys[i+copy_offset] = featureCache::makeKey( orig_keys[i], Rect(), true, options_hash );
+    }
+    cout<<"Sampling done "<<endl;
+    return true;
+}
 
-		if(!bf::exists(neg_img_path))
-		{
-			cout<<"negative image folder path "<<neg_img_path<<" dose not exist "<<endl;
-			return false;
-		}
+/* uniform sample of at most capacity windows out of a stream ( reservoir sampling ), one per mining thread */
+struct windowReservoir
+{
+    vector<Mat> columns;    /* feature columns of the kept windows */
+    int capacity;
+    long long seen;         /* number of windows offered */
+    RNG rng;
+
+    void init( int cap, unsigned int seed )
+    {
+        columns.clear();
+        capacity = cap;
+        seen = 0;
+        rng = RNG( seed );
+    }
 
-		int number_of_neg_images = 	getNumberOfFilesInDir( opts.negImgDir );
+    /* slot for the next window of the stream, -1 -> the window is dropped, no need to compute its features */
+    int offer()
+    {
+        seen++;
+        if( seen <= capacity )
+        {
+            columns.push_back( Mat() );
+            return columns.size()-1;
+        }
+        long long j = (long long)( rng.uniform( 0.0, 1.0 )*seen );
+        return j < capacity ? (int)j : -1;
+    }
+};
+
+/* mine negative windows from opts.negImgDir, stage 0 -> random windows, otherwise the false positives of sc ( hard negatives ).
+ * Images are taken in random order and the mining stops once opts.nNeg windows are found, at most opts.nPerNeg per image.
+ * The features of the random windows are computed right away, the ones of the hard negatives are copied from the pyramid
+ * ( softcascade::detectFeatures ), crops are not kept, each thread keeps a reservoir of at most opts.nNeg feature columns */
+bool mineNegatives( const softcascade &sc,         /*  in: detector */
+                    const feature_Pyramids &ff,    /*  in: feature generator */
+                    int stage,                     /*  in: stage */
+                    featureCache *cache,           /*  in: features of the random windows already computed, can be 0 */
+                    unsigned long long options_hash,   /*  in: featureOptionsHash, for the cache keys */
+                    Mat &neg_data )                /* out: features of the negatives, one column per window */
+{
+    cout<<"Mining negatives ..."<<endl;
+    TickMeter tk;tk.start();
+    const cascadeParameter opts = sc.getParas();
+    const int Nthreads = omp_get_max_threads();
+    const int feature_dim = opts.modelDsPad.width/opts.shrink*opts.modelDsPad.height/opts.shrink*opts.nchannels;
+    const int modelDsBig_width = std::max( 8*opts.shrink, opts.modelDsPad.width)+std::max(2, 64/opts.shrink)*opts.shrink;
+    const int modelDsBig_height = std::max( 8*opts.shrink,opts.modelDsPad.height)+std::max(2,64/opts.shrink)*opts.shrink;
+
+    bf::path neg_img_path(opts.negImgDir);
+    if(!bf::exists(neg_img_path))
+    {
+        cout<<"negative image folder path "<<neg_img_path<<" dose not exist "<<endl;
+        return false;
+    }
 
-		/* shuffle the path */
-		vector<string> neg_paths;
-        bf::directory_iterator end_it;int number_target = 0;
-        for( bf::directory_iterator file_iter(neg_img_path); file_iter!=end_it; file_iter++)
-		{
-            string pathname = file_iter->path().string();
-			string extname  = bf::extension( *file_iter);
-			if( extname!=".jpg" && extname!=".bmp" && extname!=".png" &&
-					extname!=".JPG" && extname!=".BMP" && extname!=".PNG")
-				continue;
-			neg_paths.push_back( pathname );
-		}
-		std::random_shuffle( neg_paths.begin(), neg_paths.end(),myrandom);
-       
-		#pragma omp parallel for num_threads(Nthreads) /* openmp -->but no error check in runtime ... */
-		for( int c=0;c<number_of_neg_images ;c++)
-		{
-			vector<Rect> target_rects;
+    /* shuffle the path */
+    vector<string> neg_paths;
+    bf::directory_iterator end_it;
+    for( bf::directory_iterator file_iter(neg_img_path); file_iter!=end_it; file_iter++)
+    {
+        string pathname = file_iter->path().string();
+        string extname  = bf::extension( *file_iter);
+        if( extname!=".jpg" && extname!=".bmp" && extname!=".png" &&
+                extname!=".JPG" && extname!=".BMP" && extname!=".PNG")
+            continue;
+        neg_paths.push_back( pathname );
+    }
+    std::random_shuffle( neg_paths.begin(), neg_paths.end(),myrandom);
+    datasetReader reader;
+    reader.open( neg_paths, 2, 2*Nthreads );
+
+    vector<windowReservoir> reservoirs( Nthreads );
+    for( int c=0;c<Nthreads;c++)
+        reservoirs[c].init( opts.nNeg, std::rand() );
+    int n_found = 0;
+    int n_images = 0;
+
+    /* the images are decoded ahead by the reader, each thread takes the next one */
+    #pragma omp parallel num_threads(Nthreads)
+    {
+        windowReservoir &reservoir = reservoirs[ omp_get_thread_num() ];
+        int index = 0;
+        Mat img;
+        while( reader.next( index, img ))
+        {
+            if( img.empty())
+                continue;
+            vector<Rect> target_rects;
             vector<double> conf_v;
-
-			Mat img = imread( neg_paths[c] );
-            //if(img.empty())
-            //{
-            //    cout<<"can not read image "<<neg_paths[c]<<endl;
-            //    return false;
-            //}
-			/*  inf stage == 0, first time just sample the image, otherwise add the "hard sample" */
-			if( stage==0 )
-			{
+            /*  inf stage == 0, first time just sample the image, otherwise add the "hard sample" */
+            if( stage==0 )
+            {
                 /*  sampling and shuffle  */
-				sampleRects( number_target_per_image, img.size(), opts.modelDs, target_rects );
+                sampleRects( opts.nPerNeg, img.size(), opts.modelDs, target_rects );
                 std::random_shuffle( target_rects.begin(), target_rects.end() , myrandom);
-				if( target_rects.size() > number_target_per_image)
-					target_rects.resize( number_target_per_image );
-			}
-			else
-			{
-                /* boostrap the negative samples */
-                sc.detectMultiScale( img, target_rects, conf_v, Size(0,0), Size(0,0) );
-
-                if( target_rects.size() > number_target_per_image )
-                    target_rects.resize( number_target_per_image);
-			}
-            /*  resize the rect to fixed widht / height ratio, for pedestrain det , is 41/100 for INRIA database */
-            for ( int i=0;i<target_rects.size();i++) 
-            {
-                target_rects[i] = resizeToFixedRatio( target_rects[i], opts.modelDs.width*1.0/opts.modelDs.height, 1); /* respect to height */
-                /* grow it a little bit */
-                int modelDsBig_width = std::max( 8*opts.shrink, opts.modelDsPad.width)+std::max(2, 64/opts.shrink)*opts.shrink;
-                int modelDsBig_height = std::max( 8*opts.shrink,opts.modelDsPad.height)+std::max(2,64/opts.shrink)*opts.shrink;
+                if( (int)target_rects.size() > opts.nPerNeg )
+                    target_rects.resize( opts.nPerNeg );
+                const unsigned long long image_hash = cache ? featureCache::hashImage( img ) : 0;
 
-                double w_ratio = modelDsBig_width*1.0/opts.modelDs.width;
-                double h_ratio = modelDsBig_height*1.0/opts.modelDs.height;
-                target_rects[i] = resizeBbox( target_rects[i], h_ratio, w_ratio);
-                
-                /* finally crop the image */
-                Mat target_obj = cropImage( img, target_rects[i]);
-                cv::resize( target_obj, target_obj, cv::Size(modelDsBig_width, modelDsBig_height), 0, 0, INTER_AREA);
-                #pragma omp critical
+                for ( int i=0;i<target_rects.size();i++)
                 {
-                    origsamples.push_back( target_obj );
+                    int slot = reservoir.offer();
+                    if( slot < 0 )
+                        continue;
+                    /*  resize the rect to fixed widht / height ratio, then grow it a little bit, same as the positives */
+                    Rect r = resizeToFixedRatio( target_rects[i], opts.modelDs.width*1.0/opts.modelDs.height, 1);
+                    r = resizeBbox( r, modelDsBig_height*1.0/opts.modelDs.height, modelDsBig_width*1.0/opts.modelDs.width );
+                    Mat &column = reservoir.columns[slot];
+                    column.create( feature_dim, 1, CV_32F );
+                    const unsigned long long key = featureCache::makeKey( image_hash, r, false, options_hash );
+                    if( cache && cache->lookup( key, column ))
+                        continue;
+
+                    Mat target_obj = cropImage( img, r );
+                    cv::resize( target_obj, target_obj, cv::Size(modelDsBig_width, modelDsBig_height), 0, 0, INTER_AREA);
+
+                    vector<Mat> feas;
+                    ff.computeChannels_sse( target_obj, feas );
+                    for(int j=0;j<feas.size();j++)
+                        ff.convTri( feas[j], feas[j], train_smooth_size, train_smooth_dim );
+                    makeTrainData( feas, column, opts.modelDsPad, opts.shrink );
+                    if( cache )
+                        cache->insert( key, column );
                 }
             }
-		}
-        /* random shuffle and sampling  */
-        if(origsamples.size() > number_to_sample)
-        {
-            std::random_shuffle( origsamples.begin(), origsamples.end(), myrandom);
-            origsamples.resize( number_to_sample );
+            else
+            {
+                /* boostrap the negative samples, their features come with them from the pyramid */
+                Mat hard_features;
+                if( !sc.detectFeatures( img, target_rects, conf_v, hard_features ))
+                {
+                    cout<<"<mineNegatives><warning> detectFeatures failed on image "<<index<<", skipped"<<endl;
+                    continue;
+                }
+                if( (int)target_rects.size() > opts.nPerNeg )
+                    target_rects.resize( opts.nPerNeg );
+                for( int i=0;i<target_rects.size();i++)
+                {
+                    int slot = reservoir.offer();
+                    if( slot >= 0 )
+                        hard_features.col(i).copyTo( reservoir.columns[slot] );
+                }
+            }
+
+            bool enough = false;
+            #pragma omp critical(mine_negatives_count)
+            {
+                n_images++;
+                n_found += target_rects.size();
+                enough = n_found >= opts.nNeg;
+            }
+            if( enough )
+                reader.stop();
         }
     }
-    cout<<"Sampling done "<<endl;
+
+    /* random shuffle and sampling  */
+    vector<Mat*> found;
+    for( int c=0;c<Nthreads;c++)
+        for( unsigned int i=0;i<reservoirs[c].columns.size();i++)
+            found.push_back( &reservoirs[c].columns[i] );
+    if( (int)found.size() > opts.nNeg )
+    {
+        std::random_shuffle( found.begin(), found.end(), myrandom );
+        found.resize( opts.nNeg );
+    }
+    neg_data = Mat::zeros( feature_dim, found.size(), CV_32F );
+    for( unsigned int c=0;c<found.size();c++)
+        found[c]->copyTo( neg_data.col(c) );
+
+    tk.stop();
+    reader.reportThroughput( "Mining negatives", Nthreads );
+    cout<<"Mining done, "<<n_images<<" of "<<neg_paths.size()<<" images, "<<n_found<<" windows found, "
+        <<neg_data.cols<<" kept, time "<<tk.getTimeSec()<<" s"<<endl;
     return true;
 }
- 
-int runTrainAndTest()
+
+/* the float negatives of a stage on disk, read back by the next stage for the windows it keeps.
+ * Layout : rows and cols ( 2 ints ), then the rows of data one after the other */
+bool saveNegatives( const string &path,        /*  in: file to write */
+                    const Mat &data )          /*  in: featuredim x number neg, CV_32F */
+{
+    ofstream out( path.c_str(), ios::out | ios::binary | ios::trunc );
+    const int info[2] = { data.rows, data.cols };
+    out.write( reinterpret_cast<const char*>( info ), sizeof(info) );
+    for( int r=0;r<data.rows;r++)
+        out.write( reinterpret_cast<const char*>( data.ptr<float>(r) ), data.cols*sizeof(float) );
+    out.close();
+    if( !out.good())
+    {
+        cout<<"<saveNegatives><error> can not write "<<path<<endl;
+        return false;
+    }
+    return true;
+}
+
+/* copy the columns keep of the negatives saved by saveNegatives to the first keep.size() columns of data */
+bool loadNegatives( const string &path,        /*  in: file written by saveNegatives */
+                    const vector<int> &keep,   /*  in: columns to read */
+                    Mat &data )                /* out: featuredim x ( >= keep.size() ), CV_32F */
+{
+    if( keep.empty() )
+        return true;
+    mappedFile file;
+    if( !file.open( path ))
+        return false;
+    int info[2] = { 0, 0 };
+    if( file.size() >= sizeof(info) )
+        memcpy( info, file.data(), sizeof(info) );
+    if( info[0] != data.rows || info[1] <= 0 || file.size() != sizeof(info) + (size_t)info[0]*info[1]*sizeof(float) )
+    {
+        cout<<"<loadNegatives><error> "<<path<<" does not hold "<<data.rows<<" dim negatives"<<endl;
+        return false;
+    }
+    /* the mapping is page aligned, the floats after the 8 bytes header are aligned too */
+    const float *in = reinterpret_cast<const float*>( file.data() + sizeof(info) );
+    for( int r=0;r<data.rows;r++)
+    {
+        const float *row = in + (size_t)r*info[1];
+        float *o = data.ptr<float>(r);
+        for( unsigned int i=0;i<keep.size();i++)
+            o[i] = row[ keep[i] ];
+    }
+    return true;
+}
+
+int runTrainAndTest( const string &output_dir )     /* in : folder of the model and of the training files */
 {
     std::srand ( unsigned ( std::time(0) ) );
     Mat Km = get_Km(1);
@@ -378,9 +546,8 @@ int runTrainAndTest()
     sc.setDebug( false);
     sc.setFeatureGen( ff1 );
 
-    vector<Mat> neg_samples;
-    vector<Mat> neg_origsamples;
-    vector<Mat> neg_previousSamples;
+    Mat neg_mined_data;             /* features of the negatives mined in this stage, one column per window */
+    int n_previous = 0;             /* number of negatives used by the previous stage, their features are in neg_previous_path */
 
     vector<Mat> pos_samples;
     vector<Mat> pos_origsamples;
@@ -393,6 +560,31 @@ int runTrainAndTest()
     Mat pos_train_data;
     Mat neg_train_data;
 
+    /* the model and the training files go to output_dir */
+    bf::path out_path( output_dir );
+    if( !bf::exists( out_path ) && !bf::create_directories( out_path ))
+    {
+        cout<<"<runTrainAndTest><error> can not create output folder "<<out_path<<endl;
+        return -1;
+    }
+    /* quantized training data is written here for each stage, the training maps it instead of
+     * keeping the float and the quantized data in memory */
+    string train_store_path = ( out_path / "train_data.qstore" ).string();
+    /* float negatives of the last stage, only the kept ones are read back */
+    string neg_previous_path = ( out_path / "train_negatives.f32" ).string();
+    /* positives are the same for all the stages, their range is reused */
+    quantizeCache pos_quantize_cache;
+    /* feature vectors of the positives and of the random negatives, kept from one run to the next */
+    const unsigned long long options_hash = featureOptionsHash( ff1, cas_para );
+    featureCache feature_cache;
+    featureCache *cache = &feature_cache;       /* 0 once the cache fails, the features are computed again */
+    if( !feature_cache.open( ( out_path / "train_features.fcache" ).string(), final_feature_dim, options_hash ))
+    {
+        cout<<"<runTrainAndTest><warning> feature cache disabled"<<endl;
+        cache = 0;
+    }
+    vector<unsigned long long> pos_keys;
+
     vector<Adaboost> v_ab;
 	/*-----------------------------------------------------------------------------
 	 *  Step 2 : iterate bootstraping and training
@@ -404,7 +596,7 @@ int runTrainAndTest()
 		/*  2--> compute lambdas */
 		if( stage == 0)
 		{
-            sampleWins( sc, stage, true,has_groundtruth,  pos_samples, pos_origsamples);
+            sampleWins( sc, stage, has_groundtruth, options_hash, pos_samples, pos_origsamples, pos_keys );
             ff1.compute_lambdas( pos_origsamples );
 		}
 
@@ -412,20 +604,30 @@ int runTrainAndTest()
         if( stage == 0)
         {
             cout<<"->Making positive training data ";
+            pos_quantize_cache.generation++;        /* new positives, their range is computed again */
             pos_train_data = Mat::zeros( final_feature_dim, pos_samples.size(), CV_32F);
             #pragma omp parallel for num_threads(Nthreads)
             for ( int c=0;c<pos_samples.size();c++) 
             {
+                Mat tmp = pos_train_data.col(c);
+                if( cache && cache->lookup( pos_keys[c], tmp ))
+                    continue;
                 vector<Mat> feas;
                 ff1.computeChannels_sse( pos_samples[c], feas );
                 
                 for(int i=0;i<feas.size();i++)
                 {
-                    ff1.convTri( feas[i], feas[i], 1,1);
+                    ff1.convTri( feas[i], feas[i], train_smooth_size, train_smooth_dim );
                 }
 
-                Mat tmp = pos_train_data.col(c);
                 makeTrainData( feas, tmp , cas_para.modelDsPad, cas_para.shrink);
+                if( cache )
+                    cache->insert( pos_keys[c], tmp );
+            }
+            if( cache && !cache->flush())
+            {
+                cout<<"<runTrainAndTest><warning> feature cache disabled"<<endl;
+                cache = 0;
             }
             /* delete others */
             vector<Mat>().swap(pos_samples);
@@ -434,51 +636,65 @@ int runTrainAndTest()
         }
 
 		/* 4--> sample negatives and compute features, accumulate negatives from previous stages */
-        sampleWins( sc, stage, false, has_groundtruth,  neg_samples, neg_origsamples );          /* remember the neg_samples is empty */
-
-        vector<Mat> accu_neg;
-        if( stage ==0 )                                   /* stage == 0 */
+        if( !mineNegatives( sc, ff1, stage, cache, options_hash, neg_mined_data ))
+            return -1;
+        if( cache && !cache->flush())
         {
-            accu_neg = neg_origsamples;
+            cout<<"<runTrainAndTest><warning> feature cache disabled"<<endl;
+            cache = 0;
         }
-        else
+        if( cache )
         {
-            int n1 = std::max(cas_para.nAccNeg,cas_para.nNeg)-neg_origsamples.size();   /* how many will be save from previous stage */
-			cout<<"add 'hard example' "<<neg_origsamples.size()<<", keep "<<n1<<" neg examples from previous stage "<<endl;
-            if( n1 < neg_previousSamples.size())
-            {
-                std::random_shuffle( neg_previousSamples.begin(), neg_previousSamples.end(), myrandom);
-                neg_previousSamples.resize( n1 );
-            }
-            accu_neg.reserve( neg_previousSamples.size() + neg_origsamples.size() );
-            accu_neg.insert( accu_neg.begin(), neg_origsamples.begin(), neg_origsamples.end());    
-            accu_neg.insert( accu_neg.begin(), neg_previousSamples.begin(), neg_previousSamples.end());
+            long cache_hits = 0, cache_misses = 0;
+            cache->getStats( cache_hits, cache_misses );
+            cout<<"feature cache : "<<cache_hits<<" hits, "<<cache_misses<<" misses"<<endl;
         }
-        neg_previousSamples = accu_neg;
-        neg_train_data = Mat::zeros( final_feature_dim, accu_neg.size(), CV_32F);
 
-        cout<<"->Making negative training data ";
-        #pragma omp parallel for num_threads(Nthreads)
-        for ( int c=0;c<accu_neg.size();c++)
+        if( stage ==0 )                                   /* stage == 0 */
         {
-            vector<Mat> feas;
-            ff1.computeChannels_sse( accu_neg[c], feas );
-            for(int i=0;i<feas.size();i++)
+            neg_train_data = neg_mined_data;
+        }
+        else
+        {
+            int n1 = std::max(cas_para.nAccNeg,cas_para.nNeg)-neg_mined_data.cols;   /* how many will be save from previous stage */
+			cout<<"add 'hard example' "<<neg_mined_data.cols<<", keep "<<n1<<" neg examples from previous stage "<<endl;
+            vector<int> keep( n_previous );
+            for( int c=0;c<n_previous;c++)
+                keep[c] = c;
+            if( n1 < (int)keep.size())
             {
-                ff1.convTri( feas[i], feas[i], 1, 1);
+                std::random_shuffle( keep.begin(), keep.end(), myrandom);
+                keep.resize( std::max( n1, 0 ) );
+                std::sort( keep.begin(), keep.end() );
             }
-            Mat tmp = neg_train_data.col(c);
-            makeTrainData( feas, tmp , cas_para.modelDsPad, cas_para.shrink);
+            neg_train_data = Mat::zeros( final_feature_dim, keep.size() + neg_mined_data.cols, CV_32F);
+            if( !loadNegatives( neg_previous_path, keep, neg_train_data ))
+                return -1;
+            if( neg_mined_data.cols > 0 )
+                neg_mined_data.copyTo( neg_train_data.colRange( keep.size(), neg_train_data.cols ));
         }
-        cout<<"done. number : "<<accu_neg.size()<<endl;
+        neg_mined_data = Mat();
+        /* features of the accumulated negatives go to disk, they are not computed again in the next stage */
+        if( !saveNegatives( neg_previous_path, neg_train_data ))
+            return -1;
+        n_previous = neg_train_data.cols;
 
         cout<<"neg_train_data's size "<<neg_train_data.size()<<"feature dim "<<neg_train_data.rows<<endl;
         cout<<"pos_train_data's size "<<pos_train_data.size()<<"feature dim "<<pos_train_data.rows<<endl;
 
-		/* 5-->  train boosted classifiers */
+        /* 5--> write the quantized data, the float negatives are released before the boosting */
+        cout<<"->Writing quantized training data to "<<train_store_path<<endl;
+        if( !quantizedStore::write( train_store_path, neg_train_data, pos_train_data, tree_par.nBins, &pos_quantize_cache ))
+            return -1;
+        neg_train_data = Mat();
+        Ptr<quantizedStore> train_store = new quantizedStore();
+        if( !train_store->open( train_store_path ))
+            return -1;
+
+		/* 6-->  train boosted classifiers */
         Adaboost ab;ab.SetDebug(false);  
         cout<<"-- Training with "<<cas_para.nWeaks[stage]<<" weak classifiers."<<endl;
-        ab.Train( neg_train_data, pos_train_data, cas_para.nWeaks[stage], tree_par);
+        ab.Train( train_store, cas_para.nWeaks[stage], tree_par);
         
 		vector<Adaboost> t_v;
         t_v.push_back( ab );
@@ -490,8 +706,7 @@ int runTrainAndTest()
         double avg_train_neg_score = 0;
         Mat pre_neg_score;
         Mat pre_pos_score;
-        ab.Apply( pos_train_data, pre_pos_score);
-        ab.Apply( neg_train_data, pre_neg_score);
+        ab.getTrainScores( pre_neg_score, pre_pos_score );
         for( int c=0;c<pre_pos_score.rows;c++)
         {
             avg_train_pos_score += pre_pos_score.at<double>(c,0);
@@ -510,14 +725,14 @@ int runTrainAndTest()
     pos_train_data = Mat::zeros(1,1,CV_32F);
 
     /*  save the model */
-    sc.Save("for_test_sc.xml");
+    sc.Save( ( out_path / "for_test_sc.xml" ).string() );
     return 0;
 }
 
 
 
-/* detector parameter define */
+/* detector parameter define, argv[1] is the output folder, the current one by default */
 int main( int argc, char** argv)
 {
-    return runTrainAndTest();
+    return runTrainAndTest( argc > 1 ? argv[1] : "." );
 }
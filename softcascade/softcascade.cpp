@@ -4,6 +4,10 @@
 #include <assert.h>
 #include <cmath>
 #include <sstream>
+#include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <omp.h>
 #include "opencv2/highgui/highgui.hpp"
 #include "softcascade.hpp"
 #include "../binaryTree/binarytree.hpp"
@@ -14,8 +18,180 @@
 using namespace cv;
 using namespace std;
 
+/* level sizes kept by softcascade::levelNodes */
+#define MAX_RESOLVED_LEVELS 256
 
-template <typename T> void _apply( const T *input_data,                 /* in : (nchannels*nheight)x(nwidth) channels feature, already been scaled with shrink*/
+/* resolve the feature index to the offset in a level, fid = c*mh*mw + h*mw + w  ->  c*in_height*in_width + h*in_width + w */
+static void resolveNodes( const cascadeNode *nodes,                /* in : packed nodes, fid is the index in the model window */
+                          const int &number_of_nodes,               /* in : number of nodes */
+                          const int &in_width,                      /* in : width of a single channel image */
+                          const int &in_height,                     /* in : height of a single channel image */
+                          const cascadeParameter &opts,             /* in : detector options */
+                          vector<cascadeNode> &level_nodes )        /* out: same nodes, fid is the offset in this level */
+{
+    const int model_w = opts.modelDsPad.width/opts.shrink;
+    const int model_h = opts.modelDsPad.height/opts.shrink;
+    level_nodes.assign( nodes, nodes + number_of_nodes );
+    for( int c=0;c<level_nodes.size();c++)
+    {
+        const int fid = level_nodes[c].fid;
+        const int nc  = fid/(model_w*model_h);
+        const int pos = fid - nc*model_w*model_h;
+        level_nodes[c].fid = nc*in_width*in_height + (pos/model_w)*in_width + pos%model_w;
+    }
+}
+
+
+/* STATS = true -> the number of trees and split nodes evaluated by each window is added to stats,
+ * the STATS = false instantiation has no trace of it */
+template <typename T, bool STATS> void _apply( const T *input_data,                 /* in : (nchannels*nheight)x(nwidth) channels feature, already been scaled with shrink*/
+                                               const int &in_width,                 /* in : width of a single channel image */
+                                               const int &in_height,                /* in : height of a single channel image */
+                                               const vector<cascadeNode> &nodes,    /* in : packed nodes of the cascade, resolved for this level ( resolveNodes ) */
+                                               const int &nodes_per_tree,           /* in : number of nodes reserved for each tree in nodes */
+                                               const cascadeParameter &opts,        /* in : detector options */
+                                               const double *reject_thrs,           /* in : rejection threshold of each tree, the last one is cascThr */
+                                               const int &tree_depth,               /* in : 0 if tree varies, number of nodes otherwise */
+                                               const int &row_begin,                /* in : first row of windows to scan */
+                                               const int &row_end,                  /* in : last row of windows to scan + 1 */
+                                               vector<Rect> &results,               /* out: detected results */
+                                               vector<double> &confidence,          /* out: detection confidence, same size as results */
+                                               cascadeStats *stats )                /* out: evaluation depth, only used if STATS */
+{
+    const int shrink      = opts.shrink;
+    const int modelHeight = opts.modelDsPad.height;
+    const int modelWidth  = opts.modelDsPad.width;
+    const int modelW_fit  = opts.modelDs.width;
+    const int modelH_fit  = opts.modelDs.height;
+    const int modelW_shift= (modelWidth - opts.modelDs.width)/2 - opts.pad.width;
+    const int modelH_shift= (modelHeight- opts.modelDs.height)/2 - opts.pad.height;
+    const int stride      = opts.stride;
+    const int number_of_trees = nodes.size()/nodes_per_tree;
+
+    /* calculate the scan step on cols */
+    int n_width  = (int) ceil((in_width*shrink-modelWidth+1)/stride);
+
+    const cascadeNode *t_nodes_start = &nodes[0];
+
+    /*  apply classifier to each block */
+    for(int c=row_begin;c<row_end;c++)
+    {
+        for(int w=0;w<n_width;w++)
+        {
+            const T *probe_feature_starter = input_data + (c*stride/shrink)*in_width + (w*stride/shrink);
+            const cascadeNode *t_nodes = t_nodes_start;
+            double h=0;
+            int n_trees = number_of_trees;
+            int n_visits = 0;
+            
+            /*  full tree case, save the look up operation with child */
+            if( tree_depth != 0)
+            {
+                for( int t=0;t<number_of_trees;t++)
+                {
+                    int position = 0;
+                    while( t_nodes[position].child)
+                    {
+                        if( STATS )
+                            n_visits++;
+                        position = (( probe_feature_starter[t_nodes[position].fid] < t_nodes[position].thr) ? position*2+1 : position*2+2);
+                    }
+                    h += t_nodes[position].hs;
+                    t_nodes += nodes_per_tree;
+
+                    if( h <=reject_thrs[t])     /* reject once the score is less than the threshold of this tree */
+                    {
+                        h = std::min( h, opts.cascThr );
+                        if( STATS )
+                            n_trees = t+1;
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                for( int t=0;t<number_of_trees;t++)
+                {
+                    int position = 0;
+                    while( t_nodes[position].child)
+                    {
+                        if( STATS )
+                            n_visits++;
+                        position = (( probe_feature_starter[t_nodes[position].fid] < t_nodes[position].thr) ? t_nodes[position].child: t_nodes[position].child + 1);
+                    }
+                    h += t_nodes[position].hs;
+                    t_nodes += nodes_per_tree;
+
+                    if( h <=reject_thrs[t])     /* reject once the score is less than the threshold of this tree */
+                    {
+                        h = std::min( h, opts.cascThr );
+                        if( STATS )
+                            n_trees = t+1;
+                        break;
+                    }
+                }
+            }
+            if( STATS )
+                stats->addWindow( n_trees, n_visits );
+
+            /* add detection result */
+            if( h>opts.cascThr)
+            {
+                Rect tmp( w*stride+modelW_shift, c*stride+modelH_shift, modelW_fit, modelH_fit );
+                results.push_back( tmp );
+                confidence.push_back( h );
+            }
+        }
+    }
+}
+
+/* depth-2 full trees on float or quantized data, a row of windows is evaluated at a time with the simd kernels */
+template <typename T, typename scanRowKernel> static void _apply_rows( const T *input_data, /* in : (nchannels*nheight)x(nwidth) channels feature, already been scaled with shrink*/
+                         const int &in_width,                       /* in : width of a single channel image */
+                         const int &in_height,                      /* in : height of a single channel image */
+                         const vector<cascadeNode> &nodes,          /* in : packed nodes of the cascade, resolved for this level ( resolveNodes ) */
+                         const int &nodes_per_tree,                 /* in : number of nodes reserved for each tree in nodes */
+                         const cascadeParameter &opts,              /* in : detector options, stride should be a multiple of shrink */
+                         const double *reject_thrs,                 /* in : rejection threshold of each tree, the last one is cascThr */
+                         scanRowKernel scan_row,                    /* in : row kernel for T, see cascadeKernels.h */
+                         const int &row_begin,                      /* in : first row of windows to scan */
+                         const int &row_end,                        /* in : last row of windows to scan + 1 */
+                         vector<Rect> &results,                     /* out: detected results */
+                         vector<double> &confidence )               /* out: detection confidence, same size as results */
+{
+    const int shrink      = opts.shrink;
+    const int modelHeight = opts.modelDsPad.height;
+    const int modelWidth  = opts.modelDsPad.width;
+    const int modelW_fit  = opts.modelDs.width;
+    const int modelH_fit  = opts.modelDs.height;
+    const int modelW_shift= (modelWidth - opts.modelDs.width)/2 - opts.pad.width;
+    const int modelH_shift= (modelHeight- opts.modelDs.height)/2 - opts.pad.height;
+    const int stride      = opts.stride;
+    const int number_of_trees = nodes.size()/nodes_per_tree;
+
+    int n_width  = (int) ceil((in_width*shrink-modelWidth+1)/stride);
+    if( n_width <= 0 )
+        return;
+
+    vector<double> scores( n_width );
+    for( int c=row_begin;c<row_end;c++)
+    {
+        scan_row( input_data + (c*stride/shrink)*in_width, n_width, stride/shrink, &nodes[0],
+                  number_of_trees, nodes_per_tree, reject_thrs, &scores[0] );
+        for( int w=0;w<n_width;w++)
+        {
+            if( scores[w] > opts.cascThr )
+            {
+                results.push_back( Rect( w*stride+modelW_shift, c*stride+modelH_shift, modelW_fit, modelH_fit ));
+                confidence.push_back( scores[w] );
+            }
+        }
+    }
+}
+
+
+/* same as _apply, walking the nxK Mats directly, only used for comparison with the packed layout */
+template <typename T> void _apply_mat( const T *input_data,             /* in : (nchannels*nheight)x(nwidth) channels feature, already been scaled with shrink*/
                                    const int &in_width,                 /* in : width of a single channel image */
                                    const int &in_height,                /* in : height of a single channel image */
                                    const Mat &fids,                     /* in : (number_of_trees)x(number_of_nodes) fids matrix */
@@ -23,7 +199,10 @@ template <typename T> void _apply( const T *input_data,                 /* in :
                                    const Mat &thrs,                     /* in : thrs */
                                    const Mat &hs,                       /* in : hs  */
                                    const cascadeParameter &opts,        /* in : detector options */
+                                   const double *reject_thrs,           /* in : rejection threshold of each tree, the last one is cascThr */
                                    const int &tree_depth,               /* in : 0 if tree varies, number of nodes otherwise */
+                                   const int &row_begin,                /* in : first row of windows to scan */
+                                   const int &row_end,                  /* in : last row of windows to scan + 1 */
                                    vector<Rect> &results,               /* out: detected results */
                                    vector<double> &confidence )         /* out: detection confidence, same size as results */
 {
@@ -43,8 +222,7 @@ template <typename T> void _apply( const T *input_data,                 /* in :
     const int number_of_trees = fids.rows;
     const int number_of_nodes = fids.cols;
 
-    /* calculate the scan step on rows and cols */
-    int n_height = (int) ceil((in_height*shrink-modelHeight+1)/stride);
+    /* calculate the scan step on cols */
     int n_width  = (int) ceil((in_width*shrink-modelWidth+1)/stride);
 
     /* generate the feature index array */
@@ -64,7 +242,7 @@ template <typename T> void _apply( const T *input_data,                 /* in :
     int iter_offset = child.cols;                   /* shift the pointer to next tree */
 
     /*  apply classifier to each block */
-    for(int c=0;c<n_height;c++)
+    for(int c=row_begin;c<row_end;c++)
     {
         for(int w=0;w<n_width;w++)
         {
@@ -93,8 +271,11 @@ template <typename T> void _apply( const T *input_data,                 /* in :
                     t_thrs += iter_offset;
                     t_hs += iter_offset;
 
-                    if( h <=opts.cascThr)       /* reject once the score is less than cascade threshold */
+                    if( h <=reject_thrs[t])     /* reject once the score is less than the threshold of this tree */
+                    {
+                        h = std::min( h, opts.cascThr );
                         break;
+                    }
                 }
             }
             else
@@ -114,8 +295,11 @@ template <typename T> void _apply( const T *input_data,                 /* in :
                         position = (( probe_feature_starter[cids[t_fids[position]]] < t_thrs[position]) ? t_child[position]: t_child[position] + 1);
                     }
                     h += t_hs[position];
-                    if( h <=opts.cascThr)       /* reject once the score is less than cascade threshold */
+                    if( h <=reject_thrs[t])     /* reject once the score is less than the threshold of this tree */
+                    {
+                        h = std::min( h, opts.cascThr );
                         break;
+                    }
                 }
             }
             /* add detection result */
@@ -129,6 +313,34 @@ template <typename T> void _apply( const T *input_data,                 /* in :
     }
     delete [] cids;
 }
+
+
+/* smallest float which is not less than t, ( x < t ) <=> ( x < roundThresholdUp(t) ) holds for any float x */
+static float roundThresholdUp( double t )
+{
+    float f = (float)t;
+    if( (double)f < t )
+        f = nextafterf( f, HUGE_VALF );
+    return f;
+}
+
+
+softcascade::softcascade()
+{
+    m_debug = false;
+    m_number_of_trees = 0;
+    m_tree_nodes = -1;
+    m_tree_depth = 0;
+    m_packed_stride = 0;
+    m_packed_size = 0;
+    m_mapped_nodes = 0;
+    m_use_packed = true;
+    m_simd_level = getCpuSimdLevel();
+    m_quantized_depth = -1;
+    m_collect_stats = false;
+}
+
+
 bool softcascade::Combine(vector<Adaboost> &ads )
 {
     /*  ==================== get informations ==================== */
@@ -189,6 +401,9 @@ bool softcascade::Combine(vector<Adaboost> &ads )
 
     /*  shift the hs */
     m_hs = m_hs + m_opts.cascCal;
+
+    /*  rejection thresholds calibrated for the previous model are not valid any more */
+    m_opts.cascThrs.clear();
     cout<<"softcascade : number of trees "<<m_number_of_trees<<endl;
 
     int counter = 0;
@@ -213,6 +428,9 @@ bool softcascade::Combine(vector<Adaboost> &ads )
     /*  set the depth */
     setTreeDepth();
 
+    /*  make the packed node array used for detection */
+    packModel();
+
     if(m_debug)
     {
         cout<<"fids samples \n"<<m_fids.rowRange(0,10)<<endl;
@@ -238,9 +456,222 @@ bool softcascade::Combine(vector<Adaboost> &ads )
 }
 
 
+bool softcascade::packModel()
+{
+    if(!checkModel() || !hasMatModel())
+        return false;
+
+    m_packed_stride = m_fids.cols;
+    m_packed_nodes.resize( m_number_of_trees*m_packed_stride );
+    for( int t=0;t<m_number_of_trees;t++)
+    {
+        const int *t_fids    = m_fids.ptr<int>(t);
+        const int *t_child   = m_child.ptr<int>(t);
+        const double *t_thrs = m_thrs.ptr<double>(t);
+        const double *t_hs   = m_hs.ptr<double>(t);
+        cascadeNode *t_nodes = &m_packed_nodes[t*m_packed_stride];
+        for( int n=0;n<m_packed_stride;n++)
+        {
+            t_nodes[n].fid   = t_fids[n];
+            t_nodes[n].thr   = roundThresholdUp( t_thrs[n] );
+            t_nodes[n].hs    = (float)t_hs[n];
+            t_nodes[n].child = t_child[n];
+        }
+    }
+    m_packed_size = m_packed_nodes.size();
+    m_mapped_nodes = 0;
+    m_mapping.release();
+    updateRejectThresholds();
+    return quantizeModel();
+}
+
+
+void softcascade::updateRejectThresholds()
+{
+    if( !m_opts.cascThrs.empty() && m_opts.cascThrs.size() != m_number_of_trees )
+    {
+        cout<<"<softcascade::updateRejectThresholds><warning> "<<m_opts.cascThrs.size()<<" rejection thresholds for "
+            <<m_number_of_trees<<" trees, using cascThr for all the trees "<<endl;
+    }
+    if( m_opts.cascThrs.size() == m_number_of_trees )
+        m_reject_thrs = m_opts.cascThrs;
+    else
+        m_reject_thrs.assign( m_number_of_trees, m_opts.cascThr );
+    /* the last tree decides if the window is accepted */
+    if( !m_reject_thrs.empty())
+        m_reject_thrs.back() = m_opts.cascThr;
+}
+
+
+bool softcascade::traceScores( const Mat &data,             /* in : featureDim x numberOfSamples, CV_32F */
+                               Mat &traces ) const          /* out: numberOfSamples x number_of_trees, CV_64F */
+{
+    if( !checkModel() || packedNodes() == 0 )
+        return false;
+    const int model_dim = (m_opts.modelDsPad.width/m_opts.shrink)*(m_opts.modelDsPad.height/m_opts.shrink)*m_opts.nchannels;
+    if( data.type() != CV_32F || data.rows != model_dim )
+    {
+        cout<<"<softcascade::traceScores><error> data should be CV_32F with "<<model_dim<<" rows "<<endl;
+        return false;
+    }
+
+    traces.create( data.cols, m_number_of_trees, CV_64F );
+    #pragma omp parallel for
+    for( int c=0;c<data.cols;c++)
+    {
+        /*  columns are not continuous, same as Predict */
+        Mat sample;
+        data.col(c).copyTo( sample );
+        const float *probe = sample.ptr<float>(0);
+        const cascadeNode *t_nodes = packedNodes();
+        double *trace = traces.ptr<double>(c);
+        double h = 0;
+        for( int t=0;t<m_number_of_trees;t++)
+        {
+            int position = 0;
+            while( t_nodes[position].child)
+            {
+                if( m_tree_depth != 0 )
+                    position = (( probe[t_nodes[position].fid] < t_nodes[position].thr) ? position*2+1 : position*2+2);
+                else
+                    position = (( probe[t_nodes[position].fid] < t_nodes[position].thr) ? t_nodes[position].child : t_nodes[position].child + 1);
+            }
+            h += t_nodes[position].hs;
+            trace[t] = h;
+            t_nodes += m_packed_stride;
+        }
+    }
+    return true;
+}
+
+
+bool softcascade::calibrateRejection( const Mat &pos_data,      /* in : featureDim x numberOfSamples, CV_32F, positives not used in training */
+                                      double target_recall,     /* in : fraction of the accepted positives to keep */
+                                      double &recall )          /* out: fraction actually kept */
+{
+    if( target_recall <= 0 || target_recall > 1 )
+    {
+        cout<<"<softcascade::calibrateRejection><error> target_recall should be in (0, 1] "<<endl;
+        return false;
+    }
+    Mat traces;
+    if( !traceScores( pos_data, traces ))
+        return false;
+
+    /*  only the positives accepted by the full cascade are used */
+    vector<int> alive;
+    for( int c=0;c<traces.rows;c++)
+    {
+        if( traces.at<double>( c, m_number_of_trees-1 ) > m_opts.cascThr )
+            alive.push_back( c );
+    }
+    const int n_accepted = alive.size();
+    if( n_accepted == 0 )
+    {
+        cout<<"<softcascade::calibrateRejection><error> no positive is accepted by the cascade "<<endl;
+        return false;
+    }
+
+    /*  the misses allowed are spread evenly over the trees, threshold of tree t is just below the
+     *  lowest score of the positives still alive after the misses allowed at t are removed */
+    const int n_misses = (int)floor( (1 - target_recall)*n_accepted );
+    int n_rejected = 0;
+    vector<double> reject_thrs( m_number_of_trees, m_opts.cascThr );
+    vector<double> alive_scores;
+    for( int t=0;t<m_number_of_trees-1;t++)
+    {
+        alive_scores.resize( alive.size() );
+        for( unsigned int c=0;c<alive.size();c++)
+            alive_scores[c] = traces.at<double>( alive[c], t );
+        std::sort( alive_scores.begin(), alive_scores.end() );
+
+        const int n_allowed = std::min( (int)alive.size() - 1, (int)((long long)n_misses*(t+1)/(m_number_of_trees-1)) - n_rejected );
+        if( n_allowed > 0 )
+            reject_thrs[t] = alive_scores[n_allowed-1];
+        else
+            reject_thrs[t] = alive_scores[0] - 1e-6;
+
+        /*  remove the rejected ones, ties may remove a few more than allowed */
+        vector<int> still_alive;
+        for( unsigned int c=0;c<alive.size();c++)
+        {
+            if( traces.at<double>( alive[c], t ) > reject_thrs[t] )
+                still_alive.push_back( alive[c] );
+        }
+        n_rejected += alive.size() - still_alive.size();
+        alive.swap( still_alive );
+    }
+
+    recall = 1.0*alive.size()/n_accepted;
+    m_opts.cascThrs = reject_thrs;
+    updateRejectThresholds();
+    cout<<"softcascade : calibrated on "<<n_accepted<<" positives out of "<<traces.rows<<", recall "<<recall<<endl;
+    return true;
+}
+
+
+bool softcascade::quantizeModel()
+{
+    m_channel_scales.clear();
+    m_quantized_nodes.clear();
+    m_quantized_depth = -1;
+    /* the nodes or the options change, the levels are resolved again */
+    #pragma omp critical(softcascade_resolved_nodes)
+    m_resolved_nodes.clear();
+    if( m_opts.channelDepth == CV_32F )
+        return true;
+    if( m_opts.channelDepth != CV_8U && m_opts.channelDepth != CV_16U )
+    {
+        cout<<"<softcascade::quantizeModel><error> channelDepth should be CV_32F, CV_8U or CV_16U "<<endl;
+        return false;
+    }
+    const cascadeNode *nodes = packedNodes();
+    if( nodes == 0 )
+    {
+        cout<<"<softcascade::quantizeModel><error> packed model is empty "<<endl;
+        return false;
+    }
+
+    const int model_area = (m_opts.modelDsPad.width/m_opts.shrink)*(m_opts.modelDsPad.height/m_opts.shrink);
+    const double max_value = m_opts.channelDepth == CV_8U ? 255 : 65535;
+
+    /*  largest threshold of each channel, leaves have no threshold */
+    vector<double> max_thr( m_opts.nchannels, 0 );
+    for( int n=0;n<m_packed_size;n++)
+    {
+        const int nc = nodes[n].fid/model_area;
+        if( nodes[n].child && nc >= 0 && nc < m_opts.nchannels )
+            max_thr[nc] = std::max( max_thr[nc], (double)nodes[n].thr );
+    }
+    m_channel_scales.resize( m_opts.nchannels );
+    for( int c=0;c<m_opts.nchannels;c++)
+        m_channel_scales[c] = max_thr[c] > 0 ? (float)( max_value/max_thr[c] ) : 1.0f;
+
+    /*  x < thr  ->  round( x*scale ) < round( thr*scale ), only features within half a step of the
+     *  threshold may take the other branch. The integers are exact in float */
+    m_quantized_nodes.assign( nodes, nodes + m_packed_size );
+    for( int n=0;n<m_packed_size;n++)
+    {
+        const int nc = nodes[n].fid/model_area;
+        if( m_quantized_nodes[n].child && nc >= 0 && nc < m_opts.nchannels )
+            m_quantized_nodes[n].thr = (float)cvRound( nodes[n].thr*(double)m_channel_scales[nc] );
+    }
+    m_quantized_depth = m_opts.channelDepth;
+    return true;
+}
+
+
+const cascadeNode* softcascade::nodesForDepth( int depth ) const
+{
+    if( depth == CV_8U || depth == CV_16U )
+        return ( depth == m_quantized_depth && !m_quantized_nodes.empty()) ? &m_quantized_nodes[0] : 0;
+    return packedNodes();
+}
+
+
 bool softcascade::setTreeDepth()
 {
-    if(!checkModel())
+    if(!checkModel() || !hasMatModel())
         return false;
 
     m_tree_depth = 0;
@@ -279,15 +710,22 @@ bool softcascade::setTreeDepth()
 }
 
 
+bool softcascade::hasMatModel() const
+{
+    return !( m_fids.empty() || m_thrs.empty() || m_child.empty() || m_weights.empty()|| m_hs.empty() || m_depth.empty());
+}
+
+
 bool softcascade::checkModel() const
 {
-    if( m_fids.empty() || m_thrs.empty() || m_child.empty() || m_weights.empty()|| m_hs.empty() || m_depth.empty())
+    /* a model loaded by LoadBinary only has the packed nodes */
+    if( !hasMatModel() && packedNodes() == 0 )
     {
         cout<<"<softcascade::checkModel><error> Model is empty "<<endl;
         return false;
     }
-    if( !m_fids.isContinuous() || !m_thrs.isContinuous() || !m_child.isContinuous() ||
-            !m_depth.isContinuous() || !m_hs.isContinuous() || !m_weights.isContinuous())
+    if( hasMatModel() && ( !m_fids.isContinuous() || !m_thrs.isContinuous() || !m_child.isContinuous() ||
+            !m_depth.isContinuous() || !m_hs.isContinuous() || !m_weights.isContinuous()))
     {
         cout<<"<softcascade::checkModel><error> Model is not continuous "<<endl;
         return false;
@@ -300,21 +738,86 @@ bool softcascade::checkModel() const
 
 bool softcascade::Apply( const vector<Mat> &input_data,      /*  in: channels feature which has a continuous mem like nchannelsxfeature_widthxfeature_height*/
                          vector<Rect> &results,              /* out: results */ 
-                         vector<double> &confidence) const   /* out: confidence */
+                         vector<double> &confidence,         /* out: confidence */
+                         cascadeStats *stats) const          /* out: evaluation depth, 0 -> not collected */
+{
+    if( !checkInput( input_data ))
+        return false;
+    if( stats && stats->depth_hist.size() < m_number_of_trees )
+        stats->depth_hist.resize( m_number_of_trees, 0 );
+
+    const int n_height = (int) ceil((input_data[0].rows*m_opts.shrink-m_opts.modelDsPad.height+1)/m_opts.stride);
+    if( n_height <= 0 )
+        return true;
+
+    /* nodes resolved for this level size, only once for all the images of the same size */
+    vector<cascadeNode> no_nodes;
+    Ptr< vector<cascadeNode> > resolved;
+    if( m_use_packed )
+        resolved = levelNodes( input_data[0].type(), input_data[0].cols, input_data[0].rows );
+    const vector<cascadeNode> &level_nodes = m_use_packed ? *resolved : no_nodes;
+
+    /* split the rows of windows into tiles, about 4 tiles per thread for load balance. Each tile has
+     * its own result buffer, the buffers are merged in tile order, so the output is the same as the
+     * single thread scan */
+    const int n_threads = m_opts.nThreads > 0 ? m_opts.nThreads : omp_get_max_threads();
+    const int tile_rows = std::max( 1, n_height/(4*n_threads) );
+    const int n_tiles   = (n_height + tile_rows - 1)/tile_rows;
+    if( n_threads == 1 || n_tiles == 1 )
+    {
+        applyRows( input_data, level_nodes, 0, n_height, results, confidence, stats );
+        return true;
+    }
+
+    vector< vector<Rect> > tile_results( n_tiles );
+    vector< vector<double> > tile_confidence( n_tiles );
+    vector<cascadeStats> tile_stats( stats ? n_tiles : 0 );
+    for( unsigned int t=0;t<tile_stats.size();t++)
+        tile_stats[t].reset( m_number_of_trees );
+    #pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+    for( int t=0;t<n_tiles;t++)
+    {
+        applyRows( input_data, level_nodes, t*tile_rows, std::min( n_height, (t+1)*tile_rows ), tile_results[t], tile_confidence[t],
+                   stats ? &tile_stats[t] : 0 );
+    }
+
+    for( int t=0;t<n_tiles;t++)
+    {
+        results.insert( results.end(), tile_results[t].begin(), tile_results[t].end() );
+        confidence.insert( confidence.end(), tile_confidence[t].begin(), tile_confidence[t].end() );
+        if( stats )
+            stats->merge( tile_stats[t] );
+    }
+    return true;
+}
+
+
+bool softcascade::checkInput( const vector<Mat> &input_data ) const
 {
     /*  --------------------------- check --------------------------------*/
     if(!checkModel())
         return false;
 
+    if( m_use_packed && packedNodes() == 0 )
+    {
+        cout<<"<softcascade::checkInput><error> packed model is empty "<<endl;
+        return false;
+    }
+    if( !m_use_packed && !hasMatModel())
+    {
+        cout<<"<softcascade::checkInput><error> model has no Mat layout, it is loaded from a binary file "<<endl;
+        return false;
+    }
+
     if(!input_data[0].isContinuous())
     {
-        cout<<"<softcascade::Apply><error> input_data shoule be continuous ~"<<endl;
+        cout<<"<softcascade::checkInput><error> input_data shoule be continuous ~"<<endl;
         return false;
     }
 
     if( m_opts.nchannels != input_data.size())
     {
-        cout<<"<softcascade::Apply><error> input_data's size should equ nchannels "<<endl;
+        cout<<"<softcascade::checkInput><error> input_data's size should equ nchannels "<<endl;
         return false;
     }
 
@@ -323,43 +826,229 @@ bool softcascade::Apply( const vector<Mat> &input_data,      /*  in: channels fe
     {
         if( (const float*)(input_data[0].data) + (m_opts.nchannels-1)*input_data[0].cols*input_data[0].rows != (const float*)input_data[m_opts.nchannels-1].data )
         {
-            cout<<"<softcascade::Apply><error> input_data's memory not continuous "<<endl;
+            cout<<"<softcascade::checkInput><error> input_data's memory not continuous "<<endl;
             return false;
         }
-        _apply( (const float*)input_data[0].data,input_data[0].cols,input_data[0].rows,m_fids,m_child,m_thrs,m_hs,m_opts,m_tree_depth,results,confidence);
     }
     else if(input_data[0].type() == CV_64F)
     {
         if( (const double*)(input_data[0].data)+(m_opts.nchannels-1)*input_data[0].cols*input_data[0].rows!=(const double*)input_data[m_opts.nchannels-1].data )
         {
-            cout<<"<softcascade::Apply><error> input_data's memory not continuous "<<endl;
+            cout<<"<softcascade::checkInput><error> input_data's memory not continuous "<<endl;
             return false;
         }
-        _apply( (const double*)input_data[0].data,input_data[0].cols,input_data[0].rows,m_fids,m_child,m_thrs,m_hs,m_opts,m_tree_depth,results,confidence);
     }
     else if(input_data[0].type() == CV_32S)
     {
         if( (const int*)(input_data[0].data)+(m_opts.nchannels-1)*input_data[0].cols*input_data[0].rows!=(const int*)input_data[m_opts.nchannels-1].data )
         {
-            cout<<"<softcascade::Apply><error> input_data's memory not continuous "<<endl;
+            cout<<"<softcascade::checkInput><error> input_data's memory not continuous "<<endl;
+            return false;
+        }
+    }
+    else if(input_data[0].type() == CV_8U || input_data[0].type() == CV_16U )
+    {
+        /* quantized levels, only with the packed nodes quantized for the same depth */
+        if( !m_use_packed || nodesForDepth( input_data[0].type()) == 0 )
+        {
+            cout<<"<softcascade::checkInput><error> quantized input needs channelDepth set to the same depth "<<endl;
+            return false;
+        }
+        if( input_data[0].data + (m_opts.nchannels-1)*input_data[0].cols*input_data[0].rows*input_data[0].elemSize() != input_data[m_opts.nchannels-1].data )
+        {
+            cout<<"<softcascade::checkInput><error> input_data's memory not continuous "<<endl;
             return false;
         }
-        
-        _apply( (const int*)input_data[0].data, input_data[0].cols, input_data[0].rows, m_fids, m_child, m_thrs, m_hs, m_opts, m_tree_depth, results, confidence);
     }
     else
     {
-        cout<<"softcascade::Apply><error> unsupported data type, must be one of CV_64F, CV_32F or CV_32S "<<endl;
+        cout<<"<softcascade::checkInput><error> unsupported data type, must be one of CV_64F, CV_32F, CV_32S, CV_16U or CV_8U "<<endl;
         return false;
     }
     /*  --------------------------- check done ----------------------------*/
     return true;
+
+}
+
+
+bool softcascade::resolveLevelNodes( const Size &level_size,                    /* in : size of a single channel of the level */
+                                     vector<cascadeNode> &level_nodes) const    /* out: resolved nodes */
+{
+    const cascadeNode *nodes = nodesForDepth( m_opts.channelDepth );
+    if( nodes == 0 )
+    {
+        cout<<"<softcascade::resolveLevelNodes><error> packed model is empty, or not quantized for channelDepth "<<endl;
+        return false;
+    }
+    resolveNodes( nodes, m_packed_size, level_size.width, level_size.height, m_opts, level_nodes );
+    return true;
+}
+
+
+Ptr< vector<cascadeNode> > softcascade::levelNodes( int type,            /* in : type of the channels */
+                                                    int in_width,        /* in : width of a single channel */
+                                                    int in_height ) const/* in : height of a single channel */
+{
+    const int kind = ( type == CV_8U || type == CV_16U ) ? type : CV_32F;
+    const long long key = ( (long long)kind << 48 ) | ( (long long)in_width << 24 ) | (long long)in_height;
+    Ptr< vector<cascadeNode> > nodes;
+    #pragma omp critical(softcascade_resolved_nodes)
+    {
+        map<long long, Ptr< vector<cascadeNode> > >::const_iterator it = m_resolved_nodes.find( key );
+        if( it != m_resolved_nodes.end() )
+            nodes = it->second;
+    }
+    if( !nodes.empty() )
+        return nodes;
+
+    nodes = new vector<cascadeNode>();
+    resolveNodes( nodesForDepth( type ), m_packed_size, in_width, in_height, m_opts, *nodes );
+    #pragma omp critical(softcascade_resolved_nodes)
+    {
+        /* images of many sizes ( negatives mining ) would keep too many levels, start again */
+        if( m_resolved_nodes.size() >= MAX_RESOLVED_LEVELS )
+            m_resolved_nodes.clear();
+        m_resolved_nodes[key] = nodes;
+    }
+    return nodes;
+}
+
+
+bool softcascade::Predict( const double *data,      /* in : test data, must be continuous in memory */
+                           double &score) const     /* out: score */
+{
+    if( !hasMatModel() )
+        return Predict<double>( data, score );
+    if( !checkModel())
+        return false;
+    double h = 0;
+    for( int t=0;t<m_number_of_trees;t++)
+    {
+        const int *t_child   = m_child.ptr<int>(t);
+        const int *t_fids    = m_fids.ptr<int>(t);
+        const double *t_thrs = m_thrs.ptr<double>(t);
+        const double *t_hs   = m_hs.ptr<double>(t);
+        int position = 0;
+        while( t_child[position] )
+        {
+            const bool left = data[t_fids[position]] < t_thrs[position];
+            if( m_tree_depth != 0 )
+                position = left ? position*2+1 : position*2+2;
+            else
+                position = left ? t_child[position] : t_child[position] + 1;
+        }
+        h += t_hs[position];
+        if( h < m_reject_thrs[t])
+        {
+            h = std::min( h, m_reject_thrs.back() );
+            break;
+        }
+    }
+    score = h;
+    return true;
+}
+
+
+bool softcascade::scanLevel( const vector<Mat> &input_data,                 /* in : channel features */
+                             const vector<cascadeNode> &level_nodes,        /* in : output of resolveLevelNodes for this level size */
+                             vector<Rect> &results,                         /* out: detect results */
+                             vector<double> &confidence,                    /* out: detect confidence */
+                             cascadeStats *stats) const                     /* out: evaluation depth, 0 -> not collected */
+{
+    if( !checkInput( input_data ))
+        return false;
+    if( stats && stats->depth_hist.size() < m_number_of_trees )
+        stats->depth_hist.resize( m_number_of_trees, 0 );
+    if( m_use_packed && level_nodes.size() != m_packed_size)
+    {
+        cout<<"<softcascade::scanLevel><error> level_nodes does not match the model "<<endl;
+        return false;
+    }
+    const int n_height = (int) ceil((input_data[0].rows*m_opts.shrink-m_opts.modelDsPad.height+1)/m_opts.stride);
+    if( n_height > 0 )
+        applyRows( input_data, level_nodes, 0, n_height, results, confidence, stats );
+    return true;
+}
+
+
+void softcascade::applyRows( const vector<Mat> &input_data,         /* in : channels feature, checked by Apply */
+                             const vector<cascadeNode> &level_nodes,/* in : packed nodes resolved for this level, empty if m_use_packed is false */
+                             int row_begin,                         /* in : first row of windows to scan */
+                             int row_end,                           /* in : last row of windows to scan + 1 */
+                             vector<Rect> &results,                 /* out: results */
+                             vector<double> &confidence,            /* out: confidence */
+                             cascadeStats *stats) const             /* out: evaluation depth, 0 -> not collected */
+{
+    const int in_width  = input_data[0].cols;
+    const int in_height = input_data[0].rows;
+    /* double channels keep the double thresholds and hs of the Mats, the packed ones are float */
+    const bool double_mats = input_data[0].type() == CV_64F && hasMatModel();
+    if( stats && m_use_packed && !double_mats )
+    {
+        /* the instrumented scan, one window at a time */
+        const int type = input_data[0].type();
+        if( type == CV_32F )
+            _apply<float,true>( (const float*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, stats);
+        else if( type == CV_64F )
+            _apply<double,true>( (const double*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, stats);
+        else if( type == CV_32S )
+            _apply<int,true>( (const int*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, stats);
+        else if( type == CV_8U )
+            _apply<uchar,true>( (const uchar*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, stats);
+        else if( type == CV_16U )
+            _apply<ushort,true>( (const ushort*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, stats);
+        return;
+    }
+    const bool row_kernel = m_use_packed && m_simd_level != SIMD_NONE && m_tree_depth == 2 && m_packed_stride >= 7 && m_opts.stride%m_opts.shrink == 0;
+    if( input_data[0].type() == CV_32F)
+    {
+        if( row_kernel )
+            _apply_rows( (const float*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], getScanRowDepth2( m_simd_level ), row_begin, row_end, results, confidence);
+        else if( m_use_packed )
+            _apply<float,false>( (const float*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, 0);
+        else
+            _apply_mat( (const float*)input_data[0].data, in_width, in_height, m_fids, m_child, m_thrs, m_hs, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence);
+    }
+    else if(input_data[0].type() == CV_64F)
+    {
+        if( m_use_packed && !double_mats )
+            _apply<double,false>( (const double*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, 0);
+        else
+            _apply_mat( (const double*)input_data[0].data, in_width, in_height, m_fids, m_child, m_thrs, m_hs, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence);
+    }
+    else if(input_data[0].type() == CV_32S)
+    {
+        if( m_use_packed )
+            _apply<int,false>( (const int*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, 0);
+        else
+            _apply_mat( (const int*)input_data[0].data, in_width, in_height, m_fids, m_child, m_thrs, m_hs, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence);
+    }
+    else if(input_data[0].type() == CV_8U)
+    {
+        /* quantized levels, checkInput made sure the packed nodes are used */
+        if( row_kernel )
+            _apply_rows( (const uchar*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], getScanRowDepth2_u8( m_simd_level ), row_begin, row_end, results, confidence);
+        else
+            _apply<uchar,false>( (const uchar*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, 0);
+    }
+    else if(input_data[0].type() == CV_16U)
+    {
+        if( row_kernel )
+            _apply_rows( (const ushort*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], getScanRowDepth2_u16( m_simd_level ), row_begin, row_end, results, confidence);
+        else
+            _apply<ushort,false>( (const ushort*)input_data[0].data, in_width, in_height, level_nodes, m_packed_stride, m_opts, &m_reject_thrs[0], m_tree_depth, row_begin, row_end, results, confidence, 0);
+    }
 }
 
 
 
 bool softcascade::Save( string path_to_model )      /*  in: where to save the model, models is saved by opencv FileStorage */
 {
+    if( !hasMatModel())
+    {
+        cout<<"<softcascade::Save><error> model has no Mat layout ( loaded from a binary file ), use SaveBinary "<<endl;
+        return false;
+    }
     FileStorage fs( path_to_model, FileStorage::WRITE);
     if( !fs.isOpened())
     {
@@ -395,6 +1084,10 @@ bool softcascade::Save( string path_to_model )      /*  in: where to save the mo
     fs<<"]";
     fs<<"m_opts_cascThr"<<m_opts.cascThr;
     fs<<"m_opts_cascCal"<<m_opts.cascCal;
+    fs<<"m_opts_cascThrs"<<"[";
+    for( int c=0;c<m_opts.cascThrs.size();c++)
+        fs<<m_opts.cascThrs[c];
+    fs<<"]";
     fs<<"m_opts_pBoost_nweaks"<<m_opts.pBoost_nweaks;
     fs<<"m_opts_infos"<<m_opts.infos;
     fs<<"m_opts_nPos"<<m_opts.nPos;
@@ -434,6 +1127,7 @@ bool softcascade::Load( string path_to_model )      /* in : path of the model, s
     fs["m_opts_nWeaks"]>>m_opts.nWeaks;
     fs["m_opts_cascThr"]>>m_opts.cascThr;
     fs["m_opts_cascCal"]>>m_opts.cascCal;
+    fs["m_opts_cascThrs"]>>m_opts.cascThrs;    /* not in older models -> empty */
     fs["m_opts_pBoost_nweaks"]>>m_opts.pBoost_nweaks;
     fs["m_opts_infos"]>>m_opts.infos;
     fs["m_opts_nPos"]>>m_opts.nPos;
@@ -442,12 +1136,251 @@ bool softcascade::Load( string path_to_model )      /* in : path of the model, s
     fs["m_opts_nAccNeg"]>>m_opts.nAccNeg;
     fs["m_opts_pad"]>>m_opts.pad;
     fs["m_opts_nchannels"]>>m_opts.nchannels;
+
+    if( !setTreeDepth() || !packModel())
+    {
+        cout<<"<softcascade::Load><error> model "<<path_to_model<<" is not valid "<<endl;
+        return false;
+    }
     
     cout<<"Loading Model Done "<<endl;
     cout<<"# Model Info --> "<<m_opts.infos<<endl;
     return true;
 }
 
+/* 
+ * binary model file, little endian, made by SaveBinary, read by LoadBinary
+ *
+ *   header  ( 64 bytes, binaryModelHeader )
+ *   options ( cascadeParameter fields written one after another, see writeOptions )
+ *   nodes   ( number_of_trees*nodes_per_tree cascadeNode, starts at a multiple of 64 )
+ *
+ * the nodes are used in place from the mapped file, the file has to be rewritten when
+ * cascadeNode or the header changes ( increase BINARY_MODEL_VERSION )
+ */
+#define BINARY_MODEL_VERSION 1
+#define BINARY_MODEL_ALIGN   64
+static const char binary_model_magic[8] = { 'S','C','M','O','D','E','L','\0' };
+
+struct binaryModelHeader
+{
+    char magic[8];                      /* "SCMODEL" */
+    unsigned int bom;                   /* 0x01020304, detects a file written on a big endian machine */
+    unsigned int version;               /* BINARY_MODEL_VERSION */
+    unsigned int header_size;           /* sizeof(binaryModelHeader) */
+    unsigned int node_size;             /* sizeof(cascadeNode) */
+    int number_of_trees;                /* number of trees */
+    int nodes_per_tree;                 /* nodes reserved for each tree ( m_packed_stride ) */
+    int tree_nodes;                     /* m_tree_nodes */
+    int tree_depth;                     /* m_tree_depth */
+    unsigned long long options_offset;  /* offset of the option block */
+    unsigned long long options_size;    /* size of the option block */
+    unsigned long long nodes_offset;    /* offset of the nodes, multiple of BINARY_MODEL_ALIGN */
+};
+
+/* compile time size checks, the layout on disk must not depend on the compiler */
+typedef char binary_header_size_check[ sizeof(binaryModelHeader) == 64 ? 1 : -1 ];
+typedef char binary_node_size_check[ sizeof(cascadeNode) == 16 ? 1 : -1 ];
+
+template<typename T> static void writeValue( vector<unsigned char> &buffer, const T &value )
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char*>( &value );
+    buffer.insert( buffer.end(), p, p + sizeof(T) );
+}
+
+template<typename T> static bool readValue( const unsigned char *&cursor, const unsigned char *end, T &value )
+{
+    if( end - cursor < (ptrdiff_t)sizeof(T) )
+        return false;
+    memcpy( &value, cursor, sizeof(T) );
+    cursor += sizeof(T);
+    return true;
+}
+
+static void writeOptions( const cascadeParameter &opts,         /* in : options of the model */
+                          vector<unsigned char> &buffer )       /* out: option block */
+{
+    writeValue( buffer, opts.modelDs.width );      writeValue( buffer, opts.modelDs.height );
+    writeValue( buffer, opts.modelDsPad.width );   writeValue( buffer, opts.modelDsPad.height );
+    writeValue( buffer, opts.pad.width );          writeValue( buffer, opts.pad.height );
+    writeValue( buffer, opts.stride );
+    writeValue( buffer, opts.shrink );
+    writeValue( buffer, opts.nchannels );
+    writeValue( buffer, opts.cascThr );
+    writeValue( buffer, opts.cascCal );
+    writeValue( buffer, opts.pBoost_nweaks );
+    writeValue( buffer, opts.nPos );
+    writeValue( buffer, opts.nNeg );
+    writeValue( buffer, opts.nPerNeg );
+    writeValue( buffer, opts.nAccNeg );
+    writeValue( buffer, (int)opts.nWeaks.size() );
+    for( unsigned int c=0;c<opts.nWeaks.size();c++)
+        writeValue( buffer, opts.nWeaks[c] );
+    writeValue( buffer, (int)opts.filter.size() );
+    for( unsigned int c=0;c<opts.filter.size();c++)
+        writeValue( buffer, opts.filter[c] );
+    writeValue( buffer, (int)opts.infos.size() );
+    buffer.insert( buffer.end(), opts.infos.begin(), opts.infos.end() );
+    writeValue( buffer, (int)opts.cascThrs.size() );
+    for( unsigned int c=0;c<opts.cascThrs.size();c++)
+        writeValue( buffer, opts.cascThrs[c] );
+}
+
+static bool readOptions( const unsigned char *cursor,           /* in : start of the option block */
+                         const unsigned char *end,              /* in : end of the option block */
+                         cascadeParameter &opts )               /* out: options, fields not in the block are kept */
+{
+    bool ok = readValue( cursor, end, opts.modelDs.width )    && readValue( cursor, end, opts.modelDs.height ) &&
+              readValue( cursor, end, opts.modelDsPad.width ) && readValue( cursor, end, opts.modelDsPad.height ) &&
+              readValue( cursor, end, opts.pad.width )        && readValue( cursor, end, opts.pad.height ) &&
+              readValue( cursor, end, opts.stride )  && readValue( cursor, end, opts.shrink ) &&
+              readValue( cursor, end, opts.nchannels ) &&
+              readValue( cursor, end, opts.cascThr ) && readValue( cursor, end, opts.cascCal ) &&
+              readValue( cursor, end, opts.pBoost_nweaks ) &&
+              readValue( cursor, end, opts.nPos )    && readValue( cursor, end, opts.nNeg ) &&
+              readValue( cursor, end, opts.nPerNeg ) && readValue( cursor, end, opts.nAccNeg );
+    int n = 0;
+    if( !ok || !readValue( cursor, end, n ) || n < 0 || end - cursor < (ptrdiff_t)(n*sizeof(int)) )
+        return false;
+    opts.nWeaks.resize( n );
+    for( int c=0;c<n;c++)
+        readValue( cursor, end, opts.nWeaks[c] );
+    if( !readValue( cursor, end, n ) || n < 0 || end - cursor < (ptrdiff_t)(n*sizeof(int)) )
+        return false;
+    opts.filter.resize( n );
+    for( int c=0;c<n;c++)
+        readValue( cursor, end, opts.filter[c] );
+    if( !readValue( cursor, end, n ) || n < 0 || end - cursor < n )
+        return false;
+    opts.infos.assign( reinterpret_cast<const char*>( cursor ), n );
+    cursor += n;
+
+    /* rejection thresholds, the block of older files ends before them */
+    opts.cascThrs.clear();
+    if( cursor == end )
+        return true;
+    if( !readValue( cursor, end, n ) || n < 0 || end - cursor < (ptrdiff_t)(n*sizeof(double)) )
+        return false;
+    opts.cascThrs.resize( n );
+    for( int c=0;c<n;c++)
+        readValue( cursor, end, opts.cascThrs[c] );
+    return true;
+}
+
+bool softcascade::SaveBinary( string path_to_model ) const     /*  in: where to save the model */
+{
+    if( !checkModel() || packedNodes() == 0 )
+    {
+        cout<<"<softcascade::SaveBinary><error> model is not valid "<<endl;
+        return false;
+    }
+
+    vector<unsigned char> options;
+    writeOptions( m_opts, options );
+
+    binaryModelHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, binary_model_magic, sizeof(header.magic) );
+    header.bom             = 0x01020304;
+    header.version         = BINARY_MODEL_VERSION;
+    header.header_size     = sizeof(binaryModelHeader);
+    header.node_size       = sizeof(cascadeNode);
+    header.number_of_trees = m_number_of_trees;
+    header.nodes_per_tree  = m_packed_stride;
+    header.tree_nodes      = m_tree_nodes;
+    header.tree_depth      = m_tree_depth;
+    header.options_offset  = sizeof(binaryModelHeader);
+    header.options_size    = options.size();
+    header.nodes_offset    = ( header.options_offset + header.options_size + BINARY_MODEL_ALIGN - 1 )/BINARY_MODEL_ALIGN*BINARY_MODEL_ALIGN;
+
+    ofstream out( path_to_model.c_str(), ios::out | ios::binary | ios::trunc );
+    if( !out.is_open())
+    {
+        cout<<"<softcascade::SaveBinary><error> Can not open file "<<path_to_model<<endl;
+        return false;
+    }
+    vector<char> padding( header.nodes_offset - header.options_offset - header.options_size, 0 );
+    out.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+    out.write( reinterpret_cast<const char*>( &options[0] ), options.size() );
+    if( !padding.empty())
+        out.write( &padding[0], padding.size() );
+    out.write( reinterpret_cast<const char*>( packedNodes() ), m_packed_size*sizeof(cascadeNode) );
+    if( !out.good())
+    {
+        cout<<"<softcascade::SaveBinary><error> Failed to write "<<path_to_model<<endl;
+        return false;
+    }
+    out.close();
+    cout<<"Saving Binary Model Done "<<endl;
+    return true;
+}
+
+bool softcascade::LoadBinary( string path_to_model )   /*  in: path of the binary model */
+{
+    Ptr<mappedFile> mapping = new mappedFile();
+    if( !mapping->open( path_to_model ))
+    {
+        cout<<"<softcascade::LoadBinary><error> Can not load model file "<<path_to_model<<endl;
+        return false;
+    }
+
+    binaryModelHeader header;
+    if( mapping->size() < sizeof(header) )
+    {
+        cout<<"<softcascade::LoadBinary><error> file is too small "<<path_to_model<<endl;
+        return false;
+    }
+    memcpy( &header, mapping->data(), sizeof(header) );
+    if( memcmp( header.magic, binary_model_magic, sizeof(header.magic) ) != 0 || header.bom != 0x01020304 )
+    {
+        cout<<"<softcascade::LoadBinary><error> "<<path_to_model<<" is not a binary model, or has a different byte order "<<endl;
+        return false;
+    }
+    if( header.version != BINARY_MODEL_VERSION || header.header_size != sizeof(binaryModelHeader) || header.node_size != sizeof(cascadeNode) )
+    {
+        cout<<"<softcascade::LoadBinary><error> unsupported version "<<header.version<<" of "<<path_to_model<<", convert the xml model again "<<endl;
+        return false;
+    }
+    unsigned long long number_of_nodes = (unsigned long long)header.number_of_trees*header.nodes_per_tree;
+    if( header.number_of_trees <= 0 || header.nodes_per_tree <= 0 || header.nodes_offset%BINARY_MODEL_ALIGN != 0 ||
+            header.options_offset + header.options_size > header.nodes_offset ||
+            header.nodes_offset + number_of_nodes*sizeof(cascadeNode) > mapping->size() )
+    {
+        cout<<"<softcascade::LoadBinary><error> "<<path_to_model<<" is truncated or broken "<<endl;
+        return false;
+    }
+
+    cascadeParameter opts = m_opts;
+    const unsigned char *options_start = mapping->data() + header.options_offset;
+    if( !readOptions( options_start, options_start + header.options_size, opts ))
+    {
+        cout<<"<softcascade::LoadBinary><error> option block of "<<path_to_model<<" is broken "<<endl;
+        return false;
+    }
+
+    /* only the packed layout is available, the Mats are released */
+    m_fids.release(); m_child.release(); m_thrs.release(); m_hs.release();
+    m_weights.release(); m_depth.release(); m_nodes.release();
+    m_packed_nodes.clear();
+
+    m_opts            = opts;
+    m_number_of_trees = header.number_of_trees;
+    m_packed_stride   = header.nodes_per_tree;
+    m_tree_nodes      = header.tree_nodes;
+    m_tree_depth      = header.tree_depth;
+    m_packed_size     = number_of_nodes;
+    m_mapping         = mapping;
+    m_mapped_nodes    = reinterpret_cast<const cascadeNode*>( mapping->data() + header.nodes_offset );
+    updateRejectThresholds();
+    if( !quantizeModel())
+        return false;
+
+    cout<<"Loading Binary Model Done "<<endl;
+    cout<<"# Model Info --> "<<m_opts.infos<<endl;
+    return true;
+}
+
+
 cascadeParameter softcascade::getParas() const
 {
     return m_opts;
@@ -456,9 +1389,47 @@ cascadeParameter softcascade::getParas() const
 void softcascade::setParas( const cascadeParameter &in_par )
 {
     m_opts = in_par; 
+    /* the rejection thresholds follow cascThr, the quantized thresholds follow channelDepth */
+    if( packedNodes() != 0 )
+    {
+        updateRejectThresholds();
+        quantizeModel();
+    }
 }
 
 
+void softcascade::mapLevelResults( const vector<Rect> &t_tar,             /* in : detections on the level */
+                                   const vector<double> &t_conf,          /* in : confidence */
+                                   double appro_scale,                    /* in : scale of the level */
+                                   double scale_w,                        /* in : width scale of the level */
+                                   double scale_h,                        /* in : height scale of the level */
+                                   const Size &image_size,                /* in : size of the image */
+                                   double threshold,                      /* in : detect threshold */
+                                   vector<Rect> &targets,                 /* out: target positions */
+                                   vector<double> &confidence )           /* out: target confidence */
+{
+    for ( int i=0;i<t_tar.size(); i++) 
+    {
+        if(t_conf[i] < threshold)
+            continue;
+
+        Rect s( t_tar[i].x/appro_scale, t_tar[i].y/appro_scale, t_tar[i].width/scale_w, t_tar[i].height/scale_h  );
+
+         /* some times the rects on the border are out of the image */
+        if( s.x + s.width > image_size.width )
+            s.width = image_size.width - s.x - 1;
+        if( s.y + s.height > image_size.height )
+            s.height = image_size.height - s.y - 1;
+        if( s.x < 0)
+            s.x = 0;
+        if( s.y < 0)
+            s.y = 0;
+
+        targets.push_back( s );
+        confidence.push_back( t_conf[i]);
+    }
+}
+
 bool softcascade::detectMultiScale( const Mat &image,                   /* in : image */
                                    vector<Rect> &targets,               /* out: target positions*/
                                    vector<double> &confidence,          /* out: target confidence */
@@ -468,37 +1439,93 @@ bool softcascade::detectMultiScale( const Mat &image,                   /* in :
                                    int stride,                          /* in : detection stride */
                                    double threshold ) const             /* in : detect threshold */
 {
-    vector< vector<Mat> > approPyramid;
-    vector<double> appro_scales;
-    vector<double> scale_w;
-    vector<double> scale_h;
+    if( !m_opts.streamLevels )
+    {
+        vector< vector<Mat> > approPyramid;
+        vector<double> appro_scales;
+        vector<double> scale_w;
+        vector<double> scale_h;
 
-    m_feature_gen.chnsPyramid_sse( image, approPyramid, appro_scales, scale_h, scale_w);
-    for( int c=0;c<approPyramid.size();c++)
+        m_feature_gen.chnsPyramid_sse( image, approPyramid, appro_scales, scale_h, scale_w);
+        Mat quantized_memory;
+        vector<Mat> quantized_level;
+        vector<cascadeStats> level_stats( m_collect_stats ? approPyramid.size() : 0 );
+        for( int c=0;c<approPyramid.size();c++)
+        {
+            vector<Rect> t_tar;
+            vector<double> t_conf;
+            cascadeStats *stats = m_collect_stats ? &level_stats[c] : 0;
+            if( m_opts.channelDepth != CV_32F )
+            {
+                if( !m_feature_gen.quantizeLevel( approPyramid[c], m_channel_scales, m_opts.channelDepth, quantized_memory, quantized_level ))
+                    return false;
+                Apply( quantized_level, t_tar, t_conf, stats );
+            }
+            else
+                Apply( approPyramid[c], t_tar, t_conf, stats );
+            mapLevelResults( t_tar, t_conf, appro_scales[c], scale_w[c], scale_h[c], image.size(), threshold, targets, confidence );
+        }
+        mergeLevelStats( level_stats );
+    }
+    else
     {
-        vector<Rect> t_tar;
-        vector<double> t_conf;
-        Apply( approPyramid[c], t_tar, t_conf);
-        for ( int i=0;i<t_tar.size(); i++) 
+        /* real layers first, then each approximated layer is a task: compute it, scan it, free it.
+         * Layers are ordered from the largest to the smallest, so the dynamic schedule hands out the
+         * largest ones first, and the results are merged in layer order as above */
+        pyramidState state;
+        if( !m_feature_gen.prepareApproxPyramid( image, state ))
+            return false;
+
+        const int n_levels  = state.scales.size();
+        const int n_threads = m_opts.nThreads > 0 ? m_opts.nThreads : omp_get_max_threads();
+        vector< vector<Rect> > level_targets( n_levels );
+        vector< vector<double> > level_confidence( n_levels );
+        vector<cascadeStats> level_stats( m_collect_stats ? n_levels : 0 );
+        bool failed = false;            /* a level could not be quantized */
+        #pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+        for( int c=0;c<n_levels;c++)
         {
-            if(t_conf[i] < threshold)
+            bool stop = false;
+            #pragma omp critical(detect_multiscale_failed)
+            stop = failed;
+            if( stop )
                 continue;
 
-            Rect s( t_tar[i].x/appro_scales[c], t_tar[i].y/appro_scales[c], t_tar[i].width/scale_w[c], t_tar[i].height/scale_h[c]  );
+            vector<Mat> level;
+            m_feature_gen.computeApproxLevel( state, c, level );
+
+            /* quantized level, the float one is released before the scan */
+            Mat quantized_memory;
+            if( m_opts.channelDepth != CV_32F )
+            {
+                vector<Mat> quantized_level;
+                if( !m_feature_gen.quantizeLevel( level, m_channel_scales, m_opts.channelDepth, quantized_memory, quantized_level ))
+                {
+                    #pragma omp critical(detect_multiscale_failed)
+                    failed = true;
+                    continue;
+                }
+                level.swap( quantized_level );
+            }
 
-             /* some times the rects on the border are out of the image */
-            if( s.x + s.width > image.cols )
-                s.width = image.cols - s.x - 1;
-            if( s.y + s.height > image.rows )
-                s.height = image.rows - s.y - 1;
-            if( s.x < 0)
-                s.x = 0;
-            if( s.y < 0)
-                s.y - 0;
+            vector<Rect> t_tar;
+            vector<double> t_conf;
+            Apply( level, t_tar, t_conf, m_collect_stats ? &level_stats[c] : 0 );
+            level.clear();
+            mapLevelResults( t_tar, t_conf, state.scales[c], state.scalesw[c], state.scalesh[c], image.size(), threshold, level_targets[c], level_confidence[c] );
+        }
+        if( failed )
+        {
+            cout<<"<softcascade::detectMultiScale><error> failed to quantize a level"<<endl;
+            return false;
+        }
 
-            targets.push_back( s );
-            confidence.push_back( t_conf[i]);
+        for( int c=0;c<n_levels;c++)
+        {
+            targets.insert( targets.end(), level_targets[c].begin(), level_targets[c].end() );
+            confidence.insert( confidence.end(), level_confidence[c].begin(), level_confidence[c].end() );
         }
+        mergeLevelStats( level_stats );
     }
     /* TODO filter the detection results according to the minSize maxSize */
     
@@ -508,6 +1535,91 @@ bool softcascade::detectMultiScale( const Mat &image,                   /* in :
     return true;
 }
 
+/* feature vector of the window found at level position r ( output of Apply ), in the layout of makeTrainData */
+static void copyWindowFeature( const vector<Mat> &level,               /* in : float channels of the level */
+                               const Rect &r,                          /* in : window, in level pixels */
+                               const cascadeParameter &opts,           /* in : detector options */
+                               Mat &column )                           /* out: featureDim x 1, CV_32F */
+{
+    const int w_f = opts.modelDsPad.width/opts.shrink;
+    const int h_f = opts.modelDsPad.height/opts.shrink;
+    /* inverse of the window position in _apply */
+    const int x_s = ( r.x - ( opts.modelDsPad.width - opts.modelDs.width )/2 + opts.pad.width )/opts.shrink;
+    const int y_s = ( r.y - ( opts.modelDsPad.height- opts.modelDs.height)/2 + opts.pad.height)/opts.shrink;
+    column.create( w_f*h_f*level.size(), 1, CV_32F );
+    float *out = (float*)column.data;
+    for( unsigned int c=0;c<level.size();c++)
+        for( int j=0;j<h_f;j++)
+        {
+            const float *in = level[c].ptr<float>( y_s + j ) + x_s;
+            for( int i=0;i<w_f;i++)
+                *out++ = in[i];
+        }
+}
+
+bool softcascade::detectFeatures( const Mat &image,                 /* in : image */
+                                  vector<Rect> &targets,            /* out: target positions */
+                                  vector<double> &confidence,       /* out: target confidence */
+                                  Mat &features,                    /* out: featureDim x targets.size() */
+                                  double threshold ) const          /* in : detect threshold */
+{
+    /* nothing is given back on failure */
+    targets.clear();
+    confidence.clear();
+    features.release();
+
+    vector< vector<Mat> > approPyramid;
+    vector<double> appro_scales;
+    vector<double> scale_w;
+    vector<double> scale_h;
+    m_feature_gen.chnsPyramid_sse( image, approPyramid, appro_scales, scale_h, scale_w);
+
+    /* same as detectMultiScale, the columns follow the targets */
+    vector<Rect> all_targets;
+    vector<double> all_confidence;
+    vector<Mat> all_columns;
+    Mat quantized_memory;
+    vector<Mat> quantized_level;
+    for( int c=0;c<approPyramid.size();c++)
+    {
+        /* the columns are featureDim long, made of nchannels channels */
+        if( (int)approPyramid[c].size() != m_opts.nchannels )
+        {
+            cout<<"<softcascade::detectFeatures><error> level "<<c<<" has "<<approPyramid[c].size()<<" channels, the model "<<m_opts.nchannels<<endl;
+            return false;
+        }
+        vector<Rect> t_tar;
+        vector<double> t_conf;
+        if( m_opts.channelDepth != CV_32F )
+        {
+            if( !m_feature_gen.quantizeLevel( approPyramid[c], m_channel_scales, m_opts.channelDepth, quantized_memory, quantized_level ))
+                return false;
+            Apply( quantized_level, t_tar, t_conf);
+        }
+        else
+            Apply( approPyramid[c], t_tar, t_conf);
+        for( unsigned int i=0;i<t_tar.size();i++)
+        {
+            if( t_conf[i] < threshold )
+                continue;
+            all_columns.push_back( Mat() );
+            copyWindowFeature( approPyramid[c], t_tar[i], m_opts, all_columns.back() );
+        }
+        mapLevelResults( t_tar, t_conf, appro_scales[c], scale_w[c], scale_h[c], image.size(), threshold, all_targets, all_confidence );
+    }
+
+    /* non max supression, the column of each target left is given by its index before */
+    targets = all_targets;
+    confidence = all_confidence;
+    vector<int> kept;
+    NonMaxSupress( targets, confidence, kept );
+    const int feature_dim = m_opts.modelDsPad.width/m_opts.shrink*m_opts.modelDsPad.height/m_opts.shrink*m_opts.nchannels;
+    features.create( feature_dim, targets.size(), CV_32F );
+    for( unsigned int i=0;i<kept.size();i++)
+        all_columns[ kept[i] ].copyTo( features.col(i) );
+    return true;
+}
+
 bool softcascade::Apply( const Mat &input_image,        /*  in: !!! image !!! */
                     vector<Rect> &results,              /* out: detect results */
                     vector<double> &confidence) 	    /* out: detect confidence */
@@ -522,6 +1634,40 @@ void softcascade::setDebug( bool m_d )
     m_debug = m_d;
 }
 
+void softcascade::setPackedEvaluation( bool use_packed )
+{
+    m_use_packed = use_packed;
+}
+
+void softcascade::setCollectStats( bool collect )
+{
+    m_collect_stats = collect;
+}
+
+void softcascade::resetStats()
+{
+    m_level_stats.clear();
+}
+
+void softcascade::mergeLevelStats( const vector<cascadeStats> &level_stats ) const
+{
+    if( level_stats.empty() )
+        return;
+    /* images may be detected in parallel ( detect_check ) */
+    #pragma omp critical(softcascade_level_stats)
+    {
+        if( m_level_stats.size() < level_stats.size() )
+            m_level_stats.resize( level_stats.size() );
+        for( unsigned int c=0;c<level_stats.size();c++)
+            m_level_stats[c].merge( level_stats[c] );
+    }
+}
+
+void softcascade::setSimdLevel( int simd_level )
+{
+    m_simd_level = std::min( simd_level, getCpuSimdLevel() );
+}
+
 bool softcascade::getFeatureChannelAndPosition( const int featureIndex, 
                                            Point & position,
                                            int &nchannel) const
@@ -542,7 +1688,7 @@ bool softcascade::getFeatureChannelAndPosition( const int featureIndex,
 
 void softcascade::visulizeFeature()
 {
-    if( !checkModel())
+    if( !checkModel() || !hasMatModel())
         return;
     
     int number_channels = m_opts.nchannels;
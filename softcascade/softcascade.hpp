@@ -4,11 +4,15 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <map>
+#include <algorithm>
 #include "opencv2/highgui/highgui.hpp"
 #include "../Adaboost/Adaboost.hpp"
 #include "../binaryTree/binarytree.hpp"
 
 #include "../chnfeature/Pyramid.h"
+#include "cascadeKernels.h"
+#include "../misc/mappedFile.h"
 
 using namespace std;
 using namespace cv;
@@ -24,6 +28,7 @@ struct cascadeParameter
 	int stride;							/* [4] spatial stride between detection windows */
 	double cascThr;						/* [-1] constant cascade threshold (affects speed/accuracy)*/
 	double cascCal;						/* [.005] cascade calibration (affects speed/accuracy) */
+	vector<double> cascThrs;			/* [] rejection threshold of each tree, made by softcascade::calibrateRejection, empty -> cascThr for all the trees */
 	vector<int> nWeaks;					/* [128] vector defining number weak clfs per stagemodel eg[64 128 256 1024]*/
 	int pBoost_nweaks;					/* parameters for boosting */
 	tree_para pBoost_pTree;				/* parameters for boosting */
@@ -40,6 +45,9 @@ struct cascadeParameter
     Size pad;                           /* ----------> get it from feature generator */
     int    nchannels;                   /* ----------> number of channels, usually 1 */
 	int shrink;							/* ----------> should be provided by the chnPyramid */
+	int nThreads;						/* [0] number of threads used to scan a pyramid level, 0 -> omp_get_max_threads() */
+	bool streamLevels;					/* [true] detectMultiScale computes and scans each pyramid level as a task, instead of building the whole pyramid first */
+	int channelDepth;					/* [CV_32F] depth of the levels scanned by detectMultiScale, CV_8U or CV_16U -> quantized levels, see softcascade::getChannelScales */
 
 	cascadeParameter()
 	{
@@ -62,6 +70,9 @@ struct cascadeParameter
 		nAccNeg = 10000;
 
 		shrink = 4;
+		nThreads = 0;
+		streamLevels = true;
+		channelDepth = CV_32F;
 
         posGtDir = "";
         posImgDir = "";
@@ -70,11 +81,64 @@ struct cascadeParameter
 	}
 };
 
+/* how deep the windows go into the cascade, collected by Apply when asked ( see setCollectStats ) */
+struct cascadeStats
+{
+	long long windows;					/* number of windows scanned */
+	long long trees;					/* number of trees evaluated, summed over the windows */
+	long long node_visits;				/* number of split nodes evaluated ( feature reads ), summed over the windows */
+	vector<long long> depth_hist;		/* depth_hist[t] -> number of windows which evaluated t+1 trees, accepted windows are in the last bin */
+
+	cascadeStats()
+	{
+		windows = 0;
+		trees = 0;
+		node_visits = 0;
+	}
+
+	/* clear, with one bin per tree */
+	void reset( int number_of_trees )
+	{
+		windows = trees = node_visits = 0;
+		depth_hist.assign( number_of_trees, 0 );
+	}
+
+	/* a window which evaluated n_trees trees and n_visits split nodes, depth_hist must have n_trees bins at least */
+	void addWindow( int n_trees, int n_visits )
+	{
+		windows++;
+		trees += n_trees;
+		node_visits += n_visits;
+		depth_hist[n_trees-1]++;
+	}
+
+	void merge( const cascadeStats &other )
+	{
+		windows += other.windows;
+		trees += other.trees;
+		node_visits += other.node_visits;
+		if( depth_hist.size() < other.depth_hist.size() )
+			depth_hist.resize( other.depth_hist.size(), 0 );
+		for( unsigned int t=0;t<other.depth_hist.size();t++)
+			depth_hist[t] += other.depth_hist[t];
+	}
+
+	double averageTrees() const
+	{
+		return windows > 0 ? 1.0*trees/windows : 0;
+	}
+};
+
 
 class softcascade
 {
+    /* scans the levels with scanLevel and maps them back with mapLevelResults */
+    friend class DetectorSession;
+
 	public:
 
+        softcascade();
+
 		/* 
 		 * ===  FUNCTION  ======================================================================
 		 *         Name:  Load
@@ -93,7 +157,9 @@ class softcascade
 		 */
 		bool Apply( const vector<Mat> &input_data,		/*  in: channel features, input_data.size() == nchannels */
 				    vector<Rect> &results,              /* out: detect results */
-                    vector<double> &confidence) const;	/* out: detect confidence */
+                    vector<double> &confidence,         /* out: detect confidence */
+                    cascadeStats *stats = 0) const;     /* out: if not 0, the evaluation depth of the windows is added to it,
+                                                                this uses the one window at a time scan of the packed nodes */
 
         /* 
          * ===  FUNCTION  ======================================================================
@@ -120,6 +186,24 @@ class softcascade
                                int stride = 4,                      /* in : detection stride */
                                double threshold = 0) const;         /* in : detect threshold */
 
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  detectFeatures
+         *  Description:  same as detectMultiScale, and the feature vector of each detection is
+         *                copied from the pyramid level it was found on, in the layout of
+         *                makeTrainData ( float, also when channelDepth is CV_8U or CV_16U ).
+         *                Used to mine hard negatives without cropping and computing the channels
+         *                of each window again, the features of approximated levels are the
+         *                approximated ones. Targets, confidence and features are empty
+         *                when it returns false
+         * =====================================================================================
+         */
+        bool detectFeatures( const Mat &image,                      /* in : image */
+                             vector<Rect> &targets,                 /* out: target positions */
+                             vector<double> &confidence,            /* out: target confidence */
+                             Mat &features,                         /* out: featureDim x targets.size(), CV_32F, column i is targets[i] */
+                             double threshold = 0) const;           /* in : detect threshold */
+
 		/* 
 		 * ===  FUNCTION  ======================================================================
 		 *         Name:  Predict
@@ -135,49 +219,65 @@ class softcascade
 		{
 			if(!checkModel())
 				return false;
+			if( packedNodes() == 0 )
+			{
+				cout<<"<softcascade::Predict><error> packed model is empty "<<endl;
+				return false;
+			}
 			double h = 0;
+			/* data is continuous, the feature index is used as offset directly */
+			const cascadeNode *t_nodes = packedNodes();
 			if(m_tree_depth != 0)
 			{
 				for( int t=0;t<m_number_of_trees;t++)
 				{
 					int position = 0;
-					
-					const int *t_child   = m_child.ptr<int>(t);
-					const int *t_fids    = m_fids.ptr<int>(t);
-					const double *t_thrs = m_thrs.ptr<double>(t);
-					const double *t_hs   = m_hs.ptr<double>(t);
-
-					while( t_child[position])
+					while( t_nodes[position].child)
 					{
-						position = (( data[t_fids[position]] < t_thrs[position]) ? position*2+1:position*2+2);
+						position = (( data[t_nodes[position].fid] < t_nodes[position].thr) ? position*2+1:position*2+2);
 					}
-					h += t_hs[position];
-                    if( h < m_opts.cascThr)
+					h += t_nodes[position].hs;
+					t_nodes += m_packed_stride;
+                    if( h < m_reject_thrs[t])
+                    {
+                        h = std::min( h, m_reject_thrs.back() );
                         break;
+                    }
 				}
 
 			}
 			else
 			{
-				for( int c=0;c<m_number_of_trees;c++)
+				for( int t=0;t<m_number_of_trees;t++)
 				{
 					int position   = 0;
-					const int *t_child   = m_child.ptr<int>(c);
-					const int *t_fids    = m_fids.ptr<int>(c);
-					const double *t_thrs = m_thrs.ptr<double>(c);
-					const double *t_hs   = m_hs.ptr<double>(c);
-					while( t_child[position] )  /*  iterate the tree */
+					while( t_nodes[position].child )  /*  iterate the tree */
 					{
-						position = (( data[t_fids[position]] < t_thrs[position]) ? t_child[position]: t_child[position] + 1);
+						position = (( data[t_nodes[position].fid] < t_nodes[position].thr) ? t_nodes[position].child: t_nodes[position].child + 1);
 					}
-					h += t_hs[position];
-                    if( h < m_opts.cascThr)
+					h += t_nodes[position].hs;
+					t_nodes += m_packed_stride;
+                    if( h < m_reject_thrs[t])
+                    {
+                        h = std::min( h, m_reject_thrs.back() );
                         break;
+                    }
 				}
 			}
 			score = h;
             return true;
 		}
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  Predict
+         *  Description:  double data is scored with the double thresholds and hs of the Mats,
+         *                like the model before packing. The packed nodes ( float ) are used only
+         *                for a model loaded by LoadBinary
+         * =====================================================================================
+         */
+        bool Predict( const double *data,               /* in : test data, must be continuous in memory */
+                      double &score) const;             /* out: score */
 		
 
         /* 
@@ -236,6 +336,24 @@ class softcascade
 		 */
 		bool Save( string path_to_model );		/*  in: where to save the model, models is saved by opencv FileStorage */
 
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  SaveBinary
+		 *  Description:  save the packed model in the binary format, see softcascade.cpp
+		 * =====================================================================================
+		 */
+		bool SaveBinary( string path_to_model ) const;	/*  in: where to save the model */
+
+		/* 
+		 * ===  FUNCTION  ======================================================================
+		 *         Name:  LoadBinary
+		 *  Description:  map a model saved by SaveBinary, the nodes are used in place, without
+		 *                copy. Only the packed layout is available after that ( no Save, no
+		 *                visulizeFeature, no setPackedEvaluation(false) )
+		 * =====================================================================================
+		 */
+		bool LoadBinary( string path_to_model );		/*  in: path of the binary model */
+
 		
 		/* 
 		 * ===  FUNCTION  ======================================================================
@@ -298,8 +416,263 @@ class softcascade
          */
         void visulizeFeature();
 
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  setPackedEvaluation
+         *  Description:  true -> Apply uses the packed node array( default ), false -> Apply walks
+         *                the nxK Mats m_fids, m_child, m_thrs and m_hs, kept for comparison.
+         *                The packed nodes keep thr and hs in float, CV_64F channels are always
+         *                scanned on the Mats when the model has them, without the statistics
+         * =====================================================================================
+         */
+        void setPackedEvaluation( bool use_packed );
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  setSimdLevel
+         *  Description:  kernel used for depth-2 trees on float features, SIMD_NONE -> one window
+         *                at a time, SIMD_SSE2 -> 4 windows, SIMD_AVX2 -> 8 windows. Default is the
+         *                best one supported by the cpu, higher levels are clamped to it
+         * =====================================================================================
+         */
+        void setSimdLevel( int simd_level );
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  traceScores
+         *  Description:  score of each sample after each tree, without rejection, row i of
+         *                traces is the trace of column i of data
+         * =====================================================================================
+         */
+        bool traceScores( const Mat &data,                  /* in : featureDim x numberOfSamples, CV_32F */
+                          Mat &traces ) const;              /* out: numberOfSamples x number_of_trees, CV_64F */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  calibrateRejection
+         *  Description:  rejection threshold of each tree ( cascadeParameter::cascThrs ) from
+         *                the traces of held out positives, in the way of direct backward
+         *                pruning : the threshold of a tree is the lowest score of the positives
+         *                which are still alive there. Positives rejected by the full cascade
+         *                ( score <= cascThr ) are ignored, and up to ( 1 - target_recall ) of
+         *                the others may be rejected, spread evenly over the trees
+         * =====================================================================================
+         */
+        bool calibrateRejection( const Mat &pos_data,       /* in : featureDim x numberOfSamples, CV_32F, positives not used in training */
+                                 double target_recall,      /* in : fraction of the accepted positives to keep, eg 0.995 */
+                                 double &recall );          /* out: fraction actually kept */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  getRejectThresholds
+         *  Description:  threshold used after each tree, cascThrs when calibrated and cascThr
+         *                otherwise, the last one is always cascThr
+         * =====================================================================================
+         */
+        const vector<double>& getRejectThresholds() const
+        {
+            return m_reject_thrs;
+        }
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  getChannelScales
+         *  Description:  scale of each channel for the quantized levels ( channelDepth CV_8U or
+         *                CV_16U ), give them to feature_Pyramids::quantizeLevel. Empty if
+         *                channelDepth is CV_32F
+         * =====================================================================================
+         */
+        const vector<float>& getChannelScales() const
+        {
+            return m_channel_scales;
+        }
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  resolveLevelNodes
+         *  Description:  packed nodes with the feature index replaced by the offset in a pyramid
+         *                level of the given size, can be computed once for a fixed level size.
+         *                The thresholds are the ones of cascadeParameter::channelDepth
+         * =====================================================================================
+         */
+        bool resolveLevelNodes( const Size &level_size,                 /* in : size of a single channel of the level */
+                                vector<cascadeNode> &level_nodes) const;/* out: resolved nodes */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  scanLevel
+         *  Description:  same as Apply, single thread, with the nodes already resolved for this
+         *                level, results are appended
+         * =====================================================================================
+         */
+        bool scanLevel( const vector<Mat> &input_data,                  /* in : channel features, input_data.size() == nchannels */
+                        const vector<cascadeNode> &level_nodes,         /* in : output of resolveLevelNodes for this level size */
+                        vector<Rect> &results,                          /* out: detect results */
+                        vector<double> &confidence,                     /* out: detect confidence */
+                        cascadeStats *stats = 0) const;                 /* out: evaluation depth, same as Apply */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  setCollectStats
+         *  Description:  true -> detectMultiScale adds the evaluation depth of the windows of
+         *                each pyramid level to getLevelStats(), off by default. The scan is
+         *                slower when on ( no simd row kernel )
+         * =====================================================================================
+         */
+        void setCollectStats( bool collect );
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  getLevelStats
+         *  Description:  statistics of each pyramid level, summed over the images given to
+         *                detectMultiScale since the last resetStats
+         * =====================================================================================
+         */
+        const vector<cascadeStats>& getLevelStats() const
+        {
+            return m_level_stats;
+        }
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  resetStats
+         *  Description:  clear the statistics of all the levels
+         * =====================================================================================
+         */
+        void resetStats();
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  getFeatureGen
+         *  Description:  return the feature generator
+         * =====================================================================================
+         */
+        const feature_Pyramids& getFeatureGen() const
+        {
+            return m_feature_gen;
+        }
+
 	private:
 
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  packModel
+         *  Description:  build the packed node array from m_fids, m_child, m_thrs and m_hs,
+         *                called by Combine and Load
+         * =====================================================================================
+         */
+        bool packModel();
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  updateRejectThresholds
+         *  Description:  make m_reject_thrs from cascThrs and cascThr, called when the model
+         *                or the options change. cascThrs is ignored if it does not match the
+         *                number of trees
+         * =====================================================================================
+         */
+        void updateRejectThresholds();
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  quantizeModel
+         *  Description:  channel scales and packed nodes with integer thresholds for
+         *                m_opts.channelDepth, called when the model is loaded and by setParas.
+         *                The scale of a channel maps its largest threshold to the largest
+         *                integer, larger features saturate without changing any split
+         * =====================================================================================
+         */
+        bool quantizeModel();
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  nodesForDepth
+         *  Description:  packed nodes with the thresholds of channels of the given depth, the
+         *                quantized nodes for CV_8U or CV_16U, 0 if not available
+         * =====================================================================================
+         */
+        const cascadeNode* nodesForDepth( int depth ) const;
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  packedNodes
+         *  Description:  the packed nodes, in the mapped file or in m_packed_nodes, 0 if empty
+         * =====================================================================================
+         */
+        const cascadeNode* packedNodes() const
+        {
+            if( m_mapped_nodes )
+                return m_mapped_nodes;
+            return m_packed_nodes.empty() ? 0 : &m_packed_nodes[0];
+        }
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  hasMatModel
+         *  Description:  true if m_fids, m_child, m_thrs etc are set, false for a model loaded by LoadBinary
+         * =====================================================================================
+         */
+        bool hasMatModel() const;
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  applyRows
+         *  Description:  scan the rows [row_begin, row_end) of windows, called by Apply for each tile
+         * =====================================================================================
+         */
+        void applyRows( const vector<Mat> &input_data,          /* in : channels feature, checked by Apply */
+                        const vector<cascadeNode> &level_nodes, /* in : packed nodes resolved for this level */
+                        int row_begin,                          /* in : first row of windows to scan */
+                        int row_end,                            /* in : last row of windows to scan + 1 */
+                        vector<Rect> &results,                  /* out: results */
+                        vector<double> &confidence,             /* out: confidence */
+                        cascadeStats *stats) const;             /* out: evaluation depth, 0 -> not collected */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  mapLevelResults
+         *  Description:  map the detections on a pyramid level back to the image, results are
+         *                appended. Also used by DetectorSession
+         * =====================================================================================
+         */
+        static void mapLevelResults( const vector<Rect> &t_tar,         /* in : detections on the level */
+                                     const vector<double> &t_conf,      /* in : confidence */
+                                     double appro_scale,                /* in : scale of the level */
+                                     double scale_w,                    /* in : width scale of the level */
+                                     double scale_h,                    /* in : height scale of the level */
+                                     const Size &image_size,            /* in : size of the image */
+                                     double threshold,                  /* in : detect threshold */
+                                     vector<Rect> &targets,             /* out: target positions */
+                                     vector<double> &confidence );      /* out: target confidence */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  levelNodes
+         *  Description:  packed nodes for channels of type and size in_width x in_height,
+         *                resolved by the first call for this level size and kept for the next
+         *                ones, thread safe
+         * =====================================================================================
+         */
+        Ptr< vector<cascadeNode> > levelNodes( int type,                /* in : type of the channels */
+                                               int in_width,            /* in : width of a single channel */
+                                               int in_height ) const;   /* in : height of a single channel */
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  mergeLevelStats
+         *  Description:  add the statistics of the levels of one image to m_level_stats
+         * =====================================================================================
+         */
+        void mergeLevelStats( const vector<cascadeStats> &level_stats ) const;
+
+        /* 
+         * ===  FUNCTION  ======================================================================
+         *         Name:  checkInput
+         *  Description:  check the type and memory layout of the channel features
+         * =====================================================================================
+         */
+        bool checkInput( const vector<Mat> &input_data ) const;
+
 		/* 
 		 * ===  FUNCTION  ======================================================================
 		 *         Name:  setTreeDepth
@@ -334,6 +707,21 @@ class softcascade
 		int m_tree_nodes;					/* if all the tree have the same structure, this will be the number of the nodes of each tree, otherwise -1*/
 		int m_tree_depth;					/* depth of all leaf nodes (or 0 if leaf depth varies) */
 
+		vector<cascadeNode> m_packed_nodes;	/* (n*K) packed nodes made by packModel, tree t starts at t*m_packed_stride */
+		int m_packed_stride;				/* number of nodes reserved for each tree, equals K */
+		int m_packed_size;					/* total number of packed nodes, n*K */
+		Ptr<mappedFile> m_mapping;			/* mapped binary model file, set by LoadBinary */
+		const cascadeNode *m_mapped_nodes;	/* packed nodes inside m_mapping, used instead of m_packed_nodes */
+		bool m_use_packed;					/* Apply on the packed nodes or on the Mats */
+		int  m_simd_level;					/* SIMD_NONE, SIMD_SSE2 or SIMD_AVX2, see setSimdLevel */
+		vector<float> m_channel_scales;		/* nchannels scales of the quantized levels, see quantizeModel */
+		vector<cascadeNode> m_quantized_nodes;	/* same as the packed nodes, thresholds in the quantized domain */
+		int  m_quantized_depth;				/* CV_8U or CV_16U, depth of m_quantized_nodes, -1 if none */
+		vector<double> m_reject_thrs;		/* rejection threshold after each tree, see updateRejectThresholds */
+		bool m_collect_stats;				/* detectMultiScale collects m_level_stats */
+		mutable vector<cascadeStats> m_level_stats;	/* statistics of each pyramid level, updated by the const detectMultiScale */
+		mutable map<long long, Ptr< vector<cascadeNode> > > m_resolved_nodes;	/* levelNodes, by type and level size, cleared by quantizeModel */
+
 		cascadeParameter m_opts;            /* detectot options  */
         feature_Pyramids m_feature_gen;     /* feature generator */
 };
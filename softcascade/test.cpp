@@ -1,15 +1,21 @@
 #include <iostream>
 #include <vector>
+#include <fstream>
 #include "opencv2/contrib/contrib.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "softcascade.hpp"
 #include "../Adaboost/Adaboost.hpp"
 #include "../misc/misc.hpp"
 #include "detect_check.h"
+#include "detectorSession.hpp"
+
+#include "boost/filesystem.hpp"
 
 using namespace std;
 using namespace cv;
 
+namespace bf = boost::filesystem;
+
 
 int main( int argc, char** argv)
 {
@@ -33,8 +39,141 @@ int main( int argc, char** argv)
     //vector<double> fppis;
     //dc.generate_roc( fhog_sc, fppis, hits);
 
+    sc.setCollectStats( true );
     dc.test_detector( sc, _hit, _FPPI);
     dc.get_stat_on_missed();
     cout<<"Results : \nHit : "<<_hit<<endl<<"FPPI : "<<_FPPI<<endl;
+
+    /* how deep the windows go into the cascade, per pyramid level, the histograms are in cascade_stats.txt */
+    const vector<cascadeStats> &level_stats = sc.getLevelStats();
+    cascadeStats all_levels;
+    ofstream stats_file( "cascade_stats.txt" );
+    for( unsigned int c=0;c<level_stats.size();c++)
+    {
+        const cascadeStats &st = level_stats[c];
+        all_levels.merge( st );
+        cout<<"level "<<c<<" : "<<st.windows<<" windows, "<<st.averageTrees()<<" trees and "
+            <<( st.windows > 0 ? 1.0*st.node_visits/st.windows : 0 )<<" node visits per window"<<endl;
+        stats_file<<c;
+        for( unsigned int t=0;t<st.depth_hist.size();t++)
+            stats_file<<" "<<st.depth_hist[t];
+        stats_file<<endl;
+    }
+    cout<<"all levels : "<<all_levels.windows<<" windows, "<<all_levels.averageTrees()<<" trees and "
+        <<( all_levels.windows > 0 ? 1.0*all_levels.node_visits/all_levels.windows : 0 )<<" node visits per window"<<endl;
+    sc.setCollectStats( false );
+
+    /* the features given by detectFeatures have to give back the confidence of the detections */
+    bf::directory_iterator end_it;
+    int n_checked = 0;
+    for( bf::directory_iterator file_iter( test_img_folder ); file_iter!=end_it && n_checked < 10; file_iter++)
+    {
+        Mat img = imread( file_iter->path().string() );
+        if( img.empty())
+            continue;
+        vector<Rect> rects;
+        vector<double> conf;
+        Mat features;
+        if( !sc.detectFeatures( img, rects, conf, features ))
+            return -1;
+        for( unsigned int i=0;i<rects.size();i++)
+        {
+            Mat column = features.col(i).clone();
+            double score = 0;
+            sc.Predict( (const float*)column.data, score );
+            if( std::abs( score - conf[i] ) > 1e-6 )
+            {
+                cout<<"detectFeatures : window "<<i<<" of "<<file_iter->path()<<" scores "<<score<<", detected with "<<conf[i]<<endl;
+                return -1;
+            }
+        }
+        n_checked++;
+    }
+    cout<<"detectFeatures : features of the detections checked on "<<n_checked<<" images"<<endl;
+
+    /* double channels are scanned on the Mats ( double thr and hs ) when the model has them, a binary model
+     * only has the packed float nodes. The levels hold float values, the thresholds rounded up to float
+     * split them the same way, only the sums of the float hs may differ in the last bits */
+    if( !sc.SaveBinary( "test_sc.bin" ))
+        return -1;
+    softcascade sc_bin;
+    if( !sc_bin.LoadBinary( "test_sc.bin" ))
+        return -1;
+    for( bf::directory_iterator file_iter( test_img_folder ); file_iter!=end_it; file_iter++)
+    {
+        Mat img = imread( file_iter->path().string() );
+        if( img.empty())
+            continue;
+        vector< vector<Mat> > pyramid;
+        vector<double> scales, scale_w, scale_h;
+        sc.getFeatureGen().chnsPyramid_sse( img, pyramid, scales, scale_h, scale_w );
+        const vector<Mat> &level = pyramid[0];
+        Mat level_64f( level.size()*level[0].rows, level[0].cols, CV_64F );
+        vector<Mat> chns;
+        for( unsigned int c=0;c<level.size();c++)
+        {
+            chns.push_back( level_64f.rowRange( c*level[0].rows, (c+1)*level[0].rows ));
+            level[c].convertTo( chns.back(), CV_64F );
+        }
+        vector<Rect> rects_packed, rects_mat;
+        vector<double> conf_packed, conf_mat;
+        sc.Apply( chns, rects_mat, conf_mat );
+        sc_bin.Apply( chns, rects_packed, conf_packed );
+        bool same = rects_packed == rects_mat;
+        for( unsigned int i=0;same && i<conf_mat.size();i++)
+            same = std::abs( conf_packed[i] - conf_mat[i] ) < 1e-4;
+        if( !same )
+        {
+            cout<<"CV_64F channels : packed nodes give "<<rects_packed.size()<<" windows, the Mats "<<rects_mat.size()<<endl;
+            return -1;
+        }
+        cout<<"CV_64F channels : "<<rects_packed.size()<<" windows, packed nodes same as the Mats"<<endl;
+        break;
+    }
+    /* a session on frames of one size has to give the same detections as detectMultiScale, the
+     * images are resized to the size of the first one */
+    DetectorSession session;
+    int n_frames = 0;
+    for( bf::directory_iterator file_iter( test_img_folder ); file_iter!=end_it && n_frames < 10; file_iter++)
+    {
+        Mat img = imread( file_iter->path().string() );
+        if( img.empty())
+            continue;
+        if( n_frames == 0 && !session.init( sc, img.size() ))
+            return -1;
+        if( img.size() != session.getFrameSize() )
+            cv::resize( img, img, session.getFrameSize() );
+        vector<Rect> rects_session, rects_detector;
+        vector<double> conf_session, conf_detector;
+        if( !session.detect( img, rects_session, conf_session, 0 ) ||
+                !sc.detectMultiScale( img, rects_detector, conf_detector, Size(41,100), Size(1000,2000), 1.2, 1, 0 ))
+            return -1;
+        if( rects_session != rects_detector || conf_session != conf_detector )
+        {
+            cout<<"DetectorSession : "<<rects_session.size()<<" windows on "<<file_iter->path()
+                <<", detectMultiScale "<<rects_detector.size()<<endl;
+            return -1;
+        }
+        n_frames++;
+    }
+    cout<<"DetectorSession : same detections as detectMultiScale on "<<n_frames<<" frames"<<endl;
+
+    long scales_hits = 0, scales_misses = 0;
+    sc.getFeatureGen().getScalesCacheStats( scales_hits, scales_misses );
+    cout<<"getscales cache : "<<scales_hits<<" hits, "<<scales_misses<<" misses"<<endl;
+
+    /* same model on quantized channels, accuracy against the float channels */
+    const int depths[2] = { CV_8U, CV_16U };
+    const char *depth_names[2] = { "uint8", "uint16" };
+    for( int d=0;d<2;d++)
+    {
+        softcascade sc_q = sc;
+        cascadeParameter q_opts = sc_q.getParas();
+        q_opts.channelDepth = depths[d];
+        sc_q.setParas( q_opts );
+        double delta_hit = 0, delta_FPPI = 0;
+        cout<<"Quantized channels, "<<depth_names[d]<<endl;
+        dc.compare_detectors( sc, sc_q, delta_hit, delta_FPPI );
+    }
 	return 0;
 }